@@ -2,8 +2,10 @@
 
 #include "common.h"
 #include "hash.h"
+#include "parallel.h"
 #include "printers.h"
 #include "random.h"
+#include "sampling.h"
 #include "sequence_ops.h"
 
 #include <algorithm>
@@ -19,6 +21,9 @@
 
 namespace jngen {
 
+template<typename T>
+class GenericArrayStream;
+
 template<typename T>
 class GenericArray : public ReprProxy<GenericArray<T>>, public std::vector<T> {
 public:
@@ -66,9 +71,19 @@ public:
     static GenericArray<T> random(size_t size, const Args& ... args);
     template<typename ...Args>
     static GenericArray<T> randomUnique(size_t size, const Args& ... args);
+    static GenericArray<T> randomUniqueSorted(size_t size, T n);
+    static GenericArray<T> randomUniqueSorted(size_t size, T l, T r);
     template<typename ...Args>
     static GenericArray<T> randomAll(const Args& ... args);
 
+    // Defined in array_stream.h.
+    template<typename ...Args>
+    static GenericArrayStream<T> randomStream(
+            size_t size, const Args& ... args);
+    template<typename F, typename ...Args>
+    static GenericArrayStream<T> randomfStream(
+            size_t size, F func, const Args& ... args);
+
     static GenericArray<T> id(size_t size, T start = T{});
 
     GenericArray<T>& shuffle();
@@ -110,13 +125,66 @@ public:
     operator std::string() const;
 };
 
+namespace detail {
+
+// Uses the bulk Random::fill when TypedRandom<T> supports it for given
+// arguments, and falls back to successive tnext<T> calls otherwise. Both ways
+// produce the same values.
+template<typename T, typename ...Args>
+auto fillRandom(
+        Random& random, T* out, size_t count, int, const Args& ... args)
+    -> decltype(TypedRandom<T>{random}.fill(out, count, args...))
+{
+    TypedRandom<T>{random}.fill(out, count, args...);
+}
+
+template<typename T, typename ...Args>
+void fillRandom(
+        Random& random, T* out, size_t count, long, const Args& ... args)
+{
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = random.tnext<T>(args...);
+    }
+}
+
+// Functions passed to randomf may take the generator to use as the first
+// argument; this is required to run them in parallel.
+template<typename F, typename ...Args>
+auto acceptsRandom(F& func, int, const Args& ... args)
+    -> decltype(func(std::declval<Random&>(), args...), std::true_type());
+
+template<typename F, typename ...Args>
+std::false_type acceptsRandom(F& func, long, const Args& ... args);
+
+template<typename F, typename ...Args>
+auto invokeWithRandom(F& func, Random& random, int, const Args& ... args)
+    -> decltype(func(random, args...))
+{
+    return func(random, args...);
+}
+
+template<typename F, typename ...Args>
+auto invokeWithRandom(F& func, Random&, long, const Args& ... args)
+    -> decltype(func(args...))
+{
+    return func(args...);
+}
+
+} // namespace detail
+
 template<typename T>
 template<typename ...Args>
 GenericArray<T> GenericArray<T>::random(size_t size, const Args& ... args) {
     checkLargeParameter(size);
     GenericArray<T> result(size);
-    for (T& x: result) {
-        x = rnd.tnext<T>(args...);
+    T* data = result.data();
+    if (config.threads > 0) {
+        detail::generateInChunks(size,
+            [data, &args...](Random& random, size_t begin, size_t count) {
+                detail::fillRandom<T>(random, data + begin, count, 0, args...);
+            });
+    } else {
+        detail::fillRandom<T>(rnd, data, size, 0, args...);
     }
     return result;
 }
@@ -130,8 +198,23 @@ GenericArray<T> GenericArray<T>::randomf(
 {
     checkLargeParameter(size);
     GenericArray<T> result(size);
-    for (T& x: result) {
-        x = func(args...);
+    if (config.threads > 0 &&
+            decltype(detail::acceptsRandom(func, 0, args...))::value)
+    {
+        T* data = result.data();
+        detail::generateInChunks(size,
+            [data, &func, &args...](
+                Random& random, size_t begin, size_t count)
+            {
+                for (size_t i = begin; i < begin + count; ++i) {
+                    data[i] = detail::invokeWithRandom(
+                        func, random, 0, args...);
+                }
+            });
+    } else {
+        for (T& x: result) {
+            x = detail::invokeWithRandom(func, rnd, 0, args...);
+        }
     }
     return result;
 }
@@ -181,17 +264,77 @@ GenericArray<T> GenericArray<T>::randomfUnique(
     return result;
 }
 
+namespace detail {
+
+// Integral ranges are sampled directly, other types with randomfUnique.
 template<typename T>
-template<typename ...Args>
-GenericArray<T> GenericArray<T>::randomUnique(
-        size_t size, const Args& ... args)
+GenericArray<T> randomUniqueInRange(size_t size, T l, T r, bool sorted) {
+    static_assert(
+        std::is_integral<T>::value,
+        "Only integral ranges can be sampled directly");
+    ensure(l <= r);
+    checkLargeParameter(size);
+    uint64_t maxOffset = static_cast<uint64_t>(r) - static_cast<uint64_t>(l);
+    auto offsets = sorted ?
+        sampleSortedOffsets(rnd, size, maxOffset) :
+        sampleOffsets(rnd, size, maxOffset);
+    GenericArray<T> result(size);
+    for (size_t i = 0; i < size; ++i) {
+        result[i] = static_cast<T>(static_cast<uint64_t>(l) + offsets[i]);
+    }
+    return result;
+}
+
+template<typename T, typename N>
+auto randomUnique(size_t size, int, N n)
+    -> typename std::enable_if<
+        std::is_integral<T>::value && std::is_integral<N>::value,
+        GenericArray<T>>::type
 {
+    ensure(static_cast<T>(n) > 0);
+    return randomUniqueInRange<T>(size, 0, static_cast<T>(n) - 1, false);
+}
+
+template<typename T, typename L, typename R>
+auto randomUnique(size_t size, int, L l, R r)
+    -> typename std::enable_if<
+        std::is_integral<T>::value &&
+            std::is_integral<L>::value && std::is_integral<R>::value,
+        GenericArray<T>>::type
+{
+    return randomUniqueInRange<T>(
+        size, static_cast<T>(l), static_cast<T>(r), false);
+}
+
+template<typename T, typename ...Args>
+GenericArray<T> randomUnique(size_t size, long, const Args& ... args) {
     return GenericArray<T>::randomfUnique(
         size,
         [](Args... args) { return rnd.tnext<T>(args...); },
         args...);
 }
 
+} // namespace detail
+
+template<typename T>
+template<typename ...Args>
+GenericArray<T> GenericArray<T>::randomUnique(
+        size_t size, const Args& ... args)
+{
+    return detail::randomUnique<T>(size, 0, args...);
+}
+
+template<typename T>
+GenericArray<T> GenericArray<T>::randomUniqueSorted(size_t size, T n) {
+    ensure(n > 0);
+    return detail::randomUniqueInRange<T>(size, 0, n - 1, true);
+}
+
+template<typename T>
+GenericArray<T> GenericArray<T>::randomUniqueSorted(size_t size, T l, T r) {
+    return detail::randomUniqueInRange<T>(size, l, r, true);
+}
+
 template<typename T>
 template<typename F, typename ...Args>
 GenericArray<T> GenericArray<T>::randomfAll(
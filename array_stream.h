@@ -0,0 +1,163 @@
+#pragma once
+
+#include "array.h"
+#include "common.h"
+#include "parallel.h"
+#include "printers.h"
+#include "random.h"
+#include "repr.h"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace jngen {
+
+// A random array which is never stored as a whole. Elements are generated
+// chunk by chunk when the array is printed or traversed, so the memory used
+// is O(chunk size) instead of O(size). Each chunk has its own stream derived
+// from the state of rnd at creation, hence the content is fixed at creation:
+// printing the array twice yields the same output.
+template<typename T>
+class GenericArrayStream : public ReprProxy<GenericArrayStream<T>> {
+public:
+    // Fills |count| elements at |out| using the given generator.
+    typedef std::function<void(Random&, T*, size_t)> Generator;
+
+    // |parallel| should be false if the generator uses global state, e.g.
+    // calls rnd directly.
+    GenericArrayStream(
+            size_t size, Generator generator, bool parallel = true) :
+        size_(size),
+        generator_(std::move(generator)),
+        parallel_(parallel),
+        base_(rnd.split(1)[0])
+    {  }
+
+    size_t size() const { return size_; }
+
+    // Calls f(const T* data, size_t count) for consecutive chunks. With
+    // config.threads > 0 that many chunks are generated in parallel unless
+    // the stream is sequential.
+    template<typename F>
+    void forEachChunk(F f) const;
+
+    GenericArray<T> toArray() const;
+
+private:
+    size_t size_;
+    Generator generator_;
+    bool parallel_;
+    Random base_;
+};
+
+template<typename T>
+template<typename F>
+void GenericArrayStream<T>::forEachChunk(F f) const {
+    const size_t CHUNK = detail::PARALLEL_CHUNK_SIZE;
+    size_t chunks = (size_ + CHUNK - 1) / CHUNK;
+    size_t batch = parallel_ ? std::max(config.threads, 1) : 1;
+    std::vector<std::vector<T>> buffers(std::min(batch, chunks));
+
+    for (size_t start = 0; start < chunks; start += batch) {
+        size_t count = std::min(batch, chunks - start);
+        detail::parallelFor(count, [&](size_t i) {
+            size_t chunk = start + i;
+            size_t length = std::min(CHUNK, size_ - chunk * CHUNK);
+            Random random = base_.stream(chunk);
+            Generator generator = generator_;
+            buffers[i].resize(length);
+            generator(random, buffers[i].data(), length);
+        });
+        for (size_t i = 0; i < count; ++i) {
+            f(static_cast<const T*>(buffers[i].data()), buffers[i].size());
+        }
+    }
+}
+
+template<typename T>
+GenericArray<T> GenericArrayStream<T>::toArray() const {
+    checkLargeParameter(size_);
+    GenericArray<T> result;
+    result.reserve(size_);
+    forEachChunk([&result](const T* data, size_t count) {
+        result.insert(result.end(), data, data + count);
+    });
+    return result;
+}
+
+template<typename T>
+template<typename ...Args>
+GenericArrayStream<T> GenericArray<T>::randomStream(
+        size_t size, const Args& ... args)
+{
+    return GenericArrayStream<T>(size,
+        [args...](Random& random, T* out, size_t count) {
+            detail::fillRandom<T>(random, out, count, 0, args...);
+        });
+}
+
+template<typename T>
+template<typename F, typename ...Args>
+GenericArrayStream<T> GenericArray<T>::randomfStream(
+        size_t size, F func, const Args& ... args)
+{
+    return GenericArrayStream<T>(size,
+        [func, args...](Random& random, T* out, size_t count) mutable {
+            for (size_t i = 0; i < count; ++i) {
+                out[i] = detail::invokeWithRandom(func, random, 0, args...);
+            }
+        },
+        decltype(detail::acceptsRandom(func, 0, args...))::value);
+}
+
+namespace detail {
+
+template<typename T>
+char streamSeparator(const T*, const OutputModifier& mod) {
+    return mod.sep;
+}
+
+template<typename A, typename B>
+char streamSeparator(const std::pair<A, B>*, const OutputModifier&) {
+    return '\n';
+}
+
+} // namespace detail
+
+template<typename T>
+JNGEN_DECLARE_SIMPLE_PRINTER(GenericArrayStream<T>, 5) {
+    if (mod.printN) {
+        out << t.size() << "\n";
+    }
+    char sep = detail::streamSeparator(static_cast<const T*>(nullptr), mod);
+    bool first = true;
+    t.forEachChunk([&](const T* data, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            if (first) {
+                first = false;
+            } else {
+                out << sep;
+            }
+            JNGEN_PRINT(data[i]);
+        }
+    });
+}
+
+template<typename T>
+using TArrayStream = GenericArrayStream<T>;
+
+using ArrayStream = GenericArrayStream<int>;
+using ArrayStream64 = GenericArrayStream<long long>;
+using ArrayStreamf = GenericArrayStream<double>;
+using ArrayStreamp = GenericArrayStream<std::pair<int, int>>;
+
+} // namespace jngen
+
+using jngen::TArrayStream;
+
+using jngen::ArrayStream;
+using jngen::ArrayStream64;
+using jngen::ArrayStreamf;
+using jngen::ArrayStreamp;
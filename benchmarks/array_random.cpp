@@ -0,0 +1,76 @@
+// Compares Array::random(n, l, r) with the per-element loop it used to be
+// and measures its scaling with config.threads.
+// Build with 'make' (uses -march=native) or e.g.
+// 'make CXXFLAGS="-O2 -std=c++11 -DJNGEN_NO_SIMD"' for the scalar path.
+
+#include "../jngen.h"
+
+#include <iostream>
+#include <string>
+#include <thread>
+
+const int N = 20000000;
+
+Array elementwise(int n, int l, int r) {
+    Array result(n);
+    for (int& x: result) {
+        x = rnd.next(l, r);
+    }
+    return result;
+}
+
+void run(RandomEngine engine, const std::string& name, int l, int r) {
+    std::cerr << name << ", [" << l << ", " << r << "]\n";
+    rnd.setEngine(engine);
+
+    Array a, b;
+    rnd.seed(1);
+    {
+        ContextTimer timer("  rnd.next loop");
+        a = elementwise(N, l, r);
+    }
+    rnd.seed(1);
+    {
+        ContextTimer timer("  Array::random");
+        b = Array::random(N, l, r);
+    }
+    ensure(a == b, "Array::random differs from rnd.next loop");
+}
+
+int main() {
+    config.generateLargeObjects = true;
+
+#if defined(JNGEN_SIMD_AVX2)
+    std::cerr << "SIMD: AVX2\n";
+#elif defined(JNGEN_SIMD_SSE41)
+    std::cerr << "SIMD: SSE4.1\n";
+#elif defined(JNGEN_SIMD_NEON)
+    std::cerr << "SIMD: NEON\n";
+#else
+    std::cerr << "SIMD: none\n";
+#endif
+
+    for (int r: {99, 1000000000}) {
+        run(RandomEngine::Mt19937, "mt19937", 0, r);
+        run(RandomEngine::Xoshiro256, "xoshiro256**", 0, r);
+        run(RandomEngine::Wyrand, "wyrand", 0, r);
+    }
+
+    rnd.setEngine(RandomEngine::Mt19937);
+    int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    Array etalon;
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        config.threads = threads;
+        rnd.seed(1);
+        Array a;
+        {
+            ContextTimer timer(format(
+                "Array::random, %d thread(s)", threads));
+            a = Array::random(N, 0, 1000000000);
+        }
+        if (threads == 1) {
+            etalon = a;
+        }
+        ensure(a == etalon, "Parallel output depends on the thread count");
+    }
+}
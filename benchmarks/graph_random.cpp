@@ -0,0 +1,88 @@
+// Compares Graph::random(n, m) with the rejection loop over a hash set of
+// edges it used to be. Edges are not sorted, so that only the generation and
+// the adjacency are measured. Dense graphs are generated differently, so
+// only the time is compared for them. Finally, the parallel generation is
+// measured with different numbers of threads.
+
+#include "../jngen.h"
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+
+Graph legacyRandom(int n, int m) {
+    std::unordered_set<std::pair<int, int>> usedEdges;
+    Arrayp result;
+    result.reserve(m);
+    while (result.size() < static_cast<size_t>(m)) {
+        auto edge = rnd.nextp(n, odpair);
+        if (!usedEdges.count(edge)) {
+            usedEdges.insert(edge);
+            result.push_back(edge);
+        }
+    }
+
+    Graph graph;
+    graph.initWithEdges(n, result);
+    return graph;
+}
+
+void run(int n, int m, bool dense = false) {
+    std::cerr << "n = " << n << ", m = " << m << "\n";
+
+    Graph a, b;
+    rnd.seed(1);
+    {
+        ContextTimer timer("  hash set");
+        a = legacyRandom(n, m);
+    }
+    rnd.seed(1);
+    {
+        ContextTimer timer("  Graph::random");
+        b = Graph::random(n, m);
+    }
+    if (!dense) {
+        ensure(
+            a.edges() == b.edges(), "Graph::random differs from the old loop");
+    }
+}
+
+void runParallel(int n, int m) {
+    std::cerr << "n = " << n << ", m = " << m << "\n";
+
+    int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    Graph first;
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        config.threads = threads;
+        rnd.seed(1);
+        Graph g;
+        {
+            ContextTimer timer(format("  %d threads", threads));
+            g = Graph::random(n, m).connected();
+        }
+        if (threads == 1) {
+            first = g;
+        } else {
+            ensure(
+                g.edges() == first.edges(),
+                "Graph::random depends on the number of threads");
+        }
+    }
+    config.threads = 0;
+}
+
+int main() {
+    config.generateLargeObjects = true;
+    config.normalizeEdges = false;
+
+    run(1000000, 10000000);
+    run(100000, 10000000);
+    run(10000, 10000000);
+    run(1000, 200000);
+    run(2000, 1800000, true);
+    run(2000, 1999000, true);
+
+    runParallel(10000000, 100000000);
+}
@@ -0,0 +1,37 @@
+// Generates many short strings from a pattern: with rnd.next(pattern), which
+// looks the pattern up on every call, and with a Pattern parsed once and a
+// reused buffer.
+
+#include "../jngen.h"
+
+#include <iostream>
+#include <string>
+
+const int N = 2000000;
+const std::string PATTERN = "[a-z]{5,10}";
+
+int main() {
+    size_t total1 = 0;
+    rnd.seed(1);
+    {
+        ContextTimer timer("rnd.next(string)");
+        for (int i = 0; i < N; ++i) {
+            total1 += rnd.next(PATTERN).size();
+        }
+    }
+
+    size_t total2 = 0;
+    rnd.seed(1);
+    {
+        ContextTimer timer("rnd.next(Pattern, buffer)");
+        Pattern pattern(PATTERN);
+        std::string buffer;
+        for (int i = 0; i < N; ++i) {
+            buffer.clear();
+            rnd.next(pattern, buffer);
+            total2 += buffer.size();
+        }
+    }
+
+    ensure(total1 == total2);
+}
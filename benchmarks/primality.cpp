@@ -0,0 +1,105 @@
+// Measures primality test throughput: isPrime with Montgomery and Barrett
+// reduction against the previous implementation, which reduced each product
+// with a 128-bit division and used nine witnesses for 64-bit numbers.
+
+#include "../jngen.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+const int N = 1000000;
+
+long long legacyMultiply(long long x, long long y, long long mod) {
+    return static_cast<__int128>(x) * y % mod;
+}
+
+bool legacyIsPrime(long long n) {
+    static const std::vector<long long> INT_WITNESSES{2, 7, 61};
+    static const std::vector<long long> LONG_LONG_WITNESSES
+        {2, 3, 5, 7, 11, 13, 17, 19, 23};
+
+    if (n <= 10000) {
+        for (int i = 2; i * i <= n; ++i) {
+            if (n % i == 0) {
+                return false;
+            }
+        }
+        return n != 1;
+    }
+
+    int r = 0;
+    long long d = n - 1;
+    while (d % 2 == 0) {
+        ++r;
+        d /= 2;
+    }
+
+    const auto& witnesses = n < std::numeric_limits<int>::max() ?
+        INT_WITNESSES : LONG_LONG_WITNESSES;
+    for (long long a: witnesses) {
+        long long x = 1;
+        long long base = a;
+        for (long long k = d; k; k >>= 1) {
+            if (k & 1) {
+                x = legacyMultiply(x, base, n);
+            }
+            base = legacyMultiply(base, base, n);
+        }
+        if (x == 1 || x == n - 1) {
+            continue;
+        }
+
+        bool composite = true;
+        for (int i = 0; i < r - 1 && composite; ++i) {
+            x = legacyMultiply(x, x, n);
+            if (x == 1) {
+                return false;
+            }
+            if (x == n - 1) {
+                composite = false;
+            }
+        }
+        if (composite) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename F>
+void run(const std::string& name, const Array64& numbers, F isPrime) {
+    auto start = std::chrono::steady_clock::now();
+    int primes = 0;
+    for (long long x: numbers) {
+        primes += isPrime(x);
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cerr << "  " << name << ": "
+        << static_cast<long long>(numbers.size() / elapsed.count())
+        << " tests/s" << std::endl;
+    // Keeps the loop from being optimized out.
+    ensure(primes != -1);
+}
+
+void compare(const std::string& name, const Array64& numbers) {
+    std::cerr << name << "\n";
+    run("before", numbers, legacyIsPrime);
+    run("after", numbers, [](long long x) { return isPrime(x); });
+}
+
+int main() {
+    rnd.seed(1);
+    for (long long r: {1000000000ll, 1000000000000000000ll}) {
+        auto odd = Array64::random(N, 5000, r / 2);
+        for (auto& x: odd) {
+            x = 2 * x + 1;
+        }
+        compare(format("random odd numbers up to %lld", r), odd);
+        compare(
+            format("primes up to %lld", r),
+            rndm.randomPrimes(N, r / 2, r));
+    }
+}
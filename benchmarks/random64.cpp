@@ -0,0 +1,35 @@
+// Measures bounded 64-bit draws (next(long long), next(size_t), as used by
+// choice and shuffle) with different engines. Mt19937 spends two 32-bit calls
+// on each word and masks it, 64-bit engines use a single call and 128-bit
+// multiplication.
+
+#include "../jngen.h"
+
+#include <iostream>
+#include <string>
+
+const int N = 20000000;
+
+void run(RandomEngine engine, const std::string& name, long long bound) {
+    rnd.setEngine(engine);
+    rnd.seed(1);
+    long long sum = 0;
+    {
+        ContextTimer timer(format("  %s", name.c_str()));
+        for (int i = 0; i < N; ++i) {
+            sum += rnd.next(bound);
+        }
+    }
+    // Keeps the loop from being optimized out.
+    ensure(sum != 42);
+}
+
+int main() {
+    for (long long bound: {1000000ll, 3000000000000000000ll, (1ll << 62) + 1}) {
+        std::cerr << "next(" << bound << ")\n";
+        run(RandomEngine::Mt19937, "mt19937", bound);
+        run(RandomEngine::Mt19937_64, "mt19937_64", bound);
+        run(RandomEngine::Xoshiro256, "xoshiro256**", bound);
+        run(RandomEngine::Wyrand, "wyrand", bound);
+    }
+}
@@ -9,6 +9,7 @@ HEADER_REGEX = re.compile('#include "(.*)"')
 # must be among the dependencies of some file from here.
 LIBRARY_HEADERS = [
     "array.h",
+    "array_stream.h",
     "random.h",
     "common.h",
     "tree.h",
@@ -6,6 +6,10 @@ struct Config {
     bool generateLargeObjects = false;
     bool largeOptionIndices = false;
     bool normalizeEdges = true;
+    int threads = 0;
+    // Exact integer wnext in O(1) draws, except for |w| > 8 with n^(|w|+1)
+    // above 2^128, where the default formula is kept.
+    bool fastWnext = false;
 };
 
 #ifdef JNGEN_DECLARE_ONLY
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "common.h"
+#include "random.h"
+
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+namespace jngen {
+
+// Samples indices with probabilities proportional to fixed weights in O(1)
+// per sample after O(n) preprocessing (Walker's alias method, Vose's
+// construction). Integer weights are handled exactly.
+class DiscreteDistribution {
+public:
+    DiscreteDistribution() {}
+
+    template<typename Numeric>
+    DiscreteDistribution(const std::vector<Numeric>& weights) {
+        build(weights, std::is_integral<Numeric>{});
+    }
+
+    template<typename Numeric>
+    DiscreteDistribution(const std::initializer_list<Numeric>& weights) :
+            DiscreteDistribution(std::vector<Numeric>(weights))
+    {  }
+
+    size_t size() const { return alias_.size(); }
+
+    size_t next() const { return next(rnd); }
+    size_t next(Random& random) const;
+
+private:
+    template<typename Numeric>
+    void build(const std::vector<Numeric>& weights, std::true_type);
+    template<typename Numeric>
+    void build(const std::vector<Numeric>& weights, std::false_type);
+
+    // Splits the scaled weights into buckets of capacity |total|: bucket i
+    // keeps index i with probability threshold[i] / total and yields
+    // alias[i] otherwise.
+    template<typename W>
+    void buildTables(std::vector<W> scaled, W total, std::vector<W>& threshold);
+
+    bool exact_ = true;
+    uint64_t total_ = 0;
+    std::vector<uint64_t> threshold_;
+    std::vector<double> probability_;
+    std::vector<size_t> alias_;
+};
+
+// Samples indices proportionally to integer weights which may change
+// between samples. Sampling and updates take O(log n) (Fenwick tree).
+// Yields exactly the same indices as rnd.nextByDistribution(weights) with
+// current weights.
+class DynamicDistribution {
+public:
+    DynamicDistribution() {}
+
+    template<typename Numeric>
+    DynamicDistribution(const std::vector<Numeric>& weights) {
+        static_assert(
+            std::is_integral<Numeric>::value,
+            "DynamicDistribution supports only integer weights");
+        std::vector<long long> w(weights.begin(), weights.end());
+        init(w);
+    }
+
+    size_t size() const { return weights_.size(); }
+    long long total() const { return total_; }
+    long long weight(size_t index) const { return weights_.at(index); }
+
+    void add(size_t index, long long delta);
+    void set(size_t index, long long weight);
+
+    size_t next() const { return next(rnd); }
+    size_t next(Random& random) const;
+
+private:
+    void init(const std::vector<long long>& weights);
+
+    std::vector<long long> weights_;
+    std::vector<long long> tree_;
+    long long total_ = 0;
+};
+
+template<typename W>
+void DiscreteDistribution::buildTables(
+        std::vector<W> scaled, W total, std::vector<W>& threshold)
+{
+    size_t n = scaled.size();
+    threshold.assign(n, total);
+    alias_.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        alias_[i] = i;
+    }
+
+    std::vector<size_t> small, large;
+    for (size_t i = 0; i < n; ++i) {
+        (scaled[i] < total ? small : large).push_back(i);
+    }
+    while (!small.empty() && !large.empty()) {
+        size_t less = small.back();
+        small.pop_back();
+        size_t more = large.back();
+
+        threshold[less] = scaled[less];
+        alias_[less] = more;
+        scaled[more] -= total - scaled[less];
+        if (scaled[more] < total) {
+            large.pop_back();
+            small.push_back(more);
+        }
+    }
+    // Remaining buckets are full, up to rounding for floating weights.
+}
+
+template<typename Numeric>
+void DiscreteDistribution::build(
+        const std::vector<Numeric>& weights, std::true_type)
+{
+    ensure(!weights.empty(), "Cannot sample by empty distribution");
+    uint64_t total = 0;
+    for (auto w: weights) {
+        ensure(w >= 0, "Weights must be non-negative");
+        total += static_cast<uint64_t>(w);
+    }
+    ensure(total > 0, "Sum of weights must be positive");
+    size_t n = weights.size();
+    ensure(
+        total <= std::numeric_limits<uint64_t>::max() / n,
+        "Sum of weights is too large");
+
+    std::vector<uint64_t> scaled;
+    for (auto w: weights) {
+        scaled.push_back(static_cast<uint64_t>(w) * n);
+    }
+    exact_ = true;
+    total_ = total;
+    buildTables(scaled, total, threshold_);
+}
+
+template<typename Numeric>
+void DiscreteDistribution::build(
+        const std::vector<Numeric>& weights, std::false_type)
+{
+    ensure(!weights.empty(), "Cannot sample by empty distribution");
+    double total = 0;
+    for (auto w: weights) {
+        ensure(w >= 0, "Weights must be non-negative");
+        total += w;
+    }
+    ensure(total > 0, "Sum of weights must be positive");
+    size_t n = weights.size();
+
+    std::vector<double> scaled;
+    for (auto w: weights) {
+        scaled.push_back(w * n / total);
+    }
+    exact_ = false;
+    buildTables(scaled, 1.0, probability_);
+}
+
+} // namespace jngen
+
+using jngen::DiscreteDistribution;
+using jngen::DynamicDistribution;
+
+#ifndef JNGEN_DECLARE_ONLY
+#define JNGEN_INCLUDE_DISTRIBUTION_INL_H
+#include "impl/distribution_inl.h"
+#undef JNGEN_INCLUDE_DISTRIBUTION_INL_H
+#endif // JNGEN_DECLARE_ONLY
@@ -2,12 +2,17 @@
 
 #include "array.h"
 #include "dsu.h"
+#include "parallel.h"
 #include "printers.h"
+#include "radix_sort.h"
+#include "span.h"
 #include "weight.h"
 
 #include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <iterator>
+#include <numeric>
 #include <set>
 #include <utility>
 #include <vector>
@@ -18,14 +23,14 @@ class GenericGraph {
 public:
     virtual ~GenericGraph() {}
 
-    virtual int n() const { return adjList_.size(); }
+    virtual int n() const { return vertexLabel_.size(); }
     virtual int m() const { return numEdges_; }
 
     bool directed() const { return directed_; }
 
     // u, v: labels
     virtual void addEdge(int u, int v, const Weight& w = Weight{});
-    virtual bool isConnected() const { return dsu_.isConnected(); }
+    virtual bool isConnected() const { return dsu().isConnected(); }
 
     virtual int vertexLabel(int v) const { return vertexLabel_.at(v); }
     virtual int vertexByLabel(int v) const { return vertexByLabel_.at(v); }
@@ -37,6 +42,21 @@ public:
     // return: array<label, label>
     virtual Arrayp edges() const;
 
+    // v: label
+    // return: span<label>, valid until the graph is modified
+    // requires: the graph is frozen
+    Span<int> neighbors(int v) const;
+
+    // v: label
+    // return: span<edge index>, i-th edge leads to neighbors(v)[i]
+    // requires: the graph is frozen
+    Span<int> incidentEdges(int v) const;
+
+    // Moves adjacency lists to the compressed storage. Generators return
+    // frozen graphs; addEdge unfreezes the graph until the next call.
+    void freeze();
+    bool frozen() const { return frozen_; }
+
     // order: by labels
     // TODO: think about ordering here
     virtual void setVertexWeights(const WeightArray& weights);
@@ -72,10 +92,26 @@ protected:
 
     void extend(size_t size);
 
+    // Returns the components of the graph, rebuilding them if the graph was
+    // created by initWithEdges.
+    Dsu& dsu() const;
+
     // v: vertex number
     // returns: array<number>
     Array internalEdges(int v) const;
 
+    // v: vertex number
+    // returns: span<edge index>, does not freeze the graph
+    Span<int> internalIncidentEdges(int v) const;
+
+    // Moves them back to per-vertex lists before adding an edge.
+    void thaw();
+    // Fills adjLabels_ after the graph is frozen or relabeled.
+    void updateAdjacentLabels();
+    // Fills the compressed storage from edges_ using config.threads threads,
+    // exactly as initWithEdges does with one.
+    void buildAdjacencyInParallel();
+
     // u, v: vertex numbers
     void addEdgeUnsafe(int u, int v);
 
@@ -93,8 +129,21 @@ protected:
 
     bool directed_ = false;
 
-    Dsu dsu_;
+    // initWithEdges leaves dsu_ stale, since most generated graphs never
+    // need it, and dsu() rebuilds it on demand.
+    mutable Dsu dsu_;
+    mutable bool dsuStale_ = false;
+
+    // While edges are added one by one, adjList_[v] holds indices of edges
+    // incident to v. Otherwise the graph is frozen: these indices are stored
+    // in adjEdges_[adjOffsets_[v]..adjOffsets_[v + 1]) and adjLabels_ holds
+    // labels of their other ends in the same order.
+    bool frozen_ = false;
     std::vector<Array> adjList_;
+    Array adjOffsets_;
+    Array adjEdges_;
+    Array adjLabels_;
+
     Array vertexLabel_;
     Array vertexByLabel_;
     Arrayp edges_;
@@ -108,7 +157,16 @@ struct Hash<GenericGraph> {
     uint64_t operator()(const GenericGraph& graph) const {
         uint64_t h = 0;
         for (int i = 0; i < graph.n(); ++i) {
-            impl::hashCombine(h, Hash<Array>{}(graph.edges(i)));
+            if (!graph.frozen()) {
+                impl::hashCombine(h, Hash<Array>{}(graph.edges(i)));
+                continue;
+            }
+            // Same as Hash<Array> of graph.edges(i), but without a copy.
+            auto neighbors = graph.neighbors(i);
+            uint64_t vertexHash = 0;
+            impl::hashCombine(vertexHash, neighbors.size());
+            impl::hashCombine(vertexHash, neighbors.begin(), neighbors.end());
+            impl::hashCombine(h, vertexHash);
         }
         return h;
     }
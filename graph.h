@@ -6,6 +6,9 @@
 #include "hash.h"
 #include "tree.h"
 
+#include <cmath>
+#include <functional>
+#include <limits>
 #include <memory>
 #include <set>
 #include <utility>
@@ -45,6 +48,9 @@ public:
             int n, int m, int elongation, int spread);
     static BuilderProxy randomBipartite(int n1, int n2, int m);
     static BuilderProxy completeBipartite(int n1, int n2);
+    static BuilderProxy randomRegular(int n, int d);
+    static BuilderProxy fromDegreeSequence(const Array& degrees);
+    static BuilderProxy randomExpectedDegrees(const Arrayf& weights);
 };
 
 inline void Graph::setN(int n) {
@@ -0,0 +1,63 @@
+#ifndef JNGEN_INCLUDE_DISTRIBUTION_INL_H
+#error File "distribution_inl.h" must not be included directly.
+#include "../distribution.h" // for completion engine
+#endif
+
+namespace jngen {
+
+size_t DiscreteDistribution::next(Random& random) const {
+    ensure(!alias_.empty(), "Cannot sample by empty distribution");
+    size_t bucket = random.next(alias_.size());
+    bool keep;
+    if (exact_) {
+        keep = random.next(static_cast<size_t>(total_)) < threshold_[bucket];
+    } else {
+        keep = random.nextf() < probability_[bucket];
+    }
+    return keep ? bucket : alias_[bucket];
+}
+
+void DynamicDistribution::init(const std::vector<long long>& weights) {
+    weights_.assign(weights.size(), 0);
+    tree_.assign(weights.size() + 1, 0);
+    total_ = 0;
+    for (size_t i = 0; i < weights.size(); ++i) {
+        add(i, weights[i]);
+    }
+}
+
+void DynamicDistribution::add(size_t index, long long delta) {
+    ensure(index < weights_.size(), "Index is out of range");
+    ensure(weights_[index] + delta >= 0, "Weights must be non-negative");
+    weights_[index] += delta;
+    total_ += delta;
+    for (size_t i = index + 1; i < tree_.size(); i += i & -i) {
+        tree_[i] += delta;
+    }
+}
+
+void DynamicDistribution::set(size_t index, long long weight) {
+    ensure(index < weights_.size(), "Index is out of range");
+    add(index, weight - weights_[index]);
+}
+
+size_t DynamicDistribution::next(Random& random) const {
+    ensure(total_ > 0, "Sum of weights must be positive");
+    long long x = random.next(total_);
+
+    // Find the first index whose prefix sum exceeds x.
+    size_t pos = 0;
+    size_t step = 1;
+    while (step * 2 < tree_.size()) {
+        step *= 2;
+    }
+    for (; step > 0; step /= 2) {
+        if (pos + step < tree_.size() && tree_[pos + step] <= x) {
+            pos += step;
+            x -= tree_[pos];
+        }
+    }
+    return pos;
+}
+
+} // namespace jngen
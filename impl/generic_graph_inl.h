@@ -58,6 +58,12 @@ Array GenericGraph::edges(int v) const {
     ensure(v < n(), "Graph::edges(v)");
     v = vertexByLabel(v);
 
+    if (frozen_) {
+        return Array(
+            adjLabels_.begin() + adjOffsets_[v],
+            adjLabels_.begin() + adjOffsets_[v + 1]);
+    }
+
     Array result = internalEdges(v);
     for (auto& x: result) {
         x = vertexLabel(x);
@@ -66,6 +72,24 @@ Array GenericGraph::edges(int v) const {
     return result;
 }
 
+Span<int> GenericGraph::neighbors(int v) const {
+    ensure(v < n(), "Graph::neighbors(v)");
+    ensure(frozen_, "Graph::neighbors(v): call freeze() after addEdge");
+    v = vertexByLabel(v);
+
+    return Span<int>(
+        adjLabels_.data() + adjOffsets_[v],
+        adjLabels_.data() + adjOffsets_[v + 1]);
+}
+
+Span<int> GenericGraph::incidentEdges(int v) const {
+    ensure(v < n(), "Graph::incidentEdges(v)");
+    ensure(frozen_, "Graph::incidentEdges(v): call freeze() after addEdge");
+    v = vertexByLabel(v);
+
+    return internalIncidentEdges(v);
+}
+
 Arrayp GenericGraph::edges() const {
     auto edges = edges_;
     for (auto& e: edges) {
@@ -100,6 +124,9 @@ void GenericGraph::doShuffle() {
     vertexByLabel_ = vertexLabel_.inverse();
 
     doShuffleEdges();
+    if (frozen_) {
+        updateAdjacentLabels();
+    }
 }
 
 void GenericGraph::doShuffleAllBut(const Array& except) {
@@ -119,13 +146,17 @@ void GenericGraph::doShuffleAllBut(const Array& except) {
     vertexByLabel_ = vertexLabel_.inverse();
 
     doShuffleEdges();
+    if (frozen_) {
+        updateAdjacentLabels();
+    }
 }
 
 void GenericGraph::doShuffleEdges() {
     if (!directed_) {
-        for (auto& edge: edges_) {
-            if (rnd.next(2)) {
-                std::swap(edge.first, edge.second);
+        Array flips = Array::random(edges_.size(), 2);
+        for (size_t i = 0; i < edges_.size(); ++i) {
+            if (flips[i]) {
+                std::swap(edges_[i].first, edges_[i].second);
             }
         }
     }
@@ -137,25 +168,106 @@ void GenericGraph::extend(size_t size) {
     checkLargeParameter(size);
     size_t oldSize = n();
     if (size > oldSize) {
-        adjList_.resize(size);
+        if (frozen_) {
+            adjOffsets_.resize(size + 1, adjOffsets_.back());
+        } else {
+            adjList_.resize(size);
+        }
         vertexLabel_ += Array::id(size - oldSize, oldSize);
         vertexByLabel_ += Array::id(size - oldSize, oldSize);
-        dsu_.extend(size);
+        if (!dsuStale_) {
+            dsu_.extend(size);
+        }
+    }
+}
+
+Dsu& GenericGraph::dsu() const {
+    if (dsuStale_) {
+        dsu_ = Dsu();
+        dsu_.extend(n());
+        for (const auto& edge: edges_) {
+            dsu_.unite(edge.first, edge.second);
+        }
+        dsuStale_ = false;
     }
+    return dsu_;
 }
 
 Array GenericGraph::internalEdges(int v) const {
+    auto ids = internalIncidentEdges(v);
     Array result;
+    result.reserve(ids.size());
     std::transform(
-        adjList_[v].begin(),
-        adjList_[v].end(),
+        ids.begin(),
+        ids.end(),
         std::back_inserter(result),
         [this, v](int x) { return edgeOtherEnd(v, x); }
     );
     return result;
 }
 
+Span<int> GenericGraph::internalIncidentEdges(int v) const {
+    if (frozen_) {
+        return Span<int>(
+            adjEdges_.data() + adjOffsets_[v],
+            adjEdges_.data() + adjOffsets_[v + 1]);
+    }
+    return Span<int>(
+        adjList_[v].data(), adjList_[v].data() + adjList_[v].size());
+}
+
+void GenericGraph::freeze() {
+    if (frozen_) {
+        return;
+    }
+
+    adjOffsets_.assign(n() + 1, 0);
+    for (int v = 0; v < n(); ++v) {
+        adjOffsets_[v + 1] = adjOffsets_[v] + adjList_[v].size();
+    }
+
+    adjEdges_.clear();
+    adjEdges_.reserve(adjOffsets_.back());
+    for (const auto& ids: adjList_) {
+        adjEdges_.insert(adjEdges_.end(), ids.begin(), ids.end());
+    }
+    std::vector<Array>().swap(adjList_);
+
+    frozen_ = true;
+    updateAdjacentLabels();
+}
+
+void GenericGraph::thaw() {
+    if (!frozen_) {
+        return;
+    }
+
+    adjList_.resize(n());
+    for (int v = 0; v < n(); ++v) {
+        adjList_[v].assign(
+            adjEdges_.begin() + adjOffsets_[v],
+            adjEdges_.begin() + adjOffsets_[v + 1]);
+    }
+    Array().swap(adjOffsets_);
+    Array().swap(adjEdges_);
+    Array().swap(adjLabels_);
+
+    frozen_ = false;
+}
+
+void GenericGraph::updateAdjacentLabels() {
+    ENSURE(frozen_, "GenericGraph::updateAdjacentLabels");
+    adjLabels_.resize(adjEdges_.size());
+    for (int v = 0; v < n(); ++v) {
+        for (int i = adjOffsets_[v]; i != adjOffsets_[v + 1]; ++i) {
+            adjLabels_[i] = vertexLabel_[edgeOtherEnd(v, adjEdges_[i])];
+        }
+    }
+}
+
 void GenericGraph::addEdgeUnsafe(int u, int v) {
+    thaw();
+
     int id = numEdges_++;
     edges_.emplace_back(u, v);
 
@@ -184,9 +296,18 @@ void GenericGraph::permuteEdges(const Array& order) {
     edges_ = edges_.subseq(order);
 
     auto newByOld = order.inverse();
-    for (int v = 0; v < n(); ++v) {
-        for (auto& x: adjList_[v]) {
-            x = newByOld[x];
+    if (frozen_) {
+        detail::parallelForChunks(
+            adjEdges_.size(), [this, &newByOld](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    adjEdges_[i] = newByOld[adjEdges_[i]];
+                }
+            });
+    } else {
+        for (int v = 0; v < n(); ++v) {
+            for (auto& x: adjList_[v]) {
+                x = newByOld[x];
+            }
         }
     }
 
@@ -202,7 +323,7 @@ void GenericGraph::addEdge(int u, int v, const Weight& w) {
     u = vertexByLabel(u);
     v = vertexByLabel(v);
 
-    dsu_.unite(u, v);
+    dsu().unite(u, v);
     addEdgeUnsafe(u, v);
 
     if (!w.empty()) {
@@ -313,10 +434,23 @@ void GenericGraph::normalizeEdges() {
         }
     }
 
-    auto order = Array::id(numEdges_).sorted(
-        [this](int i, int j) {
-            return edges_[i] < edges_[j];
-        });
+    // Equal edges are indistinguishable, so a stable radix sort gives the
+    // same graph as a comparison sort would.
+    std::vector<detail::KeyIndex> keys(numEdges_);
+    detail::parallelForChunks(numEdges_, [&](size_t begin, size_t end) {
+        for (size_t id = begin; id < end; ++id) {
+            keys[id] = {
+                static_cast<uint64_t>(edges_[id].first) * n() +
+                    edges_[id].second,
+                static_cast<int>(id)};
+        }
+    });
+    detail::sortByKey(keys, detail::bitWidth(static_cast<uint64_t>(n()) * n()));
+
+    Array order(numEdges_);
+    for (int i = 0; i < numEdges_; ++i) {
+        order[i] = keys[i].index;
+    }
 
     permuteEdges(order);
 }
@@ -337,33 +471,99 @@ int GenericGraph::compareTo(const GenericGraph& other) const {
 
 void GenericGraph::initWithEdges(int n, const Arrayp& edges) {
     ENSURE(this->n() == 0, "Can call initWithEdges only on empty graph");
+
+    // The graph is built frozen, so adjacency lists go straight to the
+    // compressed storage without per-vertex allocations.
+    std::vector<Array>().swap(adjList_);
+    adjOffsets_.assign(1, 0);
+    frozen_ = true;
     extend(n);
+    dsuStale_ = true;
 
     edges_ = edges;
     numEdges_ = edges.size();
 
-
-    Array degree(n);
-    for (const auto& edge: edges) {
-        ++degree[edge.first];
-        if (!directed_ && edge.first != edge.second) {
-            ++degree[edge.second];
+    if (config.threads > 0) {
+        buildAdjacencyInParallel();
+    } else {
+        // adjOffsets_[v] is the end of the v-th block at first, and moves to
+        // its beginning as edges are placed from the last one.
+        for (const auto& edge: edges) {
+            ++adjOffsets_[edge.first];
+            if (!directed_ && edge.first != edge.second) {
+                ++adjOffsets_[edge.second];
+            }
         }
-
-        dsu_.unite(edge.first, edge.second);
-    }
-    for (int i = 0; i < n; ++i) {
-        adjList_[i].reserve(degree[i]);
-    }
-    for (size_t id = 0; id != edges.size(); ++id) {
-        const auto& edge = edges[id];
-        adjList_[edge.first].push_back(id);
-        if (!directed_ && edge.first != edge.second) {
-            adjList_[edge.second].push_back(id);
+        std::partial_sum(
+            adjOffsets_.begin(), adjOffsets_.end(), adjOffsets_.begin());
+
+        // Vertices are not relabeled yet, so the labels of other ends are
+        // known right away, and normalizeEdges() changes only edge indices.
+        adjEdges_.resize(adjOffsets_.back());
+        adjLabels_.resize(adjOffsets_.back());
+        for (int id = numEdges_ - 1; id >= 0; --id) {
+            const auto& edge = edges[id];
+            int position = --adjOffsets_[edge.first];
+            adjEdges_[position] = id;
+            adjLabels_[position] = edge.second;
+            if (!directed_ && edge.first != edge.second) {
+                position = --adjOffsets_[edge.second];
+                adjEdges_[position] = id;
+                adjLabels_[position] = edge.first;
+            }
         }
     }
 
     normalizeEdges();
 }
 
+void GenericGraph::buildAdjacencyInParallel() {
+    int n = this->n();
+
+    // Degrees do not depend on the order of increments. Edges are then put
+    // into their blocks in arbitrary order, and each block is sorted, so the
+    // result is the same as the one of the serial placement.
+    std::vector<std::atomic<int>> position(n);
+    detail::parallelForChunks(numEdges_, [&](size_t begin, size_t end) {
+        for (size_t id = begin; id < end; ++id) {
+            const auto& edge = edges_[id];
+            ++position[edge.first];
+            if (!directed_ && edge.first != edge.second) {
+                ++position[edge.second];
+            }
+        }
+    });
+
+    adjOffsets_.assign(n + 1, 0);
+    for (int v = 0; v < n; ++v) {
+        adjOffsets_[v + 1] = adjOffsets_[v] + position[v];
+        position[v] = adjOffsets_[v];
+    }
+
+    adjEdges_.resize(adjOffsets_.back());
+    adjLabels_.resize(adjOffsets_.back());
+    detail::parallelForChunks(numEdges_, [&](size_t begin, size_t end) {
+        for (size_t id = begin; id < end; ++id) {
+            const auto& edge = edges_[id];
+            adjEdges_[position[edge.first]++] = id;
+            if (!directed_ && edge.first != edge.second) {
+                adjEdges_[position[edge.second]++] = id;
+            }
+        }
+    });
+
+    detail::parallelForChunks(n, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) {
+            std::sort(
+                adjEdges_.begin() + adjOffsets_[v],
+                adjEdges_.begin() + adjOffsets_[v + 1]);
+            for (int i = adjOffsets_[v]; i != adjOffsets_[v + 1]; ++i) {
+                const auto& edge = edges_[adjEdges_[i]];
+                adjLabels_[i] = edge.first == static_cast<int>(v) ?
+                    edge.second : edge.first;
+            }
+        }
+    });
+}
+
 } // namespace jngen
@@ -5,24 +5,152 @@
 
 #include "../array.h"
 #include "../common.h"
+#include "../parallel.h"
 #include "../printers.h"
+#include "../radix_sort.h"
 
 namespace jngen {
 
 namespace graph_detail {
 
 Graph BuilderProxy::g() const {
-    return builder_(traits_);
+    Graph g = builder_(traits_);
+    g.freeze();
+    return g;
 }
 
 BuilderProxy::operator Graph() const {
     return g();
 }
 
+std::pair<int, int> orderedEdge(int u, int v) {
+    return u < v ? std::make_pair(u, v) : std::make_pair(v, u);
+}
+
+// Rewires undirected edges with switches: edges (a, b) and (c, d) are replaced
+// by (a, c) and (b, d), which keeps degrees of all vertices. Only switches
+// giving edges allowed by traits are made. Adjacency lists are kept to look
+// up edges, so a lookup takes time proportional to the smaller degree. Since
+// degrees do not change, the lists are stored in a single array.
+class EdgeSwitcher {
+public:
+    EdgeSwitcher(int n, const Traits& t, Arrayp& edges) :
+        t_(t),
+        edges_(edges),
+        offset_(n + 1),
+        size_(n)
+    {
+        for (const auto& edge: edges_) {
+            ++offset_[edge.first + 1];
+            ++offset_[edge.second + 1];
+        }
+        std::partial_sum(offset_.begin(), offset_.end(), offset_.begin());
+        adjacent_.resize(offset_.back());
+        for (const auto& edge: edges_) {
+            add(edge.first, edge.second);
+        }
+    }
+
+    // Returns true if the i-th edge is a loop or a multiple edge forbidden by
+    // traits.
+    bool isForbidden(int i) const {
+        const auto& edge = edges_[i];
+        if (edge.first == edge.second && !t_.allowLoops) {
+            return true;
+        }
+        return !t_.allowMulti && count(edge.first, edge.second) > 1;
+    }
+
+    // Tries to switch the i-th and the j-th edges, taking the ends of the
+    // latter in random order. Returns true on success.
+    bool trySwitch(int i, int j) {
+        if (i == j) {
+            return false;
+        }
+        int a = edges_[i].first;
+        int b = edges_[i].second;
+        int c = edges_[j].first;
+        int d = edges_[j].second;
+        if (rnd.next(2)) {
+            std::swap(c, d);
+        }
+
+        remove(a, b);
+        remove(c, d);
+        bool success = isAllowed(a, c);
+        if (success) {
+            add(a, c);
+            success = isAllowed(b, d);
+            if (!success) {
+                remove(a, c);
+            }
+        }
+        if (!success) {
+            add(a, b);
+            add(c, d);
+            return false;
+        }
+
+        add(b, d);
+        edges_[i] = orderedEdge(a, c);
+        edges_[j] = orderedEdge(b, d);
+        return true;
+    }
+
+private:
+    bool isAllowed(int u, int v) const {
+        return (u != v || t_.allowLoops) && (t_.allowMulti || !count(u, v));
+    }
+
+    int count(int u, int v) const {
+        if (size_[u] > size_[v]) {
+            std::swap(u, v);
+        }
+        auto begin = adjacent_.begin() + offset_[u];
+        return std::count(begin, begin + size_[u], v);
+    }
+
+    // A loop takes one place in the list, though it adds 2 to the degree.
+    void add(int u, int v) {
+        adjacent_[offset_[u] + size_[u]++] = v;
+        if (u != v) {
+            adjacent_[offset_[v] + size_[v]++] = u;
+        }
+    }
+
+    void remove(int u, int v) {
+        erase(u, v);
+        if (u != v) {
+            erase(v, u);
+        }
+    }
+
+    void erase(int u, int v) {
+        auto begin = adjacent_.begin() + offset_[u];
+        auto end = begin + size_[u];
+        auto it = std::find(begin, end, v);
+        ENSURE(it != end, "EdgeSwitcher::erase");
+        *it = *(end - 1);
+        --size_[u];
+    }
+
+    const Traits& t_;
+    Arrayp& edges_;
+    Array offset_;
+    Array size_;
+    Array adjacent_;
+};
+
 class GraphRandom {
     using BuilderProxy = graph_detail::BuilderProxy;
     using Traits = graph_detail::Traits;
 
+    // Graphs with given degrees are rewired with switches: the configuration
+    // model gives up after this many attempts (plus 10 per edge), and a graph
+    // built deterministically is shuffled with this many switches per edge.
+    static constexpr long long MAX_SWITCH_ATTEMPTS = 1000;
+    static constexpr long long SWITCHES_PER_EDGE = 10;
+
 public:
     GraphRandom() {
         static bool created = false;
@@ -166,6 +294,41 @@ public:
         });
     }
 
+    static BuilderProxy randomRegular(int n, int d) {
+        ensure(
+            n >= 0 && d >= 0,
+            "Number of vertices and degree must be nonnegative");
+        return fromDegreeSequence(std::vector<int>(n, d));
+    }
+
+    static BuilderProxy fromDegreeSequence(const Array& degrees) {
+        long long sum = 0;
+        for (int d: degrees) {
+            ensure(d >= 0, "Degrees of vertices must be nonnegative");
+            sum += d;
+        }
+        ensure(sum % 2 == 0, "The sum of degrees must be even");
+        ensure(
+            sum / 2 <= std::numeric_limits<int>::max(),
+            "Too many edges in the graph");
+        checkLargeParameter(degrees.size());
+        checkLargeParameter(sum / 2);
+        return BuilderProxy(
+            Traits(degrees.size(), sum / 2), [degrees](Traits t) {
+                return doFromDegreeSequence(t, degrees);
+            });
+    }
+
+    static BuilderProxy randomExpectedDegrees(const Arrayf& weights) {
+        for (double w: weights) {
+            ensure(w >= 0, "Expected degrees must be nonnegative");
+        }
+        checkLargeParameter(weights.size());
+        return BuilderProxy(Traits(weights.size()), [weights](Traits t) {
+            return doRandomExpectedDegrees(t, weights);
+        });
+    }
+
 private:
     static Graph doRandom(Traits t) {
         int n = t.n;
@@ -175,49 +338,50 @@ private:
             ensure(m <= maxEdges(n, t), "Too many edges in the graph");
         }
 
-        std::unordered_set<std::pair<int, int>> usedEdges;
+        Arrayp result;
 
         if (t.connected) {
             ensure(m >= n - 1, "Not enough edges for a connected graph");
-            auto treeEdges = Tree::random(n).edges();
+            result = Tree::random(n).edges();
             if (t.directed) {
-                for (auto& edge: treeEdges) {
-                    if (rnd.next(2)) {
-                        std::swap(edge.first, edge.second);
+                Array flips = Array::random(result.size(), 2);
+                for (size_t i = 0; i < result.size(); ++i) {
+                    if (flips[i]) {
+                        std::swap(result[i].first, result[i].second);
                     }
                 }
             }
-            usedEdges.insert(treeEdges.begin(), treeEdges.end());
-            ENSURE(usedEdges.size() == static_cast<size_t>(n - 1));
         }
 
-        auto edgeIsGood = [&usedEdges, t](std::pair<int, int> edge) {
-            if (!t.allowMulti && usedEdges.count(edge)) {
-                return false;
-            }
-            if (t.directed && !t.allowAntiparallel &&
-                    usedEdges.count({edge.second, edge.first}))
-            {
-                return false;
-            }
-            return true;
-        };
-
-        Arrayp result(usedEdges.begin(), usedEdges.end());
         result.reserve(m);
-
-        while (result.size() < static_cast<size_t>(m)) {
-            auto edge = randomEdge(n, t);
-            if (edgeIsGood(edge)) {
-                usedEdges.insert(edge);
-                result.push_back(edge);
-            }
+        bool ordered = t.directed && t.allowAntiparallel;
+        // If loops are allowed in unordered pairs, randomEdge returns a loop
+        // half as often as any other edge, so edges are not equiprobable and
+        // only rejection sampling reproduces the distribution.
+        bool equiprobable = !t.allowLoops || ordered;
+        if (!t.allowMulti && equiprobable &&
+                isDense(m, maxEdges(n, t), result.size())) {
+            // Rows are first ends of edges in canonical order (see
+            // addRandomEdges), columns are second ends.
+            addDenseEdges(
+                n, m, maxEdges(n, t), t, result,
+                n,
+                [ordered, &t](int u) {
+                    return ordered ? 0 : t.allowLoops ? u : u + 1;
+                },
+                ordered && !t.allowLoops);
+        } else {
+            addRandomEdges(n, m, t, result,
+                [n, &t](Random& random, size_t count,
+                        std::pair<int, int>* out) {
+                    randomEdges(random, n, t, count, out);
+                });
         }
 
         Graph graph;
 
         if (t.directed && t.acyclic) {
-            makeAcyclic(result);
+            makeAcyclic(n, result);
         }
         if (t.directed) {
             graph.directed_ = true;
@@ -235,63 +399,99 @@ private:
 
         auto treeEdges = tree.edges();
         if (t.directed && !t.acyclic) {
-            for (auto& edge: treeEdges) {
-                if (rnd.next(2)) {
-                    std::swap(edge.first, edge.second);
+            Array flips = Array::random(treeEdges.size(), 2);
+            for (size_t i = 0; i < treeEdges.size(); ++i) {
+                if (flips[i]) {
+                    std::swap(treeEdges[i].first, treeEdges[i].second);
                 }
             }
         }
 
+        std::string error = format("Cannot generate random stretched graph "
+            "with parameters %d, %d, %d, %d", t.n, t.m, elongation, spread);
+        constexpr size_t MAX_ATTEMPTS = 1000;
+
         Arrayp edges = treeEdges;
         edges.reserve(t.m);
 
-        std::unordered_set<std::pair<int, int>> usedEdges(
-            treeEdges.begin(), treeEdges.end());
+        if (config.threads > 0) {
+            // Candidates are drawn as in the sequential loop below, but in
+            // parallel chunks, and checked by addRandomEdges. Loops are
+            // redrawn at once.
+            ensure(t.m >= t.n - 1, "Not enough edges for a connected graph");
+            bool complete = addRandomEdges(t.n, t.m, t, edges,
+                [&parents, &error, t, spread](Random& random, size_t count,
+                        std::pair<int, int>* out) {
+                    for (size_t i = 0; i < count; ++i) {
+                        size_t attemptsToFail = MAX_ATTEMPTS;
+                        while (true) {
+                            int u = random.next(t.n);
+                            int up = random.next(0, spread);
+                            int v = u;
+                            for (int iter = 0; iter < up; ++iter) {
+                                v = parents[v];
+                            }
+                            if (t.allowLoops || u != v) {
+                                if (t.directed && !t.acyclic &&
+                                        random.next(2)) {
+                                    std::swap(u, v);
+                                }
+                                out[i] = {v, u};
+                                break;
+                            }
+                            ensure(--attemptsToFail != 0, error);
+                        }
+                    }
+                },
+                MAX_ATTEMPTS);
+            ensure(complete, error);
+        } else {
+            std::unordered_set<std::pair<int, int>> usedEdges(
+                treeEdges.begin(), treeEdges.end());
+
+            auto edgeIsGood = [&usedEdges, t](std::pair<int, int> edge) {
+                if (!t.allowMulti && usedEdges.count(edge)) {
+                    return false;
+                }
+                if (t.directed && !t.allowAntiparallel &&
+                        usedEdges.count({edge.second, edge.first}))
+                {
+                    return false;
+                }
+                return true;
+            };
 
-        auto edgeIsGood = [&usedEdges, t](std::pair<int, int> edge) {
-            if (!t.allowMulti && usedEdges.count(edge)) {
-                return false;
-            }
-            if (t.directed && !t.allowAntiparallel &&
-                    usedEdges.count({edge.second, edge.first}))
-            {
-                return false;
-            }
-            return true;
-        };
+            size_t attemptsToFail = MAX_ATTEMPTS;
 
-        constexpr size_t MAX_ATTEMPTS = 1000;
-        size_t attemptsToFail = MAX_ATTEMPTS;
+            while (static_cast<int>(edges.size()) != t.m) {
+                if (--attemptsToFail == 0) {
+                    ensure(false, error);
+                }
+                int u = rnd.next(t.n);
+                int up = rnd.next(0, spread);
+                int v = u;
+                for (int iter = 0; iter < up; ++iter) {
+                    v = parents[v];
+                }
 
-        while (static_cast<int>(edges.size()) != t.m) {
-            if (--attemptsToFail == 0) {
-                ensure(false, format("Cannot generate random stretched graph "
-                    "with parameters %d, %d, %d, %d",
-                    t.n, t.m, elongation, spread));
-            }
-            int u = rnd.next(t.n);
-            int up = rnd.next(0, spread);
-            int v = u;
-            for (int iter = 0; iter < up; ++iter) {
-                v = parents[v];
-            }
+                ENSURE(v <= u);
 
-            ENSURE(v <= u);
+                if (!t.allowLoops && u == v) {
+                    continue;
+                }
 
-            if (!t.allowLoops && u == v) {
-                continue;
-            }
+                if (!edgeIsGood({v, u})) {
+                    continue;
+                }
 
-            if (!edgeIsGood({v, u})) {
-                continue;
-            }
+                if (t.directed && !t.acyclic && rnd.next(2)) {
+                    std::swap(u, v);
+                }
 
-            if (t.directed && !t.acyclic && rnd.next(2)) {
-                std::swap(u, v);
+                edges.emplace_back(v, u);
+                usedEdges.emplace(v, u);
+                attemptsToFail = MAX_ATTEMPTS;
             }
-
-            edges.emplace_back(v, u);
-            attemptsToFail = MAX_ATTEMPTS;
         }
 
         Graph graph;
@@ -313,41 +513,32 @@ private:
 
         ensure(!t.directed, "Directed bipartite graphs are not supported");
 
-        std::unordered_set<std::pair<int, int>> usedEdges;
+        Arrayp result;
 
         if (t.connected) {
             ensure(m >= n1 + n2 - 1, "Not enough edges for a connected graph");
             auto pruferCode = Array::random(n2 - 1, 0, n1 - 1) +
                 Array::random(n1 - 1, n1, n1 + n2 - 1);
             pruferCode.shuffle();
-            auto treeEdges = Tree::fromPruferSequence(pruferCode).edges();
-            usedEdges.insert(treeEdges.begin(), treeEdges.end());
-            ENSURE(usedEdges.size() == static_cast<size_t>(n1 + n2 - 1));
+            result = Tree::fromPruferSequence(pruferCode).edges();
         }
 
-        auto edgeIsGood = [&usedEdges, t](std::pair<int, int> edge) {
-            if (!t.allowMulti && usedEdges.count(edge)) {
-                return false;
-            }
-            if (t.directed && !t.allowAntiparallel &&
-                    usedEdges.count({edge.second, edge.first}))
-            {
-                return false;
-            }
-            return true;
-        };
-
-        Arrayp result(usedEdges.begin(), usedEdges.end());
         result.reserve(m);
-
-        while (result.size() < static_cast<size_t>(m)) {
-            int u = rnd.next(0, n1 - 1);
-            int v = rnd.next(n1, n1 + n2 - 1);
-            std::pair<int, int> edge(u, v);
-            if (edgeIsGood(edge)) {
-                usedEdges.insert(edge);
-                result.push_back(edge);
-            }
+        long long maxEdges = static_cast<long long>(n1) * n2;
+        if (!t.allowMulti && isDense(m, maxEdges, result.size())) {
+            addDenseEdges(
+                n1 + n2, m, maxEdges, t, result,
+                n1, [n1](int) { return n1; }, false);
+        } else {
+            addRandomEdges(n1 + n2, m, t, result,
+                [n1, n2](Random& random, size_t count,
+                        std::pair<int, int>* out) {
+                    for (size_t i = 0; i < count; ++i) {
+                        int u = random.next(0, n1 - 1);
+                        int v = random.next(n1, n1 + n2 - 1);
+                        out[i] = {u, v};
+                    }
+                });
         }
 
         Graph graph;
@@ -360,6 +551,315 @@ private:
         return rnd.nextp(n, RandomPairTraits{!t.directed, !t.allowLoops});
     }
 
+    // Writes to |out| the same |count| edges as successive calls of
+    // randomEdge(n, t) would return if rnd were |random|.
+    static void randomEdges(
+        Random& random, int n, const Traits& t, size_t count,
+        std::pair<int, int>* out)
+    {
+        Array values;
+        int first = -1;
+        while (count > 0) {
+            // Each edge takes at least two numbers (one if it is already
+            // started), so no more numbers are drawn than randomEdge would.
+            values.resize(2 * count - (first != -1));
+            random.fill(values.data(), values.size(), n);
+            for (int x: values) {
+                if (first == -1) {
+                    first = x;
+                } else if (t.allowLoops || x != first) {
+                    if (!t.directed && first > x) {
+                        *out++ = {x, first};
+                    } else {
+                        *out++ = {first, x};
+                    }
+                    first = -1;
+                    --count;
+                }
+            }
+        }
+    }
+
+    // Calls draw(random, count, out), which writes |count| random edges to
+    // out[0..count). The whole range is drawn from rnd, unless
+    // config.threads is set: then its chunks are drawn in parallel from
+    // streams split off rnd, so that they do not depend on the number of
+    // threads.
+    template<typename Draw>
+    static void drawEdges(size_t count, std::pair<int, int>* out, Draw& draw) {
+        if (config.threads > 0) {
+            detail::generateInChunks(
+                count, [out, &draw](Random& random, size_t begin, size_t size) {
+                    draw(random, size, out + begin);
+                });
+        } else {
+            draw(rnd, count, out);
+        }
+    }
+
+    // Appends random edges on n vertices to |result| until it has m of them.
+    // Edges are generated with drawEdges and are rejected if they are
+    // duplicate or antiparallel to already taken ones (as forbidden by
+    // traits), exactly as if they were drawn and checked one by one. Instead
+    // of looking up each edge in a hash set, the edges are drawn in batches
+    // and the rejected ones are found by sorting packed keys. A batch is never
+    // larger than the number of edges still missing, so without
+    // config.threads the draws are the same as with one-by-one checks. With
+    // it, every step is split into chunks processed in parallel, and the
+    // result depends only on the seed. If maxRejections is positive and that
+    // many draws in a row are rejected, stops and returns false.
+    template<typename Draw>
+    static bool addRandomEdges(
+        int n, int m, const Traits& t, Arrayp& result, Draw draw,
+        size_t maxRejections = 0)
+    {
+        bool checkAntiparallel = t.directed && !t.allowAntiparallel;
+        if (t.allowMulti && !checkAntiparallel) {
+            size_t taken = result.size();
+            result.resize(m);
+            drawEdges(m - taken, result.data() + taken, draw);
+            return true;
+        }
+
+        // Edges with the same key are checked against each other. With
+        // allowMulti (and antiparallel edges forbidden) the edge is taken
+        // unless the opposite one is, which is stored in the lowest bit of
+        // used keys. A loop is opposite to itself.
+        auto key = [n, checkAntiparallel, &t](std::pair<int, int> edge) {
+            if ((!t.directed || checkAntiparallel) &&
+                    edge.first > edge.second) {
+                std::swap(edge.first, edge.second);
+            }
+            return static_cast<uint64_t>(edge.first) * n + edge.second;
+        };
+        auto orientation = [&t](const std::pair<int, int>& edge) {
+            return t.allowMulti && edge.first > edge.second ? 1 : 0;
+        };
+
+        int bits = detail::bitWidth(static_cast<uint64_t>(n) * n);
+
+        std::vector<uint64_t> used;
+        used.reserve(m);
+        for (const auto& edge: result) {
+            used.push_back(key(edge) << 1 | orientation(edge));
+        }
+        std::sort(used.begin(), used.end());
+
+        Arrayp batch;
+        std::vector<detail::KeyIndex> keys;
+        std::vector<char> taken;
+        std::vector<uint64_t> merged;
+        size_t rejections = 0;
+
+        while (result.size() < static_cast<size_t>(m)) {
+            batch.resize(m - result.size());
+            drawEdges(batch.size(), batch.data(), draw);
+
+            keys.resize(batch.size());
+            detail::parallelForChunks(
+                batch.size(), [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; ++i) {
+                        keys[i] = {key(batch[i]), static_cast<int>(i)};
+                    }
+                });
+            detail::sortByKey(keys, bits);
+
+            // Sorted keys are split into segments which do not break groups
+            // of equal keys. Each segment is checked against its own range of
+            // used keys.
+            std::vector<size_t> segmentBegin{0};
+            for (size_t i = detail::PARALLEL_CHUNK_SIZE; i < keys.size();
+                    i += detail::PARALLEL_CHUNK_SIZE) {
+                size_t j = i;
+                while (j < keys.size() && keys[j].key == keys[j - 1].key) {
+                    ++j;
+                }
+                if (j < keys.size() && j > segmentBegin.back()) {
+                    segmentBegin.push_back(j);
+                }
+            }
+            size_t segments = segmentBegin.size();
+            segmentBegin.push_back(keys.size());
+
+            std::vector<size_t> usedBegin(segments + 1, 0);
+            usedBegin[segments] = used.size();
+            for (size_t s = 1; s < segments; ++s) {
+                usedBegin[s] = std::lower_bound(
+                    used.begin(), used.end(),
+                    keys[segmentBegin[s]].key << 1) - used.begin();
+            }
+
+            taken.assign(batch.size(), false);
+            std::vector<std::vector<uint64_t>> added(segments);
+            detail::parallelFor(segments, [&](size_t s) {
+                auto usedIt = used.begin() + usedBegin[s];
+                auto usedEnd = used.begin() + usedBegin[s + 1];
+                for (size_t i = segmentBegin[s]; i != segmentBegin[s + 1]; ) {
+                    uint64_t k = keys[i].key;
+                    // Keys are sorted, so used ones are walked forward as in
+                    // a merge.
+                    while (usedIt != usedEnd && *usedIt < (k << 1)) {
+                        ++usedIt;
+                    }
+                    // -1 if no edge with this key is taken, its orientation
+                    // otherwise.
+                    int state = -1;
+                    if (usedIt != usedEnd && (*usedIt >> 1) == k) {
+                        state = *usedIt & 1;
+                    }
+                    bool isNew = state == -1;
+
+                    for (; i != segmentBegin[s + 1] && keys[i].key == k; ++i) {
+                        const auto& edge = batch[keys[i].index];
+                        if (state == -1) {
+                            state = orientation(edge);
+                            taken[keys[i].index] = true;
+                        } else if (t.allowMulti &&
+                                edge.first != edge.second &&
+                                orientation(edge) == state) {
+                            taken[keys[i].index] = true;
+                        }
+                    }
+                    if (isNew) {
+                        added[s].push_back(k << 1 | state);
+                    }
+                }
+            });
+
+            std::vector<size_t> mergedBegin(segments + 1, 0);
+            for (size_t s = 0; s < segments; ++s) {
+                mergedBegin[s + 1] = mergedBegin[s] +
+                    (usedBegin[s + 1] - usedBegin[s]) + added[s].size();
+            }
+            merged.resize(mergedBegin[segments]);
+            detail::parallelFor(segments, [&](size_t s) {
+                std::merge(
+                    used.begin() + usedBegin[s],
+                    used.begin() + usedBegin[s + 1],
+                    added[s].begin(), added[s].end(),
+                    merged.begin() + mergedBegin[s]);
+            });
+            used.swap(merged);
+
+            // Taken edges are appended in the order they were drawn.
+            size_t chunks = (batch.size() + detail::PARALLEL_CHUNK_SIZE - 1) /
+                detail::PARALLEL_CHUNK_SIZE;
+            std::vector<size_t> resultBegin(chunks + 1);
+            resultBegin[0] = result.size();
+            detail::parallelForChunks(
+                batch.size(), [&](size_t begin, size_t end) {
+                    resultBegin[begin / detail::PARALLEL_CHUNK_SIZE + 1] =
+                        std::count(
+                            taken.begin() + begin, taken.begin() + end, true);
+                });
+            std::partial_sum(
+                resultBegin.begin(), resultBegin.end(), resultBegin.begin());
+            result.resize(resultBegin[chunks]);
+            detail::parallelForChunks(
+                batch.size(), [&](size_t begin, size_t end) {
+                    size_t position =
+                        resultBegin[begin / detail::PARALLEL_CHUNK_SIZE];
+                    for (size_t i = begin; i < end; ++i) {
+                        if (taken[i]) {
+                            result[position++] = batch[i];
+                        }
+                    }
+                });
+
+            if (maxRejections > 0 && result.size() < static_cast<size_t>(m)) {
+                size_t last = batch.size();
+                while (last > 0 && !taken[last - 1]) {
+                    --last;
+                }
+                rejections = last == 0 ?
+                    rejections + batch.size() : batch.size() - last;
+                if (rejections >= maxRejections) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Returns true if at least half of edges which are not taken yet are to
+    // be added. Rejection sampling would then draw too many duplicates, so
+    // all possible edges are enumerated instead.
+    static bool isDense(int m, long long maxEdges, size_t taken) {
+        return 2 * (m - static_cast<long long>(taken)) >
+            maxEdges - static_cast<long long>(taken);
+    }
+
+    // Appends to |result| edges chosen uniformly among those not taken yet,
+    // until it has m of them. All allowed edges in canonical order (see
+    // addRandomEdges) are (u, v) for u in [0, rows) and v in
+    // [firstColumn(u), n), except loops if skipLoops is set; there are
+    // maxEdges of them. The edges which are left out are sampled, and the
+    // added ones are shuffled, so the result is distributed exactly as the
+    // one of addRandomEdges, in O(maxEdges) time.
+    template<typename FirstColumn>
+    static void addDenseEdges(
+        int n, int m, long long maxEdges, const Traits& t, Arrayp& result,
+        int rows, FirstColumn firstColumn, bool skipLoops)
+    {
+        bool canonical = !(t.directed && t.allowAntiparallel);
+        std::vector<uint64_t> taken;
+        taken.reserve(result.size());
+        for (auto edge: result) {
+            if (canonical && edge.first > edge.second) {
+                std::swap(edge.first, edge.second);
+            }
+            taken.push_back(static_cast<uint64_t>(edge.first) * n + edge.second);
+        }
+        std::sort(taken.begin(), taken.end());
+
+        long long available = maxEdges - result.size();
+        long long needed = m - static_cast<long long>(result.size());
+        if (needed <= 0) {
+            return;
+        }
+        auto skipped = detail::sampleSortedOffsets(
+            rnd, available - needed, available - 1);
+
+        Arrayp added;
+        added.reserve(needed);
+        auto takenIt = taken.begin();
+        auto skippedIt = skipped.begin();
+        uint64_t index = 0;
+        for (int u = 0; u < rows; ++u) {
+            uint64_t rowKey = static_cast<uint64_t>(u) * n;
+            for (int v = firstColumn(u); v < n; ++v) {
+                if (skipLoops && u == v) {
+                    continue;
+                }
+                if (takenIt != taken.end() && *takenIt == rowKey + v) {
+                    ++takenIt;
+                    continue;
+                }
+                if (skippedIt != skipped.end() && *skippedIt == index) {
+                    ++skippedIt;
+                } else {
+                    added.emplace_back(u, v);
+                }
+                ++index;
+            }
+        }
+        ENSURE(
+            static_cast<long long>(index) == available &&
+            static_cast<long long>(added.size()) == needed,
+            "GraphRandom::addDenseEdges");
+
+        if (t.directed && !t.allowAntiparallel) {
+            Array flips = Array::random(added.size(), 2);
+            for (size_t i = 0; i < added.size(); ++i) {
+                if (flips[i]) {
+                    std::swap(added[i].first, added[i].second);
+                }
+            }
+        }
+        added.shuffle();
+        result.insert(result.end(), added.begin(), added.end());
+    }
+
     static long long maxEdges(int n, const Traits& t) {
         ENSURE(!t.allowMulti);
         long long res = static_cast<long long>(n) * (n-1);
@@ -372,8 +872,373 @@ private:
         return res;
     }
 
-    static void makeAcyclic(Arrayp& edges) {
-        auto numbering = Array::id(edges.size()).shuffle();
+    static Graph doFromDegreeSequence(Traits t, const Array& degrees) {
+        ensure(
+            !t.directed,
+            "Directed graphs with given degrees are not supported");
+
+        int n = t.n;
+        int maxDegree = degrees.empty() ?
+            0 : *std::max_element(degrees.begin(), degrees.end());
+        bool simple = !t.allowLoops && !t.allowMulti;
+        if (simple) {
+            ensure(isGraphical(degrees), "The degree sequence is not graphical");
+        } else if (!t.allowLoops) {
+            ensure(
+                maxDegree <= 2LL * t.m - maxDegree,
+                "The degree sequence is not graphical");
+        }
+
+        // A dense simple graph is generated as the complement of a sparse
+        // one, which is much easier to repair.
+        bool complement =
+            simple && t.m > static_cast<long long>(n) * (n - 1) / 4;
+        Array target = degrees;
+        if (complement) {
+            for (int& d: target) {
+                d = n - 1 - d;
+            }
+        }
+
+        Arrayp edges;
+        if (!configurationModel(n, t, target, edges)) {
+            ensure(
+                simple,
+                "Cannot generate a graph with the given degree sequence");
+            edges = havelHakimi(n, target);
+            EdgeSwitcher switcher(n, t, edges);
+            int m = edges.size();
+            for (long long i = 0; i < SWITCHES_PER_EDGE * m; ++i) {
+                switcher.trySwitch(rnd.next(m), rnd.next(m));
+            }
+        }
+        if (complement) {
+            edges = complementEdges(n, edges);
+        }
+
+        if (t.connected) {
+            connectBySwitches(n, edges);
+        }
+
+        Graph graph;
+        graph.initWithEdges(n, edges);
+        return graph;
+    }
+
+    // Checks the Erdos-Gallai condition: for each k the k largest degrees
+    // sum up to at most k(k-1) + sum of min(d, k) over the other degrees.
+    static bool isGraphical(Array degrees) {
+        int n = degrees.size();
+        std::sort(degrees.begin(), degrees.end(), std::greater<int>());
+        std::vector<long long> prefix(n + 1);
+        for (int i = 0; i < n; ++i) {
+            prefix[i + 1] = prefix[i] + degrees[i];
+        }
+        if (prefix[n] % 2 != 0) {
+            return false;
+        }
+
+        // Degrees at positions [0, atLeastK) are at least k.
+        int atLeastK = n;
+        for (long long k = 1; k <= n; ++k) {
+            while (atLeastK > 0 && degrees[atLeastK - 1] < k) {
+                --atLeastK;
+            }
+            long long rest = atLeastK > k ?
+                (atLeastK - k) * k + prefix[n] - prefix[atLeastK] :
+                prefix[n] - prefix[k];
+            if (prefix[k] > k * (k - 1) + rest) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Pairs up random stubs of vertices (the configuration model) and then
+    // rewires loops and multiple edges forbidden by traits with random
+    // switches. For sparse graphs only a few edges need it, so it takes
+    // linear time. Returns false if rewiring takes too long.
+    static bool configurationModel(
+        int n, const Traits& t, const Array& degrees, Arrayp& edges)
+    {
+        Array stubs;
+        for (int v = 0; v < n; ++v) {
+            stubs.insert(stubs.end(), degrees[v], v);
+        }
+        stubs.shuffle();
+
+        int m = stubs.size() / 2;
+        edges.resize(m);
+        for (int i = 0; i < m; ++i) {
+            edges[i] = orderedEdge(stubs[2 * i], stubs[2 * i + 1]);
+        }
+        if (t.allowLoops && t.allowMulti) {
+            return true;
+        }
+
+        // Forbidden edges are found by sorting, so that adjacency lists are
+        // built only if there are any.
+        std::vector<detail::KeyIndex> keys(m);
+        for (int i = 0; i < m; ++i) {
+            keys[i] = {
+                static_cast<uint64_t>(edges[i].first) * n + edges[i].second,
+                i};
+        }
+        detail::sortByKey(
+            keys, detail::bitWidth(static_cast<uint64_t>(n) * n));
+        Array forbidden;
+        for (int i = 0, j = 0; i < m; i = j) {
+            while (j < m && keys[j].key == keys[i].key) {
+                ++j;
+            }
+            const auto& edge = edges[keys[i].index];
+            if ((edge.first == edge.second && !t.allowLoops) ||
+                    (j - i > 1 && !t.allowMulti)) {
+                for (int k = i; k < j; ++k) {
+                    forbidden.push_back(keys[k].index);
+                }
+            }
+        }
+        if (forbidden.empty()) {
+            return true;
+        }
+
+        EdgeSwitcher switcher(n, t, edges);
+
+        long long attemptsLeft = MAX_SWITCH_ATTEMPTS + 10LL * m;
+        while (!forbidden.empty()) {
+            int i = forbidden.back();
+            if (!switcher.isForbidden(i)) {
+                forbidden.pop_back();
+                continue;
+            }
+            if (--attemptsLeft < 0) {
+                return false;
+            }
+            switcher.trySwitch(i, rnd.next(m));
+        }
+        return true;
+    }
+
+    // Builds a simple graph with the given graphical degree sequence by
+    // repeatedly connecting the vertex of the largest remaining degree to
+    // the vertices of the next largest ones.
+    static Arrayp havelHakimi(int n, const Array& degrees) {
+        // (remaining degree, vertex)
+        std::set<std::pair<int, int>> byDegree;
+        for (int v = 0; v < n; ++v) {
+            if (degrees[v] > 0) {
+                byDegree.emplace(degrees[v], v);
+            }
+        }
+
+        Arrayp edges;
+        std::vector<std::pair<int, int>> neighbors;
+        while (!byDegree.empty()) {
+            auto top = *byDegree.rbegin();
+            byDegree.erase(std::prev(byDegree.end()));
+
+            neighbors.clear();
+            auto it = byDegree.end();
+            for (int i = 0; i < top.first; ++i) {
+                ENSURE(it != byDegree.begin(), "GraphRandom::havelHakimi");
+                neighbors.push_back(*--it);
+            }
+            for (const auto& neighbor: neighbors) {
+                byDegree.erase(neighbor);
+                edges.push_back(orderedEdge(top.second, neighbor.second));
+                if (neighbor.first > 1) {
+                    byDegree.emplace(neighbor.first - 1, neighbor.second);
+                }
+            }
+        }
+        return edges;
+    }
+
+    static Arrayp complementEdges(int n, const Arrayp& edges) {
+        std::vector<Array> adjacent(n);
+        for (const auto& edge: edges) {
+            adjacent[edge.first].push_back(edge.second);
+        }
+
+        Arrayp result;
+        result.reserve(static_cast<long long>(n) * (n - 1) / 2 - edges.size());
+        for (int u = 0; u < n; ++u) {
+            adjacent[u].sort();
+            auto it = adjacent[u].begin();
+            for (int v = u + 1; v < n; ++v) {
+                if (it != adjacent[u].end() && *it == v) {
+                    ++it;
+                } else {
+                    result.emplace_back(u, v);
+                }
+            }
+        }
+        return result;
+    }
+
+    // Makes the graph connected keeping degrees of all vertices. An edge
+    // (a, b) outside a spanning forest lies on a cycle, so switching it with
+    // an edge (c, d) of another component to (a, c) and (b, d) joins the
+    // components. New edges connect different components, so they are never
+    // loops or duplicates.
+    static void connectBySwitches(int n, Arrayp& edges) {
+        if (n <= 1) {
+            return;
+        }
+        ensure(
+            edges.size() + 1 >= static_cast<size_t>(n),
+            "Not enough edges for a connected graph");
+
+        Dsu dsu;
+        dsu.extend(n);
+        std::vector<char> inForest(edges.size());
+        for (size_t i = 0; i < edges.size(); ++i) {
+            inForest[i] = dsu.unite(edges[i].first, edges[i].second);
+        }
+        if (dsu.isConnected()) {
+            return;
+        }
+
+        // Edges of each component, indexed by its root.
+        std::vector<Array> cycleEdges(n);
+        std::vector<Array> forestEdges(n);
+        for (size_t i = 0; i < edges.size(); ++i) {
+            int root = dsu.getRoot(edges[i].first);
+            (inForest[i] ? forestEdges : cycleEdges)[root].push_back(i);
+        }
+
+        Array cyclic;
+        Array acyclic;
+        for (int v: Array::id(n).shuffled()) {
+            if (dsu.getRoot(v) != v) {
+                continue;
+            }
+            ensure(
+                !forestEdges[v].empty() || !cycleEdges[v].empty(),
+                "Cannot make a graph with isolated vertices connected");
+            (cycleEdges[v].empty() ? acyclic : cyclic).push_back(v);
+        }
+        ENSURE(!cyclic.empty(), "GraphRandom::connectBySwitches");
+
+        auto takeRandom = [](Array& ids) {
+            std::swap(ids[rnd.next(ids.size())], ids.back());
+            int id = ids.back();
+            ids.pop_back();
+            return id;
+        };
+        auto join = [&edges](int i, int j) {
+            int a = edges[i].first;
+            int b = edges[i].second;
+            int c = edges[j].first;
+            int d = edges[j].second;
+            if (rnd.next(2)) {
+                std::swap(c, d);
+            }
+            edges[i] = orderedEdge(a, c);
+            edges[j] = orderedEdge(b, d);
+        };
+
+        // Joining two components with cycles leaves (b, d) on a cycle, and
+        // joining a tree uses up one cycle, which is enough since there are
+        // at least n - 1 edges.
+        Array& spare = cycleEdges[cyclic[0]];
+        for (size_t k = 1; k < cyclic.size(); ++k) {
+            Array& other = cycleEdges[cyclic[k]];
+            int i = takeRandom(spare);
+            int j = takeRandom(other);
+            join(i, j);
+            spare.push_back(j);
+            spare.insert(spare.end(), other.begin(), other.end());
+        }
+        for (int root: acyclic) {
+            ENSURE(!spare.empty(), "GraphRandom::connectBySwitches");
+            join(takeRandom(spare), takeRandom(forestEdges[root]));
+        }
+    }
+
+    // The Chung-Lu model: an edge (u, v) appears with probability
+    // min(1, w_u w_v / S), where S is the sum of weights. With vertices
+    // sorted by weight the probability does not increase along a row, so
+    // the pairs are skipped with geometric jumps as in Miller and Hagberg,
+    // "Efficient generation of networks with given expected degrees", which
+    // takes O(n + m) time.
+    static Graph doRandomExpectedDegrees(Traits t, const Arrayf& weights) {
+        ensure(
+            !t.directed,
+            "Directed graphs with given degrees are not supported");
+
+        int n = t.n;
+        double sum = 0;
+        for (double w: weights) {
+            sum += w;
+        }
+        auto order = Array::id(n).sorted([&weights](int i, int j) {
+            return weights[i] > weights[j];
+        });
+
+        Arrayp edges;
+        for (int i = 0; i < n && sum > 0; ++i) {
+            double weight = weights[order[i]];
+            int j = t.allowLoops ? i : i + 1;
+            double p = j < n ?
+                std::min(weight * weights[order[j]] / sum, 1.0) : 0;
+            while (j < n && p > 0) {
+                if (p < 1) {
+                    // Uniform from (0, 1], so that the skip is finite; nextf
+                    // may return 1.
+                    double u = (rnd.next() + 1.0) / 4294967296.0;
+                    double skip = std::floor(std::log(u) / std::log(1 - p));
+                    if (skip >= n - j) {
+                        break;
+                    }
+                    j += static_cast<int>(skip);
+                }
+                double q = std::min(weight * weights[order[j]] / sum, 1.0);
+                if (rnd.nextf() < q / p) {
+                    edges.push_back(orderedEdge(order[i], order[j]));
+                }
+                p = q;
+                ++j;
+            }
+        }
+
+        if (t.connected) {
+            linkComponents(n, edges);
+        }
+
+        Graph graph;
+        graph.initWithEdges(n, edges);
+        return graph;
+    }
+
+    // Joins components of the graph into a chain, in random order, with edges
+    // between their random vertices.
+    static void linkComponents(int n, Arrayp& edges) {
+        Dsu dsu;
+        dsu.extend(n);
+        for (const auto& edge: edges) {
+            dsu.unite(edge.first, edge.second);
+        }
+
+        std::vector<char> seen(n);
+        int last = -1;
+        for (int v: Array::id(n).shuffled()) {
+            int root = dsu.getRoot(v);
+            if (!seen[root]) {
+                seen[root] = true;
+                if (last != -1) {
+                    edges.push_back(orderedEdge(last, v));
+                }
+                last = v;
+            }
+        }
+    }
+
+    static void makeAcyclic(int n, Arrayp& edges) {
+        // The numbering used to have m elements, which is kept when m >= n
+        // for the sake of reproducibility.
+        auto numbering = Array::id(std::max<int>(n, edges.size())).shuffle();
         for (auto& edge: edges) {
             if (numbering[edge.first] > numbering[edge.second]) {
                 std::swap(edge.first, edge.second);
@@ -413,4 +1278,16 @@ Graph::BuilderProxy Graph::completeBipartite( int n1, int n2) {
     return graph_detail::GraphRandom::completeBipartite(n1, n2);
 }
 
+Graph::BuilderProxy Graph::randomRegular(int n, int d) {
+    return graph_detail::GraphRandom::randomRegular(n, d);
+}
+
+Graph::BuilderProxy Graph::fromDegreeSequence(const Array& degrees) {
+    return graph_detail::GraphRandom::fromDegreeSequence(degrees);
+}
+
+Graph::BuilderProxy Graph::randomExpectedDegrees(const Arrayf& weights) {
+    return graph_detail::GraphRandom::randomExpectedDegrees(weights);
+}
+
 } // namespace jngen
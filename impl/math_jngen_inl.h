@@ -0,0 +1,651 @@
+#ifndef JNGEN_INCLUDE_MATH_JNGEN_INL_H
+#error File "math_jngen_inl.h" must not be included directly.
+#include "../math_jngen.h" // for completion engine
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_set>
+#include <vector>
+
+namespace jngen {
+namespace detail {
+
+template<typename Arithmetic>
+bool millerRabinTest(
+        uint64_t n,
+        const Arithmetic& arithmetic,
+        const uint64_t* begin,
+        const uint64_t* end)
+{
+    int r = 0;
+    uint64_t d = n - 1;
+    while (d % 2 == 0) {
+        ++r;
+        d /= 2;
+    }
+
+    const uint64_t one = arithmetic.one();
+    const uint64_t minusOne = arithmetic.to(n - 1);
+
+    for (const uint64_t* a = begin; a != end; ++a) {
+        if (*a % n == 0) {
+            continue;
+        }
+
+        uint64_t x = modularPower(arithmetic, arithmetic.to(*a), d);
+        if (x == one || x == minusOne) {
+            continue;
+        }
+
+        bool composite = true;
+        for (int i = 0; i < r - 1 && composite; ++i) {
+            x = arithmetic.multiply(x, x);
+            if (x == minusOne) {
+                composite = false;
+            } else if (x == one) {
+                break;
+            }
+        }
+        if (composite) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool millerRabinTest(uint64_t n) {
+    // Deterministic for n < 4759123141 and for all n < 2^64 respectively.
+    static const uint64_t SMALL_WITNESSES[] = {2, 7, 61};
+    static const uint64_t WITNESSES[] =
+        {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+
+    if (n < (uint64_t(1) << 32)) {
+        return millerRabinTest(
+            n, Barrett32(n), SMALL_WITNESSES, SMALL_WITNESSES + 3);
+    }
+    if (n < 4759123141ull) {
+        return millerRabinTest(
+            n, Montgomery64(n), SMALL_WITNESSES, SMALL_WITNESSES + 3);
+    }
+    return millerRabinTest(n, Montgomery64(n), WITNESSES, WITNESSES + 7);
+}
+
+// Returns a nontrivial divisor of an odd composite n with Brent's variant of
+// the Pollard's rho algorithm: gcd is taken once per STEP differences, and if
+// it fails the last block is repeated step by step.
+uint64_t pollardRho(uint64_t n) {
+    const uint64_t STEP = 128;
+
+    Montgomery64 arithmetic(n);
+    auto difference = [](uint64_t x, uint64_t y) {
+        return x > y ? x - y : y - x;
+    };
+
+    for (uint64_t c = 1; ; ++c) {
+        uint64_t shift = arithmetic.to(c);
+        // x^2 + c in Montgomery form, the sum is below 2n < 2^64.
+        auto next = [&arithmetic, shift, n](uint64_t x) {
+            uint64_t y = arithmetic.multiply(x, x) + shift;
+            return y >= n ? y - n : y;
+        };
+
+        uint64_t x = 0;
+        uint64_t y = arithmetic.to(2);
+        uint64_t saved = y;
+        uint64_t product = arithmetic.one();
+        long long divisor = 1;
+        for (uint64_t length = 1; divisor == 1; length *= 2) {
+            x = y;
+            for (uint64_t i = 0; i < length; ++i) {
+                y = next(y);
+            }
+            for (uint64_t done = 0; done < length && divisor == 1;
+                    done += STEP)
+            {
+                saved = y;
+                for (uint64_t i = 0; i < std::min(STEP, length - done); ++i) {
+                    y = next(y);
+                    product = arithmetic.multiply(product, difference(x, y));
+                }
+                divisor = util::gcd(product, n);
+            }
+        }
+
+        if (static_cast<uint64_t>(divisor) == n) {
+            do {
+                saved = next(saved);
+                divisor = util::gcd(difference(x, saved), n);
+            } while (divisor == 1);
+        }
+        if (static_cast<uint64_t>(divisor) != n) {
+            return divisor;
+        }
+    }
+}
+
+// Appends prime factors of n without divisors below 100 to |out|.
+void factorizeLarge(uint64_t n, std::vector<long long>& out) {
+    if (n == 1) {
+        return;
+    }
+    if (isPrime(n)) {
+        out.push_back(n);
+        return;
+    }
+    uint64_t divisor = pollardRho(n);
+    factorizeLarge(divisor, out);
+    factorizeLarge(n / divisor, out);
+}
+
+// Enumerates numbers up to |upTo| with non-increasing exponents of
+// consecutive primes starting from PRIMES[index], which contain all highly
+// composite numbers, and keeps the smallest one with most divisors.
+void highlyCompositeSearch(
+        size_t index,
+        int maxExponent,
+        long long value,
+        long long divisors,
+        long long upTo,
+        long long& best,
+        long long& bestDivisors)
+{
+    static const int PRIMES[] =
+        {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53};
+
+    if (divisors > bestDivisors || (divisors == bestDivisors && value < best)) {
+        best = value;
+        bestDivisors = divisors;
+    }
+    if (index == sizeof(PRIMES) / sizeof(PRIMES[0])) {
+        return;
+    }
+
+    long long p = PRIMES[index];
+    for (int exponent = 1; exponent <= maxExponent; ++exponent) {
+        if (value > upTo / p) {
+            break;
+        }
+        value *= p;
+        highlyCompositeSearch(
+            index + 1, exponent, value, divisors * (exponent + 1), upTo,
+            best, bestDivisors);
+    }
+}
+
+long long integerSqrt(long long n) {
+    long long root = std::sqrt(static_cast<double>(n));
+    while (root > 0 && static_cast<unsigned long long>(root) * root >
+            static_cast<unsigned long long>(n))
+    {
+        --root;
+    }
+    while (static_cast<unsigned long long>(root + 1) * (root + 1) <=
+            static_cast<unsigned long long>(n))
+    {
+        ++root;
+    }
+    return root;
+}
+
+std::vector<int> sieve(int n) {
+    std::vector<char> composite(n + 1);
+    std::vector<int> primes;
+    for (int i = 2; i <= n; ++i) {
+        if (composite[i]) {
+            continue;
+        }
+        primes.push_back(i);
+        for (long long j = static_cast<long long>(i) * i; j <= n; j += i) {
+            composite[j] = true;
+        }
+    }
+    return primes;
+}
+
+void primesInRange(long long l, long long r, std::vector<long long>& out) {
+    // Sieving primes up to sqrt(r) pays off only if the range is not much
+    // shorter than sqrt(r). Otherwise smaller primes only filter out most
+    // composite numbers before the Miller-Rabin test.
+    const unsigned long long MIN_SIEVE_LIMIT = 1 << 8;
+    const unsigned long long MAX_SIEVE_LIMIT = 1 << 24;
+    const long long SEGMENT = 1 << 16;
+
+    l = std::max(l, 2ll);
+    if (l > r) {
+        return;
+    }
+
+    unsigned long long length = static_cast<unsigned long long>(r - l) + 1;
+    long long root = integerSqrt(r);
+    long long limit = std::min<unsigned long long>(
+        root,
+        std::max(
+            MIN_SIEVE_LIMIT,
+            std::min(length, MAX_SIEVE_LIMIT / 4) * 4));
+    bool complete = limit == root;
+
+    auto basePrimes = sieve(limit);
+    std::vector<char> composite(SEGMENT);
+
+    for (long long low = l; ; low += SEGMENT) {
+        size_t size = std::min(r - low, SEGMENT - 1) + 1;
+        long long high = low + static_cast<long long>(size - 1);
+        std::fill(composite.begin(), composite.begin() + size, false);
+
+        for (long long p: basePrimes) {
+            if (p * p > high) {
+                break;
+            }
+            unsigned long long offset = p * p >= low ?
+                p * p - low :
+                (p - low % p) % p;
+            for (; offset < size; offset += p) {
+                composite[offset] = true;
+            }
+        }
+
+        for (size_t i = 0; i < size; ++i) {
+            long long x = low + static_cast<long long>(i);
+            if (composite[i]) {
+                continue;
+            }
+            if (complete || x <= limit * limit || millerRabinTest(x)) {
+                out.push_back(x);
+            }
+        }
+
+        if (high == r) {
+            break;
+        }
+    }
+}
+
+Array64 RandomPrimesProxy::a() const {
+    // Ranges up to this length are enumerated, and sampling picks random
+    // elements of the list. Longer ranges contain at least 2^24 / 44 primes,
+    // so random numbers are drawn until a prime is found.
+    const unsigned long long MAX_ENUMERATED = 1 << 24;
+
+    long long l = std::max(l_, 2ll);
+    long long r = r_;
+    ensure(
+        l <= r,
+        format("There are no primes between %lld and %lld", l_, r_));
+
+    unsigned long long length = static_cast<unsigned long long>(r - l) + 1;
+    double expectedPrimes = length / std::log(static_cast<double>(r));
+
+    Array64 result;
+    if (length <= MAX_ENUMERATED ||
+            (distinct_ && count_ > expectedPrimes / 2))
+    {
+        Array64 all;
+        primesInRange(l, r, all);
+        ensure(
+            !all.empty(),
+            format("There are no primes between %lld and %lld", l_, r_));
+
+        if (distinct_) {
+            ensure(
+                count_ <= all.size(),
+                format(
+                    "There are only %d primes between %lld and %lld",
+                    static_cast<int>(all.size()), l_, r_));
+            for (auto index: sampleOffsets(rnd, count_, all.size() - 1)) {
+                result.push_back(all[index]);
+            }
+        } else {
+            result.reserve(count_);
+            for (size_t i = 0; i < count_; ++i) {
+                result.push_back(all[rnd.next(all.size())]);
+            }
+        }
+        return result;
+    }
+
+    // Candidates are primes up to 13 and numbers coprime to 2 * 3 * 5 * 7 *
+    // 11 * 13 = 30030, which are five times rarer than all numbers. The k-th
+    // of the latter is found with a table of residues modulo 30030.
+    const long long WHEEL = 2 * 3 * 5 * 7 * 11 * 13;
+    static const std::vector<int> residues = []() {
+        std::vector<int> result;
+        for (int i = 0; i < WHEEL; ++i) {
+            if (i % 2 && i % 3 && i % 5 && i % 7 && i % 11 && i % 13) {
+                result.push_back(i);
+            }
+        }
+        return result;
+    }();
+    auto countBelow = [](long long n) {
+        // Number of residues less than n modulo the wheel, 0 <= n <= WHEEL.
+        return std::lower_bound(residues.begin(), residues.end(), n) -
+            residues.begin();
+    };
+
+    std::vector<long long> smallPrimes;
+    for (long long p: {2, 3, 5, 7, 11, 13}) {
+        if (l <= p && p <= r) {
+            smallPrimes.push_back(p);
+        }
+    }
+    long long spokes = residues.size();
+    long long small = smallPrimes.size();
+    long long start = l - l % WHEEL;
+    long long before = countBelow(l - start);
+    long long total = (r - start) / WHEEL * spokes +
+        countBelow((r - start) % WHEEL + 1) - before + small;
+
+    std::unordered_set<long long> used;
+    result.reserve(count_);
+    while (result.size() < count_) {
+        long long index = rnd.next(total);
+        long long x;
+        if (index < small) {
+            x = smallPrimes[index];
+        } else {
+            index += before - small;
+            x = start + index / spokes * WHEEL + residues[index % spokes];
+        }
+        if (!isPrime(x)) {
+            continue;
+        }
+        if (distinct_ && !used.insert(x).second) {
+            continue;
+        }
+        result.push_back(x);
+    }
+    return result;
+}
+
+RandomPrimesProxy::operator Array64() const {
+    return a();
+}
+
+// The truncated geometric distribution P(x) ~ exp(-t * x) on [0, c].
+double truncatedGeometricMean(double t, double c) {
+    if (t * (c + 1) < 1e-3) {
+        return c / 2 - t * c * (c + 2) / 12;
+    }
+    return 1 / std::expm1(t) - (c + 1) / std::expm1(t * (c + 1));
+}
+
+double truncatedGeometricVariance(double t, double c) {
+    if (t * (c + 1) < 1e-3) {
+        return c * (c + 2) / 12;
+    }
+    double a = std::sinh(t / 2);
+    double b = std::sinh(t * (c + 1) / 2);
+    return 1 / (4 * a * a) - (c + 1) * (c + 1) / (4 * b * b);
+}
+
+// Returns t such that the mean of the truncated geometric distribution on
+// [0, c] is |mean| <= c / 2.
+double fitTruncatedGeometric(double c, double mean) {
+    double low = 0;
+    double high = 1;
+    while (truncatedGeometricMean(high, c) > mean) {
+        high *= 2;
+    }
+    for (int iteration = 0; iteration < 100; ++iteration) {
+        double middle = (low + high) / 2;
+        if (truncatedGeometricMean(middle, c) > mean) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Appends a uniformly random sequence of |count| non-negative numbers with
+// sum n to |out|: count - 1 bars are placed among n + count - 1 positions.
+void starsAndBars(long long n, int count, std::vector<long long>& out) {
+    auto bars = sampleSortedOffsets(rnd, count - 1, n + count - 2);
+    long long previous = -1;
+    for (long long bar: bars) {
+        out.push_back(bar - previous - 1);
+        previous = bar;
+    }
+    out.push_back(n + count - 2 - previous);
+}
+
+// Returns a uniformly random sequence of |count| numbers from [0, bound] with
+// sum n, where count >= 2 and bound < n <= count * bound.
+//
+// Parts are drawn independently from the truncated geometric distribution
+// with parameter t, except the last one, which is what remains of n. The
+// sequence is accepted if the last part is in [0, bound], with probability
+// exp(-t * last). Then every sequence with sum n has the probability
+// proportional to exp(-t * n), so the result is uniform for any t, which
+// only affects the running time.
+void boltzmannComposition(
+        long long n,
+        int count,
+        long long bound,
+        double t,
+        std::vector<long long>& out)
+{
+    // 1 - exp(-t * (bound + 1)), the mass of the truncated distribution.
+    double mass = -std::expm1(-t * (bound + 1));
+
+    auto nextPart = [&]() -> long long {
+        if (mass == 0) {
+            return rnd.next(bound + 1);
+        }
+        double x = -std::log1p(-rnd.nextf() * mass) / t;
+        return std::min(static_cast<long long>(x), bound);
+    };
+
+    out.resize(count);
+    while (true) {
+        long long remaining = n;
+        for (int i = 0; i + 1 < count; ++i) {
+            out[i] = nextPart();
+            remaining -= out[i];
+        }
+        if (remaining < 0 || remaining > bound) {
+            continue;
+        }
+        if (mass == 0 || rnd.nextf() < std::exp(-t * remaining)) {
+            out[count - 1] = remaining;
+            return;
+        }
+    }
+}
+
+Array64 randomComposition(
+        long long n, int count, long long minSize, long long maxSize)
+{
+    Array64 result;
+    if (count <= 1) {
+        if (count == 1) {
+            result.push_back(n);
+        }
+        return result;
+    }
+
+    n -= minSize * count;
+    long long bound = maxSize - minSize;
+
+    // Parts x and bound - x are interchangeable, so the sum is reduced to
+    // at most half of the maximum.
+    bool flipped = false;
+    if (bound < n && static_cast<double>(bound) * count < 2.0 * n) {
+        flipped = true;
+        n = bound * count - n;
+    }
+
+    if (bound >= n) {
+        starsAndBars(n, count, result);
+    } else {
+        // Both methods take O(count) per try. The expected number of tries
+        // for stars and bars is exp(E), where E is the expected number of
+        // parts exceeding the bound. For the Boltzmann sampler it is the
+        // inverse probability that the last part fits, which is about
+        // sqrt(2 * pi) * sigma / window: sigma is the deviation of the sum
+        // of other parts and window is the total weight of the last part.
+        double c = bound;
+        double k = count;
+        double exceeding = k * std::exp(
+            (k - 1) * std::log1p(-(c + 1) / (n + k - 1)));
+
+        double t = fitTruncatedGeometric(c, n / k);
+        double sigma = std::sqrt((k - 1) * truncatedGeometricVariance(t, c));
+        double window = t == 0 ?
+            c + 1 :
+            std::expm1(-t * (c + 1)) / std::expm1(-t);
+        double boltzmannTries = 2.5 * sigma / window;
+
+        if (exceeding < std::log(std::max(boltzmannTries, 1.0))) {
+            do {
+                result.clear();
+                starsAndBars(n, count, result);
+            } while (*std::max_element(result.begin(), result.end()) > bound);
+        } else {
+            boltzmannComposition(n, count, bound, t, result);
+        }
+    }
+
+    for (auto& x: result) {
+        x = minSize + (flipped ? bound - x : x);
+    }
+    return result;
+}
+
+} // namespace detail
+
+bool isPrime(long long n) {
+    static const int SMALL_PRIMES[] =
+        {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47};
+
+    ensure(n > 0, "isPrime() is undefined for negative numbers");
+
+    if (n == 1) {
+        return false;
+    }
+    for (int p: SMALL_PRIMES) {
+        if (n % p == 0) {
+            return n == p;
+        }
+    }
+    if (n < 53 * 53) {
+        return true;
+    }
+    return detail::millerRabinTest(n);
+}
+
+Array64 factorize(long long n) {
+    ensure(n > 0, "factorize() is undefined for non-positive numbers");
+
+    static const int SMALL_PRIMES[] = {
+        2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61,
+        67, 71, 73, 79, 83, 89, 97
+    };
+
+    Array64 result;
+    for (long long p: SMALL_PRIMES) {
+        while (n % p == 0) {
+            result.push_back(p);
+            n /= p;
+        }
+    }
+    detail::factorizeLarge(n, result);
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+long long MathRandom::nextPrime(long long n) {
+    const long long WINDOW = 1 << 8;
+
+    std::vector<long long> primes;
+    for (long long l = n; ; l += WINDOW) {
+        long long r = l + std::min(
+            WINDOW - 1, std::numeric_limits<long long>::max() - l);
+        detail::primesInRange(l, r, primes);
+        if (!primes.empty()) {
+            return primes.front();
+        }
+        ensure(
+            r != std::numeric_limits<long long>::max(),
+            format("There are no primes greater or equal to %lld", n));
+    }
+}
+
+long long MathRandom::previousPrime(long long n) {
+    const long long WINDOW = 1 << 8;
+
+    ensure(n >= 2, format("There are no primes less or equal to %lld", n));
+
+    std::vector<long long> primes;
+    for (long long r = n; ; r -= WINDOW) {
+        detail::primesInRange(std::max(2ll, r - WINDOW + 1), r, primes);
+        if (!primes.empty()) {
+            return primes.back();
+        }
+    }
+}
+
+long long MathRandom::highlyComposite(long long upTo) {
+    ensure(upTo >= 1, "There are no positive numbers below 1");
+
+    long long best = 1;
+    long long bestDivisors = 1;
+    detail::highlyCompositeSearch(
+        0, std::numeric_limits<int>::max(), 1, 1, upTo, best, bestDivisors);
+    return best;
+}
+
+long long MathRandom::primeProduct(int k, long long l, long long r) {
+    ensure(k >= 1, "Cannot make a product of less than one prime");
+    ensure(l <= r);
+    long long limit = std::numeric_limits<long long>::max();
+    for (int i = 0; i < k; ++i) {
+        ensure(
+            r <= limit,
+            format("A product of %d primes up to %lld does not fit "
+                "into long long", k, r));
+        limit /= r;
+    }
+
+    long long result = 1;
+    for (long long p: randomPrimes(k, l, r).a()) {
+        result *= p;
+    }
+    return result;
+}
+
+long long MathRandom::smooth(long long n, long long bound) {
+    // Primes up to this limit are taken from a list, larger ones are
+    // generated with rejection sampling.
+    const long long LISTED = 1 << 16;
+    static const std::vector<long long> SMALL_PRIMES = []() {
+        std::vector<long long> primes;
+        detail::primesInRange(2, LISTED, primes);
+        return primes;
+    }();
+
+    ensure(n >= 1);
+    ensure(bound >= 2, "There are no primes below 2");
+
+    long long result = 1;
+    while (n / result >= 2) {
+        long long limit = std::min(bound, n / result);
+        long long p;
+        if (limit <= LISTED) {
+            auto end = std::upper_bound(
+                SMALL_PRIMES.begin(), SMALL_PRIMES.end(), limit);
+            p = SMALL_PRIMES[rnd.next(
+                static_cast<int>(end - SMALL_PRIMES.begin()))];
+        } else {
+            do {
+                p = rnd.next(2ll, limit);
+            } while (!isPrime(p));
+        }
+        result *= p;
+    }
+    return result;
+}
+
+} // namespace jngen
@@ -5,17 +5,9 @@
 
 namespace jngen {
 
-Pattern::Pattern(const std::string& s) {
-    auto iter = cachedPatterns_.find(s);
-    if (iter != cachedPatterns_.end()) {
-        *this = iter->second;
-        return;
-    }
-    *this = Parser().parse(s);
-    cachedPatterns_[s] = *this;
-}
+namespace detail {
 
-Pattern::Pattern(Pattern p, std::pair<int, int> quantity) :
+PatternTree::PatternTree(PatternTree p, std::pair<int, int> quantity) :
     isOrPattern(false),
     min(quantity.first),
     max(quantity.second)
@@ -23,44 +15,96 @@ Pattern::Pattern(Pattern p, std::pair<int, int> quantity) :
     children.push_back(std::move(p));
 }
 
-Pattern::Pattern(std::vector<char> chars, std::pair<int, int> quantity) :
+PatternTree::PatternTree(
+        std::vector<char> chars, std::pair<int, int> quantity) :
     chars(std::move(chars)),
     isOrPattern(false),
     min(quantity.first),
     max(quantity.second)
 {  }
 
-std::map<std::string, Pattern> Pattern::cachedPatterns_;
+} // namespace detail
 
-std::string Pattern::next(std::function<int(int)>&& rnd) const {
-    if (isOrPattern) {
-        ENSURE(!children.empty());
-        return children[rnd(children.size())].next(std::move(rnd));
-    }
+Pattern::Pattern() : Pattern(detail::PatternTree()) {}
 
-    ENSURE( (!!chars.empty()) ^ (!!children.empty()) );
+Pattern::Pattern(const std::string& s) : Pattern(compile(s)) {}
 
-    int count;
-    if (min == max) {
-        count = min;
-    } else {
-        count = min + rnd(max - min + 1);
-    }
+Pattern Pattern::compile(const std::string& s) {
+    return detail::PatternCache::instance().get(s);
+}
 
-    std::string result;
-    for (int i = 0; i < count; ++i) {
-        if (!children.empty()) {
-            for (const Pattern& p: children) {
-                result += p.next(std::move(rnd));
-            }
+Pattern::Pattern(const detail::PatternTree& tree) {
+    auto program = std::make_shared<Program>();
+
+    // Breadth-first traversal puts children of each node next to each other.
+    std::vector<const detail::PatternTree*> queue = {&tree};
+    for (size_t i = 0; i < queue.size(); ++i) {
+        const detail::PatternTree& cur = *queue[i];
+        ENSURE(cur.chars.empty() || cur.children.empty());
+
+        Node node;
+        node.min = cur.min;
+        node.max = cur.max;
+        if (!cur.chars.empty()) {
+            node.kind = NodeKind::Chars;
+            node.begin = program->table.size();
+            program->table.append(cur.chars.begin(), cur.chars.end());
+            node.end = program->table.size();
         } else {
-            result += chars[rnd(chars.size())];
+            node.kind = cur.isOrPattern ? NodeKind::Or : NodeKind::Sequence;
+            node.begin = queue.size();
+            for (const auto& child: cur.children) {
+                queue.push_back(&child);
+            }
+            node.end = queue.size();
         }
+        program->nodes.push_back(node);
     }
 
+    program_ = std::move(program);
+}
+
+std::string Pattern::next(std::function<int(int)>&& rnd) const {
+    std::string result;
+    next(rnd, result);
     return result;
 }
 
+namespace detail {
+
+PatternCache& PatternCache::instance() {
+    static PatternCache cache;
+    return cache;
+}
+
+Pattern PatternCache::get(const std::string& s) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto iter = index_.find(s);
+        if (iter != index_.end()) {
+            entries_.splice(entries_.begin(), entries_, iter->second);
+            return iter->second->second;
+        }
+    }
+
+    // Parse without holding the lock; if another thread has parsed the same
+    // pattern meanwhile, either result is fine.
+    Pattern pattern(Parser().parse(s));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!index_.count(s)) {
+        entries_.emplace_front(s, pattern);
+        index_[s] = entries_.begin();
+        if (entries_.size() > CAPACITY) {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+    }
+    return pattern;
+}
+
+} // namespace detail
+
 bool Parser::isControl(char c) {
     static const std::string CONTROL_CHARS = "()[]{}|?";
     return CONTROL_CHARS.find(c) != std::string::npos;
@@ -179,17 +223,18 @@ std::vector<char> Parser::parseBlock() {
     return allowed;
 }
 
-Pattern Parser::parsePattern() {
-    std::vector<Pattern> orPatterns;
-    Pattern cur;
+detail::PatternTree Parser::parsePattern() {
+    std::vector<detail::PatternTree> orPatterns;
+    detail::PatternTree cur;
 
     while (true) {
         int nxt = next();
         if (nxt == -1 || control(nxt) == ')') {
             break;
         } else if (control(nxt) == '(') {
-            Pattern p = parsePattern();
-            cur.children.push_back(Pattern(p, tryParseQuantity()));
+            detail::PatternTree p = parsePattern();
+            cur.children.push_back(
+                detail::PatternTree(p, tryParseQuantity()));
         } else if (control(nxt) == '|') {
             orPatterns.emplace_back();
             std::swap(orPatterns.back(), cur);
@@ -202,7 +247,8 @@ Pattern Parser::parsePattern() {
                 chars = {static_cast<char>(nxt)};
             }
 
-            cur.children.push_back(Pattern(chars, tryParseQuantity()));
+            cur.children.push_back(
+                detail::PatternTree(chars, tryParseQuantity()));
         }
     }
 
@@ -212,7 +258,7 @@ Pattern Parser::parsePattern() {
         orPatterns.emplace_back();
         std::swap(orPatterns.back(), cur);
 
-        Pattern p;
+        detail::PatternTree p;
         p.isOrPattern = true;
         p.children = orPatterns;
         return p;
@@ -0,0 +1,118 @@
+#ifndef JNGEN_INCLUDE_RADIX_SORT_INL_H
+#error File "radix_sort_inl.h" must not be included directly.
+#include "../radix_sort.h" // for completion engine
+#endif
+
+#include <algorithm>
+
+namespace jngen {
+namespace detail {
+
+const int RADIX_BITS = 11;
+
+// One LSD pass: stable distribution of [begin, end) to |out| by the digit at
+// |shift|.
+void radixPass(
+    const KeyIndex* begin, const KeyIndex* end, KeyIndex* out, int shift)
+{
+    const uint64_t mask = (1 << RADIX_BITS) - 1;
+    std::vector<size_t> position(mask + 1);
+    for (auto it = begin; it != end; ++it) {
+        ++position[(it->key >> shift) & mask];
+    }
+    size_t sum = 0;
+    for (auto& x: position) {
+        size_t count = x;
+        x = sum;
+        sum += count;
+    }
+    for (auto it = begin; it != end; ++it) {
+        out[position[(it->key >> shift) & mask]++] = *it;
+    }
+}
+
+void sortByKey(std::vector<KeyIndex>& items, int bits) {
+    auto byKey = [](const KeyIndex& lhs, const KeyIndex& rhs) {
+        return lhs.key < rhs.key;
+    };
+    if (items.size() < 256 || bits == 0) {
+        std::stable_sort(items.begin(), items.end(), byKey);
+        return;
+    }
+
+    std::vector<KeyIndex> buffer(items.size());
+    if (config.threads <= 1 || items.size() <= PARALLEL_CHUNK_SIZE) {
+        for (int shift = 0; shift < bits; shift += RADIX_BITS) {
+            radixPass(
+                items.data(), items.data() + items.size(),
+                buffer.data(), shift);
+            items.swap(buffer);
+        }
+        return;
+    }
+
+    // The top digit splits the items into buckets, each chunk of the input
+    // distributing its items to its own part of every bucket. Then buckets
+    // are sorted by the remaining digits independently.
+    int topBits = std::min(bits, RADIX_BITS);
+    int shift = bits - topBits;
+    size_t buckets = size_t(1) << topBits;
+    size_t size = items.size();
+    size_t chunks = (size + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+
+    std::vector<size_t> position(chunks * buckets);
+    parallelFor(chunks, [&](size_t chunk) {
+        size_t* count = &position[chunk * buckets];
+        size_t end = std::min(size, (chunk + 1) * PARALLEL_CHUNK_SIZE);
+        for (size_t i = chunk * PARALLEL_CHUNK_SIZE; i < end; ++i) {
+            ++count[items[i].key >> shift];
+        }
+    });
+
+    std::vector<size_t> bucketBegin(buckets + 1);
+    size_t sum = 0;
+    for (size_t bucket = 0; bucket < buckets; ++bucket) {
+        bucketBegin[bucket] = sum;
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            size_t count = position[chunk * buckets + bucket];
+            position[chunk * buckets + bucket] = sum;
+            sum += count;
+        }
+    }
+    bucketBegin[buckets] = sum;
+
+    parallelFor(chunks, [&](size_t chunk) {
+        size_t* next = &position[chunk * buckets];
+        size_t end = std::min(size, (chunk + 1) * PARALLEL_CHUNK_SIZE);
+        for (size_t i = chunk * PARALLEL_CHUNK_SIZE; i < end; ++i) {
+            buffer[next[items[i].key >> shift]++] = items[i];
+        }
+    });
+
+    // All buckets take the same number of passes, so the sorted items end up
+    // in the same array.
+    int passes = (shift + RADIX_BITS - 1) / RADIX_BITS;
+    parallelFor(buckets, [&](size_t bucket) {
+        KeyIndex* from = buffer.data() + bucketBegin[bucket];
+        KeyIndex* to = items.data() + bucketBegin[bucket];
+        size_t count = bucketBegin[bucket + 1] - bucketBegin[bucket];
+        for (int pass = 0; pass < passes; ++pass) {
+            radixPass(from, from + count, to, pass * RADIX_BITS);
+            std::swap(from, to);
+        }
+    });
+    if (passes % 2 == 0) {
+        items.swap(buffer);
+    }
+}
+
+int bitWidth(uint64_t n) {
+    int bits = 0;
+    while (bits < 64 && (uint64_t(1) << bits) < n) {
+        ++bits;
+    }
+    return bits;
+}
+
+} // namespace detail
+} // namespace jngen
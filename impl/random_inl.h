@@ -56,42 +56,216 @@ uint64_t maskForBound(uint64_t bound) {
     return mask;
 }
 
+// base^exp, or 0 if it does not fit into T.
+template<typename T>
+T powerOrZero(T base, int exp) {
+    T result = 1;
+    for (int i = 0; i < exp; ++i) {
+        if (base != 0 && result > static_cast<T>(~T(0)) / base) {
+            return 0;
+        }
+        result *= base;
+    }
+    return result;
+}
+
+// Largest exp such that base^exp fits into T, base >= 2.
+template<typename T>
+int maxExponent(T base) {
+    int result = 0;
+    for (T power = 1; power <= static_cast<T>(~T(0)) / base; power *= base) {
+        ++result;
+    }
+    return result;
+}
+
+// Integer k-th root of value < n^k, given its estimate in [0, n). n^k must
+// fit into T, so (result + 1)^k never overflows.
+template<typename T>
+T integerRoot(T value, int k, T estimate) {
+    T result = estimate;
+    while (result > 0 && powerOrZero(result, k) > value) {
+        --result;
+    }
+    while (powerOrZero<T>(result + 1, k) <= value) {
+        ++result;
+    }
+    return result;
+}
+
 void Random::seed(uint32_t val) {
-    randomEngine_.seed(val);
+    seed_.assign(1, val);
+    scalarSeed_ = true;
+    reseed();
 }
 
 void Random::seed(const std::vector<uint32_t>& seed) {
-    std::seed_seq seq(seed.begin(), seed.end());
-    randomEngine_.seed(seq);
+    seed_ = seed;
+    scalarSeed_ = false;
+    reseed();
+}
+
+void Random::setEngine(RandomEngine engine) {
+    engine_ = engine;
+    reseed();
+}
+
+void Random::reseed() {
+    if (scalarSeed_) {
+        switch (engine_) {
+        case RandomEngine::Mt19937: mt19937_.seed(seed_[0]); break;
+        case RandomEngine::Xoshiro256: xoshiro256_.seed(seed_[0]); break;
+        case RandomEngine::Pcg64: pcg64_.seed(seed_[0]); break;
+        case RandomEngine::Wyrand: wyrand_.seed(seed_[0]); break;
+        case RandomEngine::Philox: philox_.seed(seed_[0]); break;
+        case RandomEngine::Mt19937_64: mt19937_64_.seed(seed_[0]); break;
+        }
+    } else {
+        std::seed_seq seq(seed_.begin(), seed_.end());
+        switch (engine_) {
+        case RandomEngine::Mt19937: mt19937_.seed(seq); break;
+        case RandomEngine::Xoshiro256: xoshiro256_.seed(seq); break;
+        case RandomEngine::Pcg64: pcg64_.seed(seq); break;
+        case RandomEngine::Wyrand: wyrand_.seed(seq); break;
+        case RandomEngine::Philox: philox_.seed(seq); break;
+        case RandomEngine::Mt19937_64: mt19937_64_.seed(seq); break;
+        }
+    }
+}
+
+uint64_t Random::streamKey() const {
+    if (scalarSeed_) {
+        uint64_t x = seed_[0];
+        return detail::splitmix64(x);
+    }
+    std::seed_seq seq(seed_.begin(), seed_.end());
+    return detail::generateSeedWords(seq, 1)[0];
+}
+
+Random Random::makeStream(
+        uint64_t key, uint64_t index, std::vector<uint32_t> seed)
+{
+    // Stream 0 is the one of a generator with the Philox engine selected.
+    // The result is seeded here, so it does not need random_device.
+    Random result{Unseeded{}};
+    result.seed_ = std::move(seed);
+    result.scalarSeed_ = false;
+    result.engine_ = RandomEngine::Philox;
+    result.philox_.seed(key, index + 1);
+    return result;
+}
+
+Random Random::stream(uint64_t index) const {
+    // Reseeding a stream with setEngine uses the parent seed extended with
+    // the stream index.
+    std::vector<uint32_t> seed = seed_;
+    seed.push_back(index >> 32);
+    seed.push_back(static_cast<uint32_t>(index));
+    return makeStream(streamKey(), index, seed);
+}
+
+std::vector<Random> Random::split(size_t count) {
+    uint64_t key = next64();
+    std::vector<Random> result;
+    result.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::vector<uint32_t> seed = {
+            static_cast<uint32_t>(key >> 32),
+            static_cast<uint32_t>(key),
+            static_cast<uint32_t>(i)
+        };
+        result.push_back(makeStream(key, i, seed));
+    }
+    return result;
 }
 
 uint32_t Random::next() {
-    return randomEngine_();
+    switch (engine_) {
+    case RandomEngine::Xoshiro256: return xoshiro256_.next32();
+    case RandomEngine::Pcg64: return pcg64_.next32();
+    case RandomEngine::Wyrand: return wyrand_.next32();
+    case RandomEngine::Philox: return philox_.next32();
+    case RandomEngine::Mt19937_64: return mt19937_64_.next32();
+    default: return mt19937_.next32();
+    }
 }
 
 uint64_t Random::next64() {
-    uint64_t a = next();
-    uint64_t b = next();
-    return (a << 32) ^ b;
+    switch (engine_) {
+    case RandomEngine::Xoshiro256: return xoshiro256_.next64();
+    case RandomEngine::Pcg64: return pcg64_.next64();
+    case RandomEngine::Wyrand: return wyrand_.next64();
+    case RandomEngine::Philox: return philox_.next64();
+    case RandomEngine::Mt19937_64: return mt19937_64_.next64();
+    default: return mt19937_.next64();
+    }
 }
 
 double Random::nextf() {
-    return (double)randomEngine_() / randomEngine_.max();
+    return (double)next() / std::numeric_limits<uint32_t>::max();
+}
+
+uint32_t Random::uniform32(uint32_t bound) {
+    if (bound == 0) {
+        return next();
+    }
+#ifdef JNGEN_FAST_RANDOM
+    return next() % bound;
+#else
+    switch (engine_) {
+    case RandomEngine::Xoshiro256:
+        return detail::uniformLemire32(xoshiro256_, bound);
+    case RandomEngine::Pcg64:
+        return detail::uniformLemire32(pcg64_, bound);
+    case RandomEngine::Wyrand:
+        return detail::uniformLemire32(wyrand_, bound);
+    case RandomEngine::Philox:
+        return detail::uniformLemire32(philox_, bound);
+    case RandomEngine::Mt19937_64:
+        return detail::uniformLemire32(mt19937_64_, bound);
+    default:
+        return detail::uniformMasked32(mt19937_, bound, maskForBound(bound));
+    }
+#endif
+}
+
+uint64_t Random::uniform64(uint64_t bound) {
+    if (bound == 0) {
+        return next64();
+    }
+#ifdef JNGEN_FAST_RANDOM
+    return next64() % bound;
+#else
+    switch (engine_) {
+    case RandomEngine::Xoshiro256:
+        return detail::uniformLemire64(xoshiro256_, bound);
+    case RandomEngine::Pcg64:
+        return detail::uniformLemire64(pcg64_, bound);
+    case RandomEngine::Wyrand:
+        return detail::uniformLemire64(wyrand_, bound);
+    case RandomEngine::Philox:
+        return detail::uniformLemire64(philox_, bound);
+    case RandomEngine::Mt19937_64:
+        return detail::uniformLemire64(mt19937_64_, bound);
+    default:
+        return detail::uniformMasked64(mt19937_, bound, maskForBound(bound));
+    }
+#endif
 }
 
 int Random::next(int n) {
     ensure(n > 0);
-    return uniformRandom(n, *this, (uint32_t (Random::*)())&Random::next);
+    return uniform32(n);
 }
 
 long long Random::next(long long n) {
     ensure(n > 0);
-    return uniformRandom(n, *this, &Random::next64);
+    return uniform64(n);
 }
 
 size_t Random::next(size_t n) {
     ensure(n > 0);
-    return uniformRandom(n, *this, &Random::next64);
+    return uniform64(n);
 }
 
 double Random::next(double n) {
@@ -102,20 +276,19 @@ double Random::next(double n) {
 int Random::next(int l, int r) {
     ensure(l <= r);
     uint32_t n = static_cast<uint32_t>(r) - l + 1;
-    return l + uniformRandom(
-        n, *this, (uint32_t (Random::*)())&Random::next);
+    return static_cast<uint32_t>(l) + uniform32(n);
 }
 
 long long Random::next(long long l, long long r) {
     ensure(l <= r);
     uint64_t n = static_cast<uint64_t>(r) - l + 1;
-    return l + uniformRandom(n, *this, &Random::next64);
+    return static_cast<uint64_t>(l) + uniform64(n);
 }
 
 size_t Random::next(size_t l, size_t r) {
     ensure(l <= r);
     uint64_t n = static_cast<uint64_t>(r) - l + 1;
-    return l + uniformRandom(n, *this, &Random::next64);
+    return l + uniform64(n);
 }
 
 double Random::next(double l, double r) {
@@ -123,8 +296,76 @@ double Random::next(double l, double r) {
     return l + next(r-l);
 }
 
+void Random::fill(int* out, size_t count, int n) {
+    ensure(n > 0);
+    fillUniform32(out, count, n, 0);
+}
+
+void Random::fill(long long* out, size_t count, long long n) {
+    ensure(n > 0);
+    fillUniform64(out, count, n, 0);
+}
+
+void Random::fill(size_t* out, size_t count, size_t n) {
+    ensure(n > 0);
+    fillUniform64(out, count, n, 0);
+}
+
+void Random::fill(double* out, size_t count, double n) {
+    ensure(n >= 0);
+    fill(out, count, 0.0, n);
+}
+
+void Random::fill(int* out, size_t count, int l, int r) {
+    ensure(l <= r);
+    uint32_t n = static_cast<uint32_t>(r) - l + 1;
+    fillUniform32(out, count, n, l);
+}
+
+void Random::fill(long long* out, size_t count, long long l, long long r) {
+    ensure(l <= r);
+    uint64_t n = static_cast<uint64_t>(r) - l + 1;
+    fillUniform64(out, count, n, l);
+}
+
+void Random::fill(size_t* out, size_t count, size_t l, size_t r) {
+    ensure(l <= r);
+    uint64_t n = static_cast<uint64_t>(r) - l + 1;
+    fillUniform64(out, count, n, l);
+}
+
+void Random::fill(double* out, size_t count, double l, double r) {
+    ensure(l <= r);
+    switch (engine_) {
+    case RandomEngine::Xoshiro256:
+        fillReal(xoshiro256_, out, count, l, r - l); break;
+    case RandomEngine::Pcg64:
+        fillReal(pcg64_, out, count, l, r - l); break;
+    case RandomEngine::Wyrand:
+        fillReal(wyrand_, out, count, l, r - l); break;
+    case RandomEngine::Philox:
+        fillReal(philox_, out, count, l, r - l); break;
+    case RandomEngine::Mt19937_64:
+        fillReal(mt19937_64_, out, count, l, r - l); break;
+    default:
+        fillReal(mt19937_, out, count, l, r - l); break;
+    }
+}
+
+void Random::fill(uint32_t* out, size_t count) {
+    fillUniform32(out, count, 0, 0);
+}
+
+void Random::fill(uint64_t* out, size_t count) {
+    fillUniform64(out, count, 0, 0);
+}
+
 int Random::wnext(int n, int w) {
     ensure(n > 0);
+    uint64_t offset;
+    if (config.fastWnext && w != 0 && fastWnext(n, w, offset)) {
+        return offset;
+    }
     if (std::abs(w) <= WNEXT_LIMIT) {
         return smallWnext<int>(w, n);
     } else {
@@ -135,6 +376,10 @@ int Random::wnext(int n, int w) {
 
 long long Random::wnext(long long n, int w) {
     ensure(n > 0);
+    uint64_t offset;
+    if (config.fastWnext && w != 0 && fastWnext(n, w, offset)) {
+        return offset;
+    }
     if (std::abs(w) <= WNEXT_LIMIT) {
         return smallWnext<long long>(w, n);
     } else {
@@ -144,6 +389,10 @@ long long Random::wnext(long long n, int w) {
 
 size_t Random::wnext(size_t n, int w) {
     ensure(n > 0);
+    uint64_t offset;
+    if (config.fastWnext && w != 0 && fastWnext(n, w, offset)) {
+        return offset;
+    }
     if (std::abs(w) <= WNEXT_LIMIT) {
         return smallWnext<size_t>(w, n);
     } else {
@@ -162,30 +411,42 @@ double Random::wnext(double n, int w) {
 
 int Random::wnext(int l, int r, int w) {
     ensure(l <= r);
+    uint32_t n = static_cast<uint32_t>(r) - l + 1;
+    uint64_t offset;
+    if (config.fastWnext && w != 0 && n != 0 && fastWnext(n, w, offset)) {
+        return static_cast<uint32_t>(l) + offset;
+    }
     if (std::abs(w) <= WNEXT_LIMIT) {
         return smallWnext<int>(w, l, r);
     } else {
-        uint32_t n = static_cast<uint32_t>(r) - l + 1;
         return l + static_cast<uint32_t>(n * realWnext(w));
     }
 }
 
 long long Random::wnext(long long l, long long r, int w) {
     ensure(l <= r);
+    uint64_t n = static_cast<uint64_t>(r) - l + 1;
+    uint64_t offset;
+    if (config.fastWnext && w != 0 && n != 0 && fastWnext(n, w, offset)) {
+        return l + offset;
+    }
     if (std::abs(w) <= WNEXT_LIMIT) {
         return smallWnext<long long>(w, l, r);
     } else {
-        uint64_t n = static_cast<uint64_t>(r) - l + 1;
         return l + static_cast<uint64_t>(n * realWnext(w));
     }
 }
 
 size_t Random::wnext(size_t l, size_t r, int w) {
     ensure(l <= r);
+    uint64_t n = static_cast<uint64_t>(r) - l + 1;
+    uint64_t offset;
+    if (config.fastWnext && w != 0 && n != 0 && fastWnext(n, w, offset)) {
+        return l + offset;
+    }
     if (std::abs(w) <= WNEXT_LIMIT) {
         return smallWnext<size_t>(w, l, r);
     } else {
-        uint64_t n = static_cast<uint64_t>(r) - l + 1;
         return l + static_cast<uint64_t>(n * realWnext(w));
     }
 }
@@ -199,8 +460,76 @@ double Random::wnext(double l, double r, int w) {
     }
 }
 
+bool Random::fastWnext(uint64_t n, int w, uint64_t& result) {
+    if (n == 1) {
+        result = 0;
+        return true;
+    }
+    // The maximum of k values is the maximum over groups of them, each group
+    // as large as maxOfUniform allows.
+    int k = std::abs(w) + 1;
+#if defined(__SIZEOF_INT128__)
+    int group = maxExponent<unsigned __int128>(n);
+#else
+    int group = maxExponent<uint64_t>(n);
+#endif
+    if (group < k && std::abs(w) > WNEXT_LIMIT) {
+        return false;
+    }
+    result = 0;
+    for (int left = k; left > 0; left -= group) {
+        result = std::max(result, maxOfUniform(n, std::min(left, group)));
+    }
+    if (w < 0) {
+        result = n - 1 - result;
+    }
+    return true;
+}
+
+uint64_t Random::maxOfUniform(uint64_t n, int k) {
+    // The maximum of k values from [0, n) does not exceed x with probability
+    // ((x + 1) / n)^k, so it is the integer k-th root of a uniform value from
+    // [0, n^k).
+    uint64_t total = powerOrZero(n, k);
+    if (total != 0) {
+        uint64_t value = uniform64(total);
+        uint64_t estimate = std::pow(static_cast<double>(value), 1.0 / k);
+        return integerRoot(value, k, std::min(estimate, n - 1));
+    }
+#if defined(__SIZEOF_INT128__)
+    typedef unsigned __int128 uint128;
+    uint128 total128 = powerOrZero<uint128>(n, k);
+    // Uniform value from [0, n^k) by rejection. Only the upper half is
+    // masked, so at least half of the draws are accepted.
+    uint64_t mask = maskForBound(
+        static_cast<uint64_t>((total128 - 1) >> 64) + 1);
+    uint128 value;
+    do {
+        value = static_cast<uint128>(next64() & mask) << 64;
+        value |= next64();
+    } while (value >= total128);
+    long double estimate = std::pow(
+        static_cast<long double>(value), 1.0L / k);
+    return static_cast<uint64_t>(integerRoot<uint128>(value, k,
+        estimate < n ? static_cast<uint64_t>(estimate) : n - 1));
+#else
+    ENSURE(false, "maxOfUniform: n^k does not fit into 64 bits");
+    return 0;
+#endif
+}
+
 std::string Random::next(const std::string& pattern) {
-    return Pattern(pattern).next([this](int n) { return next(n); });
+    return next(Pattern(pattern));
+}
+
+std::string Random::next(const Pattern& pattern) {
+    std::string result;
+    next(pattern, result);
+    return result;
+}
+
+void Random::next(const Pattern& pattern, std::string& out) {
+    pattern.next([this](int n) { return next(n); }, out);
 }
 
 } // namespace jngen
@@ -45,6 +45,124 @@ std::string parseAllowedChars(std::string pattern) {
     return result;
 }
 
+AlphabetTable::AlphabetTable(const std::string& alphabet) :
+    chars_(parseAllowedChars(alphabet)),
+    bits_(-1)
+{
+    ensure(!chars_.empty(), "Cannot select from an empty container");
+    for (int bits = 0; bits <= 8; ++bits) {
+        if (chars_.size() == (size_t(1) << bits)) {
+            bits_ = bits;
+        }
+    }
+}
+
+void AlphabetTable::fill(Random& random, char* out, size_t count) const {
+    bool legacy = random.engine() == RandomEngine::Mt19937;
+#ifndef JNGEN_FAST_RANDOM
+    if (legacy) {
+        fillLegacy(random, out, count);
+        return;
+    }
+#endif
+    if (legacy) {
+        fillIndices<size_t>(random, out, count);
+    } else if (bits_ != -1) {
+        fillBits(random, out, count);
+    } else {
+        fillIndices<int>(random, out, count);
+    }
+}
+
+void AlphabetTable::fillLegacy(Random& random, char* out, size_t count) const {
+    // A choice draws a 64-bit word from two 32-bit ones and takes it modulo
+    // a mask of at most 8 bits, so only the second word matters. Such words
+    // are picked from a block and reduced as by next(int).
+    const size_t BLOCK = 512;
+    uint32_t words[2 * BLOCK];
+    uint32_t values[BLOCK];
+    uint32_t bound = chars_.size();
+    uint32_t mask = maskForBound(bound);
+    while (count > 0) {
+        size_t size = std::min(count, BLOCK);
+        random.fill(words, 2 * size);
+        for (size_t i = 0; i < size; ++i) {
+            values[i] = words[2 * i + 1];
+        }
+        size = reduceMasked32(values, size, bound, mask, values);
+        for (size_t i = 0; i < size; ++i) {
+            out[i] = chars_[values[i]];
+        }
+        out += size;
+        count -= size;
+    }
+}
+
+void AlphabetTable::fillBits(Random& random, char* out, size_t count) const {
+    if (bits_ == 0) {
+        std::fill(out, out + count, chars_[0]);
+        return;
+    }
+    // Each 64-bit word yields 64 / bits_ characters.
+    const size_t BLOCK = 512;
+    uint64_t words[BLOCK];
+    const size_t perWord = 64 / bits_;
+    const uint64_t mask = (uint64_t(1) << bits_) - 1;
+    while (count > 0) {
+        size_t size = std::min((count + perWord - 1) / perWord, BLOCK);
+        random.fill(words, size);
+        for (size_t i = 0; i < size && count > 0; ++i) {
+            uint64_t word = words[i];
+            for (size_t j = 0; j < perWord && count > 0; ++j) {
+                *out++ = chars_[word & mask];
+                word >>= bits_;
+                --count;
+            }
+        }
+    }
+}
+
+// Open addressing hash table for the birthday search. Stores pairs (hash,
+// word), where the hash is less than 2^32 - 1 and the word is packed into a
+// number, in 12 bytes per slot.
+class CollisionTable {
+public:
+    enum class Result { Inserted, Duplicate, Collision };
+
+    explicit CollisionTable(size_t size) {
+        size_t capacity = 1;
+        while (capacity < 2 * size) {
+            capacity *= 2;
+        }
+        keys_.assign(capacity, 0);
+        words_.assign(capacity, 0);
+    }
+
+    // On collision stores the word with the same hash to |other|.
+    Result insert(uint64_t hash, uint64_t word, uint64_t& other) {
+        // Zero marks an empty slot.
+        uint32_t key = hash + 1;
+        size_t mask = keys_.size() - 1;
+        size_t i = (key * 0x9e3779b97f4a7c15ull) >> 32 & mask;
+        for (; keys_[i] != 0; i = (i + 1) & mask) {
+            if (keys_[i] == key) {
+                if (words_[i] == word) {
+                    return Result::Duplicate;
+                }
+                other = words_[i];
+                return Result::Collision;
+            }
+        }
+        keys_[i] = key;
+        words_[i] = word;
+        return Result::Inserted;
+    }
+
+private:
+    std::vector<uint32_t> keys_;
+    std::vector<uint64_t> words_;
+};
+
 std::vector<std::string> extendAntiHash(
         const std::vector<std::string>& chars,
         HashBase base,
@@ -71,17 +189,9 @@ std::vector<std::string> extendAntiHash(
         for (char c: s) {
             hash = (hash * p + c) % mod;
         }
-        charHashes.push_back(hash);
+        charHashes.push_back((hash + mod) % mod);
     }
 
-    auto computeHash = [&charHashes, mod, pPower](const std::vector<int>& a) {
-        long long hash = 0;
-        for (int x: a) {
-            hash = (hash * pPower + charHashes[x]) % mod;
-        }
-        return hash;
-    };
-
     // This bounds were achieved empirically and should be justified.
     int needForMatch;
     if (count == 2) {
@@ -99,34 +209,274 @@ std::vector<std::string> extendAntiHash(
         if (wordCount < needForMatch) {
             continue;
         }
-
-        std::vector<std::pair<long long, Array>> words;
-        std::map<long long, int> hashCount;
-        std::set<Array> used;
-
-        for (int i = 0; i < needForMatch; ++i) {
-            Array w = Array::random(length, chars.size());
-            if (used.count(w)) {
-                --i;
-                continue;
+        ENSURE(wordCount < 1e19, "Words cannot be packed into 64 bits");
+
+        // Words are kept as numbers in base chars.size().
+        Barrett32 arithmetic(mod);
+        auto hashAndPack = [&charHashes, arithmetic, pPower, length, &chars](
+                const int* word, uint64_t& packed)
+        {
+            uint64_t hash = 0;
+            packed = 0;
+            for (int i = 0; i < length; ++i) {
+                hash = arithmetic.reduce(hash * pPower + charHashes[word[i]]);
+                packed = packed * chars.size() + word[i];
+            }
+            return hash;
+        };
+
+        auto unpack = [length, &chars](uint64_t packed) {
+            std::vector<int> word(length);
+            for (int i = length - 1; i >= 0; --i) {
+                word[i] = packed % chars.size();
+                packed /= chars.size();
+            }
+            std::string result;
+            for (int c: word) {
+                result += chars[c];
             }
-            used.insert(w);
-            long long hash = computeHash(w);
-            words.emplace_back(hash, w);
-            if (++hashCount[hash] == count) {
-                std::vector<std::string> result;
-                for (const auto& kv: words) {
-                    if (kv.first == hash) {
-                        std::string word;
-                        for (int c: kv.second) {
-                            word += chars[c];
-                        }
-                        result.push_back(word);
+            return result;
+        };
+
+        CollisionTable table(needForMatch);
+        uint64_t packed;
+        uint64_t other;
+
+        if (config.threads == 0) {
+            std::vector<int> word(length);
+            for (int i = 0; i < needForMatch; ++i) {
+                fillRandom<int>(rnd, word.data(), length, 0, chars.size());
+                uint64_t hash = hashAndPack(word.data(), packed);
+                auto result = table.insert(hash, packed, other);
+                if (result == CollisionTable::Result::Duplicate) {
+                    --i;
+                } else if (result == CollisionTable::Result::Collision) {
+                    return {unpack(other), unpack(packed)};
+                }
+            }
+            continue;
+        }
+
+        // Words are generated in chunks from separate streams by several
+        // threads at once and inserted in the same order as sequentially,
+        // so the result does not depend on the number of threads.
+        const size_t CHUNK = 1 << 12;
+        size_t chunks = (needForMatch + CHUNK - 1) / CHUNK;
+        auto streams = rnd.split(chunks);
+        size_t batch = config.threads;
+        std::vector<std::vector<std::pair<uint64_t, uint64_t>>> generated(
+            batch);
+
+        for (size_t start = 0; start < chunks; start += batch) {
+            size_t batchSize = std::min(batch, chunks - start);
+            parallelFor(batchSize, [&](size_t i) {
+                size_t chunk = start + i;
+                generated[i].resize(
+                    std::min(CHUNK, needForMatch - chunk * CHUNK));
+                std::vector<int> word(length);
+                for (auto& kv: generated[i]) {
+                    fillRandom<int>(
+                        streams[chunk], word.data(), length, 0, chars.size());
+                    kv.first = hashAndPack(word.data(), kv.second);
+                }
+            });
+            for (size_t i = 0; i < batchSize; ++i) {
+                size_t duplicates = 0;
+                for (const auto& kv: generated[i]) {
+                    packed = kv.second;
+                    auto result = table.insert(kv.first, packed, other);
+                    if (result == CollisionTable::Result::Duplicate) {
+                        ++duplicates;
+                    } else if (result == CollisionTable::Result::Collision) {
+                        return {unpack(other), unpack(packed)};
                     }
                 }
-                return result;
+                // As in the sequential search, duplicates are replaced with
+                // new words, drawn from the stream of the same chunk.
+                std::vector<int> word(length);
+                while (duplicates > 0) {
+                    fillRandom<int>(streams[start + i],
+                        word.data(), length, 0, chars.size());
+                    uint64_t hash = hashAndPack(word.data(), packed);
+                    auto result = table.insert(hash, packed, other);
+                    if (result == CollisionTable::Result::Inserted) {
+                        --duplicates;
+                    } else if (result == CollisionTable::Result::Collision) {
+                        return {unpack(other), unpack(packed)};
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Finds c[i] in {-1, 0, 1}, not all zero, such that sum c[i] * values[i] is
+// zero (as an integer). Values are sorted and split into adjacent pairs, each
+// pair is replaced with its difference; with n values this makes them about
+// n/2 times smaller on each of log(n) levels, until some value turns zero.
+// Returns an empty vector if no such value appears.
+std::vector<int> treeAttack(const std::vector<uint64_t>& values) {
+    struct Node {
+        uint64_t value;
+        // Nodes taken with the sign of this node and with the opposite one.
+        int plus;
+        int minus;
+    };
+
+    size_t n = values.size();
+    std::vector<Node> nodes;
+    nodes.reserve(2 * n);
+    std::vector<int> current;
+    for (size_t i = 0; i < n; ++i) {
+        nodes.push_back({values[i], -1, -1});
+        current.push_back(i);
+    }
+
+    int root = -1;
+    while (true) {
+        for (int id: current) {
+            if (nodes[id].value == 0) {
+                root = id;
+                break;
             }
         }
+        if (root != -1 || current.size() < 2) {
+            break;
+        }
+
+        std::sort(current.begin(), current.end(), [&nodes](int a, int b) {
+            return nodes[a].value < nodes[b].value;
+        });
+        std::vector<int> next;
+        for (size_t i = 0; i + 1 < current.size(); i += 2) {
+            int lower = current[i];
+            int upper = current[i + 1];
+            nodes.push_back(
+                {nodes[upper].value - nodes[lower].value, upper, lower});
+            next.push_back(nodes.size() - 1);
+        }
+        current.swap(next);
+    }
+
+    if (root == -1) {
+        return {};
+    }
+
+    std::vector<int> coefficients(n);
+    std::vector<std::pair<int, int>> stack = {{root, 1}};
+    while (!stack.empty()) {
+        int id = stack.back().first;
+        int sign = stack.back().second;
+        stack.pop_back();
+        if (nodes[id].plus == -1) {
+            coefficients[id] = sign;
+        } else {
+            stack.emplace_back(nodes[id].plus, sign);
+            stack.emplace_back(nodes[id].minus, -sign);
+        }
+    }
+    return coefficients;
+}
+
+// Polynomial hash arithmetic modulo |mod|, where mod = 0 stands for 2^64
+// (that is, unsigned overflow).
+uint64_t multiplyModulo(uint64_t x, uint64_t y, uint64_t mod) {
+    if (mod == 0) {
+        return x * y;
+    }
+    return multiply(
+        static_cast<long long>(x), static_cast<long long>(y),
+        static_cast<long long>(mod));
+}
+
+uint64_t stringHash(const std::string& s, uint64_t p, uint64_t mod) {
+    uint64_t hash = 0;
+    for (char c: s) {
+        hash = multiplyModulo(hash, p, mod);
+        if (mod == 0) {
+            hash += static_cast<uint64_t>(c);
+        } else {
+            hash = (hash + static_cast<uint64_t>(c < 0 ? c + mod : c)) % mod;
+        }
+    }
+    return hash;
+}
+
+// Given two strings |chars| of equal length, builds two strings of them with
+// equal hashes modulo the base with the tree attack. Used for moduli above
+// 2e9 and for 2^64, where birthday search is infeasible. The result length
+// grows by a factor of about 2^sqrt(2 log2(mod)), e.g. 2048 for 64-bit
+// moduli.
+std::vector<std::string> treeAntiHash(
+        const std::vector<std::string>& chars, HashBase base)
+{
+    ensure(chars.size() >= 2, "Cannot generate anti-hash test of one char");
+
+    uint64_t mod = base.first;
+    uint64_t p = base.second;
+
+    // Two distinct words to build the result from.
+    std::string x = chars[0];
+    std::string y = chars[1];
+    if (chars.size() > 2) {
+        int i = rnd.next(static_cast<int>(chars.size()));
+        int j = rnd.next(static_cast<int>(chars.size()) - 1);
+        x = chars[i];
+        y = chars[j < i ? j : j + 1];
+    }
+    ENSURE(x.size() == y.size());
+
+    uint64_t diff = stringHash(y, p, mod) - stringHash(x, p, mod);
+    if (mod != 0) {
+        diff = (diff + mod) % mod;
+    }
+    if (diff == 0) {
+        return {x, y};
+    }
+
+    uint64_t pPower = 1;
+    for (size_t i = 0; i < x.size(); ++i) {
+        pPower = multiplyModulo(pPower, p, mod);
+    }
+
+    int bits = mod == 0 ? 64 : 0;
+    while (bits < 64 && (uint64_t(1) << bits) < mod) {
+        ++bits;
+    }
+    int levels = 1;
+    while (levels * (levels + 1) / 2 < bits) {
+        ++levels;
+    }
+
+    for (; ; ++levels) {
+        ensure(levels <= 24, "Cannot generate anti-hash test for this modulo");
+        size_t n = size_t(1) << levels;
+        // Word w[0..n) has hash sum h(w[i]) * pPower^(n-1-i), so swapping
+        // x and y at position i changes it by diff * pPower^(n-1-i).
+        std::vector<uint64_t> values(n);
+        uint64_t cur = diff;
+        for (size_t i = n; i-- > 0; ) {
+            values[i] = cur;
+            cur = multiplyModulo(cur, pPower, mod);
+        }
+
+        auto coefficients = treeAttack(values);
+        if (coefficients.empty()) {
+            continue;
+        }
+
+        std::string first, second;
+        for (int c: coefficients) {
+            if (c == 0) {
+                const std::string& s = rnd.next(2) ? y : x;
+                first += s;
+                second += s;
+            } else {
+                first += c == 1 ? y : x;
+                second += c == 1 ? x : y;
+            }
+        }
+        return {first, second};
     }
 }
 
@@ -135,13 +485,14 @@ StringPair minimalAntiHashTest(
         const std::string allowedChars)
 {
     for (auto base: bases) {
-        ensure(base.first >= 0, "0 < MOD must hold");
-        ensure(
-            base.first <= (long long)(2e9),
-            "Modules larger than 2'000'000'000 are not supported yet");
-        ensure(
-            0 < base.second && base.second < base.first,
-            "0 <= P < MOD must hold");
+        ensure(base.first >= 0, "0 <= MOD must hold");
+        if (base.first == 0) {
+            ensure(base.second != 0, "P != 0 must hold");
+        } else {
+            ensure(
+                0 < base.second && base.second < base.first,
+                "0 < P < MOD must hold");
+        }
     }
 
     std::vector<int> counts;
@@ -159,7 +510,11 @@ StringPair minimalAntiHashTest(
     }
 
     for (size_t i = 0; i != bases.size(); ++i) {
-        cur = extendAntiHash(cur, bases[i], counts[i]);
+        if (bases[i].first == 0 || bases[i].first > (long long)(2e9)) {
+            cur = treeAntiHash(cur, bases[i]);
+        } else {
+            cur = extendAntiHash(cur, bases[i], counts[i]);
+        }
         ensure(static_cast<int>(cur.size()) == counts[i],
             "Cannot generate long enough pair with same hash");
     }
@@ -172,15 +527,34 @@ StringPair minimalAntiHashTest(
 
 std::string StringRandom::random(int len, const std::string& alphabet) {
     checkLargeParameter(len);
-    std::string chars = detail::parseAllowedChars(alphabet);
-    std::string res;
-    res.reserve(len);
-    for (int i = 0; i < len; ++i) {
-        res += choice(chars);
-    }
+    detail::AlphabetTable table(alphabet);
+    std::string res(len, ' ');
+    table.fill(rnd, &res[0], res.size());
     return res;
 }
 
+StringStream StringRandom::randomStream(
+        size_t len, const std::string& alphabet)
+{
+    return StringStream(len, alphabet);
+}
+
+StringStream::StringStream(size_t size, const std::string& alphabet) :
+    size_(size),
+    table_(alphabet),
+    base_(rnd.split(1)[0])
+{  }
+
+std::string StringStream::str() const {
+    checkLargeParameter(size_);
+    std::string result;
+    result.reserve(size_);
+    forEachChunk([&result](const char* data, size_t count) {
+        result.append(data, count);
+    });
+    return result;
+}
+
 std::string StringRandom::thueMorse(int len, char first, char second) {
     ensure(len >= 0);
     checkLargeParameter(len);
@@ -0,0 +1,193 @@
+#ifndef JNGEN_INCLUDE_SAMPLING_INL_H
+#error File "sampling_inl.h" must not be included directly.
+#include "../sampling.h" // for completion engine
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+namespace jngen {
+namespace detail {
+
+uint64_t randomOffset(Random& random, uint64_t maxOffset) {
+    if (maxOffset < static_cast<uint64_t>(std::numeric_limits<int>::max())) {
+        return random.next(static_cast<int>(maxOffset + 1));
+    }
+    if (maxOffset < static_cast<uint64_t>(
+            std::numeric_limits<long long>::max()))
+    {
+        return random.next(static_cast<long long>(maxOffset + 1));
+    }
+    while (true) {
+        uint64_t x = random.next64();
+        if (x <= maxOffset) {
+            return x;
+        }
+    }
+}
+
+std::vector<uint64_t> sampleOffsets(
+        Random& random, size_t size, uint64_t maxOffset)
+{
+    ensure(
+        size == 0 || size - 1 <= maxOffset,
+        "There are not enough unique elements");
+
+    std::vector<uint64_t> result(size);
+
+    if (maxOffset / 4 < size) {
+        // The range is small, so the array may be stored explicitly.
+        std::vector<uint64_t> values(maxOffset + 1);
+        std::iota(values.begin(), values.end(), 0);
+        for (size_t i = 0; i < size; ++i) {
+            uint64_t j = i + randomOffset(random, maxOffset - i);
+            std::swap(values[i], values[j]);
+            result[i] = values[i];
+        }
+        return result;
+    }
+
+    // Only displaced elements are stored; position i is never read again
+    // after step i, so it is not updated.
+    std::unordered_map<uint64_t, uint64_t> displaced;
+    displaced.reserve(size * 2);
+    auto valueAt = [&displaced](uint64_t pos) {
+        auto it = displaced.find(pos);
+        return it == displaced.end() ? pos : it->second;
+    };
+    for (size_t i = 0; i < size; ++i) {
+        uint64_t j = i + randomOffset(random, maxOffset - i);
+        result[i] = valueAt(j);
+        displaced[j] = valueAt(i);
+    }
+    return result;
+}
+
+std::vector<uint64_t> sampleSortedOffsets(
+        Random& random, size_t size, uint64_t maxOffset)
+{
+    ensure(
+        maxOffset < static_cast<uint64_t>(
+            std::numeric_limits<long long>::max()),
+        "The range is too wide for sorted sampling");
+    ensure(
+        size == 0 || size - 1 <= maxOffset,
+        "There are not enough unique elements");
+
+    std::vector<uint64_t> result;
+    result.reserve(size);
+    if (size == 0) {
+        return result;
+    }
+
+    // Uniform in (0, 1) with 53 bits of precision.
+    auto uniform = [&random]() {
+        return ((random.next64() >> 11) + 0.5) / 9007199254740992.0;
+    };
+
+    // The code follows the paper: J. S. Vitter, "An efficient algorithm for
+    // sequential random sampling", 1987. n elements are still to be selected
+    // from the remaining N; s is the number of elements to skip.
+    long long n = size;
+    long long N = maxOffset + 1;
+    long long current = -1;
+
+    double nreal = n;
+    double Nreal = N;
+    double ninv = 1.0 / nreal;
+    double vprime = std::exp(std::log(uniform()) * ninv);
+    long long qu1 = N - n + 1;
+    double qu1real = Nreal - nreal + 1.0;
+    const long long NEG_ALPHA_INV = -13;
+    long long threshold = -NEG_ALPHA_INV * n;
+
+    while (n > 1 && threshold < N) {
+        double nmin1inv = 1.0 / (nreal - 1.0);
+        long long s;
+        while (true) {
+            double x;
+            while (true) {
+                x = Nreal * (1.0 - vprime);
+                s = static_cast<long long>(x);
+                if (s < qu1) {
+                    break;
+                }
+                vprime = std::exp(std::log(uniform()) * ninv);
+            }
+
+            double u = uniform();
+            double negSreal = -static_cast<double>(s);
+            double y1 = std::exp(std::log(u * Nreal / qu1real) * nmin1inv);
+            vprime = y1 * (1.0 - x / Nreal) * (qu1real / (negSreal + qu1real));
+            if (vprime <= 1.0) {
+                break;
+            }
+
+            double y2 = 1.0;
+            double top = Nreal - 1.0;
+            double bottom;
+            long long limit;
+            if (n - 1 > s) {
+                bottom = Nreal - nreal;
+                limit = N - s;
+            } else {
+                bottom = Nreal + negSreal - 1.0;
+                limit = qu1;
+            }
+            for (long long t = N - 1; t >= limit; --t) {
+                y2 = y2 * top / bottom;
+                top -= 1.0;
+                bottom -= 1.0;
+            }
+            if (Nreal / (Nreal - x) >= y1 * std::exp(std::log(y2) * nmin1inv)) {
+                vprime = std::exp(std::log(uniform()) * nmin1inv);
+                break;
+            }
+            vprime = std::exp(std::log(uniform()) * ninv);
+        }
+
+        current += s + 1;
+        result.push_back(current);
+        N -= s + 1;
+        Nreal = N;
+        --n;
+        nreal = n;
+        ninv = nmin1inv;
+        qu1 -= s;
+        qu1real = qu1;
+        threshold += NEG_ALPHA_INV;
+    }
+
+    if (n > 1) {
+        // Few elements are left to skip, fall back to Algorithm A.
+        double top = N - n;
+        Nreal = N;
+        while (n > 1) {
+            double v = uniform();
+            long long s = 0;
+            double quot = top / Nreal;
+            while (quot > v) {
+                ++s;
+                top -= 1.0;
+                Nreal -= 1.0;
+                quot = quot * top / Nreal;
+            }
+            current += s + 1;
+            result.push_back(current);
+            Nreal -= 1.0;
+            --n;
+        }
+        current += static_cast<long long>(Nreal * uniform()) + 1;
+    } else {
+        current += static_cast<long long>(N * vprime) + 1;
+    }
+    result.push_back(current);
+
+    return result;
+}
+
+} // namespace detail
+} // namespace jngen
@@ -9,7 +9,7 @@ void Tree::addEdge(int u, int v, const Weight& w) {
     u = vertexByLabel(u);
     v = vertexByLabel(v);
 
-    int ret = dsu_.unite(u, v);
+    int ret = dsu().unite(u, v);
     ensure(ret, "A cycle appeared in the tree");
 
     addEdgeUnsafe(u, v);
@@ -22,7 +22,8 @@ void Tree::addEdge(int u, int v, const Weight& w) {
 bool Tree::canAddEdge(int u, int v) {
     u = vertexByLabel(u);
     v = vertexByLabel(v);
-    return dsu_.getRoot(u) != dsu_.getRoot(v);
+    Dsu& components = dsu();
+    return components.getRoot(u) != components.getRoot(v);
 }
 
 Array Tree::parents(int root) const {
@@ -36,7 +37,8 @@ Array Tree::parents(int root) const {
     for (size_t i = 0; i < queue.size(); ++i) {
         int v = queue[i];
         used[v] = true;
-        for (auto to: internalEdges(v)) {
+        for (int id: internalIncidentEdges(v)) {
+            int to = edgeOtherEnd(v, id);
             if (!used[to]) {
                 parents[to] = v;
                 queue.push_back(to);
@@ -85,6 +87,7 @@ Tree Tree::link(int vInThis, const Tree& other, int vInOther) {
 
     t.addEdge(vInThis, vInOther + n());
 
+    t.freeze();
     return t;
 }
 
@@ -110,6 +113,7 @@ Tree Tree::glue(int vInThis, const Tree& other, int vInOther) {
 
     ensure(t.n() == n() + other.n() - 1);
 
+    t.freeze();
     return t;
 }
 
@@ -123,6 +127,7 @@ Tree Tree::bamboo(int size) {
         t.addEdge(i, i+1);
     }
     t.normalizeEdges();
+    t.freeze();
     return t;
 }
 
@@ -130,7 +135,9 @@ Tree Tree::random(int size) {
     ensure(size > 0, "Number of vertices in the tree must be positive");
     checkLargeParameter(size);
     if (size == 1) {
-        return Tree();
+        Tree t;
+        t.freeze();
+        return t;
     }
     return fromPruferSequence(Array::random(size - 2, size));
 }
@@ -144,6 +151,7 @@ Tree Tree::randomPrim(int size, int elongation) {
         t.addEdge(parent, v);
     }
     t.normalizeEdges();
+    t.freeze();
     return t;
 }
 
@@ -158,6 +166,7 @@ Tree Tree::randomKruskal(int size) {
             t.addEdge(e.first, e.second);
         }
     }
+    t.freeze();
     return t;
 }
 
@@ -169,6 +178,7 @@ Tree Tree::star(int size) {
         t.addEdge(0, i);
     }
     t.normalizeEdges();
+    t.freeze();
     return t;
 }
 
@@ -182,6 +192,7 @@ Tree Tree::caterpillar(int size, int length) {
         t.addEdge(rnd.next(length), i);
     }
     t.normalizeEdges();
+    t.freeze();
     return t;
 }
 
@@ -198,6 +209,7 @@ Tree Tree::kary(int size, int k) {
         t.addEdge((i - 1) / k, i);
     }
     t.normalizeEdges();
+    t.freeze();
     return t;
 }
 
@@ -229,6 +241,7 @@ Tree Tree::fromPruferSequence(const Array& code) {
     ENSURE(leaves.size() == 2u);
     t.addEdge(*leaves.begin(), *leaves.rbegin());
     t.normalizeEdges();
+    t.freeze();
     return t;
 
 }
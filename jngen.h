@@ -100,6 +100,10 @@ struct Config {
     bool generateLargeObjects = false;
     bool largeOptionIndices = false;
     bool normalizeEdges = true;
+    int threads = 0;
+    // Exact integer wnext in O(1) draws, except for |w| > 8 with n^(|w|+1)
+    // above 2^128, where the default formula is kept.
+    bool fastWnext = false;
 };
 
 #ifdef JNGEN_DECLARE_ONLY
@@ -1321,8 +1325,12 @@ struct hash<std::pair<T, U>> {
 #include <algorithm>
 #include <cctype>
 #include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -1330,31 +1338,141 @@ struct hash<std::pair<T, U>> {
 
 namespace jngen {
 
+namespace detail {
+
+// Syntax tree of a pattern as built by Parser.
+struct PatternTree {
+    PatternTree() : isOrPattern(false), min(1), max(1) {}
+    PatternTree(PatternTree p, std::pair<int, int> quantity);
+    PatternTree(std::vector<char> chars, std::pair<int, int> quantity);
+
+    std::vector<char> chars;
+    std::vector<PatternTree> children;
+    bool isOrPattern;
+    int min;
+    int max;
+};
+
+class PatternCache;
+
+} // namespace detail
+
+// A pattern compiled to a flat program: an array of nodes where children of
+// each node occupy a contiguous range, and a table with the characters of
+// all character sets. Generation does not allocate memory except for the
+// output.
+//
+// The program is immutable and shared between copies of a Pattern, so
+// copying is cheap and one Pattern may be used from many threads at once
+// (each of them with its own Random).
 class Pattern {
-    friend class Parser;
+    friend class detail::PatternCache;
 public:
-    Pattern() : isOrPattern(false), min(1), max(1) {}
+    Pattern();
+
+    // Same as Pattern::compile(s).
     Pattern(const std::string& s);
 
+    // Returns the pattern from a process-wide cache of recently used
+    // patterns, parsing it on a miss. Thread-safe.
+    static Pattern compile(const std::string& s);
+
     std::string next(std::function<int(int)>&& rnd) const;
 
+    // Appends a random string matching the pattern to |out|. |rnd(n)| must
+    // return a random integer from [0, n).
+    template<typename Rnd>
+    void next(Rnd&& rnd, std::string& out) const {
+        run(0, rnd, out);
+    }
+
 private:
-    Pattern(Pattern p, std::pair<int, int> quantity);
+    enum class NodeKind { Chars, Sequence, Or };
+
+    // Chars: characters table[begin..end), repeated from min to max times.
+    // Sequence: nodes[begin..end) one after another, repeated the same way.
+    // Or: one of nodes[begin..end).
+    struct Node {
+        NodeKind kind;
+        int min;
+        int max;
+        int begin;
+        int end;
+    };
 
-    Pattern(std::vector<char> chars, std::pair<int, int> quantity);
+    struct Program {
+        std::vector<Node> nodes;
+        std::string table;
+    };
 
-    std::vector<char> chars;
-    std::vector<Pattern> children;
-    bool isOrPattern;
-    int min;
-    int max;
+    explicit Pattern(const detail::PatternTree& tree);
+
+    template<typename Rnd>
+    void run(int index, Rnd& rnd, std::string& out) const;
+
+    std::shared_ptr<const Program> program_;
+};
+
+namespace detail {
+
+// Least recently used patterns, at most CAPACITY of them.
+class PatternCache {
+public:
+    static PatternCache& instance();
+
+    Pattern get(const std::string& s);
 
-    static std::map<std::string, Pattern> cachedPatterns_;
+private:
+    static const size_t CAPACITY = 1024;
+
+    typedef std::list<std::pair<std::string, Pattern>> Entries;
+
+    std::mutex mutex_;
+    // Most recently used first.
+    Entries entries_;
+    std::unordered_map<std::string, Entries::iterator> index_;
 };
 
+} // namespace detail
+
+template<typename Rnd>
+void Pattern::run(int index, Rnd& rnd, std::string& out) const {
+    // Random calls are made in the same order as they used to be made by the
+    // recursive generator, so outputs do not change.
+    const Node& node = program_->nodes[index];
+    if (node.kind == NodeKind::Or) {
+        ENSURE(node.begin != node.end);
+        run(node.begin + rnd(node.end - node.begin), rnd, out);
+        return;
+    }
+
+    ENSURE(node.begin != node.end);
+
+    int count;
+    if (node.min == node.max) {
+        count = node.min;
+    } else {
+        count = node.min + rnd(node.max - node.min + 1);
+    }
+
+    if (node.kind == NodeKind::Chars) {
+        const char* chars = program_->table.data() + node.begin;
+        int size = node.end - node.begin;
+        for (int i = 0; i < count; ++i) {
+            out += chars[rnd(size)];
+        }
+    } else {
+        for (int i = 0; i < count; ++i) {
+            for (int child = node.begin; child != node.end; ++child) {
+                run(child, rnd, out);
+            }
+        }
+    }
+}
+
 class Parser {
 public:
-    Pattern parse(const std::string& s) {
+    detail::PatternTree parse(const std::string& s) {
         this->s = s;
         pos = 0;
         return parsePattern();
@@ -1380,7 +1498,7 @@ private:
 
     std::vector<char> parseBlock();
 
-    Pattern parsePattern();
+    detail::PatternTree parsePattern();
 
     std::string s;
     size_t pos;
@@ -1396,17 +1514,9 @@ private:
 
 namespace jngen {
 
-Pattern::Pattern(const std::string& s) {
-    auto iter = cachedPatterns_.find(s);
-    if (iter != cachedPatterns_.end()) {
-        *this = iter->second;
-        return;
-    }
-    *this = Parser().parse(s);
-    cachedPatterns_[s] = *this;
-}
+namespace detail {
 
-Pattern::Pattern(Pattern p, std::pair<int, int> quantity) :
+PatternTree::PatternTree(PatternTree p, std::pair<int, int> quantity) :
     isOrPattern(false),
     min(quantity.first),
     max(quantity.second)
@@ -1414,44 +1524,96 @@ Pattern::Pattern(Pattern p, std::pair<int, int> quantity) :
     children.push_back(std::move(p));
 }
 
-Pattern::Pattern(std::vector<char> chars, std::pair<int, int> quantity) :
+PatternTree::PatternTree(
+        std::vector<char> chars, std::pair<int, int> quantity) :
     chars(std::move(chars)),
     isOrPattern(false),
     min(quantity.first),
     max(quantity.second)
 {  }
 
-std::map<std::string, Pattern> Pattern::cachedPatterns_;
+} // namespace detail
 
-std::string Pattern::next(std::function<int(int)>&& rnd) const {
-    if (isOrPattern) {
-        ENSURE(!children.empty());
-        return children[rnd(children.size())].next(std::move(rnd));
-    }
+Pattern::Pattern() : Pattern(detail::PatternTree()) {}
 
-    ENSURE( (!!chars.empty()) ^ (!!children.empty()) );
+Pattern::Pattern(const std::string& s) : Pattern(compile(s)) {}
 
-    int count;
-    if (min == max) {
-        count = min;
-    } else {
-        count = min + rnd(max - min + 1);
-    }
+Pattern Pattern::compile(const std::string& s) {
+    return detail::PatternCache::instance().get(s);
+}
 
-    std::string result;
-    for (int i = 0; i < count; ++i) {
-        if (!children.empty()) {
-            for (const Pattern& p: children) {
-                result += p.next(std::move(rnd));
-            }
+Pattern::Pattern(const detail::PatternTree& tree) {
+    auto program = std::make_shared<Program>();
+
+    // Breadth-first traversal puts children of each node next to each other.
+    std::vector<const detail::PatternTree*> queue = {&tree};
+    for (size_t i = 0; i < queue.size(); ++i) {
+        const detail::PatternTree& cur = *queue[i];
+        ENSURE(cur.chars.empty() || cur.children.empty());
+
+        Node node;
+        node.min = cur.min;
+        node.max = cur.max;
+        if (!cur.chars.empty()) {
+            node.kind = NodeKind::Chars;
+            node.begin = program->table.size();
+            program->table.append(cur.chars.begin(), cur.chars.end());
+            node.end = program->table.size();
         } else {
-            result += chars[rnd(chars.size())];
+            node.kind = cur.isOrPattern ? NodeKind::Or : NodeKind::Sequence;
+            node.begin = queue.size();
+            for (const auto& child: cur.children) {
+                queue.push_back(&child);
+            }
+            node.end = queue.size();
         }
+        program->nodes.push_back(node);
     }
 
+    program_ = std::move(program);
+}
+
+std::string Pattern::next(std::function<int(int)>&& rnd) const {
+    std::string result;
+    next(rnd, result);
     return result;
 }
 
+namespace detail {
+
+PatternCache& PatternCache::instance() {
+    static PatternCache cache;
+    return cache;
+}
+
+Pattern PatternCache::get(const std::string& s) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto iter = index_.find(s);
+        if (iter != index_.end()) {
+            entries_.splice(entries_.begin(), entries_, iter->second);
+            return iter->second->second;
+        }
+    }
+
+    // Parse without holding the lock; if another thread has parsed the same
+    // pattern meanwhile, either result is fine.
+    Pattern pattern(Parser().parse(s));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!index_.count(s)) {
+        entries_.emplace_front(s, pattern);
+        index_[s] = entries_.begin();
+        if (entries_.size() > CAPACITY) {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+    }
+    return pattern;
+}
+
+} // namespace detail
+
 bool Parser::isControl(char c) {
     static const std::string CONTROL_CHARS = "()[]{}|?";
     return CONTROL_CHARS.find(c) != std::string::npos;
@@ -1570,17 +1732,18 @@ std::vector<char> Parser::parseBlock() {
     return allowed;
 }
 
-Pattern Parser::parsePattern() {
-    std::vector<Pattern> orPatterns;
-    Pattern cur;
+detail::PatternTree Parser::parsePattern() {
+    std::vector<detail::PatternTree> orPatterns;
+    detail::PatternTree cur;
 
     while (true) {
         int nxt = next();
         if (nxt == -1 || control(nxt) == ')') {
             break;
         } else if (control(nxt) == '(') {
-            Pattern p = parsePattern();
-            cur.children.push_back(Pattern(p, tryParseQuantity()));
+            detail::PatternTree p = parsePattern();
+            cur.children.push_back(
+                detail::PatternTree(p, tryParseQuantity()));
         } else if (control(nxt) == '|') {
             orPatterns.emplace_back();
             std::swap(orPatterns.back(), cur);
@@ -1593,7 +1756,8 @@ Pattern Parser::parsePattern() {
                 chars = {static_cast<char>(nxt)};
             }
 
-            cur.children.push_back(Pattern(chars, tryParseQuantity()));
+            cur.children.push_back(
+                detail::PatternTree(chars, tryParseQuantity()));
         }
     }
 
@@ -1603,7 +1767,7 @@ Pattern Parser::parsePattern() {
         orPatterns.emplace_back();
         std::swap(orPatterns.back(), cur);
 
-        Pattern p;
+        detail::PatternTree p;
         p.isOrPattern = true;
         p.children = orPatterns;
         return p;
@@ -1617,2349 +1781,5331 @@ Pattern Parser::parsePattern() {
 using jngen::Pattern;
 
 
-#include <algorithm>
-#include <cmath>
-#include <cstdlib>
-#include <iterator>
-#include <limits>
+#include <cstdint>
 #include <random>
-#include <string>
-#include <type_traits>
-#include <utility>
 #include <vector>
 
+// Engine selected for newly created Random objects, including the global
+// 'rnd'. Can be overridden with e.g. -DJNGEN_RANDOM_ENGINE=Xoshiro256.
+#ifndef JNGEN_RANDOM_ENGINE
+#define JNGEN_RANDOM_ENGINE Mt19937
+#endif
+
 namespace jngen {
 
-void assertRandomEngineConsistency();
-void assertIntegerSizes();
-void registerGen(int argc, char *argv[], int version = 1);
+enum class RandomEngine {
+    Mt19937,
+    Xoshiro256,
+    Pcg64,
+    Wyrand,
+    Philox,
+    Mt19937_64
+};
 
-class Random;
+namespace detail {
 
-class BaseTypedRandom {
+// Returns the lower 64 bits of a*b and stores the upper ones to |hi|.
+inline uint64_t mul128(uint64_t a, uint64_t b, uint64_t& hi) {
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 res = static_cast<unsigned __int128>(a) * b;
+    hi = static_cast<uint64_t>(res >> 64);
+    return static_cast<uint64_t>(res);
+#else
+    uint64_t aLo = a & 0xffffffffu, aHi = a >> 32;
+    uint64_t bLo = b & 0xffffffffu, bHi = b >> 32;
+    uint64_t ll = aLo * bLo;
+    uint64_t lh = aLo * bHi;
+    uint64_t hl = aHi * bLo;
+    uint64_t hh = aHi * bHi;
+    uint64_t mid = (ll >> 32) + (lh & 0xffffffffu) + (hl & 0xffffffffu);
+    hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+    return (mid << 32) | (ll & 0xffffffffu);
+#endif
+}
+
+inline uint64_t rotl64(uint64_t x, int k) {
+    return (x << k) | (x >> ((64 - k) & 63));
+}
+
+inline uint64_t rotr64(uint64_t x, int k) {
+    return (x >> k) | (x << ((64 - k) & 63));
+}
+
+inline uint64_t splitmix64(uint64_t& x) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// Draws |count| 64-bit words from the seed sequence.
+inline std::vector<uint64_t> generateSeedWords(
+        std::seed_seq& seq, size_t count)
+{
+    std::vector<uint32_t> words(count * 2);
+    seq.generate(words.begin(), words.end());
+    std::vector<uint64_t> result(count);
+    for (size_t i = 0; i < count; ++i) {
+        result[i] = (static_cast<uint64_t>(words[2*i]) << 32) | words[2*i + 1];
+    }
+    return result;
+}
+
+// All engines share the same interface: seeding with a single value or
+// with a seed sequence, and producing 32- and 64-bit words. 64-bit engines
+// yield the upper half of a 64-bit word on next32().
+
+class Mt19937Engine {
 public:
-    BaseTypedRandom(Random& random) : random(random) {}
+    void seed(uint32_t val) { engine_.seed(val); }
+    void seed(std::seed_seq& seq) { engine_.seed(seq); }
 
-protected:
-    Random& random;
+    uint32_t next32() { return engine_(); }
+
+    uint64_t next64() {
+        uint64_t a = next32();
+        uint64_t b = next32();
+        return (a << 32) ^ b;
+    }
+
+private:
+    std::mt19937 engine_;
 };
 
-template<typename T>
-struct TypedRandom;
+// std::mt19937_64: the 64-bit Mersenne Twister, one call per 64-bit word.
+class Mt19937_64Engine {
+public:
+    void seed(uint32_t val) { engine_.seed(val); }
+    void seed(std::seed_seq& seq) { engine_.seed(seq); }
 
-uint64_t maskForBound(uint64_t bound);
+    uint32_t next32() { return next64() >> 32; }
+    uint64_t next64() { return engine_(); }
 
-template<typename Result, typename Source>
-Result uniformRandom(Result bound, Random& random, Source (Random::*method)()) {
-    static_assert(sizeof(Result) <= sizeof(Source),
-        "uniformRandom: Source type must be at least as large as Result type");
-#ifdef JNGEN_FAST_RANDOM
-    return (random.*method)() % bound;
-#else
-    Source mask = maskForBound(bound);
-    while (true) {
-        Source outcome = (random.*method)() & mask;
-        if (outcome < static_cast<Source>(bound)) {
-            return outcome;
+private:
+    std::mt19937_64 engine_;
+};
+
+// xoshiro256** by D. Blackman and S. Vigna.
+class Xoshiro256Engine {
+public:
+    void seed(uint32_t val) {
+        uint64_t x = val;
+        for (auto& s: s_) {
+            s = splitmix64(x);
         }
     }
-#endif
-}
 
-class Random {
-public:
-    Random() {
-        assertRandomEngineConsistency();
-        assertIntegerSizes();
-        std::vector<uint32_t> seedSeq;
-        // 4 random_device calls is enough for everyone
-        std::random_device rd;
+    void seed(std::seed_seq& seq) {
+        auto words = generateSeedWords(seq, 4);
         for (size_t i = 0; i < 4; ++i) {
-            seedSeq.push_back(rd());
+            s_[i] = words[i];
         }
-        seed(seedSeq);
+        if (!(s_[0] | s_[1] | s_[2] | s_[3])) {
+            // all-zero state is a fixed point
+            seed(0);
+        }
+    }
+
+    uint32_t next32() { return next64() >> 32; }
 
+    uint64_t next64() {
+        uint64_t result = rotl64(s_[1] * 5, 7) * 9;
+        uint64_t t = s_[1] << 17;
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = rotl64(s_[3], 45);
+        return result;
     }
 
-    void seed(uint32_t val);
-    void seed(const std::vector<uint32_t>& seed);
+private:
+    uint64_t s_[4] = {0, 0, 0, 0};
+};
 
-    uint32_t next();
-    uint64_t next64();
-    double nextf();
+// PCG64 (XSL RR 128/64) by M. O'Neill.
+class Pcg64Engine {
+public:
+    void seed(uint32_t val) {
+        uint64_t x = val;
+        uint64_t stateHi = splitmix64(x);
+        uint64_t stateLo = splitmix64(x);
+        seed(stateHi, stateLo, 0x5851f42d4c957f2dull, 0x14057b7ef767814full);
+    }
 
-    int next(int n);
-    long long next(long long n);
-    size_t next(size_t n);
-    double next(double n);
+    void seed(std::seed_seq& seq) {
+        auto words = generateSeedWords(seq, 4);
+        seed(words[0], words[1], words[2], words[3]);
+    }
 
-    int next(int l, int r);
-    long long next(long long l, long long r);
-    size_t next(size_t l, size_t r);
-    double next(double l, double r);
+    // Same as pcg64_srandom_r from the reference implementation.
+    void seed(
+            uint64_t stateHi, uint64_t stateLo,
+            uint64_t seqHi, uint64_t seqLo)
+    {
+        hi_ = lo_ = 0;
+        incHi_ = (seqHi << 1) | (seqLo >> 63);
+        incLo_ = (seqLo << 1) | 1;
+        step();
+        uint64_t lo = lo_ + stateLo;
+        hi_ += stateHi + (lo < lo_);
+        lo_ = lo;
+        step();
+    }
 
-    int wnext(int n, int w);
-    long long wnext(long long n, int w);
-    size_t wnext(size_t n, int w);
-    double wnext(double n, int w);
+    uint32_t next32() { return next64() >> 32; }
 
-    int wnext(int l, int r, int w);
-    long long wnext(long long l, long long r, int w);
-    size_t wnext(size_t l, size_t r, int w);
-    double wnext(double l, double r, int w);
+    uint64_t next64() {
+        step();
+        return rotr64(hi_ ^ lo_, static_cast<int>(hi_ >> 58));
+    }
 
-    std::string next(const std::string& pattern);
+private:
+    void step() {
+        const uint64_t MUL_HI = 2549297995355413924ull;
+        const uint64_t MUL_LO = 4865540595714422341ull;
 
-    template<typename ... Args>
-    std::string next(const std::string& pattern, Args... args) {
-        return next(format(pattern, args...));
+        uint64_t hi;
+        uint64_t lo = mul128(lo_, MUL_LO, hi);
+        hi += hi_ * MUL_LO + lo_ * MUL_HI;
+
+        lo_ = lo + incLo_;
+        hi_ = hi + incHi_ + (lo_ < lo);
     }
 
-    template<typename T, typename ... Args>
-    T tnext(Args... args) {
-        return TypedRandom<T>{*this}.next(args...);
+    uint64_t hi_ = 0;
+    uint64_t lo_ = 0;
+    uint64_t incHi_ = 0;
+    uint64_t incLo_ = 0;
+};
+
+// wyrand by Wang Yi.
+class WyrandEngine {
+public:
+    void seed(uint32_t val) { state_ = val; }
+
+    void seed(std::seed_seq& seq) {
+        state_ = generateSeedWords(seq, 1)[0];
     }
 
-    template<typename ... Args>
-    std::pair<int, int> nextp(Args... args) {
-        return tnext<std::pair<int, int>>(args...);
+    uint32_t next32() { return next64() >> 32; }
+
+    uint64_t next64() {
+        state_ += 0xa0761d6478bd642full;
+        uint64_t hi;
+        uint64_t lo = mul128(state_, state_ ^ 0xe7037ed1a0b428dbull, hi);
+        return hi ^ lo;
     }
 
-    template<typename Iterator>
-    auto choice(Iterator begin, Iterator end)
-            -> typename std::iterator_traits<Iterator>::value_type
-    {
-        auto length = std::distance(begin, end);
-        ensure(length > 0, "Cannot select from a range of negative length");
-        size_t index = tnext<size_t>(length);
-        std::advance(begin, index);
-        return *begin;
+private:
+    uint64_t state_ = 0;
+};
+
+// Philox4x32-10 by J. Salmon et al. A counter-based generator: the output is
+// a bijection of the 128-bit counter under the 64-bit key, so any position
+// of the sequence is reachable in O(1). The upper half of the counter selects
+// a stream and the lower one is the position within the stream.
+class PhiloxEngine {
+public:
+    void seed(uint32_t val) {
+        uint64_t x = val;
+        seed(splitmix64(x), 0);
     }
 
-    template<typename Container>
-    typename Container::value_type choice(const Container& container) {
-        ensure(!container.empty(), "Cannot select from an empty container");
-        return choice(container.begin(), container.end());
+    void seed(std::seed_seq& seq) {
+        seed(generateSeedWords(seq, 1)[0], 0);
     }
 
-    template<typename T>
-    T choice(const std::initializer_list<T>& ilist) {
-        return choice(ilist.begin(), ilist.end());
+    void seed(uint64_t key, uint64_t stream) {
+        key_[0] = static_cast<uint32_t>(key);
+        key_[1] = static_cast<uint32_t>(key >> 32);
+        stream_ = stream;
+        position_ = 0;
+        bufferPos_ = 4;
     }
 
-    template<typename Numeric>
-    size_t nextByDistribution(const std::vector<Numeric>& distribution) {
-        ensure(!distribution.empty(), "Cannot sample by empty distribution");
-        Numeric sum = std::accumulate(
-                distribution.begin(), distribution.end(), Numeric(0));
-        auto x = next(sum);
-        for (size_t i = 0; i < distribution.size(); ++i) {
-            if (x < distribution[i]) {
-                return i;
-            }
-            x -= distribution[i];
+    uint32_t next32() {
+        if (bufferPos_ == 4) {
+            generateBlock();
+            bufferPos_ = 0;
         }
-        return distribution.size() - 1;
+        return buffer_[bufferPos_++];
     }
 
-    template<typename Numeric>
-    size_t nextByDistribution(const std::initializer_list<Numeric>& ilist) {
-        // TODO: looks suboptimal
-        return nextByDistribution(std::vector<Numeric>(ilist));
+    uint64_t next64() {
+        uint64_t a = next32();
+        uint64_t b = next32();
+        return (a << 32) ^ b;
     }
 
-private:
-    template<typename T, typename ...Args>
-    T smallWnext(int w, Args... args) {
-        ENSURE(std::abs(w) <= WNEXT_LIMIT);
-        T result = next(args...);
-        while (w > 0) {
-            result = std::max(result, next(args...));
-            --w;
-        }
-        while (w < 0) {
-            result = std::min(result, next(args...));
-            ++w;
+    // Encrypts |counter| in place with |key|.
+    static void block(uint32_t counter[4], const uint32_t key[2]) {
+        const uint64_t M0 = 0xd2511f53;
+        const uint64_t M1 = 0xcd9e8d57;
+        uint32_t k0 = key[0];
+        uint32_t k1 = key[1];
+        for (int round = 0; round < 10; ++round) {
+            uint64_t p0 = M0 * counter[0];
+            uint64_t p1 = M1 * counter[2];
+            uint32_t c0 = static_cast<uint32_t>(p1 >> 32) ^ counter[1] ^ k0;
+            uint32_t c2 = static_cast<uint32_t>(p0 >> 32) ^ counter[3] ^ k1;
+            counter[0] = c0;
+            counter[1] = static_cast<uint32_t>(p1);
+            counter[2] = c2;
+            counter[3] = static_cast<uint32_t>(p0);
+            k0 += 0x9e3779b9;
+            k1 += 0xbb67ae85;
         }
-        return result;
     }
 
-    double realWnext(int w) {
-        if (w == 0) {
-            return nextf();
-        } else if (w > 0) {
-            return std::pow(nextf(), 1.0 / (w + 1));
-        } else {
-            return 1.0 - std::pow(nextf(), 1.0 / (-w + 1));
+private:
+    void generateBlock() {
+        buffer_[0] = static_cast<uint32_t>(position_);
+        buffer_[1] = static_cast<uint32_t>(position_ >> 32);
+        buffer_[2] = static_cast<uint32_t>(stream_);
+        buffer_[3] = static_cast<uint32_t>(stream_ >> 32);
+        block(buffer_, key_);
+        ++position_;
+    }
+
+    uint32_t key_[2] = {0, 0};
+    uint64_t stream_ = 0;
+    uint64_t position_ = 0;
+    uint32_t buffer_[4] = {0, 0, 0, 0};
+    int bufferPos_ = 4;
+};
+
+} // namespace detail
+
+} // namespace jngen
+
+using jngen::RandomEngine;
+
+#include <cstddef>
+#include <cstdint>
+
+// Vectorized reduction of raw engine words to a bounded range. The path is
+// chosen at compile time from the target ISA (e.g. -mavx2 or -march=native);
+// define JNGEN_NO_SIMD to force the scalar one. All paths produce exactly the
+// same output.
+
+#ifndef JNGEN_NO_SIMD
+#if defined(__AVX2__)
+#define JNGEN_SIMD_AVX2
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#define JNGEN_SIMD_SSE41
+#include <smmintrin.h>
+#elif defined(__ARM_NEON)
+#define JNGEN_SIMD_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+namespace jngen {
+namespace detail {
+
+#if defined(JNGEN_SIMD_AVX2) || defined(JNGEN_SIMD_SSE41)
+
+// For each mask of accepted lanes: the number of accepted lanes and the
+// permutation moving them to the front, preserving their order.
+template<int LANES>
+struct CompactionTable {
+    CompactionTable() {
+        for (int mask = 0; mask < (1 << LANES); ++mask) {
+            int k = 0;
+            for (int i = 0; i < LANES; ++i) {
+                if (mask & (1 << i)) {
+                    lanes[mask][k++] = i;
+                }
+            }
+            count[mask] = k;
+            while (k < LANES) {
+                lanes[mask][k++] = 0;
+            }
         }
     }
 
-    std::mt19937 randomEngine_;
-    constexpr static int WNEXT_LIMIT = 8;
+    uint32_t lanes[1 << LANES][LANES];
+    int count[1 << LANES];
 };
 
-JNGEN_EXTERN Random rnd;
-
-template<>
-struct TypedRandom<int> : public BaseTypedRandom {
-    using BaseTypedRandom::BaseTypedRandom;
-    int next(int n) { return random.next(n); }
-    int next(int l, int r) { return random.next(l, r); }
-};
+template<int LANES>
+const CompactionTable<LANES>& compactionTable() {
+    static const CompactionTable<LANES> table;
+    return table;
+}
 
-template<>
-struct TypedRandom<double> : public BaseTypedRandom {
-    using BaseTypedRandom::BaseTypedRandom;
-    double next(double n) { return random.next(n); }
-    double next(double l, double r) { return random.next(l, r); }
-};
+#endif // JNGEN_SIMD_AVX2 || JNGEN_SIMD_SSE41
 
-template<>
-struct TypedRandom<long double> : public BaseTypedRandom {
-    using BaseTypedRandom::BaseTypedRandom;
-    double next(double n) { return random.next(n); }
-    double next(double l, double r) { return random.next(l, r); }
-};
+#if defined(JNGEN_SIMD_AVX2)
 
-template<>
-struct TypedRandom<long long> : public BaseTypedRandom {
-    using BaseTypedRandom::BaseTypedRandom;
-    long long next(long long n) { return random.next(n); }
-    long long next(long long l, long long r) { return random.next(l, r); }
-};
+// Writes all 8 lanes to |out|, accepted ones first. Returns their number.
+inline size_t compact(__m256i values, __m256i accepted, uint32_t* out) {
+    const auto& table = compactionTable<8>();
+    int mask = _mm256_movemask_ps(_mm256_castsi256_ps(accepted));
+    __m256i permutation = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(table.lanes[mask]));
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(out),
+        _mm256_permutevar8x32_epi32(values, permutation));
+    return table.count[mask];
+}
 
-template<>
-struct TypedRandom<size_t> : public BaseTypedRandom {
-    using BaseTypedRandom::BaseTypedRandom;
-    size_t next(size_t n) { return random.next(n); }
-    size_t next(size_t l, size_t r) { return random.next(l, r); }
-};
+#elif defined(JNGEN_SIMD_SSE41)
 
-template<>
-struct TypedRandom<char> : public BaseTypedRandom {
-    using BaseTypedRandom::BaseTypedRandom;
-    char next(char n) { return random.next(n); }
-    char next(char l, char r) { return random.next(l, r); }
-};
+inline size_t compact(__m128i values, __m128i accepted, uint32_t* out) {
+    const auto& table = compactionTable<4>();
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(accepted));
+    const uint32_t* lanes = table.lanes[mask];
+    // _mm_shuffle_epi8 works with bytes, so lane i is bytes 4i..4i+3.
+    __m128i shuffle = _mm_set_epi8(
+        lanes[3]*4 + 3, lanes[3]*4 + 2, lanes[3]*4 + 1, lanes[3]*4,
+        lanes[2]*4 + 3, lanes[2]*4 + 2, lanes[2]*4 + 1, lanes[2]*4,
+        lanes[1]*4 + 3, lanes[1]*4 + 2, lanes[1]*4 + 1, lanes[1]*4,
+        lanes[0]*4 + 3, lanes[0]*4 + 2, lanes[0]*4 + 1, lanes[0]*4);
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(values, shuffle));
+    return table.count[mask];
+}
 
-template<typename T>
-struct TypedRandom : public BaseTypedRandom {
-    using BaseTypedRandom::BaseTypedRandom;
-    template<typename ... Args>
-    T next(Args... args) { return random.next(args...); }
-};
+#elif defined(JNGEN_SIMD_NEON)
 
-struct RandomPairTraits {
-    const bool ordered;
-    const bool distinct;
-};
+inline size_t compact(uint32x4_t values, uint32x4_t accepted, uint32_t* out) {
+    uint32_t v[4];
+    uint32_t a[4];
+    vst1q_u32(v, values);
+    vst1q_u32(a, accepted);
+    size_t k = 0;
+    for (int i = 0; i < 4; ++i) {
+        if (a[i]) {
+            out[k++] = v[i];
+        }
+    }
+    return k;
+}
 
-#ifdef JNGEN_DECLARE_ONLY
-extern RandomPairTraits opair, dpair, odpair, dopair;
-#else
-RandomPairTraits opair{true, false};
-RandomPairTraits dpair{false, true};
-RandomPairTraits odpair{true, true};
-RandomPairTraits dopair{true, true};
 #endif
 
-template<>
-struct TypedRandom<std::pair<int, int>> : public BaseTypedRandom {
-    using BaseTypedRandom::BaseTypedRandom;
+// Both reductions below process words in[0..n) in order, write the values
+// obtained from accepted words to out[0..), and return their number. They
+// match uniformMasked32 and uniformLemire32 from random.h word by word. |out|
+// must have room for n values and may coincide with |in|.
 
-    std::pair<int, int> next(int n) {
-        return next(n, {false, false});
-    }
-    std::pair<int, int> next(int l, int r) {
-        return next(l, r, {false, false});
+// Accepts w & mask if it is less than bound.
+inline size_t reduceMasked32(
+        const uint32_t* in, size_t n,
+        uint32_t bound, uint32_t mask,
+        uint32_t* out)
+{
+    size_t i = 0;
+    size_t k = 0;
+    const uint32_t maxValue = bound - 1;
+
+#if defined(JNGEN_SIMD_AVX2)
+    const __m256i vmask = _mm256_set1_epi32(mask);
+    const __m256i vmax = _mm256_set1_epi32(maxValue);
+    for (; i + 8 <= n; i += 8) {
+        __m256i w = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(in + i));
+        __m256i value = _mm256_and_si256(w, vmask);
+        __m256i accepted = _mm256_cmpeq_epi32(
+            _mm256_min_epu32(value, vmax), value);
+        k += compact(value, accepted, out + k);
+    }
+#elif defined(JNGEN_SIMD_SSE41)
+    const __m128i vmask = _mm_set1_epi32(mask);
+    const __m128i vmax = _mm_set1_epi32(maxValue);
+    for (; i + 4 <= n; i += 4) {
+        __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i value = _mm_and_si128(w, vmask);
+        __m128i accepted = _mm_cmpeq_epi32(_mm_min_epu32(value, vmax), value);
+        k += compact(value, accepted, out + k);
+    }
+#elif defined(JNGEN_SIMD_NEON)
+    const uint32x4_t vmask = vdupq_n_u32(mask);
+    const uint32x4_t vmax = vdupq_n_u32(maxValue);
+    for (; i + 4 <= n; i += 4) {
+        uint32x4_t value = vandq_u32(vld1q_u32(in + i), vmask);
+        k += compact(value, vcleq_u32(value, vmax), out + k);
     }
+#endif
 
-    std::pair<int, int> next(int n, RandomPairTraits traits) {
-        int first = rnd.next(n);
-        int second;
-        do {
-            second = rnd.next(n);
-        } while (traits.distinct && first == second);
-        if (traits.ordered && first > second) {
-            std::swap(first, second);
+    for (; i < n; ++i) {
+        uint32_t value = in[i] & mask;
+        if (value <= maxValue) {
+            out[k++] = value;
         }
-        return {first, second};
     }
-    std::pair<int, int> next(int l, int r, RandomPairTraits traits) {
-        auto res = next(r-l+1, traits);
-        res.first += l;
-        res.second += l;
-        return res;
+    return k;
+}
+
+// Accepts the upper half of w * bound if the lower half is at least
+// threshold.
+inline size_t reduceLemire32(
+        const uint32_t* in, size_t n,
+        uint32_t bound, uint32_t threshold,
+        uint32_t* out)
+{
+    size_t i = 0;
+    size_t k = 0;
+
+#if defined(JNGEN_SIMD_AVX2)
+    const __m256i vbound = _mm256_set1_epi32(bound);
+    const __m256i vthreshold = _mm256_set1_epi32(threshold);
+    for (; i + 8 <= n; i += 8) {
+        __m256i w = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(in + i));
+        // 32x32->64 multiplication is only available for even lanes.
+        __m256i even = _mm256_mul_epu32(w, vbound);
+        __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(w, 32), vbound);
+        __m256i hi = _mm256_blend_epi32(
+            _mm256_srli_epi64(even, 32), odd, 0xaa);
+        __m256i lo = _mm256_blend_epi32(
+            even, _mm256_slli_epi64(odd, 32), 0xaa);
+        __m256i accepted = _mm256_cmpeq_epi32(
+            _mm256_max_epu32(lo, vthreshold), lo);
+        k += compact(hi, accepted, out + k);
+    }
+#elif defined(JNGEN_SIMD_SSE41)
+    const __m128i vbound = _mm_set1_epi32(bound);
+    const __m128i vthreshold = _mm_set1_epi32(threshold);
+    for (; i + 4 <= n; i += 4) {
+        __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i even = _mm_mul_epu32(w, vbound);
+        __m128i odd = _mm_mul_epu32(_mm_srli_epi64(w, 32), vbound);
+        __m128i hi = _mm_blend_epi16(_mm_srli_epi64(even, 32), odd, 0xcc);
+        __m128i lo = _mm_blend_epi16(even, _mm_slli_epi64(odd, 32), 0xcc);
+        __m128i accepted = _mm_cmpeq_epi32(_mm_max_epu32(lo, vthreshold), lo);
+        k += compact(hi, accepted, out + k);
+    }
+#elif defined(JNGEN_SIMD_NEON)
+    const uint32x2_t vbound = vdup_n_u32(bound);
+    const uint32x4_t vthreshold = vdupq_n_u32(threshold);
+    for (; i + 4 <= n; i += 4) {
+        uint32x4_t w = vld1q_u32(in + i);
+        uint64x2_t low = vmull_u32(vget_low_u32(w), vbound);
+        uint64x2_t high = vmull_u32(vget_high_u32(w), vbound);
+        // val[0] holds lower halves of the products, val[1] upper ones.
+        uint32x4x2_t halves = vuzpq_u32(
+            vreinterpretq_u32_u64(low), vreinterpretq_u32_u64(high));
+        k += compact(
+            halves.val[1], vcgeq_u32(halves.val[0], vthreshold), out + k);
     }
+#endif
 
-private:
-    std::pair<int, int> ordered(std::pair<int, int> pair) const {
-        if (pair.first > pair.second) {
-            std::swap(pair.first, pair.second);
+    for (; i < n; ++i) {
+        uint64_t product = static_cast<uint64_t>(in[i]) * bound;
+        if (static_cast<uint32_t>(product) >= threshold) {
+            out[k++] = product >> 32;
         }
-        return pair;
     }
-};
+    return k;
+}
 
+} // namespace detail
 } // namespace jngen
 
-using jngen::Random;
 
-using jngen::rnd;
-using jngen::opair;
-using jngen::dpair;
-using jngen::dopair;
-using jngen::odpair;
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
-using jngen::registerGen;
+namespace jngen {
 
-#ifndef JNGEN_DECLARE_ONLY
-#define JNGEN_INCLUDE_RANDOM_INL_H
-#ifndef JNGEN_INCLUDE_RANDOM_INL_H
-#error File "random_inl.h" must not be included directly.
-#endif
+void assertRandomEngineConsistency();
+void assertIntegerSizes();
+void registerGen(int argc, char *argv[], int version = 1);
 
-namespace jngen {
+class Random;
 
-void assertRandomEngineConsistency() {
-    std::mt19937 engine(1234);
-    ENSURE(engine() == 822569775,
-        "std::mt19937 doesn't conform to the C++ standard");
-    ENSURE(engine() == 2137449171,
-        "std::mt19937 doesn't conform to the C++ standard");
-    ENSURE(engine() == 2671936806,
-        "std::mt19937 doesn't conform to the C++ standard");
-}
+class BaseTypedRandom {
+public:
+    BaseTypedRandom(Random& random) : random(random) {}
 
-void assertIntegerSizes() {
-    static_assert(
-        std::numeric_limits<unsigned char>::max() == 255,
-        "max(unsigned char) != 255");
-    static_assert(sizeof(int) == 4, "sizeof(int) != 4");
-    static_assert(sizeof(long long) == 8, "sizeof(long long) != 8");
-    static_assert(
-        sizeof(size_t) == 4 || sizeof(size_t) == 8,
-        "sizeof(size_t) is neither 4 nor 8");
-    static_assert(
-        sizeof(std::size_t) == sizeof(size_t),
-        "sizeof(size_t) != sizeof(std::size_t)");
-}
+protected:
+    Random& random;
+};
 
-void registerGen(int argc, char *argv[], int version) {
-    (void)version; // unused, only for testlib.h compatibility
+template<typename T>
+struct TypedRandom;
 
-    std::vector<uint32_t> seed;
-    for (int i = 1; i < argc; ++i) {
-        int startPosition = seed.size();
-        seed.emplace_back();
-        for (char *s = argv[i]; *s; ++s) {
-            ++seed[startPosition];
-            seed.push_back(*s);
+uint64_t maskForBound(uint64_t bound);
+
+namespace detail {
+
+// Bounded sampling kernels. Each of them consumes engine words one by one and
+// yields exactly the values that successive single draws would yield, so bulk
+// and per-call generation stay interchangeable.
+//
+// Mt19937 keeps the historical mask-and-reject scheme to keep old generators
+// reproducible. Other engines use Lemire's multiply-shift rejection: the
+// answer is the upper half of word * bound, and the word is rejected only if
+// the lower half is below 2^32 mod bound. 64-bit bounds are handled the same
+// way with a 64x64->128 multiplication.
+
+template<typename Engine>
+uint32_t uniformMasked32(Engine& engine, uint32_t bound, uint32_t mask) {
+    while (true) {
+        uint32_t outcome = engine.next32() & mask;
+        if (outcome < bound) {
+            return outcome;
         }
     }
-    rnd.seed(seed);
-}
-
-uint64_t maskForBound(uint64_t bound) {
-    --bound;
-    uint64_t mask = ~0;
-    if ((mask >> 32) >= bound) mask >>= 32;
-    if ((mask >> 16) >= bound) mask >>= 16;
-    if ((mask >> 8 ) >= bound) mask >>= 8 ;
-    if ((mask >> 4 ) >= bound) mask >>= 4 ;
-    if ((mask >> 2 ) >= bound) mask >>= 2 ;
-    if ((mask >> 1 ) >= bound) mask >>= 1 ;
-    return mask;
 }
 
-void Random::seed(uint32_t val) {
-    randomEngine_.seed(val);
+template<typename Engine>
+uint64_t uniformMasked64(Engine& engine, uint64_t bound, uint64_t mask) {
+    while (true) {
+        uint64_t outcome = engine.next64() & mask;
+        if (outcome < bound) {
+            return outcome;
+        }
+    }
 }
 
-void Random::seed(const std::vector<uint32_t>& seed) {
-    std::seed_seq seq(seed.begin(), seed.end());
-    randomEngine_.seed(seq);
+// |threshold| must be equal to (2^32 - bound) % bound.
+template<typename Engine>
+uint32_t uniformLemire32(Engine& engine, uint32_t bound, uint32_t threshold) {
+    while (true) {
+        uint64_t product = static_cast<uint64_t>(engine.next32()) * bound;
+        if (static_cast<uint32_t>(product) >= threshold) {
+            return product >> 32;
+        }
+    }
 }
 
-uint32_t Random::next() {
-    return randomEngine_();
+template<typename Engine>
+uint32_t uniformLemire32(Engine& engine, uint32_t bound) {
+    uint64_t product = static_cast<uint64_t>(engine.next32()) * bound;
+    if (static_cast<uint32_t>(product) < bound) {
+        uint32_t threshold = -bound % bound;
+        while (static_cast<uint32_t>(product) < threshold) {
+            product = static_cast<uint64_t>(engine.next32()) * bound;
+        }
+    }
+    return product >> 32;
 }
 
-uint64_t Random::next64() {
-    uint64_t a = next();
-    uint64_t b = next();
-    return (a << 32) ^ b;
+template<typename Engine>
+uint64_t uniformLemire64(Engine& engine, uint64_t bound) {
+    uint64_t hi;
+    uint64_t lo = mul128(engine.next64(), bound, hi);
+    if (lo < bound) {
+        uint64_t threshold = -bound % bound;
+        while (lo < threshold) {
+            lo = mul128(engine.next64(), bound, hi);
+        }
+    }
+    return hi;
 }
 
-double Random::nextf() {
-    return (double)randomEngine_() / randomEngine_.max();
+// Draws words from the engine in blocks and reduces them with |reduce|
+// (see random_simd.h), drawing more words for the rejected ones. Exactly the
+// same words are consumed as by a sequence of single draws.
+template<typename T, typename Engine, typename Reduce>
+void fillReduced32(
+        Engine& engine, T* out, size_t count, uint32_t base, Reduce reduce)
+{
+    const size_t BLOCK = 1024;
+    uint32_t buffer[BLOCK];
+    while (count > 0) {
+        size_t size = std::min(count, BLOCK);
+        for (size_t i = 0; i < size; ++i) {
+            buffer[i] = engine.next32();
+        }
+        size = reduce(buffer, size, buffer);
+        for (size_t i = 0; i < size; ++i) {
+            out[i] = static_cast<T>(base + buffer[i]);
+        }
+        out += size;
+        count -= size;
+    }
 }
 
-int Random::next(int n) {
-    ensure(n > 0);
-    return uniformRandom(n, *this, (uint32_t (Random::*)())&Random::next);
+template<typename T, typename Engine>
+void fillMasked32(
+        Engine& engine, T* out, size_t count, uint32_t bound, uint32_t base)
+{
+    uint32_t mask = maskForBound(bound);
+    fillReduced32(engine, out, count, base,
+        [bound, mask](const uint32_t* in, size_t n, uint32_t* res) {
+            return reduceMasked32(in, n, bound, mask, res);
+        });
 }
 
-long long Random::next(long long n) {
-    ensure(n > 0);
-    return uniformRandom(n, *this, &Random::next64);
+template<typename T, typename Engine>
+void fillMasked64(
+        Engine& engine, T* out, size_t count, uint64_t bound, uint64_t base)
+{
+    uint64_t mask = maskForBound(bound);
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = static_cast<T>(base + uniformMasked64(engine, bound, mask));
+    }
 }
 
-size_t Random::next(size_t n) {
-    ensure(n > 0);
-    return uniformRandom(n, *this, &Random::next64);
+template<typename T, typename Engine>
+void fillLemire64(
+        Engine& engine, T* out, size_t count, uint64_t bound, uint64_t base)
+{
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = static_cast<T>(base + uniformLemire64(engine, bound));
+    }
 }
 
-double Random::next(double n) {
-    ensure(n >= 0);
-    return nextf() * n;
+template<typename T, typename Engine>
+void fillLemire32(
+        Engine& engine, T* out, size_t count, uint32_t bound, uint32_t base)
+{
+    uint32_t threshold = -bound % bound;
+    fillReduced32(engine, out, count, base,
+        [bound, threshold](const uint32_t* in, size_t n, uint32_t* res) {
+            return reduceLemire32(in, n, bound, threshold, res);
+        });
 }
 
-int Random::next(int l, int r) {
-    ensure(l <= r);
-    uint32_t n = static_cast<uint32_t>(r) - l + 1;
-    return l + uniformRandom(
-        n, *this, (uint32_t (Random::*)())&Random::next);
+// Bound 0 stands for the full range of the word.
+template<typename T, typename Engine>
+void fillRaw32(Engine& engine, T* out, size_t count, uint32_t base) {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = static_cast<T>(base + engine.next32());
+    }
 }
 
-long long Random::next(long long l, long long r) {
-    ensure(l <= r);
-    uint64_t n = static_cast<uint64_t>(r) - l + 1;
-    return l + uniformRandom(n, *this, &Random::next64);
+template<typename T, typename Engine>
+void fillRaw64(Engine& engine, T* out, size_t count, uint64_t base) {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = static_cast<T>(base + engine.next64());
+    }
 }
 
-size_t Random::next(size_t l, size_t r) {
-    ensure(l <= r);
-    uint64_t n = static_cast<uint64_t>(r) - l + 1;
-    return l + uniformRandom(n, *this, &Random::next64);
-}
+} // namespace detail
 
-double Random::next(double l, double r) {
-    ensure(l <= r);
-    return l + next(r-l);
-}
+class Random {
+public:
+    Random() {
+        assertRandomEngineConsistency();
+        assertIntegerSizes();
+        std::vector<uint32_t> seedSeq;
+        // 4 random_device calls is enough for everyone
+        std::random_device rd;
+        for (size_t i = 0; i < 4; ++i) {
+            seedSeq.push_back(rd());
+        }
+        seed(seedSeq);
 
-int Random::wnext(int n, int w) {
-    ensure(n > 0);
-    if (std::abs(w) <= WNEXT_LIMIT) {
-        return smallWnext<int>(w, n);
-    } else {
-        double t = realWnext(w);
-        return n * t;
     }
-}
 
-long long Random::wnext(long long n, int w) {
-    ensure(n > 0);
-    if (std::abs(w) <= WNEXT_LIMIT) {
-        return smallWnext<long long>(w, n);
-    } else {
-        return n * realWnext(w);
+    void seed(uint32_t val);
+    void seed(const std::vector<uint32_t>& seed);
+
+    // Switching the engine reseeds it with the last seed passed to this
+    // object, so setEngine and seed/registerGen may be called in any order.
+    void setEngine(RandomEngine engine);
+    RandomEngine engine() const { return engine_; }
+
+    // Independent Philox generators for parallel work. stream(i) depends only
+    // on the last seed of this object and on i, so a fixed seed gives the
+    // same streams regardless of what was generated before. split(k) takes
+    // one 64-bit value from this generator and derives k streams from it;
+    // successive split calls yield different streams.
+    Random stream(uint64_t index) const;
+    std::vector<Random> split(size_t count);
+
+    uint32_t next();
+    uint64_t next64();
+    double nextf();
+
+    int next(int n);
+    long long next(long long n);
+    size_t next(size_t n);
+    double next(double n);
+
+    int next(int l, int r);
+    long long next(long long l, long long r);
+    size_t next(size_t l, size_t r);
+    double next(double l, double r);
+
+    int wnext(int n, int w);
+    long long wnext(long long n, int w);
+    size_t wnext(size_t n, int w);
+    double wnext(double n, int w);
+
+    int wnext(int l, int r, int w);
+    long long wnext(long long l, long long r, int w);
+    size_t wnext(size_t l, size_t r, int w);
+    double wnext(double l, double r, int w);
+
+    std::string next(const std::string& pattern);
+
+    // A pattern may be parsed once and reused, appending to a buffer which
+    // keeps its capacity between calls.
+    std::string next(const Pattern& pattern);
+    void next(const Pattern& pattern, std::string& out);
+
+    template<typename ... Args>
+    std::string next(const std::string& pattern, Args... args) {
+        return next(format(pattern, args...));
     }
-}
 
-size_t Random::wnext(size_t n, int w) {
-    ensure(n > 0);
-    if (std::abs(w) <= WNEXT_LIMIT) {
-        return smallWnext<size_t>(w, n);
-    } else {
-        return n * realWnext(w);
+    template<typename T, typename ... Args>
+    T tnext(Args... args) {
+        return TypedRandom<T>{*this}.next(args...);
     }
-}
 
-double Random::wnext(double n, int w) {
-    ensure(n >= 0);
-    if (std::abs(w) <= WNEXT_LIMIT) {
-        return smallWnext<double>(w, n);
-    } else {
-        return realWnext(w) * n;
+    template<typename ... Args>
+    std::pair<int, int> nextp(Args... args) {
+        return tnext<std::pair<int, int>>(args...);
     }
-}
 
-int Random::wnext(int l, int r, int w) {
-    ensure(l <= r);
-    if (std::abs(w) <= WNEXT_LIMIT) {
-        return smallWnext<int>(w, l, r);
-    } else {
-        uint32_t n = static_cast<uint32_t>(r) - l + 1;
-        return l + static_cast<uint32_t>(n * realWnext(w));
+    template<typename Iterator>
+    auto choice(Iterator begin, Iterator end)
+            -> typename std::iterator_traits<Iterator>::value_type
+    {
+        auto length = std::distance(begin, end);
+        ensure(length > 0, "Cannot select from a range of negative length");
+        size_t index = tnext<size_t>(length);
+        std::advance(begin, index);
+        return *begin;
     }
-}
 
-long long Random::wnext(long long l, long long r, int w) {
-    ensure(l <= r);
-    if (std::abs(w) <= WNEXT_LIMIT) {
-        return smallWnext<long long>(w, l, r);
-    } else {
-        uint64_t n = static_cast<uint64_t>(r) - l + 1;
-        return l + static_cast<uint64_t>(n * realWnext(w));
+    template<typename Container>
+    typename Container::value_type choice(const Container& container) {
+        ensure(!container.empty(), "Cannot select from an empty container");
+        return choice(container.begin(), container.end());
     }
-}
 
-size_t Random::wnext(size_t l, size_t r, int w) {
-    ensure(l <= r);
-    if (std::abs(w) <= WNEXT_LIMIT) {
-        return smallWnext<size_t>(w, l, r);
-    } else {
-        uint64_t n = static_cast<uint64_t>(r) - l + 1;
-        return l + static_cast<uint64_t>(n * realWnext(w));
+    template<typename T>
+    T choice(const std::initializer_list<T>& ilist) {
+        return choice(ilist.begin(), ilist.end());
     }
-}
 
-double Random::wnext(double l, double r, int w) {
-    ensure(l <= r);
-    if (std::abs(w) <= WNEXT_LIMIT) {
-        return smallWnext<double>(w, l, r);
-    } else {
-        return realWnext(w) * (r - l) + l;
+    template<typename Numeric>
+    size_t nextByDistribution(const std::vector<Numeric>& distribution) {
+        ensure(!distribution.empty(), "Cannot sample by empty distribution");
+        Numeric sum = std::accumulate(
+                distribution.begin(), distribution.end(), Numeric(0));
+        auto x = next(sum);
+        for (size_t i = 0; i < distribution.size(); ++i) {
+            if (x < distribution[i]) {
+                return i;
+            }
+            x -= distribution[i];
+        }
+        return distribution.size() - 1;
     }
-}
 
-std::string Random::next(const std::string& pattern) {
-    return Pattern(pattern).next([this](int n) { return next(n); });
-}
+    template<typename Numeric>
+    size_t nextByDistribution(const std::initializer_list<Numeric>& ilist) {
+        // TODO: looks suboptimal
+        return nextByDistribution(std::vector<Numeric>(ilist));
+    }
 
-} // namespace jngen
-#undef JNGEN_INCLUDE_RANDOM_INL_H
-#endif // JNGEN_DECLARE_ONLY
+    // Bulk generation: fill(out, count, args...) writes to out[0..count) the
+    // same values as |count| successive next(args...) calls would return.
+    void fill(int* out, size_t count, int n);
+    void fill(long long* out, size_t count, long long n);
+    void fill(size_t* out, size_t count, size_t n);
+    void fill(double* out, size_t count, double n);
 
+    void fill(int* out, size_t count, int l, int r);
+    void fill(long long* out, size_t count, long long l, long long r);
+    void fill(size_t* out, size_t count, size_t l, size_t r);
+    void fill(double* out, size_t count, double l, double r);
 
-#include <iterator>
-#include <sstream>
-#include <string>
+    // Raw words: the same as |count| successive next() or next64() calls.
+    void fill(uint32_t* out, size_t count);
+    void fill(uint64_t* out, size_t count);
 
-namespace jngen {
-namespace options {
+private:
+    template<typename T, typename ...Args>
+    T smallWnext(int w, Args... args) {
+        ENSURE(std::abs(w) <= WNEXT_LIMIT);
+        T result = next(args...);
+        while (w > 0) {
+            result = std::max(result, next(args...));
+            --w;
+        }
+        while (w < 0) {
+            result = std::min(result, next(args...));
+            ++w;
+        }
+        return result;
+    }
 
-struct Range {
-    int first;
-    int last;
-    int step;
+    // Closed-form wnext for config.fastWnext: an offset in [0, n), n > 0.
+    // Returns false if |w| > WNEXT_LIMIT and n^(|w|+1) does not fit into 128
+    // bits, then the default formula is used.
+    bool fastWnext(uint64_t n, int w, uint64_t& result);
+    // Maximum of k values from [0, n); n^k must fit into 128 bits (64 if
+    // 128-bit integers are not supported).
+    uint64_t maxOfUniform(uint64_t n, int k);
 
-    Range(int first, int last, int step = 1) :
-        first(first),
-        last(last),
-        step(step)
-    {
-        ensure(first <= last);
-        ensure(step > 0);
+    double realWnext(int w) {
+        if (w == 0) {
+            return nextf();
+        } else if (w > 0) {
+            return std::pow(nextf(), 1.0 / (w + 1));
+        } else {
+            return 1.0 - std::pow(nextf(), 1.0 / (-w + 1));
+        }
     }
 
-    class iterator {
-    public:
-        using iterator_category = std::forward_iterator_tag;
-        using value_type = int;
-        using reference = const int&;
-        using pointer = const int*;
-        using difference_type = int;
+    struct Unseeded {};
 
-        iterator(int value, int step, int last) :
-            value_(value),
-            step_(step),
-            last_(last)
-        {  }
+    // Leaves engines in their default states, to be seeded by the caller.
+    explicit Random(Unseeded) {}
 
-        iterator& operator++() {
-            ensure(value_ <= last_, "Cannot increment past-the-end iterator");
-            value_ += step_;
-            return *this;
-        }
+    void reseed();
 
-        iterator operator++(int) {
-            iterator copy = *this;
-            ++*this;
-            return copy;
+    // Key of the Philox streams derived from the current seed.
+    uint64_t streamKey() const;
+    static Random makeStream(
+            uint64_t key, uint64_t index, std::vector<uint32_t> seed);
+
+    uint32_t uniform32(uint32_t bound);
+    uint64_t uniform64(uint64_t bound);
+
+    template<typename T, typename Engine>
+    void fillUniform32(
+            Engine& engine, T* out, size_t count, uint32_t bound, uint32_t base,
+            bool legacy)
+    {
+        if (bound == 0) {
+            detail::fillRaw32(engine, out, count, base);
+            return;
         }
+#ifdef JNGEN_FAST_RANDOM
+        (void)legacy;
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = static_cast<T>(base + engine.next32() % bound);
+        }
+#else
+        if (legacy) {
+            detail::fillMasked32(engine, out, count, bound, base);
+        } else {
+            detail::fillLemire32(engine, out, count, bound, base);
+        }
+#endif
+    }
 
-        int operator*() const {
-            ensure(value_ <= last_, "Cannot dereference past-the-end iterator");
-            return value_;
+    template<typename T, typename Engine>
+    void fillUniform64(
+            Engine& engine, T* out, size_t count, uint64_t bound, uint64_t base,
+            bool legacy)
+    {
+        if (bound == 0) {
+            detail::fillRaw64(engine, out, count, base);
+            return;
+        }
+#ifdef JNGEN_FAST_RANDOM
+        (void)legacy;
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = static_cast<T>(base + engine.next64() % bound);
+        }
+#else
+        if (legacy) {
+            detail::fillMasked64(engine, out, count, bound, base);
+        } else {
+            detail::fillLemire64(engine, out, count, bound, base);
         }
+#endif
+    }
 
-        bool operator==(const iterator& other) const {
-            if (value_ <= last_) {
-                return value_ == other.value_;
-            }
-            return other.value_ > last_;
+    template<typename T>
+    void fillUniform32(T* out, size_t count, uint32_t bound, uint32_t base) {
+        switch (engine_) {
+        case RandomEngine::Xoshiro256:
+            fillUniform32(xoshiro256_, out, count, bound, base, false); break;
+        case RandomEngine::Pcg64:
+            fillUniform32(pcg64_, out, count, bound, base, false); break;
+        case RandomEngine::Wyrand:
+            fillUniform32(wyrand_, out, count, bound, base, false); break;
+        case RandomEngine::Philox:
+            fillUniform32(philox_, out, count, bound, base, false); break;
+        case RandomEngine::Mt19937_64:
+            fillUniform32(mt19937_64_, out, count, bound, base, false); break;
+        default:
+            fillUniform32(mt19937_, out, count, bound, base, true); break;
         }
+    }
 
-        bool operator!=(const iterator& other) const {
-            return !(*this == other);
+    template<typename T>
+    void fillUniform64(T* out, size_t count, uint64_t bound, uint64_t base) {
+        switch (engine_) {
+        case RandomEngine::Xoshiro256:
+            fillUniform64(xoshiro256_, out, count, bound, base, false); break;
+        case RandomEngine::Pcg64:
+            fillUniform64(pcg64_, out, count, bound, base, false); break;
+        case RandomEngine::Wyrand:
+            fillUniform64(wyrand_, out, count, bound, base, false); break;
+        case RandomEngine::Philox:
+            fillUniform64(philox_, out, count, bound, base, false); break;
+        case RandomEngine::Mt19937_64:
+            fillUniform64(mt19937_64_, out, count, bound, base, false); break;
+        default:
+            fillUniform64(mt19937_, out, count, bound, base, true); break;
+        }
+    }
+
+    template<typename Engine>
+    void fillReal(
+            Engine& engine, double* out, size_t count, double l, double d)
+    {
+        const double MAX = std::numeric_limits<uint32_t>::max();
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = l + engine.next32() / MAX * d;
         }
+    }
 
-    private:
-        int value_;
-        int step_;
-        int last_;
-    };
+    RandomEngine engine_ = RandomEngine::JNGEN_RANDOM_ENGINE;
+    detail::Mt19937Engine mt19937_;
+    detail::Xoshiro256Engine xoshiro256_;
+    detail::Pcg64Engine pcg64_;
+    detail::WyrandEngine wyrand_;
+    detail::PhiloxEngine philox_;
+    detail::Mt19937_64Engine mt19937_64_;
 
-    iterator begin() const {
-        return { first, step, last };
-    }
+    std::vector<uint32_t> seed_;
+    bool scalarSeed_ = false;
 
-    iterator end() const {
-        return { last + 1, step, last };
+    constexpr static int WNEXT_LIMIT = 8;
+};
+
+JNGEN_EXTERN Random rnd;
+
+template<>
+struct TypedRandom<int> : public BaseTypedRandom {
+    using BaseTypedRandom::BaseTypedRandom;
+    int next(int n) { return random.next(n); }
+    int next(int l, int r) { return random.next(l, r); }
+    void fill(int* out, size_t count, int n) { random.fill(out, count, n); }
+    void fill(int* out, size_t count, int l, int r) {
+        random.fill(out, count, l, r);
     }
+};
 
-    static Range fromString(std::string s) {
-        for (char& c: s) {
-            ensure(c != ' ', "No spaces allowed in range description");
-            if (c == ':') {
-                c = ' ';
-            }
-        }
+template<>
+struct TypedRandom<double> : public BaseTypedRandom {
+    using BaseTypedRandom::BaseTypedRandom;
+    double next(double n) { return random.next(n); }
+    double next(double l, double r) { return random.next(l, r); }
+    void fill(double* out, size_t count, double n) { random.fill(out, count, n); }
+    void fill(double* out, size_t count, double l, double r) {
+        random.fill(out, count, l, r);
+    }
+};
 
-        std::istringstream ss(s);
-        int first = 1;
-        int last = std::numeric_limits<int>::max() - 1;
-        int step = 1;
-        if (!(ss >> first)) {
-            ensure(false, "Failed to parse range");
-        }
-        if (!(ss >> last)) {
-            return Range(first, last, step);
+template<>
+struct TypedRandom<long double> : public BaseTypedRandom {
+    using BaseTypedRandom::BaseTypedRandom;
+    double next(double n) { return random.next(n); }
+    double next(double l, double r) { return random.next(l, r); }
+};
+
+template<>
+struct TypedRandom<long long> : public BaseTypedRandom {
+    using BaseTypedRandom::BaseTypedRandom;
+    long long next(long long n) { return random.next(n); }
+    long long next(long long l, long long r) { return random.next(l, r); }
+    void fill(long long* out, size_t count, long long n) { random.fill(out, count, n); }
+    void fill(long long* out, size_t count, long long l, long long r) {
+        random.fill(out, count, l, r);
+    }
+};
+
+template<>
+struct TypedRandom<size_t> : public BaseTypedRandom {
+    using BaseTypedRandom::BaseTypedRandom;
+    size_t next(size_t n) { return random.next(n); }
+    size_t next(size_t l, size_t r) { return random.next(l, r); }
+    void fill(size_t* out, size_t count, size_t n) { random.fill(out, count, n); }
+    void fill(size_t* out, size_t count, size_t l, size_t r) {
+        random.fill(out, count, l, r);
+    }
+};
+
+template<>
+struct TypedRandom<char> : public BaseTypedRandom {
+    using BaseTypedRandom::BaseTypedRandom;
+    char next(char n) { return random.next(n); }
+    char next(char l, char r) { return random.next(l, r); }
+};
+
+template<typename T>
+struct TypedRandom : public BaseTypedRandom {
+    using BaseTypedRandom::BaseTypedRandom;
+    template<typename ... Args>
+    T next(Args... args) { return random.next(args...); }
+};
+
+struct RandomPairTraits {
+    const bool ordered;
+    const bool distinct;
+};
+
+#ifdef JNGEN_DECLARE_ONLY
+extern RandomPairTraits opair, dpair, odpair, dopair;
+#else
+RandomPairTraits opair{true, false};
+RandomPairTraits dpair{false, true};
+RandomPairTraits odpair{true, true};
+RandomPairTraits dopair{true, true};
+#endif
+
+template<>
+struct TypedRandom<std::pair<int, int>> : public BaseTypedRandom {
+    using BaseTypedRandom::BaseTypedRandom;
+
+    std::pair<int, int> next(int n) {
+        return next(n, {false, false});
+    }
+    std::pair<int, int> next(int l, int r) {
+        return next(l, r, {false, false});
+    }
+
+    std::pair<int, int> next(int n, RandomPairTraits traits) {
+        int first = random.next(n);
+        int second;
+        do {
+            second = random.next(n);
+        } while (traits.distinct && first == second);
+        if (traits.ordered && first > second) {
+            std::swap(first, second);
         }
-        if (!(ss >> step)) {
-            return Range(first, last, step);
+        return {first, second};
+    }
+    std::pair<int, int> next(int l, int r, RandomPairTraits traits) {
+        auto res = next(r-l+1, traits);
+        res.first += l;
+        res.second += l;
+        return res;
+    }
+
+private:
+    std::pair<int, int> ordered(std::pair<int, int> pair) const {
+        if (pair.first > pair.second) {
+            std::swap(pair.first, pair.second);
         }
-        return Range(first, last, step);
+        return pair;
     }
 };
 
-} // namespace options
 } // namespace jngen
 
+using jngen::Random;
 
-#include <map>
-#include <sstream>
-#include <string>
-#include <vector>
+using jngen::rnd;
+using jngen::opair;
+using jngen::dpair;
+using jngen::dopair;
+using jngen::odpair;
+
+using jngen::registerGen;
+
+#ifndef JNGEN_DECLARE_ONLY
+#define JNGEN_INCLUDE_RANDOM_INL_H
+#ifndef JNGEN_INCLUDE_RANDOM_INL_H
+#error File "random_inl.h" must not be included directly.
+#endif
 
 namespace jngen {
 
-namespace detail {
+void assertRandomEngineConsistency() {
+    std::mt19937 engine(1234);
+    ENSURE(engine() == 822569775,
+        "std::mt19937 doesn't conform to the C++ standard");
+    ENSURE(engine() == 2137449171,
+        "std::mt19937 doesn't conform to the C++ standard");
+    ENSURE(engine() == 2671936806,
+        "std::mt19937 doesn't conform to the C++ standard");
+}
 
-template<typename T>
-constexpr bool isValidOptionType() {
-    return std::is_same<T, std::string>::value ||
-        (std::is_arithmetic<T>::value && !std::is_same<T, char>::value);
+void assertIntegerSizes() {
+    static_assert(
+        std::numeric_limits<unsigned char>::max() == 255,
+        "max(unsigned char) != 255");
+    static_assert(sizeof(int) == 4, "sizeof(int) != 4");
+    static_assert(sizeof(long long) == 8, "sizeof(long long) != 8");
+    static_assert(
+        sizeof(size_t) == 4 || sizeof(size_t) == 8,
+        "sizeof(size_t) is neither 4 nor 8");
+    static_assert(
+        sizeof(std::size_t) == sizeof(size_t),
+        "sizeof(size_t) != sizeof(std::size_t)");
 }
 
-template<typename T>
-using StringIfCharPtrElseT = typename std::conditional<
-    std::is_same<typename std::decay<T>::type, const char*>::value ||
-        std::is_same<typename std::decay<T>::type, char*>::value,
-    std::string,
-    T>::type;
+void registerGen(int argc, char *argv[], int version) {
+    (void)version; // unused, only for testlib.h compatibility
 
-} // namespace detail
+    std::vector<uint32_t> seed;
+    for (int i = 1; i < argc; ++i) {
+        int startPosition = seed.size();
+        seed.emplace_back();
+        for (char *s = argv[i]; *s; ++s) {
+            ++seed[startPosition];
+            seed.push_back(*s);
+        }
+    }
+    rnd.seed(seed);
+}
 
-struct Index {
-    size_t index;
-    std::string name;
+uint64_t maskForBound(uint64_t bound) {
+    --bound;
+    uint64_t mask = ~0;
+    if ((mask >> 32) >= bound) mask >>= 32;
+    if ((mask >> 16) >= bound) mask >>= 16;
+    if ((mask >> 8 ) >= bound) mask >>= 8 ;
+    if ((mask >> 4 ) >= bound) mask >>= 4 ;
+    if ((mask >> 2 ) >= bound) mask >>= 2 ;
+    if ((mask >> 1 ) >= bound) mask >>= 1 ;
+    return mask;
+}
 
-    Index(size_t index) : index(index) {
-        if (!config.largeOptionIndices) {
-            ensure(
-                index < 32,
-                "Looks like you called getOpt('c'). Consider using "
-                "getOpt(\"c\") or set 'config.largeOptionIndices = true' "
-                "if you indeed have more than 32 options.");
+// base^exp, or 0 if it does not fit into T.
+template<typename T>
+T powerOrZero(T base, int exp) {
+    T result = 1;
+    for (int i = 0; i < exp; ++i) {
+        if (base != 0 && result > static_cast<T>(~T(0)) / base) {
+            return 0;
         }
+        result *= base;
     }
+    return result;
+}
 
-    Index(const std::string& name) : name(name) {
-        ensure(!name.empty(), "Variable name cannot be empty");
+// Largest exp such that base^exp fits into T, base >= 2.
+template<typename T>
+int maxExponent(T base) {
+    int result = 0;
+    for (T power = 1; power <= static_cast<T>(~T(0)) / base; power *= base) {
+        ++result;
     }
+    return result;
+}
 
-    bool isNamed() const {
-        return !name.empty();
+// Integer k-th root of value < n^k, given its estimate in [0, n). n^k must
+// fit into T, so (result + 1)^k never overflows.
+template<typename T>
+T integerRoot(T value, int k, T estimate) {
+    T result = estimate;
+    while (result > 0 && powerOrZero(result, k) > value) {
+        --result;
     }
-};
+    while (powerOrZero<T>(result + 1, k) <= value) {
+        ++result;
+    }
+    return result;
+}
 
-struct VariableMap {
-    std::vector<std::string> positional;
-    std::map<std::string, std::string> named;
+void Random::seed(uint32_t val) {
+    seed_.assign(1, val);
+    scalarSeed_ = true;
+    reseed();
+}
 
-    int count(size_t pos) const {
-        return pos < positional.size();
-    }
+void Random::seed(const std::vector<uint32_t>& seed) {
+    seed_ = seed;
+    scalarSeed_ = false;
+    reseed();
+}
 
-    int count(const std::string& name) const {
-        return named.count(name);
-    }
+void Random::setEngine(RandomEngine engine) {
+    engine_ = engine;
+    reseed();
+}
 
-    std::string operator[](size_t pos) const {
-        if (!count(pos)) {
-            return "";
+void Random::reseed() {
+    if (scalarSeed_) {
+        switch (engine_) {
+        case RandomEngine::Mt19937: mt19937_.seed(seed_[0]); break;
+        case RandomEngine::Xoshiro256: xoshiro256_.seed(seed_[0]); break;
+        case RandomEngine::Pcg64: pcg64_.seed(seed_[0]); break;
+        case RandomEngine::Wyrand: wyrand_.seed(seed_[0]); break;
+        case RandomEngine::Philox: philox_.seed(seed_[0]); break;
+        case RandomEngine::Mt19937_64: mt19937_64_.seed(seed_[0]); break;
         }
-        return positional.at(pos);
-    }
-
-    std::string operator[](const std::string& name) const {
-        if (!count(name)) {
-            return "";
+    } else {
+        std::seed_seq seq(seed_.begin(), seed_.end());
+        switch (engine_) {
+        case RandomEngine::Mt19937: mt19937_.seed(seq); break;
+        case RandomEngine::Xoshiro256: xoshiro256_.seed(seq); break;
+        case RandomEngine::Pcg64: pcg64_.seed(seq); break;
+        case RandomEngine::Wyrand: wyrand_.seed(seq); break;
+        case RandomEngine::Philox: philox_.seed(seq); break;
+        case RandomEngine::Mt19937_64: mt19937_64_.seed(seq); break;
         }
-        return named.at(name);
     }
+}
 
-    int count(const Index& index) const {
-        if (index.isNamed()) {
-            return count(index.name);
-        } else {
-            return count(index.index);
-        }
+uint64_t Random::streamKey() const {
+    if (scalarSeed_) {
+        uint64_t x = seed_[0];
+        return detail::splitmix64(x);
     }
+    std::seed_seq seq(seed_.begin(), seed_.end());
+    return detail::generateSeedWords(seq, 1)[0];
+}
 
-    std::string operator[](const Index& index) const {
+Random Random::makeStream(
+        uint64_t key, uint64_t index, std::vector<uint32_t> seed)
+{
+    // Stream 0 is the one of a generator with the Philox engine selected.
+    // The result is seeded here, so it does not need random_device.
+    Random result{Unseeded{}};
+    result.seed_ = std::move(seed);
+    result.scalarSeed_ = false;
+    result.engine_ = RandomEngine::Philox;
+    result.philox_.seed(key, index + 1);
+    return result;
+}
+
+Random Random::stream(uint64_t index) const {
+    // Reseeding a stream with setEngine uses the parent seed extended with
+    // the stream index.
+    std::vector<uint32_t> seed = seed_;
+    seed.push_back(index >> 32);
+    seed.push_back(static_cast<uint32_t>(index));
+    return makeStream(streamKey(), index, seed);
+}
+
+std::vector<Random> Random::split(size_t count) {
+    uint64_t key = next64();
+    std::vector<Random> result;
+    result.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::vector<uint32_t> seed = {
+            static_cast<uint32_t>(key >> 32),
+            static_cast<uint32_t>(key),
+            static_cast<uint32_t>(i)
+        };
+        result.push_back(makeStream(key, i, seed));
+    }
+    return result;
+}
+
+uint32_t Random::next() {
+    switch (engine_) {
+    case RandomEngine::Xoshiro256: return xoshiro256_.next32();
+    case RandomEngine::Pcg64: return pcg64_.next32();
+    case RandomEngine::Wyrand: return wyrand_.next32();
+    case RandomEngine::Philox: return philox_.next32();
+    case RandomEngine::Mt19937_64: return mt19937_64_.next32();
+    default: return mt19937_.next32();
+    }
+}
+
+uint64_t Random::next64() {
+    switch (engine_) {
+    case RandomEngine::Xoshiro256: return xoshiro256_.next64();
+    case RandomEngine::Pcg64: return pcg64_.next64();
+    case RandomEngine::Wyrand: return wyrand_.next64();
+    case RandomEngine::Philox: return philox_.next64();
+    case RandomEngine::Mt19937_64: return mt19937_64_.next64();
+    default: return mt19937_.next64();
+    }
+}
+
+double Random::nextf() {
+    return (double)next() / std::numeric_limits<uint32_t>::max();
+}
+
+uint32_t Random::uniform32(uint32_t bound) {
+    if (bound == 0) {
+        return next();
+    }
+#ifdef JNGEN_FAST_RANDOM
+    return next() % bound;
+#else
+    switch (engine_) {
+    case RandomEngine::Xoshiro256:
+        return detail::uniformLemire32(xoshiro256_, bound);
+    case RandomEngine::Pcg64:
+        return detail::uniformLemire32(pcg64_, bound);
+    case RandomEngine::Wyrand:
+        return detail::uniformLemire32(wyrand_, bound);
+    case RandomEngine::Philox:
+        return detail::uniformLemire32(philox_, bound);
+    case RandomEngine::Mt19937_64:
+        return detail::uniformLemire32(mt19937_64_, bound);
+    default:
+        return detail::uniformMasked32(mt19937_, bound, maskForBound(bound));
+    }
+#endif
+}
+
+uint64_t Random::uniform64(uint64_t bound) {
+    if (bound == 0) {
+        return next64();
+    }
+#ifdef JNGEN_FAST_RANDOM
+    return next64() % bound;
+#else
+    switch (engine_) {
+    case RandomEngine::Xoshiro256:
+        return detail::uniformLemire64(xoshiro256_, bound);
+    case RandomEngine::Pcg64:
+        return detail::uniformLemire64(pcg64_, bound);
+    case RandomEngine::Wyrand:
+        return detail::uniformLemire64(wyrand_, bound);
+    case RandomEngine::Philox:
+        return detail::uniformLemire64(philox_, bound);
+    case RandomEngine::Mt19937_64:
+        return detail::uniformLemire64(mt19937_64_, bound);
+    default:
+        return detail::uniformMasked64(mt19937_, bound, maskForBound(bound));
+    }
+#endif
+}
+
+int Random::next(int n) {
+    ensure(n > 0);
+    return uniform32(n);
+}
+
+long long Random::next(long long n) {
+    ensure(n > 0);
+    return uniform64(n);
+}
+
+size_t Random::next(size_t n) {
+    ensure(n > 0);
+    return uniform64(n);
+}
+
+double Random::next(double n) {
+    ensure(n >= 0);
+    return nextf() * n;
+}
+
+int Random::next(int l, int r) {
+    ensure(l <= r);
+    uint32_t n = static_cast<uint32_t>(r) - l + 1;
+    return static_cast<uint32_t>(l) + uniform32(n);
+}
+
+long long Random::next(long long l, long long r) {
+    ensure(l <= r);
+    uint64_t n = static_cast<uint64_t>(r) - l + 1;
+    return static_cast<uint64_t>(l) + uniform64(n);
+}
+
+size_t Random::next(size_t l, size_t r) {
+    ensure(l <= r);
+    uint64_t n = static_cast<uint64_t>(r) - l + 1;
+    return l + uniform64(n);
+}
+
+double Random::next(double l, double r) {
+    ensure(l <= r);
+    return l + next(r-l);
+}
+
+void Random::fill(int* out, size_t count, int n) {
+    ensure(n > 0);
+    fillUniform32(out, count, n, 0);
+}
+
+void Random::fill(long long* out, size_t count, long long n) {
+    ensure(n > 0);
+    fillUniform64(out, count, n, 0);
+}
+
+void Random::fill(size_t* out, size_t count, size_t n) {
+    ensure(n > 0);
+    fillUniform64(out, count, n, 0);
+}
+
+void Random::fill(double* out, size_t count, double n) {
+    ensure(n >= 0);
+    fill(out, count, 0.0, n);
+}
+
+void Random::fill(int* out, size_t count, int l, int r) {
+    ensure(l <= r);
+    uint32_t n = static_cast<uint32_t>(r) - l + 1;
+    fillUniform32(out, count, n, l);
+}
+
+void Random::fill(long long* out, size_t count, long long l, long long r) {
+    ensure(l <= r);
+    uint64_t n = static_cast<uint64_t>(r) - l + 1;
+    fillUniform64(out, count, n, l);
+}
+
+void Random::fill(size_t* out, size_t count, size_t l, size_t r) {
+    ensure(l <= r);
+    uint64_t n = static_cast<uint64_t>(r) - l + 1;
+    fillUniform64(out, count, n, l);
+}
+
+void Random::fill(double* out, size_t count, double l, double r) {
+    ensure(l <= r);
+    switch (engine_) {
+    case RandomEngine::Xoshiro256:
+        fillReal(xoshiro256_, out, count, l, r - l); break;
+    case RandomEngine::Pcg64:
+        fillReal(pcg64_, out, count, l, r - l); break;
+    case RandomEngine::Wyrand:
+        fillReal(wyrand_, out, count, l, r - l); break;
+    case RandomEngine::Philox:
+        fillReal(philox_, out, count, l, r - l); break;
+    case RandomEngine::Mt19937_64:
+        fillReal(mt19937_64_, out, count, l, r - l); break;
+    default:
+        fillReal(mt19937_, out, count, l, r - l); break;
+    }
+}
+
+void Random::fill(uint32_t* out, size_t count) {
+    fillUniform32(out, count, 0, 0);
+}
+
+void Random::fill(uint64_t* out, size_t count) {
+    fillUniform64(out, count, 0, 0);
+}
+
+int Random::wnext(int n, int w) {
+    ensure(n > 0);
+    uint64_t offset;
+    if (config.fastWnext && w != 0 && fastWnext(n, w, offset)) {
+        return offset;
+    }
+    if (std::abs(w) <= WNEXT_LIMIT) {
+        return smallWnext<int>(w, n);
+    } else {
+        double t = realWnext(w);
+        return n * t;
+    }
+}
+
+long long Random::wnext(long long n, int w) {
+    ensure(n > 0);
+    uint64_t offset;
+    if (config.fastWnext && w != 0 && fastWnext(n, w, offset)) {
+        return offset;
+    }
+    if (std::abs(w) <= WNEXT_LIMIT) {
+        return smallWnext<long long>(w, n);
+    } else {
+        return n * realWnext(w);
+    }
+}
+
+size_t Random::wnext(size_t n, int w) {
+    ensure(n > 0);
+    uint64_t offset;
+    if (config.fastWnext && w != 0 && fastWnext(n, w, offset)) {
+        return offset;
+    }
+    if (std::abs(w) <= WNEXT_LIMIT) {
+        return smallWnext<size_t>(w, n);
+    } else {
+        return n * realWnext(w);
+    }
+}
+
+double Random::wnext(double n, int w) {
+    ensure(n >= 0);
+    if (std::abs(w) <= WNEXT_LIMIT) {
+        return smallWnext<double>(w, n);
+    } else {
+        return realWnext(w) * n;
+    }
+}
+
+int Random::wnext(int l, int r, int w) {
+    ensure(l <= r);
+    uint32_t n = static_cast<uint32_t>(r) - l + 1;
+    uint64_t offset;
+    if (config.fastWnext && w != 0 && n != 0 && fastWnext(n, w, offset)) {
+        return static_cast<uint32_t>(l) + offset;
+    }
+    if (std::abs(w) <= WNEXT_LIMIT) {
+        return smallWnext<int>(w, l, r);
+    } else {
+        return l + static_cast<uint32_t>(n * realWnext(w));
+    }
+}
+
+long long Random::wnext(long long l, long long r, int w) {
+    ensure(l <= r);
+    uint64_t n = static_cast<uint64_t>(r) - l + 1;
+    uint64_t offset;
+    if (config.fastWnext && w != 0 && n != 0 && fastWnext(n, w, offset)) {
+        return l + offset;
+    }
+    if (std::abs(w) <= WNEXT_LIMIT) {
+        return smallWnext<long long>(w, l, r);
+    } else {
+        return l + static_cast<uint64_t>(n * realWnext(w));
+    }
+}
+
+size_t Random::wnext(size_t l, size_t r, int w) {
+    ensure(l <= r);
+    uint64_t n = static_cast<uint64_t>(r) - l + 1;
+    uint64_t offset;
+    if (config.fastWnext && w != 0 && n != 0 && fastWnext(n, w, offset)) {
+        return l + offset;
+    }
+    if (std::abs(w) <= WNEXT_LIMIT) {
+        return smallWnext<size_t>(w, l, r);
+    } else {
+        return l + static_cast<uint64_t>(n * realWnext(w));
+    }
+}
+
+double Random::wnext(double l, double r, int w) {
+    ensure(l <= r);
+    if (std::abs(w) <= WNEXT_LIMIT) {
+        return smallWnext<double>(w, l, r);
+    } else {
+        return realWnext(w) * (r - l) + l;
+    }
+}
+
+bool Random::fastWnext(uint64_t n, int w, uint64_t& result) {
+    if (n == 1) {
+        result = 0;
+        return true;
+    }
+    // The maximum of k values is the maximum over groups of them, each group
+    // as large as maxOfUniform allows.
+    int k = std::abs(w) + 1;
+#if defined(__SIZEOF_INT128__)
+    int group = maxExponent<unsigned __int128>(n);
+#else
+    int group = maxExponent<uint64_t>(n);
+#endif
+    if (group < k && std::abs(w) > WNEXT_LIMIT) {
+        return false;
+    }
+    result = 0;
+    for (int left = k; left > 0; left -= group) {
+        result = std::max(result, maxOfUniform(n, std::min(left, group)));
+    }
+    if (w < 0) {
+        result = n - 1 - result;
+    }
+    return true;
+}
+
+uint64_t Random::maxOfUniform(uint64_t n, int k) {
+    // The maximum of k values from [0, n) does not exceed x with probability
+    // ((x + 1) / n)^k, so it is the integer k-th root of a uniform value from
+    // [0, n^k).
+    uint64_t total = powerOrZero(n, k);
+    if (total != 0) {
+        uint64_t value = uniform64(total);
+        uint64_t estimate = std::pow(static_cast<double>(value), 1.0 / k);
+        return integerRoot(value, k, std::min(estimate, n - 1));
+    }
+#if defined(__SIZEOF_INT128__)
+    typedef unsigned __int128 uint128;
+    uint128 total128 = powerOrZero<uint128>(n, k);
+    // Uniform value from [0, n^k) by rejection. Only the upper half is
+    // masked, so at least half of the draws are accepted.
+    uint64_t mask = maskForBound(
+        static_cast<uint64_t>((total128 - 1) >> 64) + 1);
+    uint128 value;
+    do {
+        value = static_cast<uint128>(next64() & mask) << 64;
+        value |= next64();
+    } while (value >= total128);
+    long double estimate = std::pow(
+        static_cast<long double>(value), 1.0L / k);
+    return static_cast<uint64_t>(integerRoot<uint128>(value, k,
+        estimate < n ? static_cast<uint64_t>(estimate) : n - 1));
+#else
+    ENSURE(false, "maxOfUniform: n^k does not fit into 64 bits");
+    return 0;
+#endif
+}
+
+std::string Random::next(const std::string& pattern) {
+    return next(Pattern(pattern));
+}
+
+std::string Random::next(const Pattern& pattern) {
+    std::string result;
+    next(pattern, result);
+    return result;
+}
+
+void Random::next(const Pattern& pattern, std::string& out) {
+    pattern.next([this](int n) { return next(n); }, out);
+}
+
+} // namespace jngen
+#undef JNGEN_INCLUDE_RANDOM_INL_H
+#endif // JNGEN_DECLARE_ONLY
+
+
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+namespace jngen {
+
+// Samples indices with probabilities proportional to fixed weights in O(1)
+// per sample after O(n) preprocessing (Walker's alias method, Vose's
+// construction). Integer weights are handled exactly.
+class DiscreteDistribution {
+public:
+    DiscreteDistribution() {}
+
+    template<typename Numeric>
+    DiscreteDistribution(const std::vector<Numeric>& weights) {
+        build(weights, std::is_integral<Numeric>{});
+    }
+
+    template<typename Numeric>
+    DiscreteDistribution(const std::initializer_list<Numeric>& weights) :
+            DiscreteDistribution(std::vector<Numeric>(weights))
+    {  }
+
+    size_t size() const { return alias_.size(); }
+
+    size_t next() const { return next(rnd); }
+    size_t next(Random& random) const;
+
+private:
+    template<typename Numeric>
+    void build(const std::vector<Numeric>& weights, std::true_type);
+    template<typename Numeric>
+    void build(const std::vector<Numeric>& weights, std::false_type);
+
+    // Splits the scaled weights into buckets of capacity |total|: bucket i
+    // keeps index i with probability threshold[i] / total and yields
+    // alias[i] otherwise.
+    template<typename W>
+    void buildTables(std::vector<W> scaled, W total, std::vector<W>& threshold);
+
+    bool exact_ = true;
+    uint64_t total_ = 0;
+    std::vector<uint64_t> threshold_;
+    std::vector<double> probability_;
+    std::vector<size_t> alias_;
+};
+
+// Samples indices proportionally to integer weights which may change
+// between samples. Sampling and updates take O(log n) (Fenwick tree).
+// Yields exactly the same indices as rnd.nextByDistribution(weights) with
+// current weights.
+class DynamicDistribution {
+public:
+    DynamicDistribution() {}
+
+    template<typename Numeric>
+    DynamicDistribution(const std::vector<Numeric>& weights) {
+        static_assert(
+            std::is_integral<Numeric>::value,
+            "DynamicDistribution supports only integer weights");
+        std::vector<long long> w(weights.begin(), weights.end());
+        init(w);
+    }
+
+    size_t size() const { return weights_.size(); }
+    long long total() const { return total_; }
+    long long weight(size_t index) const { return weights_.at(index); }
+
+    void add(size_t index, long long delta);
+    void set(size_t index, long long weight);
+
+    size_t next() const { return next(rnd); }
+    size_t next(Random& random) const;
+
+private:
+    void init(const std::vector<long long>& weights);
+
+    std::vector<long long> weights_;
+    std::vector<long long> tree_;
+    long long total_ = 0;
+};
+
+template<typename W>
+void DiscreteDistribution::buildTables(
+        std::vector<W> scaled, W total, std::vector<W>& threshold)
+{
+    size_t n = scaled.size();
+    threshold.assign(n, total);
+    alias_.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        alias_[i] = i;
+    }
+
+    std::vector<size_t> small, large;
+    for (size_t i = 0; i < n; ++i) {
+        (scaled[i] < total ? small : large).push_back(i);
+    }
+    while (!small.empty() && !large.empty()) {
+        size_t less = small.back();
+        small.pop_back();
+        size_t more = large.back();
+
+        threshold[less] = scaled[less];
+        alias_[less] = more;
+        scaled[more] -= total - scaled[less];
+        if (scaled[more] < total) {
+            large.pop_back();
+            small.push_back(more);
+        }
+    }
+    // Remaining buckets are full, up to rounding for floating weights.
+}
+
+template<typename Numeric>
+void DiscreteDistribution::build(
+        const std::vector<Numeric>& weights, std::true_type)
+{
+    ensure(!weights.empty(), "Cannot sample by empty distribution");
+    uint64_t total = 0;
+    for (auto w: weights) {
+        ensure(w >= 0, "Weights must be non-negative");
+        total += static_cast<uint64_t>(w);
+    }
+    ensure(total > 0, "Sum of weights must be positive");
+    size_t n = weights.size();
+    ensure(
+        total <= std::numeric_limits<uint64_t>::max() / n,
+        "Sum of weights is too large");
+
+    std::vector<uint64_t> scaled;
+    for (auto w: weights) {
+        scaled.push_back(static_cast<uint64_t>(w) * n);
+    }
+    exact_ = true;
+    total_ = total;
+    buildTables(scaled, total, threshold_);
+}
+
+template<typename Numeric>
+void DiscreteDistribution::build(
+        const std::vector<Numeric>& weights, std::false_type)
+{
+    ensure(!weights.empty(), "Cannot sample by empty distribution");
+    double total = 0;
+    for (auto w: weights) {
+        ensure(w >= 0, "Weights must be non-negative");
+        total += w;
+    }
+    ensure(total > 0, "Sum of weights must be positive");
+    size_t n = weights.size();
+
+    std::vector<double> scaled;
+    for (auto w: weights) {
+        scaled.push_back(w * n / total);
+    }
+    exact_ = false;
+    buildTables(scaled, 1.0, probability_);
+}
+
+} // namespace jngen
+
+using jngen::DiscreteDistribution;
+using jngen::DynamicDistribution;
+
+#ifndef JNGEN_DECLARE_ONLY
+#define JNGEN_INCLUDE_DISTRIBUTION_INL_H
+#ifndef JNGEN_INCLUDE_DISTRIBUTION_INL_H
+#error File "distribution_inl.h" must not be included directly.
+#endif
+
+namespace jngen {
+
+size_t DiscreteDistribution::next(Random& random) const {
+    ensure(!alias_.empty(), "Cannot sample by empty distribution");
+    size_t bucket = random.next(alias_.size());
+    bool keep;
+    if (exact_) {
+        keep = random.next(static_cast<size_t>(total_)) < threshold_[bucket];
+    } else {
+        keep = random.nextf() < probability_[bucket];
+    }
+    return keep ? bucket : alias_[bucket];
+}
+
+void DynamicDistribution::init(const std::vector<long long>& weights) {
+    weights_.assign(weights.size(), 0);
+    tree_.assign(weights.size() + 1, 0);
+    total_ = 0;
+    for (size_t i = 0; i < weights.size(); ++i) {
+        add(i, weights[i]);
+    }
+}
+
+void DynamicDistribution::add(size_t index, long long delta) {
+    ensure(index < weights_.size(), "Index is out of range");
+    ensure(weights_[index] + delta >= 0, "Weights must be non-negative");
+    weights_[index] += delta;
+    total_ += delta;
+    for (size_t i = index + 1; i < tree_.size(); i += i & -i) {
+        tree_[i] += delta;
+    }
+}
+
+void DynamicDistribution::set(size_t index, long long weight) {
+    ensure(index < weights_.size(), "Index is out of range");
+    add(index, weight - weights_[index]);
+}
+
+size_t DynamicDistribution::next(Random& random) const {
+    ensure(total_ > 0, "Sum of weights must be positive");
+    long long x = random.next(total_);
+
+    // Find the first index whose prefix sum exceeds x.
+    size_t pos = 0;
+    size_t step = 1;
+    while (step * 2 < tree_.size()) {
+        step *= 2;
+    }
+    for (; step > 0; step /= 2) {
+        if (pos + step < tree_.size() && tree_[pos + step] <= x) {
+            pos += step;
+            x -= tree_[pos];
+        }
+    }
+    return pos;
+}
+
+} // namespace jngen
+#undef JNGEN_INCLUDE_DISTRIBUTION_INL_H
+#endif // JNGEN_DECLARE_ONLY
+
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace jngen {
+namespace detail {
+
+// Calls f(i) for all i in [0, count) using up to config.threads threads
+// (including the calling one). The first exception thrown by f is rethrown
+// once all threads are finished; the remaining indices are skipped.
+template<typename F>
+void parallelFor(size_t count, F f) {
+    size_t threads = std::min<size_t>(std::max(config.threads, 1), count);
+    if (threads <= 1) {
+        for (size_t i = 0; i < count; ++i) {
+            f(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> nextIndex(0);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    auto worker = [&]() {
+        while (true) {
+            size_t i = nextIndex++;
+            if (i >= count) {
+                return;
+            }
+            try {
+                f(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                nextIndex = count;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads; ++i) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread: pool) {
+        thread.join();
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+// Parallel generators split their output into chunks of this size, each
+// filled from its own stream. The output thus depends on the seed only, not
+// on the number of threads.
+constexpr size_t PARALLEL_CHUNK_SIZE = 1 << 16;
+
+// Calls f(random, begin, count) for consecutive chunks of [0, size), where
+// |random| is a stream obtained with rnd.split.
+template<typename F>
+void generateInChunks(size_t size, F f) {
+    size_t chunks = (size + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+    auto streams = rnd.split(chunks);
+    parallelFor(chunks, [&](size_t chunk) {
+        size_t begin = chunk * PARALLEL_CHUNK_SIZE;
+        f(streams[chunk], begin,
+            std::min(PARALLEL_CHUNK_SIZE, size - begin));
+    });
+}
+
+// Calls f(begin, end) for consecutive chunks [begin, end) of [0, size) using
+// up to config.threads threads.
+template<typename F>
+void parallelForChunks(size_t size, F f) {
+    size_t chunks = (size + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+    parallelFor(chunks, [&](size_t chunk) {
+        size_t begin = chunk * PARALLEL_CHUNK_SIZE;
+        f(begin, std::min(size, begin + PARALLEL_CHUNK_SIZE));
+    });
+}
+
+} // namespace detail
+} // namespace jngen
+
+
+#include <cstdint>
+#include <vector>
+
+namespace jngen {
+namespace detail {
+
+struct KeyIndex {
+    uint64_t key;
+    int index;
+};
+
+// Sorts |items| by key, keeping the order of items with equal keys, given
+// that all keys are less than 2^bits. Uses up to config.threads threads; the
+// result, being the only stable order, does not depend on their number.
+void sortByKey(std::vector<KeyIndex>& items, int bits);
+
+// Returns the number of bits needed to store values from [0, n).
+int bitWidth(uint64_t n);
+
+} // namespace detail
+} // namespace jngen
+
+#ifndef JNGEN_DECLARE_ONLY
+#define JNGEN_INCLUDE_RADIX_SORT_INL_H
+#ifndef JNGEN_INCLUDE_RADIX_SORT_INL_H
+#error File "radix_sort_inl.h" must not be included directly.
+#endif
+
+#include <algorithm>
+
+namespace jngen {
+namespace detail {
+
+const int RADIX_BITS = 11;
+
+// One LSD pass: stable distribution of [begin, end) to |out| by the digit at
+// |shift|.
+void radixPass(
+    const KeyIndex* begin, const KeyIndex* end, KeyIndex* out, int shift)
+{
+    const uint64_t mask = (1 << RADIX_BITS) - 1;
+    std::vector<size_t> position(mask + 1);
+    for (auto it = begin; it != end; ++it) {
+        ++position[(it->key >> shift) & mask];
+    }
+    size_t sum = 0;
+    for (auto& x: position) {
+        size_t count = x;
+        x = sum;
+        sum += count;
+    }
+    for (auto it = begin; it != end; ++it) {
+        out[position[(it->key >> shift) & mask]++] = *it;
+    }
+}
+
+void sortByKey(std::vector<KeyIndex>& items, int bits) {
+    auto byKey = [](const KeyIndex& lhs, const KeyIndex& rhs) {
+        return lhs.key < rhs.key;
+    };
+    if (items.size() < 256 || bits == 0) {
+        std::stable_sort(items.begin(), items.end(), byKey);
+        return;
+    }
+
+    std::vector<KeyIndex> buffer(items.size());
+    if (config.threads <= 1 || items.size() <= PARALLEL_CHUNK_SIZE) {
+        for (int shift = 0; shift < bits; shift += RADIX_BITS) {
+            radixPass(
+                items.data(), items.data() + items.size(),
+                buffer.data(), shift);
+            items.swap(buffer);
+        }
+        return;
+    }
+
+    // The top digit splits the items into buckets, each chunk of the input
+    // distributing its items to its own part of every bucket. Then buckets
+    // are sorted by the remaining digits independently.
+    int topBits = std::min(bits, RADIX_BITS);
+    int shift = bits - topBits;
+    size_t buckets = size_t(1) << topBits;
+    size_t size = items.size();
+    size_t chunks = (size + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+
+    std::vector<size_t> position(chunks * buckets);
+    parallelFor(chunks, [&](size_t chunk) {
+        size_t* count = &position[chunk * buckets];
+        size_t end = std::min(size, (chunk + 1) * PARALLEL_CHUNK_SIZE);
+        for (size_t i = chunk * PARALLEL_CHUNK_SIZE; i < end; ++i) {
+            ++count[items[i].key >> shift];
+        }
+    });
+
+    std::vector<size_t> bucketBegin(buckets + 1);
+    size_t sum = 0;
+    for (size_t bucket = 0; bucket < buckets; ++bucket) {
+        bucketBegin[bucket] = sum;
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            size_t count = position[chunk * buckets + bucket];
+            position[chunk * buckets + bucket] = sum;
+            sum += count;
+        }
+    }
+    bucketBegin[buckets] = sum;
+
+    parallelFor(chunks, [&](size_t chunk) {
+        size_t* next = &position[chunk * buckets];
+        size_t end = std::min(size, (chunk + 1) * PARALLEL_CHUNK_SIZE);
+        for (size_t i = chunk * PARALLEL_CHUNK_SIZE; i < end; ++i) {
+            buffer[next[items[i].key >> shift]++] = items[i];
+        }
+    });
+
+    // All buckets take the same number of passes, so the sorted items end up
+    // in the same array.
+    int passes = (shift + RADIX_BITS - 1) / RADIX_BITS;
+    parallelFor(buckets, [&](size_t bucket) {
+        KeyIndex* from = buffer.data() + bucketBegin[bucket];
+        KeyIndex* to = items.data() + bucketBegin[bucket];
+        size_t count = bucketBegin[bucket + 1] - bucketBegin[bucket];
+        for (int pass = 0; pass < passes; ++pass) {
+            radixPass(from, from + count, to, pass * RADIX_BITS);
+            std::swap(from, to);
+        }
+    });
+    if (passes % 2 == 0) {
+        items.swap(buffer);
+    }
+}
+
+int bitWidth(uint64_t n) {
+    int bits = 0;
+    while (bits < 64 && (uint64_t(1) << bits) < n) {
+        ++bits;
+    }
+    return bits;
+}
+
+} // namespace detail
+} // namespace jngen
+#undef JNGEN_INCLUDE_RADIX_SORT_INL_H
+#endif // JNGEN_DECLARE_ONLY
+
+
+#include <iterator>
+#include <sstream>
+#include <string>
+
+namespace jngen {
+namespace options {
+
+struct Range {
+    int first;
+    int last;
+    int step;
+
+    Range(int first, int last, int step = 1) :
+        first(first),
+        last(last),
+        step(step)
+    {
+        ensure(first <= last);
+        ensure(step > 0);
+    }
+
+    class iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = int;
+        using reference = const int&;
+        using pointer = const int*;
+        using difference_type = int;
+
+        iterator(int value, int step, int last) :
+            value_(value),
+            step_(step),
+            last_(last)
+        {  }
+
+        iterator& operator++() {
+            ensure(value_ <= last_, "Cannot increment past-the-end iterator");
+            value_ += step_;
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        int operator*() const {
+            ensure(value_ <= last_, "Cannot dereference past-the-end iterator");
+            return value_;
+        }
+
+        bool operator==(const iterator& other) const {
+            if (value_ <= last_) {
+                return value_ == other.value_;
+            }
+            return other.value_ > last_;
+        }
+
+        bool operator!=(const iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        int value_;
+        int step_;
+        int last_;
+    };
+
+    iterator begin() const {
+        return { first, step, last };
+    }
+
+    iterator end() const {
+        return { last + 1, step, last };
+    }
+
+    static Range fromString(std::string s) {
+        for (char& c: s) {
+            ensure(c != ' ', "No spaces allowed in range description");
+            if (c == ':') {
+                c = ' ';
+            }
+        }
+
+        std::istringstream ss(s);
+        int first = 1;
+        int last = std::numeric_limits<int>::max() - 1;
+        int step = 1;
+        if (!(ss >> first)) {
+            ensure(false, "Failed to parse range");
+        }
+        if (!(ss >> last)) {
+            return Range(first, last, step);
+        }
+        if (!(ss >> step)) {
+            return Range(first, last, step);
+        }
+        return Range(first, last, step);
+    }
+};
+
+} // namespace options
+} // namespace jngen
+
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace jngen {
+
+namespace detail {
+
+template<typename T>
+constexpr bool isValidOptionType() {
+    return std::is_same<T, std::string>::value ||
+        (std::is_arithmetic<T>::value && !std::is_same<T, char>::value);
+}
+
+template<typename T>
+using StringIfCharPtrElseT = typename std::conditional<
+    std::is_same<typename std::decay<T>::type, const char*>::value ||
+        std::is_same<typename std::decay<T>::type, char*>::value,
+    std::string,
+    T>::type;
+
+} // namespace detail
+
+struct Index {
+    size_t index;
+    std::string name;
+
+    Index(size_t index) : index(index) {
+        if (!config.largeOptionIndices) {
+            ensure(
+                index < 32,
+                "Looks like you called getOpt('c'). Consider using "
+                "getOpt(\"c\") or set 'config.largeOptionIndices = true' "
+                "if you indeed have more than 32 options.");
+        }
+    }
+
+    Index(const std::string& name) : name(name) {
+        ensure(!name.empty(), "Variable name cannot be empty");
+    }
+
+    bool isNamed() const {
+        return !name.empty();
+    }
+};
+
+struct VariableMap {
+    std::vector<std::string> positional;
+    std::map<std::string, std::string> named;
+
+    int count(size_t pos) const {
+        return pos < positional.size();
+    }
+
+    int count(const std::string& name) const {
+        return named.count(name);
+    }
+
+    std::string operator[](size_t pos) const {
+        if (!count(pos)) {
+            return "";
+        }
+        return positional.at(pos);
+    }
+
+    std::string operator[](const std::string& name) const {
+        if (!count(name)) {
+            return "";
+        }
+        return named.at(name);
+    }
+
+    int count(const Index& index) const {
+        if (index.isNamed()) {
+            return count(index.name);
+        } else {
+            return count(index.index);
+        }
+    }
+
+    std::string operator[](const Index& index) const {
         if (index.isNamed()) {
             return (*this)[index.name];
         } else {
-            return (*this)[index.index];
+            return (*this)[index.index];
+        }
+    }
+
+    void assertExistence(const Index& index) const {
+        if (count(index)) {
+            return;
+        }
+        if (index.isNamed()) {
+            ensure(false, format(
+                    "There is no variable with name '%s'", index.name.c_str()));
+        } else {
+            ensure(false, format(
+                    "There is no variable with index %d", index.index));
+        }
+    }
+
+    bool initialized = false;
+};
+
+template<typename T>
+class PendingVariable {
+public:
+    explicit PendingVariable(std::string value) :
+        value_(std::move(value))
+    {  }
+
+    PendingVariable(std::string value, T defaultValue) :
+        value_(std::move(value)),
+        default_(std::move(defaultValue))
+    {  }
+
+    explicit PendingVariable(std::nullptr_t, T defaultValue) :
+        valid_(false),
+        default_(std::move(defaultValue))
+    {  }
+
+    // We need this check in order to make the following work:
+    // string s = getOpt(0);
+    // s = getOpt(0);
+    // Weird things happen if we allow all kind of casts. See
+    // https://stackoverflow.com/questions/46740341
+    template<
+        typename U,
+        typename std::enable_if<
+            detail::isValidOptionType<U>()>::type* = nullptr>
+    operator U() const
+    {
+        if (!valid_) {
+            return static_cast<U>(default_);
+        }
+
+        std::istringstream ss(value_);
+        U t;
+        if (ss >> t) {
+            return t;
+        } else {
+            ensure(
+                false,
+                format(
+                    "Cannot parse option. Raw value: '%s'",
+                    value_.c_str()));
+        }
+    }
+
+    // TODO: getOpt operators, like getOpt("n") == 100
+
+private:
+    bool valid_ = true;
+    std::string value_;
+    T default_;
+};
+
+template<>
+class PendingVariable<void> {
+public:
+    explicit PendingVariable(std::string value) :
+        value_(std::move(value))
+    {  }
+
+    // We need this check in order to make the following work:
+    // string s = getOpt(0);
+    // s = getOpt(0);
+    // Weird things happen if we allow all kind of casts. See
+    // https://stackoverflow.com/questions/46740341
+    template<
+        typename U,
+        typename std::enable_if<
+            detail::isValidOptionType<U>()>::type* = nullptr>
+    operator U() const
+    {
+        std::istringstream ss(value_);
+        U t;
+        if (ss >> t) {
+            return t;
+        } else {
+            ensure(
+                false,
+                format(
+                    "Cannot parse option. Raw value: '%s'",
+                    value_.c_str()));
+        }
+    }
+
+private:
+    std::string value_;
+};
+
+// TODO: think about seed as a last argument
+inline VariableMap parseArguments(const std::vector<std::string>& args) {
+    VariableMap result;
+
+    auto setNamedVar = [&result](
+            const std::string& name,
+            const std::string& value)
+    {
+        ensure(
+            !result.count(value),
+            "Named arguments must have distinct names");
+        result.named[name] = value;
+    };
+
+    std::string pendingVarName;
+
+    for (const std::string& s: args) {
+        if (s == "-") {
+            continue;
+        }
+        if (s == "--") {
+            break;
+        }
+
+        if (s[0] != '-') {
+            if (!pendingVarName.empty()) {
+                setNamedVar(pendingVarName, s);
+                pendingVarName = "";
+            } else {
+                result.positional.push_back(s);
+            }
+            continue;
+        }
+
+        if (!pendingVarName.empty()) {
+            result.named[pendingVarName] = "1";
+            pendingVarName = "";
+        }
+
+        std::string name;
+        std::string value;
+        bool foundEq = false;
+        for (char c: s.substr(1)) {
+            if (!foundEq && c == '=') {
+                foundEq = true;
+            } else {
+                if (foundEq) {
+                    value += c;
+                } else {
+                    name += c;
+                }
+            }
+        }
+        if (foundEq) {
+            setNamedVar(name, value);
+        } else {
+            pendingVarName = name;
+        }
+
+        setNamedVar(name, value);
+    }
+
+    if (!pendingVarName.empty()) {
+        result.named[pendingVarName] = "1";
+    }
+
+    result.initialized = true;
+    return result;
+}
+
+JNGEN_EXTERN VariableMap vmap;
+
+namespace detail {
+
+inline PendingVariable<void> getOpt(const Index& index) {
+    ensure(
+        vmap.initialized,
+        "parseArgs(args, argv) must be called before getOpt(...)");
+    vmap.assertExistence(index);
+    return PendingVariable<void>(vmap[index]);
+}
+
+template<typename T, typename U = detail::StringIfCharPtrElseT<T>>
+PendingVariable<U> getOpt(const Index& index, const T& defaultValue) {
+    ensure(
+        vmap.initialized,
+        "parseArgs(args, argv) must be called before getOpt(...)");
+    if (vmap.count(index)) {
+        return PendingVariable<U>(vmap[index], U{defaultValue});
+    } else {
+        return PendingVariable<U>(nullptr, U{defaultValue});
+    }
+}
+
+inline bool hasOpt(const Index& index) {
+    return vmap.count(index);
+}
+
+template<typename T>
+bool readVariable(const std::string& value, T& var) {
+    std::istringstream ss(value);
+
+    T t;
+    if (ss >> t) {
+        var = t;
+        return true;
+    }
+    return false;
+}
+
+inline int getNamedImpl(std::vector<std::string>::const_iterator) { return 0; }
+
+template<typename T, typename ... Args>
+int getNamedImpl(
+    std::vector<std::string>::const_iterator it, T& var, Args&... args)
+{
+    T value;
+    int res = 0;
+    if (readVariable(vmap[*it], value)) {
+        var = value;
+        ++res;
+    }
+    res += getNamedImpl(++it, args...);
+    return res;
+}
+
+inline int getPositionalImpl(size_t) { return 0; }
+
+template<typename T, typename ... Args>
+int getPositionalImpl(size_t index, T& var, Args&... args) {
+    T value;
+    int res = 0;
+    if (readVariable(vmap[index], value)) {
+        var = value;
+        ++res;
+    }
+    res += getPositionalImpl(index + 1, args...);
+    return res;
+}
+
+} // namespace detail
+
+template<typename ... Args>
+int doGetNamed(const std::string& names, Args&... args) {
+    ensure(
+        vmap.initialized,
+        "parseArgs(args, argv) must be called before getNamed(...)");
+
+    auto namesSplit = util::split(names, ',');
+
+    ENSURE(
+        namesSplit.size() == sizeof...(args),
+        "Number of names is not equal to number of variables");
+
+    return detail::getNamedImpl(namesSplit.begin(), args...);
+}
+
+template<typename ... Args>
+int getPositional(Args&... args) {
+    ensure(
+        vmap.initialized,
+        "parseArgs(args, argv) must be called before getPositional(...)");
+
+    return detail::getPositionalImpl(0, args...);
+}
+
+inline void parseArgs(int argc, char *argv[]) {
+    vmap = parseArguments(std::vector<std::string>(argv + 1, argv + argc));
+}
+
+inline PendingVariable<void> getOpt(size_t index) {
+    return detail::getOpt(Index(index));
+}
+
+inline PendingVariable<void> getOpt(const std::string& name) {
+    return detail::getOpt(Index(name));
+}
+
+template<typename T, typename U = detail::StringIfCharPtrElseT<T>>
+PendingVariable<U> getOpt(size_t index, const T& defaultValue) {
+    return detail::getOpt(Index(index), defaultValue);
+}
+
+template<typename T, typename U = detail::StringIfCharPtrElseT<T>>
+PendingVariable<U> getOpt(const std::string& name, const T& defaultValue) {
+    return detail::getOpt(Index(name), defaultValue);
+}
+
+inline bool hasOpt(size_t index) {
+    return vmap.count(index);
+}
+
+inline bool hasOpt(const std::string& name) {
+    return vmap.count(name);
+}
+
+inline options::Range parseRange(const std::string& value) {
+    return options::Range::fromString(value);
+
+}
+
+} // namespace jngen
+
+using jngen::parseArgs;
+using jngen::getOpt;
+using jngen::hasOpt;
+using jngen::parseRange;
+
+using jngen::getPositional;
+
+#define getNamed(...) ::jngen::doGetNamed(#__VA_ARGS__, __VA_ARGS__)
+
+
+#include <iostream>
+#include <type_traits>
+
+namespace jngen {
+
+template<int N> struct PTag : PTag<N-1> {};
+template<> struct PTag<0> {};
+struct PTagMax : PTag<20> {};
+
+struct OutputModifier {
+    int addition = 0;
+    bool printN = false;
+    bool printM = false;
+
+    int printParents;
+    bool printEdges = true;
+    bool printWeights = true;
+
+    char sep = ' ';
+};
+
+JNGEN_EXTERN OutputModifier defaultMod;
+
+template<typename T>
+class Repr {
+    friend std::ostream& operator<<(std::ostream& out, const Repr& repr) {
+        repr.print(out);
+        return out;
+    }
+
+    template<typename P>
+    friend Repr<P> repr(const P& t);
+
+    template<typename P>
+    friend class ReprProxy;
+
+protected:
+    Repr() = delete;
+    Repr(const Repr<T>&) = default;
+    Repr<T>& operator=(const Repr<T>&) = default;
+    Repr(Repr<T>&&) = default;
+    Repr<T>& operator=(Repr<T>&&) = default;
+
+public:
+    Repr(const T& object) :
+        object_(object),
+        mod_(defaultMod)
+    {  }
+
+    Repr<T>& add1(bool value = true) {
+        mod_.addition = value;
+        return *this;
+    }
+
+    Repr<T>& printN(bool value = true) {
+        mod_.printN = value;
+        return *this;
+    }
+
+    Repr<T>& printM(bool value = true) {
+        mod_.printM = value;
+        return *this;
+    }
+
+    Repr<T>& printParents(int value = -1) {
+        mod_.printParents = value;
+        mod_.printEdges = false;
+        return *this;
+    }
+
+    Repr<T>& printEdges(bool value = true) {
+        mod_.printEdges = value;
+        if (!value) {
+            mod_.printParents = -1;
         }
+        return *this;
+    }
+
+    Repr<T>& printWeights(bool value = true) {
+        mod_.printWeights = value;
+        return *this;
+    }
+
+    Repr<T>& endl(bool value = true) {
+        mod_.sep = value ? '\n' : ' ';
+        return *this;
+    }
+
+private:
+    void print(std::ostream& out) const {
+        printValue(out, object_, mod_, PTagMax{});
+    }
+
+    const T& object_;
+
+protected:
+    OutputModifier mod_;
+};
+
+class BaseReprProxy {};
+
+template<typename T>
+class ReprProxy : public BaseReprProxy {
+    friend std::ostream& operator<<(std::ostream& out, const ReprProxy& proxy) {
+        Repr<T> repr(static_cast<const T&>(proxy));
+        return out << repr;
+    }
+
+public:
+    Repr<T> add1(bool value = true) {
+        Repr<T> repr(static_cast<const T&>(*this));
+        repr.add1(value);
+        return repr;
+    }
+
+    Repr<T> printN(bool value = true) {
+        Repr<T> repr(static_cast<const T&>(*this));
+        repr.printN(value);
+        return repr;
+    }
+
+    Repr<T> printM(bool value = true) {
+        Repr<T> repr(static_cast<const T&>(*this));
+        repr.printM(value);
+        return repr;
+    }
+
+    Repr<T> printParents(int value = -1) {
+        Repr<T> repr(static_cast<const T&>(*this));
+        repr.printParents(value);
+        return repr;
+    }
+
+    Repr<T> printEdges(bool value = true) {
+        Repr<T> repr(static_cast<const T&>(*this));
+        repr.printEdges(value);
+        return repr;
+    }
+
+    Repr<T> printWeights(bool value = true) {
+        Repr<T> repr(static_cast<const T&>(*this));
+        repr.printWeights(value);
+        return repr;
+    }
+
+    Repr<T> endl(bool value = true) {
+        Repr<T> repr(static_cast<const T&>(*this));
+        repr.endl(value);
+        return repr;
+    }
+
+protected:
+    ReprProxy() {
+        static_assert(
+            std::is_base_of<ReprProxy<T>, T>::value,
+            "ReprProxy<T> must be inherited by T");
+    }
+};
+
+template<typename T>
+Repr<T> repr(const T& t) {
+    return Repr<T>(t);
+}
+
+class DefaultModSetter : public Repr<int> {
+    friend DefaultModSetter setMod();
+
+private:
+    DefaultModSetter(int val) :
+        Repr<int>(val)
+    {  }
+
+public:
+    ~DefaultModSetter() {
+        defaultMod = mod_;
+    }
+
+    Repr<int>& reset() {
+        mod_ = OutputModifier();
+        return *this;
+    }
+};
+
+inline DefaultModSetter setMod() {
+    static int dummy = 0;
+    return DefaultModSetter(dummy);
+}
+
+} // namespace jngen
+
+using jngen::repr;
+using jngen::setMod;
+
+
+#include <iostream>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+namespace jngen {
+
+namespace detail {
+
+// TODO: maybe make it more clear SFINAE, like boost::has_left_shift<X,Y>?
+// TODO: make these defines namespace independent
+
+#define JNGEN_DEFINE_FUNCTION_CHECKER(name, expr)\
+template<typename T, typename Enable = void>\
+class Has ## name ## Helper: public std::false_type {};\
+\
+template<typename T>\
+class Has ## name ## Helper<T,\
+    decltype(void(\
+        expr\
+    ))\
+> : public std::true_type {};\
+
+#define JNGEN_HAS_FUNCTION(name)\
+    ::jngen::detail::Has ## name ## Helper<T>::value
+
+JNGEN_DEFINE_FUNCTION_CHECKER(
+    OstreamMethod,
+    std::declval<std::ostream&>().operator<< (std::declval<T>())
+)
+
+JNGEN_DEFINE_FUNCTION_CHECKER(
+    OstreamFreeFunction,
+    std::operator<<(std::declval<std::ostream&>(), std::declval<T>())
+)
+
+JNGEN_DEFINE_FUNCTION_CHECKER(
+    Plus,
+    T(std::declval<T>() + 1)
+)
+
+JNGEN_DEFINE_FUNCTION_CHECKER(
+    Container,
+    std::distance(std::declval<T>().begin(), std::declval<T>().end())
+)
+
+#define JNGEN_HAS_OSTREAM()\
+    (JNGEN_HAS_FUNCTION(OstreamMethod) ||\
+        JNGEN_HAS_FUNCTION(OstreamFreeFunction))
+
+template<typename T>
+struct VectorDepth {
+    constexpr static int value = 0;
+};
+
+template<typename T, template <typename...> class C>
+struct VectorDepth<C<T>> {
+    constexpr static int value =
+        std::is_base_of<
+            std::vector<T>,
+            C<T>
+        >::value ? VectorDepth<T>::value + 1 : 0;
+};
+
+} // namespace detail
+
+#define JNGEN_DECLARE_PRINTER(constraint, priority)\
+template<typename T>\
+auto printValue(\
+    std::ostream& out, const T& t, const OutputModifier& mod, PTag<priority>)\
+    -> enable_if_t<constraint, void>
+
+#define JNGEN_DECLARE_SIMPLE_PRINTER(type, priority)\
+inline void printValue(std::ostream& out, const type& t,\
+    const OutputModifier& mod, PTag<priority>)
+
+#define JNGEN_PRINT(value)\
+printValue(out, value, mod, PTagMax{})
+
+#define JNGEN_PRINT_NO_MOD(value)\
+printValue(out, value, OutputModifier{}, PTagMax{})
+
+JNGEN_DECLARE_PRINTER(!JNGEN_HAS_OSTREAM(), 0)
+{
+    static bool locked = false;
+
+    ensure(
+            !locked,
+            std::string{} + "You are trying to print a type for which "
+            "operator<< is not defined: " + typeid(T).name());
+
+    locked = true;
+    (void)mod;
+    out << t;
+    locked = false;
+}
+
+JNGEN_DECLARE_PRINTER(JNGEN_HAS_OSTREAM(), 10)
+{
+    (void)mod;
+    out << t;
+}
+
+JNGEN_DECLARE_PRINTER(
+    JNGEN_HAS_OSTREAM() && JNGEN_HAS_FUNCTION(Plus), 11)
+{
+    if (std::is_integral<T>::value) {
+        out << T(t + mod.addition);
+    } else {
+        out << t;
     }
+}
 
-    void assertExistence(const Index& index) const {
-        if (count(index)) {
-            return;
-        }
-        if (index.isNamed()) {
-            ensure(false, format(
-                    "There is no variable with name '%s'", index.name.c_str()));
+JNGEN_DECLARE_PRINTER(detail::VectorDepth<T>::value == 1, 3)
+{
+    if (mod.printN) {
+        out << t.size() << "\n";
+    }
+    bool first = true;
+    for (const auto& x: t) {
+        if (first) {
+            first = false;
         } else {
-            ensure(false, format(
-                    "There is no variable with index %d", index.index));
+            out << mod.sep;
         }
+        JNGEN_PRINT(x);
     }
+}
 
-    bool initialized = false;
-};
+JNGEN_DECLARE_PRINTER(detail::VectorDepth<T>::value == 1 &&
+    std::tuple_size<typename T::value_type>::value == 2, 4)
+{
+    if (mod.printN) {
+        out << t.size() << "\n";
+    }
 
-template<typename T>
-class PendingVariable {
-public:
-    explicit PendingVariable(std::string value) :
-        value_(std::move(value))
-    {  }
+    bool first = true;
+    for (const auto& x: t) {
+        if (first) {
+            first = false;
+        } else {
+            out << "\n";
+        }
+        JNGEN_PRINT(x);
+    }
+}
 
-    PendingVariable(std::string value, T defaultValue) :
-        value_(std::move(value)),
-        default_(std::move(defaultValue))
-    {  }
+JNGEN_DECLARE_PRINTER(detail::VectorDepth<T>::value == 2, 4)
+{
+    if (mod.printN) {
+        out << t.size() << (mod.printM ? " " : "");
+    }
+    if (mod.printM) {
+        if (t.empty()) {
+            out << 0;
+        } else {
+            auto size = t[0].size();
+            out << size;
+            for (const auto& vec: t) {
+                ensure(size == vec.size(), "Size of all matrix elements must "
+                        "be equal if printM is specified");
+            }
+        }
+    }
 
-    explicit PendingVariable(std::nullptr_t, T defaultValue) :
-        valid_(false),
-        default_(std::move(defaultValue))
-    {  }
+    if ((mod.printN || mod.printM) && !t.empty()) {
+        out << "\n";
+    }
 
-    // We need this check in order to make the following work:
-    // string s = getOpt(0);
-    // s = getOpt(0);
-    // Weird things happen if we allow all kind of casts. See
-    // https://stackoverflow.com/questions/46740341
-    template<
-        typename U,
-        typename std::enable_if<
-            detail::isValidOptionType<U>()>::type* = nullptr>
-    operator U() const
+    auto tmp = mod;
     {
-        if (!valid_) {
-            return static_cast<U>(default_);
+        auto mod = tmp;
+        mod.printN = mod.printM = false;
+        bool first = true;
+        for (const auto& x: t) {
+            if (first) {
+                first = false;
+            } else {
+                out << '\n';
+            }
+            JNGEN_PRINT(x);
         }
+    }
+}
 
-        std::istringstream ss(value_);
-        U t;
-        if (ss >> t) {
-            return t;
+JNGEN_DECLARE_PRINTER(JNGEN_HAS_FUNCTION(Container), 2)
+{
+    if (mod.printN) {
+        out << t.size() << "\n";
+    }
+    bool first = true;
+    for (const auto& x: t) {
+        if (first) {
+            first = false;
         } else {
-            ensure(
-                false,
-                format(
-                    "Cannot parse option. Raw value: '%s'",
-                    value_.c_str()));
+            out << " ";
         }
+        JNGEN_PRINT(x);
     }
+}
 
-    // TODO: getOpt operators, like getOpt("n") == 100
+JNGEN_DECLARE_PRINTER(JNGEN_HAS_FUNCTION(Container)
+    && std::tuple_size<typename T::value_type>::value == 2, 3)
+{
+    if (mod.printN) {
+        out << t.size() << "\n";
+    }
+    bool first = true;
+    for (const auto& x: t) {
+        if (first) {
+            first = false;
+        } else {
+            out << "\n";
+        }
+        JNGEN_PRINT(x);
+    }
+}
 
-private:
-    bool valid_ = true;
-    std::string value_;
-    T default_;
-};
+// http://stackoverflow.com/a/19841470/2159939
+#define JNGEN_COMMA ,
 
-template<>
-class PendingVariable<void> {
-public:
-    explicit PendingVariable(std::string value) :
-        value_(std::move(value))
-    {  }
+template<typename Lhs, typename Rhs>
+JNGEN_DECLARE_SIMPLE_PRINTER(std::pair<Lhs JNGEN_COMMA Rhs>, 3)
+{
+    JNGEN_PRINT(t.first);
+    out << " ";
+    JNGEN_PRINT(t.second);
+}
 
-    // We need this check in order to make the following work:
-    // string s = getOpt(0);
-    // s = getOpt(0);
-    // Weird things happen if we allow all kind of casts. See
-    // https://stackoverflow.com/questions/46740341
-    template<
-        typename U,
-        typename std::enable_if<
-            detail::isValidOptionType<U>()>::type* = nullptr>
-    operator U() const
+#undef JNGEN_COMMA
+
+// Following snippet allows writing
+//     cout << pair<int, int>(1, 2) << endl;
+// in user code. I have to put it into separate namespace because
+//   1) I don't want to 'use' all operator<< from jngen
+//   2) I cannot do it in global namespace because JNGEN_HAS_OSTREAM relies
+// on that it is in jngen.
+namespace namespace_for_fake_operator_ltlt {
+
+template<typename T>
+auto operator<<(std::ostream& out, const T& t)
+    -> enable_if_t<
+            !JNGEN_HAS_OSTREAM() && !std::is_base_of<BaseReprProxy, T>::value,
+            std::ostream&
+        >
+{
+    // not jngen::printValue, because relying on ADL here for printers declared
+    // later (see, e.g., http://stackoverflow.com/questions/42833134)
+    printValue(out, t, jngen::defaultMod, jngen::PTagMax{});
+    return out;
+}
+
+} // namespace namespace_for_fake_operator_ltlt
+
+// Calling this operator inside jngen namespace doesn't work without this line.
+using namespace jngen::namespace_for_fake_operator_ltlt;
+
+} // namespace jngen
+
+using namespace jngen::namespace_for_fake_operator_ltlt;
+
+
+#include <cstdint>
+#include <vector>
+
+namespace jngen {
+namespace detail {
+
+// Returns a uniformly random integer from [0, maxOffset].
+uint64_t randomOffset(Random& random, uint64_t maxOffset);
+
+// Returns |size| distinct integers from [0, maxOffset] in random order.
+// Sparse Fisher-Yates over the implicit array 0..maxOffset: O(size) time
+// and memory, no retries.
+std::vector<uint64_t> sampleOffsets(
+        Random& random, size_t size, uint64_t maxOffset);
+
+// Returns |size| distinct integers from [0, maxOffset] in increasing order.
+// Vitter's sequential sampling (Algorithm D): O(size) expected time, no
+// memory besides the result.
+std::vector<uint64_t> sampleSortedOffsets(
+        Random& random, size_t size, uint64_t maxOffset);
+
+} // namespace detail
+} // namespace jngen
+
+#ifndef JNGEN_DECLARE_ONLY
+#define JNGEN_INCLUDE_SAMPLING_INL_H
+#ifndef JNGEN_INCLUDE_SAMPLING_INL_H
+#error File "sampling_inl.h" must not be included directly.
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+namespace jngen {
+namespace detail {
+
+uint64_t randomOffset(Random& random, uint64_t maxOffset) {
+    if (maxOffset < static_cast<uint64_t>(std::numeric_limits<int>::max())) {
+        return random.next(static_cast<int>(maxOffset + 1));
+    }
+    if (maxOffset < static_cast<uint64_t>(
+            std::numeric_limits<long long>::max()))
     {
-        std::istringstream ss(value_);
-        U t;
-        if (ss >> t) {
-            return t;
-        } else {
-            ensure(
-                false,
-                format(
-                    "Cannot parse option. Raw value: '%s'",
-                    value_.c_str()));
+        return random.next(static_cast<long long>(maxOffset + 1));
+    }
+    while (true) {
+        uint64_t x = random.next64();
+        if (x <= maxOffset) {
+            return x;
+        }
+    }
+}
+
+std::vector<uint64_t> sampleOffsets(
+        Random& random, size_t size, uint64_t maxOffset)
+{
+    ensure(
+        size == 0 || size - 1 <= maxOffset,
+        "There are not enough unique elements");
+
+    std::vector<uint64_t> result(size);
+
+    if (maxOffset / 4 < size) {
+        // The range is small, so the array may be stored explicitly.
+        std::vector<uint64_t> values(maxOffset + 1);
+        std::iota(values.begin(), values.end(), 0);
+        for (size_t i = 0; i < size; ++i) {
+            uint64_t j = i + randomOffset(random, maxOffset - i);
+            std::swap(values[i], values[j]);
+            result[i] = values[i];
         }
+        return result;
     }
 
-private:
-    std::string value_;
-};
+    // Only displaced elements are stored; position i is never read again
+    // after step i, so it is not updated.
+    std::unordered_map<uint64_t, uint64_t> displaced;
+    displaced.reserve(size * 2);
+    auto valueAt = [&displaced](uint64_t pos) {
+        auto it = displaced.find(pos);
+        return it == displaced.end() ? pos : it->second;
+    };
+    for (size_t i = 0; i < size; ++i) {
+        uint64_t j = i + randomOffset(random, maxOffset - i);
+        result[i] = valueAt(j);
+        displaced[j] = valueAt(i);
+    }
+    return result;
+}
 
-// TODO: think about seed as a last argument
-inline VariableMap parseArguments(const std::vector<std::string>& args) {
-    VariableMap result;
+std::vector<uint64_t> sampleSortedOffsets(
+        Random& random, size_t size, uint64_t maxOffset)
+{
+    ensure(
+        maxOffset < static_cast<uint64_t>(
+            std::numeric_limits<long long>::max()),
+        "The range is too wide for sorted sampling");
+    ensure(
+        size == 0 || size - 1 <= maxOffset,
+        "There are not enough unique elements");
 
-    auto setNamedVar = [&result](
-            const std::string& name,
-            const std::string& value)
-    {
-        ensure(
-            !result.count(value),
-            "Named arguments must have distinct names");
-        result.named[name] = value;
+    std::vector<uint64_t> result;
+    result.reserve(size);
+    if (size == 0) {
+        return result;
+    }
+
+    // Uniform in (0, 1) with 53 bits of precision.
+    auto uniform = [&random]() {
+        return ((random.next64() >> 11) + 0.5) / 9007199254740992.0;
     };
 
-    std::string pendingVarName;
+    // The code follows the paper: J. S. Vitter, "An efficient algorithm for
+    // sequential random sampling", 1987. n elements are still to be selected
+    // from the remaining N; s is the number of elements to skip.
+    long long n = size;
+    long long N = maxOffset + 1;
+    long long current = -1;
+
+    double nreal = n;
+    double Nreal = N;
+    double ninv = 1.0 / nreal;
+    double vprime = std::exp(std::log(uniform()) * ninv);
+    long long qu1 = N - n + 1;
+    double qu1real = Nreal - nreal + 1.0;
+    const long long NEG_ALPHA_INV = -13;
+    long long threshold = -NEG_ALPHA_INV * n;
+
+    while (n > 1 && threshold < N) {
+        double nmin1inv = 1.0 / (nreal - 1.0);
+        long long s;
+        while (true) {
+            double x;
+            while (true) {
+                x = Nreal * (1.0 - vprime);
+                s = static_cast<long long>(x);
+                if (s < qu1) {
+                    break;
+                }
+                vprime = std::exp(std::log(uniform()) * ninv);
+            }
 
-    for (const std::string& s: args) {
-        if (s == "-") {
-            continue;
-        }
-        if (s == "--") {
-            break;
-        }
+            double u = uniform();
+            double negSreal = -static_cast<double>(s);
+            double y1 = std::exp(std::log(u * Nreal / qu1real) * nmin1inv);
+            vprime = y1 * (1.0 - x / Nreal) * (qu1real / (negSreal + qu1real));
+            if (vprime <= 1.0) {
+                break;
+            }
 
-        if (s[0] != '-') {
-            if (!pendingVarName.empty()) {
-                setNamedVar(pendingVarName, s);
-                pendingVarName = "";
+            double y2 = 1.0;
+            double top = Nreal - 1.0;
+            double bottom;
+            long long limit;
+            if (n - 1 > s) {
+                bottom = Nreal - nreal;
+                limit = N - s;
             } else {
-                result.positional.push_back(s);
+                bottom = Nreal + negSreal - 1.0;
+                limit = qu1;
             }
-            continue;
+            for (long long t = N - 1; t >= limit; --t) {
+                y2 = y2 * top / bottom;
+                top -= 1.0;
+                bottom -= 1.0;
+            }
+            if (Nreal / (Nreal - x) >= y1 * std::exp(std::log(y2) * nmin1inv)) {
+                vprime = std::exp(std::log(uniform()) * nmin1inv);
+                break;
+            }
+            vprime = std::exp(std::log(uniform()) * ninv);
+        }
+
+        current += s + 1;
+        result.push_back(current);
+        N -= s + 1;
+        Nreal = N;
+        --n;
+        nreal = n;
+        ninv = nmin1inv;
+        qu1 -= s;
+        qu1real = qu1;
+        threshold += NEG_ALPHA_INV;
+    }
+
+    if (n > 1) {
+        // Few elements are left to skip, fall back to Algorithm A.
+        double top = N - n;
+        Nreal = N;
+        while (n > 1) {
+            double v = uniform();
+            long long s = 0;
+            double quot = top / Nreal;
+            while (quot > v) {
+                ++s;
+                top -= 1.0;
+                Nreal -= 1.0;
+                quot = quot * top / Nreal;
+            }
+            current += s + 1;
+            result.push_back(current);
+            Nreal -= 1.0;
+            --n;
         }
+        current += static_cast<long long>(Nreal * uniform()) + 1;
+    } else {
+        current += static_cast<long long>(N * vprime) + 1;
+    }
+    result.push_back(current);
 
-        if (!pendingVarName.empty()) {
-            result.named[pendingVarName] = "1";
-            pendingVarName = "";
+    return result;
+}
+
+} // namespace detail
+} // namespace jngen
+#undef JNGEN_INCLUDE_SAMPLING_INL_H
+#endif // JNGEN_DECLARE_ONLY
+
+
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+
+namespace jngen {
+
+namespace detail {
+
+// Merges two adjacent uniformly shuffled ranges into a uniformly shuffled
+// one. This is the merge step of MergeShuffle by A. Bacher et al.: elements
+// are taken from either range by a coin flip until one of them runs out, and
+// the rest is inserted with Fisher-Yates steps.
+template<typename Iterator>
+void mergeShuffled(
+        Iterator begin, Iterator middle, Iterator end, Random& random)
+{
+    size_t i = 0;
+    size_t j = middle - begin;
+    size_t size = end - begin;
+    uint64_t bits = 0;
+    int bitsLeft = 0;
+    while (true) {
+        if (bitsLeft == 0) {
+            bits = random.next64();
+            bitsLeft = 64;
         }
+        bool fromSecond = bits & 1;
+        bits >>= 1;
+        --bitsLeft;
 
-        std::string name;
-        std::string value;
-        bool foundEq = false;
-        for (char c: s.substr(1)) {
-            if (!foundEq && c == '=') {
-                foundEq = true;
-            } else {
-                if (foundEq) {
-                    value += c;
-                } else {
-                    name += c;
-                }
+        if (fromSecond) {
+            if (j == size) {
+                break;
             }
+            std::swap(*(begin + i), *(begin + j));
+            ++j;
+        } else if (i == j) {
+            break;
         }
-        if (foundEq) {
-            setNamedVar(name, value);
-        } else {
-            pendingVarName = name;
-        }
+        ++i;
+    }
 
-        setNamedVar(name, value);
+    for (; i < size; ++i) {
+        std::swap(*(begin + i), *(begin + random.next(i + 1)));
     }
+}
 
-    if (!pendingVarName.empty()) {
-        result.named[pendingVarName] = "1";
+// Shuffles cache-sized blocks independently and then merges them pairwise,
+// each block and each merge using its own stream. Blocks and merges of the
+// same level run in parallel. The layout depends only on the range size, so
+// the result does not depend on the number of threads.
+template<typename Iterator>
+void mergeShuffle(Iterator begin, Iterator end) {
+    size_t size = end - begin;
+    size_t blocks = 1;
+    while (size / (blocks * 2) >= PARALLEL_CHUNK_SIZE) {
+        blocks *= 2;
     }
+    auto streams = rnd.split(2 * blocks - 1);
+    auto border = [begin, size, blocks](size_t k) {
+        return begin + size * k / blocks;
+    };
 
-    result.initialized = true;
-    return result;
+    parallelFor(blocks, [&border, &streams](size_t k) {
+        Iterator first = border(k);
+        int length = border(k + 1) - first;
+        for (int i = 1; i < length; ++i) {
+            std::swap(*(first + i), *(first + streams[k].next(i + 1)));
+        }
+    });
+
+    size_t node = blocks;
+    for (size_t width = 1; width < blocks; width *= 2) {
+        size_t pairs = blocks / (width * 2);
+        parallelFor(pairs, [&border, &streams, node, width](size_t k) {
+            mergeShuffled(
+                border(2 * k * width),
+                border((2 * k + 1) * width),
+                border((2 * k + 2) * width),
+                streams[node + k]);
+        });
+        node += pairs;
+    }
 }
 
-JNGEN_EXTERN VariableMap vmap;
+} // namespace detail
 
-namespace detail {
+// TODO: deprecate random_shuffle as done in testlib.h
 
-inline PendingVariable<void> getOpt(const Index& index) {
-    ensure(
-        vmap.initialized,
-        "parseArgs(args, argv) must be called before getOpt(...)");
-    vmap.assertExistence(index);
-    return PendingVariable<void>(vmap[index]);
+template<typename Iterator>
+void shuffle(Iterator begin, Iterator end) {
+    ensure(end >= begin, "Cannot shuffle range of negative length");
+    size_t size = end - begin;
+    if (config.threads > 0 && size >= 2 * detail::PARALLEL_CHUNK_SIZE) {
+        detail::mergeShuffle(begin, end);
+        return;
+    }
+    for (size_t i = 1; i < size; ++i) {
+        std::swap(*(begin + i), *(begin + rnd.next(i + 1)));
+    }
 }
 
-template<typename T, typename U = detail::StringIfCharPtrElseT<T>>
-PendingVariable<U> getOpt(const Index& index, const T& defaultValue) {
-    ensure(
-        vmap.initialized,
-        "parseArgs(args, argv) must be called before getOpt(...)");
-    if (vmap.count(index)) {
-        return PendingVariable<U>(vmap[index], U{defaultValue});
-    } else {
-        return PendingVariable<U>(nullptr, U{defaultValue});
-    }
+template<typename Iterator>
+auto choice(Iterator begin, Iterator end)
+        -> typename std::iterator_traits<Iterator>::value_type
+{
+    return rnd.choice(begin, end);
 }
 
-inline bool hasOpt(const Index& index) {
-    return vmap.count(index);
+template<typename Container>
+typename Container::value_type choice(const Container& container) {
+    return rnd.choice(container);
 }
 
 template<typename T>
-bool readVariable(const std::string& value, T& var) {
-    std::istringstream ss(value);
-
-    T t;
-    if (ss >> t) {
-        var = t;
-        return true;
-    }
-    return false;
+T choice(std::initializer_list<T> ilist) {
+    return choice(ilist.begin(), ilist.end());
 }
 
-inline int getNamedImpl(std::vector<std::string>::const_iterator) { return 0; }
+namespace detail {
 
-template<typename T, typename ... Args>
-int getNamedImpl(
-    std::vector<std::string>::const_iterator it, T& var, Args&... args)
-{
-    T value;
-    int res = 0;
-    if (readVariable(vmap[*it], value)) {
-        var = value;
-        ++res;
+template<typename Collection2D>
+typename Collection2D::value_type interleave(const Collection2D& collection) {
+    std::vector<size_t> sizes;
+    for (const auto& c: collection) {
+        sizes.push_back(c.size());
     }
-    res += getNamedImpl(++it, args...);
-    return res;
-}
+    size_t size = std::accumulate(sizes.begin(), sizes.end(), 0u);
 
-inline int getPositionalImpl(size_t) { return 0; }
+    // Same choices as rnd.nextByDistribution(sizes) would make, but in
+    // O(log k) per element.
+    DynamicDistribution distribution(sizes);
+    typename Collection2D::value_type result;
+    while (size > 0) {
+        size_t id = distribution.next();
+        result.emplace_back(collection[id][collection[id].size() - sizes[id]]);
+        --sizes[id];
+        distribution.add(id, -1);
 
-template<typename T, typename ... Args>
-int getPositionalImpl(size_t index, T& var, Args&... args) {
-    T value;
-    int res = 0;
-    if (readVariable(vmap[index], value)) {
-        var = value;
-        ++res;
+        --size;
     }
-    res += getPositionalImpl(index + 1, args...);
-    return res;
+
+    return result;
 }
 
 } // namespace detail
 
-template<typename ... Args>
-int doGetNamed(const std::string& names, Args&... args) {
-    ensure(
-        vmap.initialized,
-        "parseArgs(args, argv) must be called before getNamed(...)");
+template<typename Collection2D>
+typename Collection2D::value_type interleave(const Collection2D& collection) {
+    return detail::interleave(collection);
+}
 
-    auto namesSplit = util::split(names, ',');
+template<typename Collection>
+Collection interleave(const std::initializer_list<Collection>& ilist) {
+    return detail::interleave<std::vector<Collection>>(ilist);
+}
 
-    ENSURE(
-        namesSplit.size() == sizeof...(args),
-        "Number of names is not equal to number of variables");
+} // namespace jngen
 
-    return detail::getNamedImpl(namesSplit.begin(), args...);
-}
+using jngen::shuffle;
+using jngen::choice;
+using jngen::interleave;
 
-template<typename ... Args>
-int getPositional(Args&... args) {
-    ensure(
-        vmap.initialized,
-        "parseArgs(args, argv) must be called before getPositional(...)");
 
-    return detail::getPositionalImpl(0, args...);
-}
+#include <algorithm>
+#include <initializer_list>
+#include <numeric>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <unordered_set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
-inline void parseArgs(int argc, char *argv[]) {
-    vmap = parseArguments(std::vector<std::string>(argv + 1, argv + argc));
-}
+namespace jngen {
 
-inline PendingVariable<void> getOpt(size_t index) {
-    return detail::getOpt(Index(index));
-}
+template<typename T>
+class GenericArrayStream;
 
-inline PendingVariable<void> getOpt(const std::string& name) {
-    return detail::getOpt(Index(name));
-}
+template<typename T>
+class GenericArray : public ReprProxy<GenericArray<T>>, public std::vector<T> {
+public:
+    typedef std::vector<T> Base;
 
-template<typename T, typename U = detail::StringIfCharPtrElseT<T>>
-PendingVariable<U> getOpt(size_t index, const T& defaultValue) {
-    return detail::getOpt(Index(index), defaultValue);
-}
+    using Base::Base;
+
+    GenericArray() {}
+    GenericArray(const GenericArray<T>&) = default;
+    GenericArray& operator=(const GenericArray<T>&) = default;
+    GenericArray(GenericArray<T>&&) = default;
+    GenericArray& operator=(GenericArray<T>&&) = default;
 
-template<typename T, typename U = detail::StringIfCharPtrElseT<T>>
-PendingVariable<U> getOpt(const std::string& name, const T& defaultValue) {
-    return detail::getOpt(Index(name), defaultValue);
-}
+    ~GenericArray() {}
 
-inline bool hasOpt(size_t index) {
-    return vmap.count(index);
-}
+    /* implicit */ GenericArray(const Base& base) :
+            Base(base)
+    {  }
 
-inline bool hasOpt(const std::string& name) {
-    return vmap.count(name);
-}
+    using Base::at;
+    using Base::size;
+    using Base::resize;
+    using Base::begin;
+    using Base::end;
+    using Base::insert;
+    using Base::clear;
+    using Base::erase;
 
-inline options::Range parseRange(const std::string& value) {
-    return options::Range::fromString(value);
+    void extend(size_t requiredSize) {
+        checkLargeParameter(requiredSize);
+        if (requiredSize > size()) {
+            resize(requiredSize);
+        }
+    }
 
-}
+    template<typename F, typename ...Args>
+    static GenericArray<T> randomf(size_t size, F func, const Args& ... args);
+    template<typename F, typename ...Args>
+    static GenericArray<T> randomfUnique(
+            size_t size, F func, const Args& ... args);
+    template<typename F, typename ...Args>
+    static GenericArray<T> randomfAll(F func, const Args& ... args);
 
-} // namespace jngen
+    template<typename ...Args>
+    static GenericArray<T> random(size_t size, const Args& ... args);
+    template<typename ...Args>
+    static GenericArray<T> randomUnique(size_t size, const Args& ... args);
+    static GenericArray<T> randomUniqueSorted(size_t size, T n);
+    static GenericArray<T> randomUniqueSorted(size_t size, T l, T r);
+    template<typename ...Args>
+    static GenericArray<T> randomAll(const Args& ... args);
 
-using jngen::parseArgs;
-using jngen::getOpt;
-using jngen::hasOpt;
-using jngen::parseRange;
+    // Defined in array_stream.h.
+    template<typename ...Args>
+    static GenericArrayStream<T> randomStream(
+            size_t size, const Args& ... args);
+    template<typename F, typename ...Args>
+    static GenericArrayStream<T> randomfStream(
+            size_t size, F func, const Args& ... args);
 
-using jngen::getPositional;
+    static GenericArray<T> id(size_t size, T start = T{});
 
-#define getNamed(...) ::jngen::doGetNamed(#__VA_ARGS__, __VA_ARGS__)
+    GenericArray<T>& shuffle();
+    GenericArray<T> shuffled() const;
 
+    GenericArray<T>& reverse();
+    GenericArray<T> reversed() const;
 
-#include <iostream>
-#include <type_traits>
+    GenericArray<T>& sort();
+    GenericArray<T> sorted() const;
 
-namespace jngen {
+    template<typename Comp>
+    GenericArray<T>& sort(Comp&& comp);
+    template<typename Comp>
+    GenericArray<T> sorted(Comp&& comp) const;
 
-template<int N> struct PTag : PTag<N-1> {};
-template<> struct PTag<0> {};
-struct PTagMax : PTag<20> {};
+    GenericArray<T>& unique();
+    GenericArray<T> uniqued() const;
 
-struct OutputModifier {
-    int addition = 0;
-    bool printN = false;
-    bool printM = false;
+    GenericArray<T> inverse() const;
 
-    int printParents;
-    bool printEdges = true;
-    bool printWeights = true;
+    template<typename Integer>
+    GenericArray<T> subseq(const std::vector<Integer>& indices) const;
 
-    char sep = ' ';
-};
+    template<typename Integer>
+    GenericArray<T> subseq(
+        const std::initializer_list<Integer>& indices) const;
 
-JNGEN_EXTERN OutputModifier defaultMod;
+    T choice() const;
+    GenericArray<T> choice(size_t count) const;
+    GenericArray<T> choiceWithRepetition(size_t count) const;
 
-template<typename T>
-class Repr {
-    friend std::ostream& operator<<(std::ostream& out, const Repr& repr) {
-        repr.print(out);
-        return out;
-    }
+    GenericArray<T>& operator+=(const GenericArray<T>& other);
+    GenericArray<T> operator+(const GenericArray<T>& other) const;
 
-    template<typename P>
-    friend Repr<P> repr(const P& t);
+    GenericArray<T>& operator*=(int k);
+    GenericArray<T> operator*(int k) const;
 
-    template<typename P>
-    friend class ReprProxy;
+    operator std::string() const;
+};
 
-protected:
-    Repr() = delete;
-    Repr(const Repr<T>&) = default;
-    Repr<T>& operator=(const Repr<T>&) = default;
-    Repr(Repr<T>&&) = default;
-    Repr<T>& operator=(Repr<T>&&) = default;
+namespace detail {
 
-public:
-    Repr(const T& object) :
-        object_(object),
-        mod_(defaultMod)
-    {  }
+// Uses the bulk Random::fill when TypedRandom<T> supports it for given
+// arguments, and falls back to successive tnext<T> calls otherwise. Both ways
+// produce the same values.
+template<typename T, typename ...Args>
+auto fillRandom(
+        Random& random, T* out, size_t count, int, const Args& ... args)
+    -> decltype(TypedRandom<T>{random}.fill(out, count, args...))
+{
+    TypedRandom<T>{random}.fill(out, count, args...);
+}
 
-    Repr<T>& add1(bool value = true) {
-        mod_.addition = value;
-        return *this;
+template<typename T, typename ...Args>
+void fillRandom(
+        Random& random, T* out, size_t count, long, const Args& ... args)
+{
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = random.tnext<T>(args...);
     }
+}
 
-    Repr<T>& printN(bool value = true) {
-        mod_.printN = value;
-        return *this;
-    }
+// Functions passed to randomf may take the generator to use as the first
+// argument; this is required to run them in parallel.
+template<typename F, typename ...Args>
+auto acceptsRandom(F& func, int, const Args& ... args)
+    -> decltype(func(std::declval<Random&>(), args...), std::true_type());
 
-    Repr<T>& printM(bool value = true) {
-        mod_.printM = value;
-        return *this;
-    }
+template<typename F, typename ...Args>
+std::false_type acceptsRandom(F& func, long, const Args& ... args);
 
-    Repr<T>& printParents(int value = -1) {
-        mod_.printParents = value;
-        mod_.printEdges = false;
-        return *this;
-    }
+template<typename F, typename ...Args>
+auto invokeWithRandom(F& func, Random& random, int, const Args& ... args)
+    -> decltype(func(random, args...))
+{
+    return func(random, args...);
+}
 
-    Repr<T>& printEdges(bool value = true) {
-        mod_.printEdges = value;
-        if (!value) {
-            mod_.printParents = -1;
-        }
-        return *this;
-    }
+template<typename F, typename ...Args>
+auto invokeWithRandom(F& func, Random&, long, const Args& ... args)
+    -> decltype(func(args...))
+{
+    return func(args...);
+}
 
-    Repr<T>& printWeights(bool value = true) {
-        mod_.printWeights = value;
-        return *this;
-    }
+} // namespace detail
 
-    Repr<T>& endl(bool value = true) {
-        mod_.sep = value ? '\n' : ' ';
-        return *this;
+template<typename T>
+template<typename ...Args>
+GenericArray<T> GenericArray<T>::random(size_t size, const Args& ... args) {
+    checkLargeParameter(size);
+    GenericArray<T> result(size);
+    T* data = result.data();
+    if (config.threads > 0) {
+        detail::generateInChunks(size,
+            [data, &args...](Random& random, size_t begin, size_t count) {
+                detail::fillRandom<T>(random, data + begin, count, 0, args...);
+            });
+    } else {
+        detail::fillRandom<T>(rnd, data, size, 0, args...);
     }
+    return result;
+}
 
-private:
-    void print(std::ostream& out) const {
-        printValue(out, object_, mod_, PTagMax{});
+template<typename T>
+template<typename F, typename ...Args>
+GenericArray<T> GenericArray<T>::randomf(
+        size_t size,
+        F func,
+        const Args& ... args)
+{
+    checkLargeParameter(size);
+    GenericArray<T> result(size);
+    if (config.threads > 0 &&
+            decltype(detail::acceptsRandom(func, 0, args...))::value)
+    {
+        T* data = result.data();
+        detail::generateInChunks(size,
+            [data, &func, &args...](
+                Random& random, size_t begin, size_t count)
+            {
+                for (size_t i = begin; i < begin + count; ++i) {
+                    data[i] = detail::invokeWithRandom(
+                        func, random, 0, args...);
+                }
+            });
+    } else {
+        for (T& x: result) {
+            x = detail::invokeWithRandom(func, rnd, 0, args...);
+        }
     }
+    return result;
+}
 
-    const T& object_;
+namespace detail {
 
-protected:
-    OutputModifier mod_;
+template<typename T, typename Enable = std::size_t>
+struct DictContainer {
+    typedef std::set<T> type;
 };
 
-class BaseReprProxy {};
-
 template<typename T>
-class ReprProxy : public BaseReprProxy {
-    friend std::ostream& operator<<(std::ostream& out, const ReprProxy& proxy) {
-        Repr<T> repr(static_cast<const T&>(proxy));
-        return out << repr;
-    }
+struct DictContainer<T, typename std::hash<T>::result_type>
+{
+    typedef std::unordered_set<T> type;
+};
 
-public:
-    Repr<T> add1(bool value = true) {
-        Repr<T> repr(static_cast<const T&>(*this));
-        repr.add1(value);
-        return repr;
-    }
+} // namespace detail
 
-    Repr<T> printN(bool value = true) {
-        Repr<T> repr(static_cast<const T&>(*this));
-        repr.printN(value);
-        return repr;
-    }
+template<typename T>
+template<typename F, typename ...Args>
+GenericArray<T> GenericArray<T>::randomfUnique(
+        size_t size,
+        F func,
+        const Args& ... args)
+{
+    typename detail::DictContainer<T>::type set;
+    checkLargeParameter(size);
+    GenericArray<T> result;
+    result.reserve(size);
 
-    Repr<T> printM(bool value = true) {
-        Repr<T> repr(static_cast<const T&>(*this));
-        repr.printM(value);
-        return repr;
-    }
+    size_t retries = (size + 10) * log(size + 10) * 2;
 
-    Repr<T> printParents(int value = -1) {
-        Repr<T> repr(static_cast<const T&>(*this));
-        repr.printParents(value);
-        return repr;
-    }
+    while (result.size() != size) {
+        T t = func(args...);
+        if (!set.count(t)) {
+            set.insert(t);
+            result.push_back(t);
+        }
+
+        if (--retries == 0) {
+            ensure(false, "There are not enough unique elements");
+        }
 
-    Repr<T> printEdges(bool value = true) {
-        Repr<T> repr(static_cast<const T&>(*this));
-        repr.printEdges(value);
-        return repr;
     }
 
-    Repr<T> printWeights(bool value = true) {
-        Repr<T> repr(static_cast<const T&>(*this));
-        repr.printWeights(value);
-        return repr;
-    }
+    return result;
+}
 
-    Repr<T> endl(bool value = true) {
-        Repr<T> repr(static_cast<const T&>(*this));
-        repr.endl(value);
-        return repr;
-    }
+namespace detail {
 
-protected:
-    ReprProxy() {
-        static_assert(
-            std::is_base_of<ReprProxy<T>, T>::value,
-            "ReprProxy<T> must be inherited by T");
+// Integral ranges are sampled directly, other types with randomfUnique.
+template<typename T>
+GenericArray<T> randomUniqueInRange(size_t size, T l, T r, bool sorted) {
+    static_assert(
+        std::is_integral<T>::value,
+        "Only integral ranges can be sampled directly");
+    ensure(l <= r);
+    checkLargeParameter(size);
+    uint64_t maxOffset = static_cast<uint64_t>(r) - static_cast<uint64_t>(l);
+    auto offsets = sorted ?
+        sampleSortedOffsets(rnd, size, maxOffset) :
+        sampleOffsets(rnd, size, maxOffset);
+    GenericArray<T> result(size);
+    for (size_t i = 0; i < size; ++i) {
+        result[i] = static_cast<T>(static_cast<uint64_t>(l) + offsets[i]);
     }
-};
+    return result;
+}
 
-template<typename T>
-Repr<T> repr(const T& t) {
-    return Repr<T>(t);
+template<typename T, typename N>
+auto randomUnique(size_t size, int, N n)
+    -> typename std::enable_if<
+        std::is_integral<T>::value && std::is_integral<N>::value,
+        GenericArray<T>>::type
+{
+    ensure(static_cast<T>(n) > 0);
+    return randomUniqueInRange<T>(size, 0, static_cast<T>(n) - 1, false);
 }
 
-class DefaultModSetter : public Repr<int> {
-    friend DefaultModSetter setMod();
+template<typename T, typename L, typename R>
+auto randomUnique(size_t size, int, L l, R r)
+    -> typename std::enable_if<
+        std::is_integral<T>::value &&
+            std::is_integral<L>::value && std::is_integral<R>::value,
+        GenericArray<T>>::type
+{
+    return randomUniqueInRange<T>(
+        size, static_cast<T>(l), static_cast<T>(r), false);
+}
 
-private:
-    DefaultModSetter(int val) :
-        Repr<int>(val)
-    {  }
+template<typename T, typename ...Args>
+GenericArray<T> randomUnique(size_t size, long, const Args& ... args) {
+    return GenericArray<T>::randomfUnique(
+        size,
+        [](Args... args) { return rnd.tnext<T>(args...); },
+        args...);
+}
 
-public:
-    ~DefaultModSetter() {
-        defaultMod = mod_;
-    }
+} // namespace detail
 
-    Repr<int>& reset() {
-        mod_ = OutputModifier();
-        return *this;
-    }
-};
+template<typename T>
+template<typename ...Args>
+GenericArray<T> GenericArray<T>::randomUnique(
+        size_t size, const Args& ... args)
+{
+    return detail::randomUnique<T>(size, 0, args...);
+}
 
-inline DefaultModSetter setMod() {
-    static int dummy = 0;
-    return DefaultModSetter(dummy);
+template<typename T>
+GenericArray<T> GenericArray<T>::randomUniqueSorted(size_t size, T n) {
+    ensure(n > 0);
+    return detail::randomUniqueInRange<T>(size, 0, n - 1, true);
 }
 
-} // namespace jngen
+template<typename T>
+GenericArray<T> GenericArray<T>::randomUniqueSorted(size_t size, T l, T r) {
+    return detail::randomUniqueInRange<T>(size, l, r, true);
+}
 
-using jngen::repr;
-using jngen::setMod;
+template<typename T>
+template<typename F, typename ...Args>
+GenericArray<T> GenericArray<T>::randomfAll(
+        F func,
+        const Args& ... args)
+{
+    typename detail::DictContainer<T>::type set;
+    GenericArray<T> result;
 
+    size_t timeAfterLastHit = 0;
 
-#include <iostream>
-#include <tuple>
-#include <type_traits>
-#include <typeinfo>
-#include <utility>
-#include <vector>
+    while (true) {
+        T t = func(args...);
+        if (!set.count(t)) {
+            set.insert(t);
+            result.push_back(t);
+            timeAfterLastHit = 0;
+        }
 
-namespace jngen {
+        ++timeAfterLastHit;
 
-namespace detail {
+        // Probability of finding not all elements is about e^{-20} ~= 1e-9
+        if (timeAfterLastHit > (result.size() + 10) * 20) {
+            return result;
+        }
+    }
+}
 
-// TODO: maybe make it more clear SFINAE, like boost::has_left_shift<X,Y>?
-// TODO: make these defines namespace independent
+template<typename T>
+template<typename ...Args>
+GenericArray<T> GenericArray<T>::randomAll(const Args& ... args)
+{
+    return GenericArray<T>::randomfAll(
+        [](Args... args) { return rnd.tnext<T>(args...); },
+        args...);
+}
 
-#define JNGEN_DEFINE_FUNCTION_CHECKER(name, expr)\
-template<typename T, typename Enable = void>\
-class Has ## name ## Helper: public std::false_type {};\
-\
-template<typename T>\
-class Has ## name ## Helper<T,\
-    decltype(void(\
-        expr\
-    ))\
-> : public std::true_type {};\
+template<typename T>
+GenericArray<T> GenericArray<T>::id(size_t size, T start) {
+    constexpr bool enable = std::is_integral<T>::value;
+    static_assert(enable, "Cannot call Array<T>::id with non-integral T");
+    checkLargeParameter(size);
 
-#define JNGEN_HAS_FUNCTION(name)\
-    ::jngen::detail::Has ## name ## Helper<T>::value
+    if (enable) {
+        GenericArray<T> result(size);
+        std::iota(result.begin(), result.end(), start);
+        return result;
+    } else {
+        return {};
+    }
+}
 
-JNGEN_DEFINE_FUNCTION_CHECKER(
-    OstreamMethod,
-    std::declval<std::ostream&>().operator<< (std::declval<T>())
-)
+template<typename T>
+GenericArray<T>& GenericArray<T>::shuffle() {
+    jngen::shuffle(begin(), end());
+    return *this;
+}
 
-JNGEN_DEFINE_FUNCTION_CHECKER(
-    OstreamFreeFunction,
-    std::operator<<(std::declval<std::ostream&>(), std::declval<T>())
-)
+template<typename T>
+GenericArray<T> GenericArray<T>::shuffled() const {
+    auto res = *this;
+    res.shuffle();
+    return res;
+}
 
-JNGEN_DEFINE_FUNCTION_CHECKER(
-    Plus,
-    T(std::declval<T>() + 1)
-)
+template<typename T>
+GenericArray<T>& GenericArray<T>::reverse() {
+    std::reverse(begin(), end());
+    return *this;
+}
 
-JNGEN_DEFINE_FUNCTION_CHECKER(
-    Container,
-    std::distance(std::declval<T>().begin(), std::declval<T>().end())
-)
+template<typename T>
+GenericArray<T> GenericArray<T>::reversed() const {
+    auto res = *this;
+    res.reverse();
+    return res;
+}
 
-#define JNGEN_HAS_OSTREAM()\
-    (JNGEN_HAS_FUNCTION(OstreamMethod) ||\
-        JNGEN_HAS_FUNCTION(OstreamFreeFunction))
+template<typename T>
+GenericArray<T>& GenericArray<T>::sort() {
+    std::sort(begin(), end());
+    return *this;
+}
 
 template<typename T>
-struct VectorDepth {
-    constexpr static int value = 0;
-};
+GenericArray<T> GenericArray<T>::sorted() const {
+    auto res = *this;
+    res.sort();
+    return res;
+}
 
-template<typename T, template <typename...> class C>
-struct VectorDepth<C<T>> {
-    constexpr static int value =
-        std::is_base_of<
-            std::vector<T>,
-            C<T>
-        >::value ? VectorDepth<T>::value + 1 : 0;
-};
+template<typename T>
+template<typename Comp>
+GenericArray<T>& GenericArray<T>::sort(Comp&& comp) {
+    std::sort(begin(), end(), comp);
+    return *this;
+}
 
-} // namespace detail
+template<typename T>
+template<typename Comp>
+GenericArray<T> GenericArray<T>::sorted(Comp&& comp) const {
+    auto res = *this;
+    res.sort(comp);
+    return res;
+}
 
-#define JNGEN_DECLARE_PRINTER(constraint, priority)\
-template<typename T>\
-auto printValue(\
-    std::ostream& out, const T& t, const OutputModifier& mod, PTag<priority>)\
-    -> enable_if_t<constraint, void>
+template<typename T>
+GenericArray<T>& GenericArray<T>::unique() {
+    erase(std::unique(begin(), end()), end());
+    return *this;
+}
 
-#define JNGEN_DECLARE_SIMPLE_PRINTER(type, priority)\
-inline void printValue(std::ostream& out, const type& t,\
-    const OutputModifier& mod, PTag<priority>)
+template<typename T>
+GenericArray<T> GenericArray<T>::uniqued() const {
+    auto res = *this;
+    res.unique();
+    return res;
+}
 
-#define JNGEN_PRINT(value)\
-printValue(out, value, mod, PTagMax{})
+template<typename T>
+GenericArray<T> GenericArray<T>::inverse() const {
+    static_assert(
+        std::is_integral<T>::value,
+        "Can only take inverse permutation of integral array");
+    int n = size();
 
-#define JNGEN_PRINT_NO_MOD(value)\
-printValue(out, value, OutputModifier{}, PTagMax{})
+    if (n == 0) {
+        return *this;
+    }
 
-JNGEN_DECLARE_PRINTER(!JNGEN_HAS_OSTREAM(), 0)
-{
-    static bool locked = false;
+    // sanity check
+    ensure(*max_element(begin(), end()) == n-1 &&
+        *min_element(begin(), end()) == 0,
+        "Trying to take inverse of the array which is not a permutation");
 
-    ensure(
-            !locked,
-            std::string{} + "You are trying to print a type for which "
-            "operator<< is not defined: " + typeid(T).name());
+    const static T NONE = static_cast<T>(-1);
+    GenericArray<T> result(n, NONE);
+    for (int i = 0; i < n; ++i) {
+        ensure(result[at(i)] == NONE,
+            "Trying to take inverse of the array which is not a permutation");
+        result[at(i)] = i;
+    }
 
-    locked = true;
-    (void)mod;
-    out << t;
-    locked = false;
+    return result;
 }
 
-JNGEN_DECLARE_PRINTER(JNGEN_HAS_OSTREAM(), 10)
+template<typename T>
+template<typename Integer>
+GenericArray<T> GenericArray<T>::subseq(
+        const std::vector<Integer>& indices) const
 {
-    (void)mod;
-    out << t;
+    GenericArray<T> result;
+    result.reserve(indices.size());
+    for (Integer idx: indices) {
+        result.push_back(at(idx));
+    }
+    return result;
 }
 
-JNGEN_DECLARE_PRINTER(
-    JNGEN_HAS_OSTREAM() && JNGEN_HAS_FUNCTION(Plus), 11)
+// TODO(ifsmirnov): ever need to make it faster?
+template<typename T>
+template<typename Integer>
+GenericArray<T> GenericArray<T>::subseq(
+        const std::initializer_list<Integer>& indices) const
 {
-    if (std::is_integral<T>::value) {
-        out << T(t + mod.addition);
-    } else {
-        out << t;
-    }
+    return subseq(std::vector<T>(indices));
 }
 
-JNGEN_DECLARE_PRINTER(detail::VectorDepth<T>::value == 1, 3)
-{
-    if (mod.printN) {
-        out << t.size() << "\n";
-    }
-    bool first = true;
-    for (const auto& x: t) {
-        if (first) {
-            first = false;
-        } else {
-            out << mod.sep;
-        }
-        JNGEN_PRINT(x);
-    }
+template<typename T>
+T GenericArray<T>::choice() const {
+    return jngen::choice(begin(), end());
 }
 
-JNGEN_DECLARE_PRINTER(detail::VectorDepth<T>::value == 1 &&
-    std::tuple_size<typename T::value_type>::value == 2, 4)
-{
-    if (mod.printN) {
-        out << t.size() << "\n";
-    }
+template<typename T>
+GenericArray<T> GenericArray<T>::choice(size_t count) const {
+    ensure(
+        count <= size(),
+        "Use Array::choiceWithRepetition to select more than size() elements");
 
-    bool first = true;
-    for (const auto& x: t) {
-        if (first) {
-            first = false;
-        } else {
-            out << "\n";
-        }
-        JNGEN_PRINT(x);
-    }
-}
+    size_t n = size();
 
-JNGEN_DECLARE_PRINTER(detail::VectorDepth<T>::value == 2, 4)
-{
-    if (mod.printN) {
-        out << t.size() << (mod.printM ? " " : "");
-    }
-    if (mod.printM) {
-        if (t.empty()) {
-            out << 0;
-        } else {
-            auto size = t[0].size();
-            out << size;
-            for (const auto& vec: t) {
-                ensure(size == vec.size(), "Size of all matrix elements must "
-                        "be equal if printM is specified");
-            }
-        }
+    std::unordered_map<size_t, size_t> used;
+    std::vector<size_t> res;
+    for (size_t i = 0; i < count; ++i) {
+        size_t oldValue = used.count(n-i-1) ? used[n-i-1] : n-i-1;
+        size_t index = rnd.tnext<size_t>(n-i);
+        res.push_back(used.count(index) ? used[index] : index);
+        used[index] = oldValue;
     }
 
-    if ((mod.printN || mod.printM) && !t.empty()) {
-        out << "\n";
-    }
+    return subseq(res);
+}
 
-    auto tmp = mod;
-    {
-        auto mod = tmp;
-        mod.printN = mod.printM = false;
-        bool first = true;
-        for (const auto& x: t) {
-            if (first) {
-                first = false;
-            } else {
-                out << '\n';
-            }
-            JNGEN_PRINT(x);
-        }
+template<typename T>
+GenericArray<T> GenericArray<T>::choiceWithRepetition(size_t count) const {
+    checkLargeParameter(count);
+    GenericArray<T> res(count);
+    for (T& t: res) {
+        t = choice();
     }
+    return res;
 }
 
-JNGEN_DECLARE_PRINTER(JNGEN_HAS_FUNCTION(Container), 2)
-{
-    if (mod.printN) {
-        out << t.size() << "\n";
-    }
-    bool first = true;
-    for (const auto& x: t) {
-        if (first) {
-            first = false;
-        } else {
-            out << " ";
-        }
-        JNGEN_PRINT(x);
+template<typename T>
+GenericArray<T>& GenericArray<T>::operator+=(const GenericArray<T>& other) {
+    if (&other == this) {
+        return *this *= 2;
     }
+    insert(end(), other.begin(), other.end());
+    return *this;
 }
 
-JNGEN_DECLARE_PRINTER(JNGEN_HAS_FUNCTION(Container)
-    && std::tuple_size<typename T::value_type>::value == 2, 3)
-{
-    if (mod.printN) {
-        out << t.size() << "\n";
-    }
-    bool first = true;
-    for (const auto& x: t) {
-        if (first) {
-            first = false;
-        } else {
-            out << "\n";
-        }
-        JNGEN_PRINT(x);
+template<typename T>
+GenericArray<T> GenericArray<T>::operator+(const GenericArray<T>& other) const {
+    GenericArray<T> copy(*this);
+    return copy += other;
+}
+
+template<typename T>
+GenericArray<T>& GenericArray<T>::operator*=(int k) {
+    if (k == 0) {
+        clear();
+        return *this;
     }
+
+    this->reserve(size() * k);
+
+    std::copy_n(begin(), size() * (k - 1), std::back_inserter(*this));
+
+    return *this;
 }
 
-// http://stackoverflow.com/a/19841470/2159939
-#define JNGEN_COMMA ,
+template<typename T>
+GenericArray<T> GenericArray<T>::operator*(int k) const {
+    GenericArray<T> copy(*this);
+    return copy *= k;
+}
 
-template<typename Lhs, typename Rhs>
-JNGEN_DECLARE_SIMPLE_PRINTER(std::pair<Lhs JNGEN_COMMA Rhs>, 3)
-{
-    JNGEN_PRINT(t.first);
-    out << " ";
-    JNGEN_PRINT(t.second);
+template<typename T>
+GenericArray<T>::operator std::string() const {
+    static_assert(std::is_same<T, char>::value, "Must not cast"
+        " TArray<T> to std::string with 'T' != 'char'");
+    return std::string(begin(), end());
 }
 
-#undef JNGEN_COMMA
+// JNGEN_EXTERN template class GenericArray<int>;
 
-// Following snippet allows writing
-//     cout << pair<int, int>(1, 2) << endl;
-// in user code. I have to put it into separate namespace because
-//   1) I don't want to 'use' all operator<< from jngen
-//   2) I cannot do it in global namespace because JNGEN_HAS_OSTREAM relies
-// on that it is in jngen.
-namespace namespace_for_fake_operator_ltlt {
+template<typename T>
+using TArray = GenericArray<T>;
+
+using Array = GenericArray<int>;
+using Array2d = GenericArray<jngen::GenericArray<int>>;
+using Array64 = GenericArray<long long>;
+using Arrayf = GenericArray<double>;
+using Arrayp = GenericArray<std::pair<int, int>>;
 
 template<typename T>
-auto operator<<(std::ostream& out, const T& t)
-    -> enable_if_t<
-            !JNGEN_HAS_OSTREAM() && !std::is_base_of<BaseReprProxy, T>::value,
-            std::ostream&
-        >
-{
-    // not jngen::printValue, because relying on ADL here for printers declared
-    // later (see, e.g., http://stackoverflow.com/questions/42833134)
-    printValue(out, t, jngen::defaultMod, jngen::PTagMax{});
-    return out;
+jngen::GenericArray<T> makeArray(const std::vector<T>& values) {
+    return jngen::GenericArray<T>(values);
+}
+
+template<typename T>
+jngen::GenericArray<T> makeArray(const std::initializer_list<T>& values) {
+    return jngen::GenericArray<T>(values);
+}
+
+template<typename T, typename U>
+TArray<std::pair<T, U>> zip(const TArray<T>& lhs, const TArray<U>& rhs) {
+    ensure(
+        lhs.size() == rhs.size(),
+        "In zip(a, b), a and b must have the same size");
+    TArray<std::pair<T, U>> result;
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        result.emplace_back(lhs[i], rhs[i]);
+    }
+    return result;
+}
+
+template<typename T, typename U>
+TArray<T> arrayCast(const TArray<U>& array) {
+    return TArray<T>(array.begin(), array.end());
 }
 
-} // namespace namespace_for_fake_operator_ltlt
+template<typename T>
+struct Hash<TArray<T>> {
+    uint64_t operator()(const TArray<T>& elements) const {
+        return Hash<std::vector<T>>{}(elements);
+    }
+};
+
+} // namespace jngen
 
-// Calling this operator inside jngen namespace doesn't work without this line.
-using namespace jngen::namespace_for_fake_operator_ltlt;
+JNGEN_DEFINE_STD_HASH_TEMPLATE(T, jngen::TArray<T>);
 
-} // namespace jngen
+using jngen::makeArray;
+using jngen::zip;
+using jngen::arrayCast;
 
-using namespace jngen::namespace_for_fake_operator_ltlt;
+using jngen::TArray;
+
+using jngen::Array;
+using jngen::Array2d;
+using jngen::Array64;
+using jngen::Arrayf;
+using jngen::Arrayp;
 
 
 #include <algorithm>
-#include <iterator>
-#include <numeric>
+#include <functional>
+#include <utility>
+#include <vector>
 
 namespace jngen {
 
-// TODO: deprecate random_shuffle as done in testlib.h
+// A random array which is never stored as a whole. Elements are generated
+// chunk by chunk when the array is printed or traversed, so the memory used
+// is O(chunk size) instead of O(size). Each chunk has its own stream derived
+// from the state of rnd at creation, hence the content is fixed at creation:
+// printing the array twice yields the same output.
+template<typename T>
+class GenericArrayStream : public ReprProxy<GenericArrayStream<T>> {
+public:
+    // Fills |count| elements at |out| using the given generator.
+    typedef std::function<void(Random&, T*, size_t)> Generator;
+
+    // |parallel| should be false if the generator uses global state, e.g.
+    // calls rnd directly.
+    GenericArrayStream(
+            size_t size, Generator generator, bool parallel = true) :
+        size_(size),
+        generator_(std::move(generator)),
+        parallel_(parallel),
+        base_(rnd.split(1)[0])
+    {  }
 
-template<typename Iterator>
-void shuffle(Iterator begin, Iterator end) {
-    ensure(end >= begin, "Cannot shuffle range of negative length");
-    size_t size = end - begin;
-    for (size_t i = 1; i < size; ++i) {
-        std::swap(*(begin + i), *(begin + rnd.next(i + 1)));
+    size_t size() const { return size_; }
+
+    // Calls f(const T* data, size_t count) for consecutive chunks. With
+    // config.threads > 0 that many chunks are generated in parallel unless
+    // the stream is sequential.
+    template<typename F>
+    void forEachChunk(F f) const;
+
+    GenericArray<T> toArray() const;
+
+private:
+    size_t size_;
+    Generator generator_;
+    bool parallel_;
+    Random base_;
+};
+
+template<typename T>
+template<typename F>
+void GenericArrayStream<T>::forEachChunk(F f) const {
+    const size_t CHUNK = detail::PARALLEL_CHUNK_SIZE;
+    size_t chunks = (size_ + CHUNK - 1) / CHUNK;
+    size_t batch = parallel_ ? std::max(config.threads, 1) : 1;
+    std::vector<std::vector<T>> buffers(std::min(batch, chunks));
+
+    for (size_t start = 0; start < chunks; start += batch) {
+        size_t count = std::min(batch, chunks - start);
+        detail::parallelFor(count, [&](size_t i) {
+            size_t chunk = start + i;
+            size_t length = std::min(CHUNK, size_ - chunk * CHUNK);
+            Random random = base_.stream(chunk);
+            Generator generator = generator_;
+            buffers[i].resize(length);
+            generator(random, buffers[i].data(), length);
+        });
+        for (size_t i = 0; i < count; ++i) {
+            f(static_cast<const T*>(buffers[i].data()), buffers[i].size());
+        }
     }
 }
 
-template<typename Iterator>
-auto choice(Iterator begin, Iterator end)
-        -> typename std::iterator_traits<Iterator>::value_type
-{
-    return rnd.choice(begin, end);
+template<typename T>
+GenericArray<T> GenericArrayStream<T>::toArray() const {
+    checkLargeParameter(size_);
+    GenericArray<T> result;
+    result.reserve(size_);
+    forEachChunk([&result](const T* data, size_t count) {
+        result.insert(result.end(), data, data + count);
+    });
+    return result;
 }
 
-template<typename Container>
-typename Container::value_type choice(const Container& container) {
-    return rnd.choice(container);
+template<typename T>
+template<typename ...Args>
+GenericArrayStream<T> GenericArray<T>::randomStream(
+        size_t size, const Args& ... args)
+{
+    return GenericArrayStream<T>(size,
+        [args...](Random& random, T* out, size_t count) {
+            detail::fillRandom<T>(random, out, count, 0, args...);
+        });
 }
 
 template<typename T>
-T choice(std::initializer_list<T> ilist) {
-    return choice(ilist.begin(), ilist.end());
+template<typename F, typename ...Args>
+GenericArrayStream<T> GenericArray<T>::randomfStream(
+        size_t size, F func, const Args& ... args)
+{
+    return GenericArrayStream<T>(size,
+        [func, args...](Random& random, T* out, size_t count) mutable {
+            for (size_t i = 0; i < count; ++i) {
+                out[i] = detail::invokeWithRandom(func, random, 0, args...);
+            }
+        },
+        decltype(detail::acceptsRandom(func, 0, args...))::value);
 }
 
 namespace detail {
 
-template<typename Collection2D>
-typename Collection2D::value_type interleave(const Collection2D& collection) {
-    std::vector<size_t> sizes;
-    for (const auto& c: collection) {
-        sizes.push_back(c.size());
-    }
-    size_t size = std::accumulate(sizes.begin(), sizes.end(), 0u);
-
-    typename Collection2D::value_type result;
-    while (size > 0) {
-        size_t id = rnd.nextByDistribution(sizes);
-        result.emplace_back(collection[id][collection[id].size() - sizes[id]]);
-        --sizes[id];
-
-        --size;
-    }
+template<typename T>
+char streamSeparator(const T*, const OutputModifier& mod) {
+    return mod.sep;
+}
 
-    return result;
+template<typename A, typename B>
+char streamSeparator(const std::pair<A, B>*, const OutputModifier&) {
+    return '\n';
 }
 
 } // namespace detail
 
-template<typename Collection2D>
-typename Collection2D::value_type interleave(const Collection2D& collection) {
-    return detail::interleave(collection);
+template<typename T>
+JNGEN_DECLARE_SIMPLE_PRINTER(GenericArrayStream<T>, 5) {
+    if (mod.printN) {
+        out << t.size() << "\n";
+    }
+    char sep = detail::streamSeparator(static_cast<const T*>(nullptr), mod);
+    bool first = true;
+    t.forEachChunk([&](const T* data, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            if (first) {
+                first = false;
+            } else {
+                out << sep;
+            }
+            JNGEN_PRINT(data[i]);
+        }
+    });
 }
 
-template<typename Collection>
-Collection interleave(const std::initializer_list<Collection>& ilist) {
-    return detail::interleave<std::vector<Collection>>(ilist);
-}
+template<typename T>
+using TArrayStream = GenericArrayStream<T>;
+
+using ArrayStream = GenericArrayStream<int>;
+using ArrayStream64 = GenericArrayStream<long long>;
+using ArrayStreamf = GenericArrayStream<double>;
+using ArrayStreamp = GenericArrayStream<std::pair<int, int>>;
 
 } // namespace jngen
 
-using jngen::shuffle;
-using jngen::choice;
-using jngen::interleave;
+using jngen::TArrayStream;
+
+using jngen::ArrayStream;
+using jngen::ArrayStream64;
+using jngen::ArrayStreamf;
+using jngen::ArrayStreamp;
+
+// This header is named 'math_jngen.h' and not 'math.h' because in the latter
+// case it will replace the standard 'math.h' if you set jngen folder as the
+// include path.
 
 
 #include <algorithm>
-#include <initializer_list>
-#include <numeric>
-#include <set>
-#include <string>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <limits>
 #include <type_traits>
 #include <unordered_set>
-#include <unordered_map>
-#include <utility>
 #include <vector>
 
 namespace jngen {
 
-template<typename T>
-class GenericArray : public ReprProxy<GenericArray<T>>, public std::vector<T> {
+namespace detail {
+
+inline int multiply(int x, int y, int mod) {
+    return static_cast<long long>(x) * y % mod;
+}
+
+inline long long multiply(long long x, long long y, long long mod) {
+#if defined(__SIZEOF_INT128__)
+    return static_cast<__int128>(x) * y % mod;
+#else
+    long long res = 0;
+    while (y) {
+        if (y&1) {
+            res = (static_cast<unsigned long long>(res) + x) % mod;
+        }
+        x = (static_cast<unsigned long long>(x) + x) % mod;
+        y >>= 1;
+    }
+    return res;
+#endif
+}
+
+// Modular arithmetic with a fixed modulus n. Numbers are kept in some
+// internal form: to() converts a number to it and from() converts it back,
+// one() and multiply() work with the internal form.
+
+#if defined(__SIZEOF_INT128__)
+
+// Montgomery form modulo an odd n: x is kept as x * 2^64 mod n, and a product
+// is reduced with two multiplications instead of a 128-bit division.
+class Montgomery64 {
 public:
-    typedef std::vector<T> Base;
+    explicit Montgomery64(uint64_t n) : n_(n) {
+        // Newton's iterations, each one doubles the number of correct bits.
+        inverse_ = n;
+        for (int i = 0; i < 5; ++i) {
+            inverse_ *= 2 - n * inverse_;
+        }
+        one_ = (0 - n) % n;
+        r2_ = static_cast<unsigned __int128>(one_) * one_ % n;
+    }
 
-    using Base::Base;
+    uint64_t one() const { return one_; }
 
-    GenericArray() {}
-    GenericArray(const GenericArray<T>&) = default;
-    GenericArray& operator=(const GenericArray<T>&) = default;
-    GenericArray(GenericArray<T>&&) = default;
-    GenericArray& operator=(GenericArray<T>&&) = default;
+    uint64_t to(uint64_t x) const { return multiply(x % n_, r2_); }
 
-    ~GenericArray() {}
+    uint64_t from(uint64_t x) const { return reduce(x); }
 
-    /* implicit */ GenericArray(const Base& base) :
-            Base(base)
-    {  }
+    uint64_t multiply(uint64_t x, uint64_t y) const {
+        return reduce(static_cast<unsigned __int128>(x) * y);
+    }
 
-    using Base::at;
-    using Base::size;
-    using Base::resize;
-    using Base::begin;
-    using Base::end;
-    using Base::insert;
-    using Base::clear;
-    using Base::erase;
+private:
+    // Returns t * 2^-64 mod n for t < n * 2^64.
+    uint64_t reduce(unsigned __int128 t) const {
+        uint64_t m = static_cast<uint64_t>(t) * inverse_;
+        uint64_t high = t >> 64;
+        uint64_t sub = (static_cast<unsigned __int128>(m) * n_) >> 64;
+        return high >= sub ? high - sub : high - sub + n_;
+    }
+
+    uint64_t n_;
+    uint64_t inverse_;
+    uint64_t one_;
+    uint64_t r2_;
+};
 
-    void extend(size_t requiredSize) {
-        checkLargeParameter(requiredSize);
-        if (requiredSize > size()) {
-            resize(requiredSize);
-        }
+// Barrett reduction modulo n < 2^32: x mod n is x - q * n, where the quotient
+// q is x * floor(2^64 / n) / 2^64 with an error of at most one.
+class Barrett32 {
+public:
+    explicit Barrett32(uint64_t n) : n_(n), m_(~uint64_t(0) / n) {}
+
+    uint64_t one() const { return 1 % n_; }
+
+    uint64_t to(uint64_t x) const { return reduce(x); }
+
+    uint64_t from(uint64_t x) const { return x; }
+
+    uint64_t reduce(uint64_t x) const {
+        uint64_t q = (static_cast<unsigned __int128>(x) * m_) >> 64;
+        uint64_t r = x - q * n_;
+        return r >= n_ ? r - n_ : r;
     }
 
-    template<typename F, typename ...Args>
-    static GenericArray<T> randomf(size_t size, F func, const Args& ... args);
-    template<typename F, typename ...Args>
-    static GenericArray<T> randomfUnique(
-            size_t size, F func, const Args& ... args);
-    template<typename F, typename ...Args>
-    static GenericArray<T> randomfAll(F func, const Args& ... args);
+    uint64_t multiply(uint64_t x, uint64_t y) const {
+        return reduce(x * y);
+    }
 
-    template<typename ...Args>
-    static GenericArray<T> random(size_t size, const Args& ... args);
-    template<typename ...Args>
-    static GenericArray<T> randomUnique(size_t size, const Args& ... args);
-    template<typename ...Args>
-    static GenericArray<T> randomAll(const Args& ... args);
+private:
+    uint64_t n_;
+    uint64_t m_;
+};
 
-    static GenericArray<T> id(size_t size, T start = T{});
+#else
 
-    GenericArray<T>& shuffle();
-    GenericArray<T> shuffled() const;
+// Without 128-bit integers both classes fall back to plain division.
+class Montgomery64 {
+public:
+    explicit Montgomery64(uint64_t n) : n_(n) {}
 
-    GenericArray<T>& reverse();
-    GenericArray<T> reversed() const;
+    uint64_t one() const { return 1 % n_; }
 
-    GenericArray<T>& sort();
-    GenericArray<T> sorted() const;
+    uint64_t to(uint64_t x) const { return x % n_; }
 
-    template<typename Comp>
-    GenericArray<T>& sort(Comp&& comp);
-    template<typename Comp>
-    GenericArray<T> sorted(Comp&& comp) const;
+    uint64_t from(uint64_t x) const { return x; }
 
-    GenericArray<T>& unique();
-    GenericArray<T> uniqued() const;
+    uint64_t multiply(uint64_t x, uint64_t y) const {
+        uint64_t result = 0;
+        for (; y; y >>= 1) {
+            if (y & 1) {
+                result = result >= n_ - x ? result - (n_ - x) : result + x;
+            }
+            x = x >= n_ - x ? x - (n_ - x) : x + x;
+        }
+        return result;
+    }
 
-    GenericArray<T> inverse() const;
+private:
+    uint64_t n_;
+};
 
-    template<typename Integer>
-    GenericArray<T> subseq(const std::vector<Integer>& indices) const;
+class Barrett32 {
+public:
+    explicit Barrett32(uint64_t n) : n_(n) {}
 
-    template<typename Integer>
-    GenericArray<T> subseq(
-        const std::initializer_list<Integer>& indices) const;
+    uint64_t one() const { return 1 % n_; }
 
-    T choice() const;
-    GenericArray<T> choice(size_t count) const;
-    GenericArray<T> choiceWithRepetition(size_t count) const;
+    uint64_t to(uint64_t x) const { return x % n_; }
 
-    GenericArray<T>& operator+=(const GenericArray<T>& other);
-    GenericArray<T> operator+(const GenericArray<T>& other) const;
+    uint64_t from(uint64_t x) const { return x; }
 
-    GenericArray<T>& operator*=(int k);
-    GenericArray<T> operator*(int k) const;
+    uint64_t reduce(uint64_t x) const { return x % n_; }
 
-    operator std::string() const;
+    uint64_t multiply(uint64_t x, uint64_t y) const { return x * y % n_; }
+
+private:
+    uint64_t n_;
 };
 
-template<typename T>
-template<typename ...Args>
-GenericArray<T> GenericArray<T>::random(size_t size, const Args& ... args) {
-    checkLargeParameter(size);
-    GenericArray<T> result(size);
-    for (T& x: result) {
-        x = rnd.tnext<T>(args...);
+#endif // defined(__SIZEOF_INT128__)
+
+// Returns x^k in the internal form of |arithmetic|.
+template<typename Arithmetic>
+uint64_t modularPower(const Arithmetic& arithmetic, uint64_t x, uint64_t k) {
+    uint64_t result = arithmetic.one();
+    for (; k; k >>= 1) {
+        if (k & 1) {
+            result = arithmetic.multiply(result, x);
+        }
+        x = arithmetic.multiply(x, x);
     }
     return result;
 }
 
-template<typename T>
-template<typename F, typename ...Args>
-GenericArray<T> GenericArray<T>::randomf(
-        size_t size,
-        F func,
-        const Args& ... args)
-{
-    checkLargeParameter(size);
-    GenericArray<T> result(size);
-    for (T& x: result) {
-        x = func(args...);
+// x^k mod |mod| for 0 <= x < mod.
+inline int power(int x, int k, int mod) {
+    Barrett32 arithmetic(mod);
+    return arithmetic.from(modularPower(arithmetic, x, k));
+}
+
+inline long long power(long long x, long long k, long long mod) {
+    if (mod % 2 == 1) {
+        Montgomery64 arithmetic(mod);
+        return arithmetic.from(modularPower(arithmetic, arithmetic.to(x), k));
+    }
+    long long res = 1;
+    while (k) {
+        if (k&1) {
+            res = multiply(res, x, mod);
+        }
+        x = multiply(x, x, mod);
+        k >>= 1;
     }
-    return result;
+    return res;
 }
 
-namespace detail {
-
-template<typename T, typename Enable = std::size_t>
-struct DictContainer {
-    typedef std::set<T> type;
-};
-
-template<typename T>
-struct DictContainer<T, typename std::hash<T>::result_type>
-{
-    typedef std::unordered_set<T> type;
-};
+// Deterministic Miller-Rabin test for odd n > 2.
+bool millerRabinTest(uint64_t n);
 
-} // namespace detail
+// Appends primes from [l, r] to |out| in increasing order. The range is
+// sieved in segments by primes up to some limit; if it is less than sqrt(r),
+// the remaining numbers are checked with millerRabinTest.
+void primesInRange(long long l, long long r, std::vector<long long>& out);
 
-template<typename T>
-template<typename F, typename ...Args>
-GenericArray<T> GenericArray<T>::randomfUnique(
-        size_t size,
-        F func,
-        const Args& ... args)
-{
-    typename detail::DictContainer<T>::type set;
-    checkLargeParameter(size);
-    GenericArray<T> result;
-    result.reserve(size);
+// Returns a uniformly random sequence of |count| numbers from
+// [minSize, maxSize] with sum n. Such a sequence must exist.
+Array64 randomComposition(
+        long long n, int count, long long minSize, long long maxSize);
 
-    size_t retries = (size + 10) * log(size + 10) * 2;
+class RandomPrimesProxy {
+public:
+    RandomPrimesProxy(size_t count, long long l, long long r) :
+        count_(count),
+        l_(l),
+        r_(r)
+    {  }
 
-    while (result.size() != size) {
-        T t = func(args...);
-        if (!set.count(t)) {
-            set.insert(t);
-            result.push_back(t);
-        }
+    Array64 a() const;
 
-        if (--retries == 0) {
-            ensure(false, "There are not enough unique elements");
-        }
+    operator Array64() const;
 
+    RandomPrimesProxy& distinct(bool value = true) {
+        distinct_ = value;
+        return *this;
     }
 
-    return result;
-}
+private:
+    size_t count_;
+    long long l_;
+    long long r_;
+    bool distinct_ = false;
+};
 
-template<typename T>
-template<typename ...Args>
-GenericArray<T> GenericArray<T>::randomUnique(
-        size_t size, const Args& ... args)
-{
-    return GenericArray<T>::randomfUnique(
-        size,
-        [](Args... args) { return rnd.tnext<T>(args...); },
-        args...);
-}
+} // namespace detail
 
-template<typename T>
-template<typename F, typename ...Args>
-GenericArray<T> GenericArray<T>::randomfAll(
-        F func,
-        const Args& ... args)
-{
-    typename detail::DictContainer<T>::type set;
-    GenericArray<T> result;
+bool isPrime(long long n);
 
-    size_t timeAfterLastHit = 0;
+// Returns prime factors of n in increasing order, each one is repeated as
+// many times as it divides n.
+Array64 factorize(long long n);
 
-    while (true) {
-        T t = func(args...);
-        if (!set.count(t)) {
-            set.insert(t);
-            result.push_back(t);
-            timeAfterLastHit = 0;
-        }
+class MathRandom {
+public:
+    MathRandom() {
+        static bool created = false;
+        ensure(!created, "jngen::MathRandom should be created only once");
+        created = true;
+    }
 
-        ++timeAfterLastHit;
+    static long long randomPrime(long long n) {
+        ensure(n > 2, format("There are no primes below %lld", n));
+        return randomPrime(2, n - 1);
+    }
 
-        // Probability of finding not all elements is about e^{-20} ~= 1e-9
-        if (timeAfterLastHit > (result.size() + 10) * 20) {
-            return result;
+    static long long randomPrime(long long l, long long r) {
+        ensure(l <= r);
+        std::unordered_set<long long> used;
+        while (static_cast<long long>(used.size()) < r - l + 1) {
+            long long x = rnd.next(l, r);
+            if (used.count(x)) {
+                continue;
+            }
+            used.insert(x);
+            if (isPrime(x)) {
+                return x;
+            }
         }
+        ensure(
+            false,
+            format(
+                "There are no primes between %lld and %lld",
+                l, r)
+        );
     }
-}
 
-template<typename T>
-template<typename ...Args>
-GenericArray<T> GenericArray<T>::randomAll(const Args& ... args)
-{
-    return GenericArray<T>::randomfAll(
-        [](Args... args) { return rnd.tnext<T>(args...); },
-        args...);
-}
+    static long long nextPrime(long long n);
 
-template<typename T>
-GenericArray<T> GenericArray<T>::id(size_t size, T start) {
-    constexpr bool enable = std::is_integral<T>::value;
-    static_assert(enable, "Cannot call Array<T>::id with non-integral T");
-    checkLargeParameter(size);
+    static long long previousPrime(long long n);
 
-    if (enable) {
-        GenericArray<T> result(size);
-        std::iota(result.begin(), result.end(), start);
+    static Array64 primes(long long l, long long r) {
+        ensure(l <= r);
+        Array64 result;
+        detail::primesInRange(l, r, result);
         return result;
-    } else {
-        return {};
     }
-}
-
-template<typename T>
-GenericArray<T>& GenericArray<T>::shuffle() {
-    jngen::shuffle(begin(), end());
-    return *this;
-}
 
-template<typename T>
-GenericArray<T> GenericArray<T>::shuffled() const {
-    auto res = *this;
-    res.shuffle();
-    return res;
-}
-
-template<typename T>
-GenericArray<T>& GenericArray<T>::reverse() {
-    std::reverse(begin(), end());
-    return *this;
-}
+    static detail::RandomPrimesProxy randomPrimes(
+            size_t count, long long n)
+    {
+        ensure(n > 2, format("There are no primes below %lld", n));
+        return randomPrimes(count, 2, n - 1);
+    }
 
-template<typename T>
-GenericArray<T> GenericArray<T>::reversed() const {
-    auto res = *this;
-    res.reverse();
-    return res;
-}
+    static detail::RandomPrimesProxy randomPrimes(
+            size_t count, long long l, long long r)
+    {
+        ensure(l <= r);
+        return detail::RandomPrimesProxy(count, l, r);
+    }
 
-template<typename T>
-GenericArray<T>& GenericArray<T>::sort() {
-    std::sort(begin(), end());
-    return *this;
-}
+    static long long highlyComposite(long long upTo);
 
-template<typename T>
-GenericArray<T> GenericArray<T>::sorted() const {
-    auto res = *this;
-    res.sort();
-    return res;
-}
+    static long long primeProduct(int k, long long l, long long r);
 
-template<typename T>
-template<typename Comp>
-GenericArray<T>& GenericArray<T>::sort(Comp&& comp) {
-    std::sort(begin(), end(), comp);
-    return *this;
-}
+    static long long semiprime(long long l, long long r) {
+        return primeProduct(2, l, r);
+    }
 
-template<typename T>
-template<typename Comp>
-GenericArray<T> GenericArray<T>::sorted(Comp&& comp) const {
-    auto res = *this;
-    res.sort(comp);
-    return res;
-}
+    static long long smooth(long long n, long long bound);
 
-template<typename T>
-GenericArray<T>& GenericArray<T>::unique() {
-    erase(std::unique(begin(), end()), end());
-    return *this;
-}
+    static Array partition(
+            int n,
+            int numParts,
+            int minSize = 0,
+            int maxSize = -1)
+    {
+        auto res = partition(
+            static_cast<long long>(n),
+            numParts,
+            static_cast<long long>(minSize),
+            static_cast<long long>(maxSize));
+        return Array(res.begin(), res.end());
+    }
 
-template<typename T>
-GenericArray<T> GenericArray<T>::uniqued() const {
-    auto res = *this;
-    res.unique();
-    return res;
-}
+    static Array64 partition(
+            long long n,
+            int numParts,
+            long long minSize = 0,
+            long long maxSize = -1)
+    {
+        if (maxSize == -1) {
+            maxSize = n;
+        }
 
-template<typename T>
-GenericArray<T> GenericArray<T>::inverse() const {
-    static_assert(
-        std::is_integral<T>::value,
-        "Can only take inverse permutation of integral array");
-    int n = size();
+        ensure(n >= 0);
+        ensure(numParts >= 0);
+        ensure(numParts * minSize <= n, "minSize is too large");
+        ensure(numParts * maxSize >= n, "maxSize is too small");
+        ensure(minSize <= maxSize);
 
-    if (n == 0) {
-        return *this;
+        return detail::randomComposition(n, numParts, minSize, maxSize);
     }
 
-    // sanity check
-    ensure(*max_element(begin(), end()) == n-1 &&
-        *min_element(begin(), end()) == 0,
-        "Trying to take inverse of the array which is not a permutation");
-
-    const static T NONE = static_cast<T>(-1);
-    GenericArray<T> result(n, NONE);
-    for (int i = 0; i < n; ++i) {
-        ensure(result[at(i)] == NONE,
-            "Trying to take inverse of the array which is not a permutation");
-        result[at(i)] = i;
+    template<typename T>
+    TArray<TArray<T>> partition(
+            TArray<T> elements,
+            int numParts,
+            int minSize = 0,
+            int maxSize = -1)
+    {
+        return partition(
+            std::move(elements),
+            partition(
+                static_cast<int>(elements.size()),
+                numParts,
+                minSize,
+                maxSize));
     }
 
-    return result;
-}
+    template<typename T>
+    TArray<TArray<T>> partition(TArray<T> elements, const Array& sizes) {
+        size_t total = std::accumulate(sizes.begin(), sizes.end(), size_t(0));
+        ensure(total == elements.size(), "sum(sizes) != elements.size()");
+        elements.shuffle();
+        TArray<TArray<T>> res;
+        auto it = elements.begin();
+        for (int size: sizes) {
+            res.emplace_back();
+            std::copy(it, it + size, std::back_inserter(res.back()));
+            it += size;
+        }
 
-template<typename T>
-template<typename Integer>
-GenericArray<T> GenericArray<T>::subseq(
-        const std::vector<Integer>& indices) const
-{
-    GenericArray<T> result;
-    result.reserve(indices.size());
-    for (Integer idx: indices) {
-        result.push_back(at(idx));
+        return res;
     }
-    return result;
-}
+};
 
-// TODO(ifsmirnov): ever need to make it faster?
-template<typename T>
-template<typename Integer>
-GenericArray<T> GenericArray<T>::subseq(
-        const std::initializer_list<Integer>& indices) const
-{
-    return subseq(std::vector<T>(indices));
-}
+JNGEN_EXTERN MathRandom rndm;
 
-template<typename T>
-T GenericArray<T>::choice() const {
-    return jngen::choice(begin(), end());
+JNGEN_DECLARE_SIMPLE_PRINTER(detail::RandomPrimesProxy, 2) {
+    JNGEN_PRINT(t.a());
 }
 
-template<typename T>
-GenericArray<T> GenericArray<T>::choice(size_t count) const {
-    ensure(
-        count <= size(),
-        "Use Array::choiceWithRepetition to select more than size() elements");
+} // namespace jngen
 
-    size_t n = size();
+#ifndef JNGEN_DECLARE_ONLY
+#define JNGEN_INCLUDE_MATH_JNGEN_INL_H
+#ifndef JNGEN_INCLUDE_MATH_JNGEN_INL_H
+#error File "math_jngen_inl.h" must not be included directly.
+#endif
 
-    std::unordered_map<size_t, size_t> used;
-    std::vector<size_t> res;
-    for (size_t i = 0; i < count; ++i) {
-        size_t oldValue = used.count(n-i-1) ? used[n-i-1] : n-i-1;
-        size_t index = rnd.tnext<size_t>(n-i);
-        res.push_back(used.count(index) ? used[index] : index);
-        used[index] = oldValue;
-    }
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_set>
+#include <vector>
 
-    return subseq(res);
-}
+namespace jngen {
+namespace detail {
 
-template<typename T>
-GenericArray<T> GenericArray<T>::choiceWithRepetition(size_t count) const {
-    checkLargeParameter(count);
-    GenericArray<T> res(count);
-    for (T& t: res) {
-        t = choice();
+template<typename Arithmetic>
+bool millerRabinTest(
+        uint64_t n,
+        const Arithmetic& arithmetic,
+        const uint64_t* begin,
+        const uint64_t* end)
+{
+    int r = 0;
+    uint64_t d = n - 1;
+    while (d % 2 == 0) {
+        ++r;
+        d /= 2;
     }
-    return res;
-}
 
-template<typename T>
-GenericArray<T>& GenericArray<T>::operator+=(const GenericArray<T>& other) {
-    if (&other == this) {
-        return *this *= 2;
+    const uint64_t one = arithmetic.one();
+    const uint64_t minusOne = arithmetic.to(n - 1);
+
+    for (const uint64_t* a = begin; a != end; ++a) {
+        if (*a % n == 0) {
+            continue;
+        }
+
+        uint64_t x = modularPower(arithmetic, arithmetic.to(*a), d);
+        if (x == one || x == minusOne) {
+            continue;
+        }
+
+        bool composite = true;
+        for (int i = 0; i < r - 1 && composite; ++i) {
+            x = arithmetic.multiply(x, x);
+            if (x == minusOne) {
+                composite = false;
+            } else if (x == one) {
+                break;
+            }
+        }
+        if (composite) {
+            return false;
+        }
     }
-    insert(end(), other.begin(), other.end());
-    return *this;
+    return true;
 }
 
-template<typename T>
-GenericArray<T> GenericArray<T>::operator+(const GenericArray<T>& other) const {
-    GenericArray<T> copy(*this);
-    return copy += other;
-}
+bool millerRabinTest(uint64_t n) {
+    // Deterministic for n < 4759123141 and for all n < 2^64 respectively.
+    static const uint64_t SMALL_WITNESSES[] = {2, 7, 61};
+    static const uint64_t WITNESSES[] =
+        {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
 
-template<typename T>
-GenericArray<T>& GenericArray<T>::operator*=(int k) {
-    if (k == 0) {
-        clear();
-        return *this;
+    if (n < (uint64_t(1) << 32)) {
+        return millerRabinTest(
+            n, Barrett32(n), SMALL_WITNESSES, SMALL_WITNESSES + 3);
+    }
+    if (n < 4759123141ull) {
+        return millerRabinTest(
+            n, Montgomery64(n), SMALL_WITNESSES, SMALL_WITNESSES + 3);
     }
+    return millerRabinTest(n, Montgomery64(n), WITNESSES, WITNESSES + 7);
+}
 
-    this->reserve(size() * k);
+// Returns a nontrivial divisor of an odd composite n with Brent's variant of
+// the Pollard's rho algorithm: gcd is taken once per STEP differences, and if
+// it fails the last block is repeated step by step.
+uint64_t pollardRho(uint64_t n) {
+    const uint64_t STEP = 128;
 
-    std::copy_n(begin(), size() * (k - 1), std::back_inserter(*this));
+    Montgomery64 arithmetic(n);
+    auto difference = [](uint64_t x, uint64_t y) {
+        return x > y ? x - y : y - x;
+    };
 
-    return *this;
-}
+    for (uint64_t c = 1; ; ++c) {
+        uint64_t shift = arithmetic.to(c);
+        // x^2 + c in Montgomery form, the sum is below 2n < 2^64.
+        auto next = [&arithmetic, shift, n](uint64_t x) {
+            uint64_t y = arithmetic.multiply(x, x) + shift;
+            return y >= n ? y - n : y;
+        };
 
-template<typename T>
-GenericArray<T> GenericArray<T>::operator*(int k) const {
-    GenericArray<T> copy(*this);
-    return copy *= k;
-}
+        uint64_t x = 0;
+        uint64_t y = arithmetic.to(2);
+        uint64_t saved = y;
+        uint64_t product = arithmetic.one();
+        long long divisor = 1;
+        for (uint64_t length = 1; divisor == 1; length *= 2) {
+            x = y;
+            for (uint64_t i = 0; i < length; ++i) {
+                y = next(y);
+            }
+            for (uint64_t done = 0; done < length && divisor == 1;
+                    done += STEP)
+            {
+                saved = y;
+                for (uint64_t i = 0; i < std::min(STEP, length - done); ++i) {
+                    y = next(y);
+                    product = arithmetic.multiply(product, difference(x, y));
+                }
+                divisor = util::gcd(product, n);
+            }
+        }
 
-template<typename T>
-GenericArray<T>::operator std::string() const {
-    static_assert(std::is_same<T, char>::value, "Must not cast"
-        " TArray<T> to std::string with 'T' != 'char'");
-    return std::string(begin(), end());
+        if (static_cast<uint64_t>(divisor) == n) {
+            do {
+                saved = next(saved);
+                divisor = util::gcd(difference(x, saved), n);
+            } while (divisor == 1);
+        }
+        if (static_cast<uint64_t>(divisor) != n) {
+            return divisor;
+        }
+    }
 }
 
-// JNGEN_EXTERN template class GenericArray<int>;
-
-template<typename T>
-using TArray = GenericArray<T>;
+// Appends prime factors of n without divisors below 100 to |out|.
+void factorizeLarge(uint64_t n, std::vector<long long>& out) {
+    if (n == 1) {
+        return;
+    }
+    if (isPrime(n)) {
+        out.push_back(n);
+        return;
+    }
+    uint64_t divisor = pollardRho(n);
+    factorizeLarge(divisor, out);
+    factorizeLarge(n / divisor, out);
+}
+
+// Enumerates numbers up to |upTo| with non-increasing exponents of
+// consecutive primes starting from PRIMES[index], which contain all highly
+// composite numbers, and keeps the smallest one with most divisors.
+void highlyCompositeSearch(
+        size_t index,
+        int maxExponent,
+        long long value,
+        long long divisors,
+        long long upTo,
+        long long& best,
+        long long& bestDivisors)
+{
+    static const int PRIMES[] =
+        {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53};
 
-using Array = GenericArray<int>;
-using Array2d = GenericArray<jngen::GenericArray<int>>;
-using Array64 = GenericArray<long long>;
-using Arrayf = GenericArray<double>;
-using Arrayp = GenericArray<std::pair<int, int>>;
+    if (divisors > bestDivisors || (divisors == bestDivisors && value < best)) {
+        best = value;
+        bestDivisors = divisors;
+    }
+    if (index == sizeof(PRIMES) / sizeof(PRIMES[0])) {
+        return;
+    }
 
-template<typename T>
-jngen::GenericArray<T> makeArray(const std::vector<T>& values) {
-    return jngen::GenericArray<T>(values);
+    long long p = PRIMES[index];
+    for (int exponent = 1; exponent <= maxExponent; ++exponent) {
+        if (value > upTo / p) {
+            break;
+        }
+        value *= p;
+        highlyCompositeSearch(
+            index + 1, exponent, value, divisors * (exponent + 1), upTo,
+            best, bestDivisors);
+    }
 }
 
-template<typename T>
-jngen::GenericArray<T> makeArray(const std::initializer_list<T>& values) {
-    return jngen::GenericArray<T>(values);
+long long integerSqrt(long long n) {
+    long long root = std::sqrt(static_cast<double>(n));
+    while (root > 0 && static_cast<unsigned long long>(root) * root >
+            static_cast<unsigned long long>(n))
+    {
+        --root;
+    }
+    while (static_cast<unsigned long long>(root + 1) * (root + 1) <=
+            static_cast<unsigned long long>(n))
+    {
+        ++root;
+    }
+    return root;
 }
 
-template<typename T, typename U>
-TArray<std::pair<T, U>> zip(const TArray<T>& lhs, const TArray<U>& rhs) {
-    ensure(
-        lhs.size() == rhs.size(),
-        "In zip(a, b), a and b must have the same size");
-    TArray<std::pair<T, U>> result;
-    for (size_t i = 0; i < lhs.size(); ++i) {
-        result.emplace_back(lhs[i], rhs[i]);
+std::vector<int> sieve(int n) {
+    std::vector<char> composite(n + 1);
+    std::vector<int> primes;
+    for (int i = 2; i <= n; ++i) {
+        if (composite[i]) {
+            continue;
+        }
+        primes.push_back(i);
+        for (long long j = static_cast<long long>(i) * i; j <= n; j += i) {
+            composite[j] = true;
+        }
     }
-    return result;
+    return primes;
 }
 
-template<typename T, typename U>
-TArray<T> arrayCast(const TArray<U>& array) {
-    return TArray<T>(array.begin(), array.end());
-}
+void primesInRange(long long l, long long r, std::vector<long long>& out) {
+    // Sieving primes up to sqrt(r) pays off only if the range is not much
+    // shorter than sqrt(r). Otherwise smaller primes only filter out most
+    // composite numbers before the Miller-Rabin test.
+    const unsigned long long MIN_SIEVE_LIMIT = 1 << 8;
+    const unsigned long long MAX_SIEVE_LIMIT = 1 << 24;
+    const long long SEGMENT = 1 << 16;
 
-template<typename T>
-struct Hash<TArray<T>> {
-    uint64_t operator()(const TArray<T>& elements) const {
-        return Hash<std::vector<T>>{}(elements);
+    l = std::max(l, 2ll);
+    if (l > r) {
+        return;
     }
-};
-
-} // namespace jngen
-
-JNGEN_DEFINE_STD_HASH_TEMPLATE(T, jngen::TArray<T>);
-
-using jngen::makeArray;
-using jngen::zip;
-using jngen::arrayCast;
-
-using jngen::TArray;
-
-using jngen::Array;
-using jngen::Array2d;
-using jngen::Array64;
-using jngen::Arrayf;
-using jngen::Arrayp;
-
-// This header is named 'math_jngen.h' and not 'math.h' because in the latter
-// case it will replace the standard 'math.h' if you set jngen folder as the
-// include path.
 
+    unsigned long long length = static_cast<unsigned long long>(r - l) + 1;
+    long long root = integerSqrt(r);
+    long long limit = std::min<unsigned long long>(
+        root,
+        std::max(
+            MIN_SIEVE_LIMIT,
+            std::min(length, MAX_SIEVE_LIMIT / 4) * 4));
+    bool complete = limit == root;
 
-#include <algorithm>
-#include <cmath>
-#include <iterator>
-#include <limits>
-#include <type_traits>
-#include <unordered_set>
-#include <vector>
-
-namespace jngen {
-
-namespace detail {
+    auto basePrimes = sieve(limit);
+    std::vector<char> composite(SEGMENT);
 
-inline int multiply(int x, int y, int mod) {
-    return static_cast<long long>(x) * y % mod;
-}
+    for (long long low = l; ; low += SEGMENT) {
+        size_t size = std::min(r - low, SEGMENT - 1) + 1;
+        long long high = low + static_cast<long long>(size - 1);
+        std::fill(composite.begin(), composite.begin() + size, false);
 
-inline long long multiply(long long x, long long y, long long mod) {
-#if defined(__SIZEOF_INT128__)
-    return static_cast<__int128>(x) * y % mod;
-#else
-    long long res = 0;
-    while (y) {
-        if (y&1) {
-            res = (static_cast<unsigned long long>(res) + x) % mod;
+        for (long long p: basePrimes) {
+            if (p * p > high) {
+                break;
+            }
+            unsigned long long offset = p * p >= low ?
+                p * p - low :
+                (p - low % p) % p;
+            for (; offset < size; offset += p) {
+                composite[offset] = true;
+            }
         }
-        x = (static_cast<unsigned long long>(x) + x) % mod;
-        y >>= 1;
-    }
-    return res;
-#endif
-}
 
-inline int power(int x, int k, int mod) {
-    int res = 1;
-    while (k) {
-        if (k&1) {
-            res = multiply(res, x, mod);
+        for (size_t i = 0; i < size; ++i) {
+            long long x = low + static_cast<long long>(i);
+            if (composite[i]) {
+                continue;
+            }
+            if (complete || x <= limit * limit || millerRabinTest(x)) {
+                out.push_back(x);
+            }
         }
-        x = multiply(x, x, mod);
-        k >>= 1;
-    }
-    return res;
-}
 
-inline long long power(long long x, long long k, long long mod) {
-    long long res = 1;
-    while (k) {
-        if (k&1) {
-            res = multiply(res, x, mod);
+        if (high == r) {
+            break;
         }
-        x = multiply(x, x, mod);
-        k >>= 1;
     }
-    return res;
 }
 
-template<typename I>
-bool millerRabinTest(I n, const std::vector<I>& witnesses) {
-    static_assert(
-        std::is_same<I, int>::value || std::is_same<I, long long>::value,
-        "millerRabinTest<int/long long> only is supported");
+Array64 RandomPrimesProxy::a() const {
+    // Ranges up to this length are enumerated, and sampling picks random
+    // elements of the list. Longer ranges contain at least 2^24 / 44 primes,
+    // so random numbers are drawn until a prime is found.
+    const unsigned long long MAX_ENUMERATED = 1 << 24;
 
-    if (n == 1) {
-        return false;
-    }
+    long long l = std::max(l_, 2ll);
+    long long r = r_;
+    ensure(
+        l <= r,
+        format("There are no primes between %lld and %lld", l_, r_));
 
-    constexpr int LIMIT = 10000;
+    unsigned long long length = static_cast<unsigned long long>(r - l) + 1;
+    double expectedPrimes = length / std::log(static_cast<double>(r));
 
-    if (n <= LIMIT) {
-        for (int i = 2; i*i <= n; ++i) {
-            if (n%i == 0) {
-                return false;
+    Array64 result;
+    if (length <= MAX_ENUMERATED ||
+            (distinct_ && count_ > expectedPrimes / 2))
+    {
+        Array64 all;
+        primesInRange(l, r, all);
+        ensure(
+            !all.empty(),
+            format("There are no primes between %lld and %lld", l_, r_));
+
+        if (distinct_) {
+            ensure(
+                count_ <= all.size(),
+                format(
+                    "There are only %d primes between %lld and %lld",
+                    static_cast<int>(all.size()), l_, r_));
+            for (auto index: sampleOffsets(rnd, count_, all.size() - 1)) {
+                result.push_back(all[index]);
+            }
+        } else {
+            result.reserve(count_);
+            for (size_t i = 0; i < count_; ++i) {
+                result.push_back(all[rnd.next(all.size())]);
             }
         }
-        return true;
-    }
-
-    int r = 0;
-    I d = n - 1;
-    while (d % 2 == 0) {
-        ++r;
-        d /= 2;
+        return result;
     }
 
-    for (I a: witnesses) {
-        I x = power(a, d, n);
-        if (x == 1 || x == n - 1) {
-            continue;
+    // Candidates are primes up to 13 and numbers coprime to 2 * 3 * 5 * 7 *
+    // 11 * 13 = 30030, which are five times rarer than all numbers. The k-th
+    // of the latter is found with a table of residues modulo 30030.
+    const long long WHEEL = 2 * 3 * 5 * 7 * 11 * 13;
+    static const std::vector<int> residues = []() {
+        std::vector<int> result;
+        for (int i = 0; i < WHEEL; ++i) {
+            if (i % 2 && i % 3 && i % 5 && i % 7 && i % 11 && i % 13) {
+                result.push_back(i);
+            }
         }
+        return result;
+    }();
+    auto countBelow = [](long long n) {
+        // Number of residues less than n modulo the wheel, 0 <= n <= WHEEL.
+        return std::lower_bound(residues.begin(), residues.end(), n) -
+            residues.begin();
+    };
 
-        bool composite = true;
-        for (int i = 0; i < r - 1; ++i) {
-            x = multiply(x, x, n);
-            if (x == 1) {
-                return false;
-            }
-            if (x == n - 1) {
-                i = r;
-                composite = false;
-                continue;
-            }
+    std::vector<long long> smallPrimes;
+    for (long long p: {2, 3, 5, 7, 11, 13}) {
+        if (l <= p && p <= r) {
+            smallPrimes.push_back(p);
+        }
+    }
+    long long spokes = residues.size();
+    long long small = smallPrimes.size();
+    long long start = l - l % WHEEL;
+    long long before = countBelow(l - start);
+    long long total = (r - start) / WHEEL * spokes +
+        countBelow((r - start) % WHEEL + 1) - before + small;
+
+    std::unordered_set<long long> used;
+    result.reserve(count_);
+    while (result.size() < count_) {
+        long long index = rnd.next(total);
+        long long x;
+        if (index < small) {
+            x = smallPrimes[index];
+        } else {
+            index += before - small;
+            x = start + index / spokes * WHEEL + residues[index % spokes];
         }
-        if (composite) {
-            return false;
+        if (!isPrime(x)) {
+            continue;
+        }
+        if (distinct_ && !used.insert(x).second) {
+            continue;
         }
+        result.push_back(x);
     }
-    return true;
+    return result;
 }
 
-} // namespace detail
-
-inline bool isPrime(long long n) {
-    const static std::vector<int> INT_WITNESSES{2, 7, 61};
-    const static std::vector<long long> LONG_LONG_WITNESSES
-        {2, 3, 5, 7, 11, 13, 17, 19, 23};
-    // todo: experiment with base
-    // 2, 325, 9375, 28178, 450775, 9780504, and 1795265022
-    // (guaranteed for all integers < 2^64)
-
-    // first strong pseudoprime to i64 bases is 3825123056546413051 ~= 3.8e18
-    ensure(n > 0, "isPrime() is undefined for negative numbers");
-    ensure(
-        n <= static_cast<long long>(3.8e18),
-        "isPrime() supports only numbers not greater than 3.8 * 10^18");
+RandomPrimesProxy::operator Array64() const {
+    return a();
+}
 
-    if (n < std::numeric_limits<int>::max()) {
-        return detail::millerRabinTest<int>(n, INT_WITNESSES);
-    } else {
-        return detail::millerRabinTest<long long>(n, LONG_LONG_WITNESSES);
+// The truncated geometric distribution P(x) ~ exp(-t * x) on [0, c].
+double truncatedGeometricMean(double t, double c) {
+    if (t * (c + 1) < 1e-3) {
+        return c / 2 - t * c * (c + 2) / 12;
     }
+    return 1 / std::expm1(t) - (c + 1) / std::expm1(t * (c + 1));
 }
 
-class MathRandom {
-public:
-    MathRandom() {
-        static bool created = false;
-        ensure(!created, "jngen::MathRandom should be created only once");
-        created = true;
+double truncatedGeometricVariance(double t, double c) {
+    if (t * (c + 1) < 1e-3) {
+        return c * (c + 2) / 12;
     }
+    double a = std::sinh(t / 2);
+    double b = std::sinh(t * (c + 1) / 2);
+    return 1 / (4 * a * a) - (c + 1) * (c + 1) / (4 * b * b);
+}
 
-    static long long randomPrime(long long n) {
-        ensure(n > 2, format("There are no primes below %lld", n));
-        return randomPrime(2, n - 1);
+// Returns t such that the mean of the truncated geometric distribution on
+// [0, c] is |mean| <= c / 2.
+double fitTruncatedGeometric(double c, double mean) {
+    double low = 0;
+    double high = 1;
+    while (truncatedGeometricMean(high, c) > mean) {
+        high *= 2;
     }
+    for (int iteration = 0; iteration < 100; ++iteration) {
+        double middle = (low + high) / 2;
+        if (truncatedGeometricMean(middle, c) > mean) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Appends a uniformly random sequence of |count| non-negative numbers with
+// sum n to |out|: count - 1 bars are placed among n + count - 1 positions.
+void starsAndBars(long long n, int count, std::vector<long long>& out) {
+    auto bars = sampleSortedOffsets(rnd, count - 1, n + count - 2);
+    long long previous = -1;
+    for (long long bar: bars) {
+        out.push_back(bar - previous - 1);
+        previous = bar;
+    }
+    out.push_back(n + count - 2 - previous);
+}
+
+// Returns a uniformly random sequence of |count| numbers from [0, bound] with
+// sum n, where count >= 2 and bound < n <= count * bound.
+//
+// Parts are drawn independently from the truncated geometric distribution
+// with parameter t, except the last one, which is what remains of n. The
+// sequence is accepted if the last part is in [0, bound], with probability
+// exp(-t * last). Then every sequence with sum n has the probability
+// proportional to exp(-t * n), so the result is uniform for any t, which
+// only affects the running time.
+void boltzmannComposition(
+        long long n,
+        int count,
+        long long bound,
+        double t,
+        std::vector<long long>& out)
+{
+    // 1 - exp(-t * (bound + 1)), the mass of the truncated distribution.
+    double mass = -std::expm1(-t * (bound + 1));
 
-    static long long randomPrime(long long l, long long r) {
-        ensure(l <= r);
-        std::unordered_set<long long> used;
-        while (static_cast<long long>(used.size()) < r - l + 1) {
-            long long x = rnd.next(l, r);
-            if (used.count(x)) {
-                continue;
-            }
-            used.insert(x);
-            if (isPrime(x)) {
-                return x;
-            }
+    auto nextPart = [&]() -> long long {
+        if (mass == 0) {
+            return rnd.next(bound + 1);
         }
-        ensure(
-            false,
-            format(
-                "There are no primes between %lld and %lld",
-                l, r)
-        );
-    }
+        double x = -std::log1p(-rnd.nextf() * mass) / t;
+        return std::min(static_cast<long long>(x), bound);
+    };
 
-    static long long nextPrime(long long n) {
-        while (!isPrime(n)) {
-            ++n;
+    out.resize(count);
+    while (true) {
+        long long remaining = n;
+        for (int i = 0; i + 1 < count; ++i) {
+            out[i] = nextPart();
+            remaining -= out[i];
+        }
+        if (remaining < 0 || remaining > bound) {
+            continue;
+        }
+        if (mass == 0 || rnd.nextf() < std::exp(-t * remaining)) {
+            out[count - 1] = remaining;
+            return;
         }
-        return n;
     }
+}
 
-    static long long previousPrime(long long n) {
-        ensure(n >= 2, format("There are no primes less or equal to %lld", n));
-        while (!isPrime(n)) {
-            --n;
+Array64 randomComposition(
+        long long n, int count, long long minSize, long long maxSize)
+{
+    Array64 result;
+    if (count <= 1) {
+        if (count == 1) {
+            result.push_back(n);
         }
-        return n;
+        return result;
     }
 
-    static Array partition(
-            int n,
-            int numParts,
-            int minSize = 0,
-            int maxSize = -1)
-    {
-        auto res = partition(
-            static_cast<long long>(n),
-            numParts,
-            static_cast<long long>(minSize),
-            static_cast<long long>(maxSize));
-        return Array(res.begin(), res.end());
+    n -= minSize * count;
+    long long bound = maxSize - minSize;
+
+    // Parts x and bound - x are interchangeable, so the sum is reduced to
+    // at most half of the maximum.
+    bool flipped = false;
+    if (bound < n && static_cast<double>(bound) * count < 2.0 * n) {
+        flipped = true;
+        n = bound * count - n;
     }
 
-    static Array64 partition(
-            long long n,
-            int numParts,
-            long long minSize = 0,
-            long long maxSize = -1)
-    {
-        if (maxSize == -1) {
-            maxSize = n;
+    if (bound >= n) {
+        starsAndBars(n, count, result);
+    } else {
+        // Both methods take O(count) per try. The expected number of tries
+        // for stars and bars is exp(E), where E is the expected number of
+        // parts exceeding the bound. For the Boltzmann sampler it is the
+        // inverse probability that the last part fits, which is about
+        // sqrt(2 * pi) * sigma / window: sigma is the deviation of the sum
+        // of other parts and window is the total weight of the last part.
+        double c = bound;
+        double k = count;
+        double exceeding = k * std::exp(
+            (k - 1) * std::log1p(-(c + 1) / (n + k - 1)));
+
+        double t = fitTruncatedGeometric(c, n / k);
+        double sigma = std::sqrt((k - 1) * truncatedGeometricVariance(t, c));
+        double window = t == 0 ?
+            c + 1 :
+            std::expm1(-t * (c + 1)) / std::expm1(-t);
+        double boltzmannTries = 2.5 * sigma / window;
+
+        if (exceeding < std::log(std::max(boltzmannTries, 1.0))) {
+            do {
+                result.clear();
+                starsAndBars(n, count, result);
+            } while (*std::max_element(result.begin(), result.end()) > bound);
+        } else {
+            boltzmannComposition(n, count, bound, t, result);
         }
+    }
 
-        ensure(n >= 0);
-        ensure(numParts >= 0);
-        ensure(numParts * minSize <= n, "minSize is too large");
-        ensure(numParts * maxSize >= n, "maxSize is too small");
-        ensure(minSize <= maxSize);
+    for (auto& x: result) {
+        x = minSize + (flipped ? bound - x : x);
+    }
+    return result;
+}
+
+} // namespace detail
 
-        n -= minSize * numParts;
+bool isPrime(long long n) {
+    static const int SMALL_PRIMES[] =
+        {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47};
 
-        auto delimiters = Array64::random(
-                numParts - 1, 0, n).sorted();
-        delimiters.insert(delimiters.begin(), 0);
-        delimiters.push_back(n);
+    ensure(n > 0, "isPrime() is undefined for negative numbers");
 
-        Array64 partition(numParts);
-        for (long long i = 0; i < numParts; ++i) {
-            partition[i] = delimiters[i + 1] - delimiters[i];
+    if (n == 1) {
+        return false;
+    }
+    for (int p: SMALL_PRIMES) {
+        if (n % p == 0) {
+            return n == p;
         }
-        partition.sort().reverse();
+    }
+    if (n < 53 * 53) {
+        return true;
+    }
+    return detail::millerRabinTest(n);
+}
 
-        long long remaining = 0;
+Array64 factorize(long long n) {
+    ensure(n > 0, "factorize() is undefined for non-positive numbers");
 
-        long long localMax = maxSize - minSize;
-        for (auto& x: partition) {
-            if (x > localMax) {
-                remaining += x - localMax;
-                x = localMax;
-            }
+    static const int SMALL_PRIMES[] = {
+        2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61,
+        67, 71, 73, 79, 83, 89, 97
+    };
 
-            x += minSize;
+    Array64 result;
+    for (long long p: SMALL_PRIMES) {
+        while (n % p == 0) {
+            result.push_back(p);
+            n /= p;
         }
+    }
+    detail::factorizeLarge(n, result);
+    std::sort(result.begin(), result.end());
+    return result;
+}
 
-        // Here we try to distribute the remaining part in some even manner
-        // between remaining slots. Looks like crap anyway, need a smarter way.
+long long MathRandom::nextPrime(long long n) {
+    const long long WINDOW = 1 << 8;
 
-        for (int divisor: { 2, 1 }) {
-            partition.shuffle();
-            for (auto& x: partition) {
-                if (x < maxSize) {
-                    long long add = std::min(
-                            remaining, (maxSize - x) / divisor);
-                    x += add;
-                    remaining -= add;
-                }
-            }
+    std::vector<long long> primes;
+    for (long long l = n; ; l += WINDOW) {
+        long long r = l + std::min(
+            WINDOW - 1, std::numeric_limits<long long>::max() - l);
+        detail::primesInRange(l, r, primes);
+        if (!primes.empty()) {
+            return primes.front();
         }
+        ensure(
+            r != std::numeric_limits<long long>::max(),
+            format("There are no primes greater or equal to %lld", n));
+    }
+}
 
-        ensure(remaining == 0, "maxSize is too small");
+long long MathRandom::previousPrime(long long n) {
+    const long long WINDOW = 1 << 8;
 
-        return partition;
-    }
+    ensure(n >= 2, format("There are no primes less or equal to %lld", n));
 
-    template<typename T>
-    TArray<TArray<T>> partition(
-            TArray<T> elements,
-            int numParts,
-            int minSize = 0,
-            int maxSize = -1)
-    {
-        return partition(
-            std::move(elements),
-            partition(
-                static_cast<int>(elements.size()),
-                numParts,
-                minSize,
-                maxSize));
+    std::vector<long long> primes;
+    for (long long r = n; ; r -= WINDOW) {
+        detail::primesInRange(std::max(2ll, r - WINDOW + 1), r, primes);
+        if (!primes.empty()) {
+            return primes.back();
+        }
     }
+}
 
-    template<typename T>
-    TArray<TArray<T>> partition(TArray<T> elements, const Array& sizes) {
-        size_t total = std::accumulate(sizes.begin(), sizes.end(), size_t(0));
-        ensure(total == elements.size(), "sum(sizes) != elements.size()");
-        elements.shuffle();
-        TArray<TArray<T>> res;
-        auto it = elements.begin();
-        for (int size: sizes) {
-            res.emplace_back();
-            std::copy(it, it + size, std::back_inserter(res.back()));
-            it += size;
-        }
+long long MathRandom::highlyComposite(long long upTo) {
+    ensure(upTo >= 1, "There are no positive numbers below 1");
 
-        return res;
+    long long best = 1;
+    long long bestDivisors = 1;
+    detail::highlyCompositeSearch(
+        0, std::numeric_limits<int>::max(), 1, 1, upTo, best, bestDivisors);
+    return best;
+}
+
+long long MathRandom::primeProduct(int k, long long l, long long r) {
+    ensure(k >= 1, "Cannot make a product of less than one prime");
+    ensure(l <= r);
+    long long limit = std::numeric_limits<long long>::max();
+    for (int i = 0; i < k; ++i) {
+        ensure(
+            r <= limit,
+            format("A product of %d primes up to %lld does not fit "
+                "into long long", k, r));
+        limit /= r;
     }
-};
 
-JNGEN_EXTERN MathRandom rndm;
+    long long result = 1;
+    for (long long p: randomPrimes(k, l, r).a()) {
+        result *= p;
+    }
+    return result;
+}
+
+long long MathRandom::smooth(long long n, long long bound) {
+    // Primes up to this limit are taken from a list, larger ones are
+    // generated with rejection sampling.
+    const long long LISTED = 1 << 16;
+    static const std::vector<long long> SMALL_PRIMES = []() {
+        std::vector<long long> primes;
+        detail::primesInRange(2, LISTED, primes);
+        return primes;
+    }();
+
+    ensure(n >= 1);
+    ensure(bound >= 2, "There are no primes below 2");
+
+    long long result = 1;
+    while (n / result >= 2) {
+        long long limit = std::min(bound, n / result);
+        long long p;
+        if (limit <= LISTED) {
+            auto end = std::upper_bound(
+                SMALL_PRIMES.begin(), SMALL_PRIMES.end(), limit);
+            p = SMALL_PRIMES[rnd.next(
+                static_cast<int>(end - SMALL_PRIMES.begin()))];
+        } else {
+            do {
+                p = rnd.next(2ll, limit);
+            } while (!isPrime(p));
+        }
+        result *= p;
+    }
+    return result;
+}
 
 } // namespace jngen
+#undef JNGEN_INCLUDE_MATH_JNGEN_INL_H
+#endif // JNGEN_DECLARE_ONLY
 
 using jngen::isPrime;
+using jngen::factorize;
 
 using jngen::rndm;
 
@@ -3987,9 +7133,10 @@ public:
     static auto randomf(
             size_t size,
             F func,
-            Args... args) -> GenericArray<decltype(func(args...))>
+            Args... args) -> GenericArray<decltype(
+                detail::invokeWithRandom(func, rnd, 0, args...))>
     {
-        typedef decltype(func(args...)) T;
+        typedef decltype(detail::invokeWithRandom(func, rnd, 0, args...)) T;
         return GenericArray<T>::randomf(size, func, args...);
     }
 
@@ -4736,6 +7883,95 @@ namespace jngen {
 typedef std::pair<long long, long long> HashBase; // (mod, base)
 typedef std::pair<std::string, std::string> StringPair;
 
+namespace detail {
+
+// Alphabet like "a-z0-9" parsed once, with bulk generation of characters.
+class AlphabetTable {
+public:
+    explicit AlphabetTable(const std::string& alphabet);
+
+    // Writes |count| random characters to |out|. With the Mt19937 engine the
+    // result is the same as of |count| successive rnd.choice calls.
+    void fill(Random& random, char* out, size_t count) const;
+
+private:
+    void fillLegacy(Random& random, char* out, size_t count) const;
+    void fillBits(Random& random, char* out, size_t count) const;
+    // Draws indices of type T with Random::fill.
+    template<typename T>
+    void fillIndices(Random& random, char* out, size_t count) const;
+
+    std::string chars_;
+    // log2(chars_.size()) for power-of-two alphabets, -1 otherwise.
+    int bits_;
+};
+
+template<typename T>
+void AlphabetTable::fillIndices(Random& random, char* out, size_t count) const {
+    // Small enough for the stack of a worker thread.
+    const size_t BLOCK = 512;
+    T indices[BLOCK];
+    while (count > 0) {
+        size_t size = std::min(count, BLOCK);
+        random.fill(indices, size, static_cast<T>(chars_.size()));
+        for (size_t i = 0; i < size; ++i) {
+            out[i] = chars_[indices[i]];
+        }
+        out += size;
+        count -= size;
+    }
+}
+
+} // namespace detail
+
+// A random string which is never stored as a whole, see rnds.randomStream.
+class StringStream {
+public:
+    StringStream(size_t size, const std::string& alphabet);
+
+    size_t size() const { return size_; }
+
+    // Calls f(const char* data, size_t count) for consecutive chunks. With
+    // config.threads > 0 that many chunks are generated in parallel.
+    template<typename F>
+    void forEachChunk(F f) const;
+
+    std::string str() const;
+
+private:
+    size_t size_;
+    detail::AlphabetTable table_;
+    Random base_;
+};
+
+template<typename F>
+void StringStream::forEachChunk(F f) const {
+    const size_t CHUNK = detail::PARALLEL_CHUNK_SIZE;
+    size_t chunks = (size_ + CHUNK - 1) / CHUNK;
+    size_t batch = std::max(config.threads, 1);
+    std::vector<std::string> buffers(std::min(batch, chunks));
+
+    for (size_t start = 0; start < chunks; start += batch) {
+        size_t count = std::min(batch, chunks - start);
+        detail::parallelFor(count, [&](size_t i) {
+            size_t chunk = start + i;
+            Random random = base_.stream(chunk);
+            buffers[i].resize(std::min(CHUNK, size_ - chunk * CHUNK));
+            table_.fill(random, &buffers[i][0], buffers[i].size());
+        });
+        for (size_t i = 0; i < count; ++i) {
+            f(static_cast<const char*>(buffers[i].data()), buffers[i].size());
+        }
+    }
+}
+
+JNGEN_DECLARE_SIMPLE_PRINTER(StringStream, 2) {
+    (void)mod;
+    t.forEachChunk([&out](const char* data, size_t count) {
+        out.write(data, count);
+    });
+}
+
 class StringRandom {
 public:
     StringRandom() {
@@ -4746,6 +7982,10 @@ public:
 
     static std::string random(int len, const std::string& alphabet = "a-z");
 
+    // Generated lazily when printed, for strings too large to be stored.
+    static StringStream randomStream(
+            size_t len, const std::string& alphabet = "a-z");
+
     template<typename ... Args>
     static std::string random(const std::string& pattern, Args... args) {
         return rnd.next(pattern, std::forward(args)...);
@@ -4766,6 +8006,7 @@ JNGEN_EXTERN StringRandom rnds;
 } // namespace jngen
 
 using jngen::rnds;
+using jngen::StringStream;
 
 #ifndef JNGEN_DECLARE_ONLY
 #define JNGEN_INCLUDE_RNDS_INL_H
@@ -4815,6 +8056,124 @@ std::string parseAllowedChars(std::string pattern) {
     return result;
 }
 
+AlphabetTable::AlphabetTable(const std::string& alphabet) :
+    chars_(parseAllowedChars(alphabet)),
+    bits_(-1)
+{
+    ensure(!chars_.empty(), "Cannot select from an empty container");
+    for (int bits = 0; bits <= 8; ++bits) {
+        if (chars_.size() == (size_t(1) << bits)) {
+            bits_ = bits;
+        }
+    }
+}
+
+void AlphabetTable::fill(Random& random, char* out, size_t count) const {
+    bool legacy = random.engine() == RandomEngine::Mt19937;
+#ifndef JNGEN_FAST_RANDOM
+    if (legacy) {
+        fillLegacy(random, out, count);
+        return;
+    }
+#endif
+    if (legacy) {
+        fillIndices<size_t>(random, out, count);
+    } else if (bits_ != -1) {
+        fillBits(random, out, count);
+    } else {
+        fillIndices<int>(random, out, count);
+    }
+}
+
+void AlphabetTable::fillLegacy(Random& random, char* out, size_t count) const {
+    // A choice draws a 64-bit word from two 32-bit ones and takes it modulo
+    // a mask of at most 8 bits, so only the second word matters. Such words
+    // are picked from a block and reduced as by next(int).
+    const size_t BLOCK = 512;
+    uint32_t words[2 * BLOCK];
+    uint32_t values[BLOCK];
+    uint32_t bound = chars_.size();
+    uint32_t mask = maskForBound(bound);
+    while (count > 0) {
+        size_t size = std::min(count, BLOCK);
+        random.fill(words, 2 * size);
+        for (size_t i = 0; i < size; ++i) {
+            values[i] = words[2 * i + 1];
+        }
+        size = reduceMasked32(values, size, bound, mask, values);
+        for (size_t i = 0; i < size; ++i) {
+            out[i] = chars_[values[i]];
+        }
+        out += size;
+        count -= size;
+    }
+}
+
+void AlphabetTable::fillBits(Random& random, char* out, size_t count) const {
+    if (bits_ == 0) {
+        std::fill(out, out + count, chars_[0]);
+        return;
+    }
+    // Each 64-bit word yields 64 / bits_ characters.
+    const size_t BLOCK = 512;
+    uint64_t words[BLOCK];
+    const size_t perWord = 64 / bits_;
+    const uint64_t mask = (uint64_t(1) << bits_) - 1;
+    while (count > 0) {
+        size_t size = std::min((count + perWord - 1) / perWord, BLOCK);
+        random.fill(words, size);
+        for (size_t i = 0; i < size && count > 0; ++i) {
+            uint64_t word = words[i];
+            for (size_t j = 0; j < perWord && count > 0; ++j) {
+                *out++ = chars_[word & mask];
+                word >>= bits_;
+                --count;
+            }
+        }
+    }
+}
+
+// Open addressing hash table for the birthday search. Stores pairs (hash,
+// word), where the hash is less than 2^32 - 1 and the word is packed into a
+// number, in 12 bytes per slot.
+class CollisionTable {
+public:
+    enum class Result { Inserted, Duplicate, Collision };
+
+    explicit CollisionTable(size_t size) {
+        size_t capacity = 1;
+        while (capacity < 2 * size) {
+            capacity *= 2;
+        }
+        keys_.assign(capacity, 0);
+        words_.assign(capacity, 0);
+    }
+
+    // On collision stores the word with the same hash to |other|.
+    Result insert(uint64_t hash, uint64_t word, uint64_t& other) {
+        // Zero marks an empty slot.
+        uint32_t key = hash + 1;
+        size_t mask = keys_.size() - 1;
+        size_t i = (key * 0x9e3779b97f4a7c15ull) >> 32 & mask;
+        for (; keys_[i] != 0; i = (i + 1) & mask) {
+            if (keys_[i] == key) {
+                if (words_[i] == word) {
+                    return Result::Duplicate;
+                }
+                other = words_[i];
+                return Result::Collision;
+            }
+        }
+        keys_[i] = key;
+        words_[i] = word;
+        return Result::Inserted;
+    }
+
+private:
+    std::vector<uint32_t> keys_;
+    std::vector<uint64_t> words_;
+};
+
 std::vector<std::string> extendAntiHash(
         const std::vector<std::string>& chars,
         HashBase base,
@@ -4841,17 +8200,9 @@ std::vector<std::string> extendAntiHash(
         for (char c: s) {
             hash = (hash * p + c) % mod;
         }
-        charHashes.push_back(hash);
+        charHashes.push_back((hash + mod) % mod);
     }
 
-    auto computeHash = [&charHashes, mod, pPower](const std::vector<int>& a) {
-        long long hash = 0;
-        for (int x: a) {
-            hash = (hash * pPower + charHashes[x]) % mod;
-        }
-        return hash;
-    };
-
     // This bounds were achieved empirically and should be justified.
     int needForMatch;
     if (count == 2) {
@@ -4869,34 +8220,274 @@ std::vector<std::string> extendAntiHash(
         if (wordCount < needForMatch) {
             continue;
         }
+        ENSURE(wordCount < 1e19, "Words cannot be packed into 64 bits");
 
-        std::vector<std::pair<long long, Array>> words;
-        std::map<long long, int> hashCount;
-        std::set<Array> used;
+        // Words are kept as numbers in base chars.size().
+        Barrett32 arithmetic(mod);
+        auto hashAndPack = [&charHashes, arithmetic, pPower, length, &chars](
+                const int* word, uint64_t& packed)
+        {
+            uint64_t hash = 0;
+            packed = 0;
+            for (int i = 0; i < length; ++i) {
+                hash = arithmetic.reduce(hash * pPower + charHashes[word[i]]);
+                packed = packed * chars.size() + word[i];
+            }
+            return hash;
+        };
 
-        for (int i = 0; i < needForMatch; ++i) {
-            Array w = Array::random(length, chars.size());
-            if (used.count(w)) {
-                --i;
-                continue;
+        auto unpack = [length, &chars](uint64_t packed) {
+            std::vector<int> word(length);
+            for (int i = length - 1; i >= 0; --i) {
+                word[i] = packed % chars.size();
+                packed /= chars.size();
             }
-            used.insert(w);
-            long long hash = computeHash(w);
-            words.emplace_back(hash, w);
-            if (++hashCount[hash] == count) {
-                std::vector<std::string> result;
-                for (const auto& kv: words) {
-                    if (kv.first == hash) {
-                        std::string word;
-                        for (int c: kv.second) {
-                            word += chars[c];
-                        }
-                        result.push_back(word);
+            std::string result;
+            for (int c: word) {
+                result += chars[c];
+            }
+            return result;
+        };
+
+        CollisionTable table(needForMatch);
+        uint64_t packed;
+        uint64_t other;
+
+        if (config.threads == 0) {
+            std::vector<int> word(length);
+            for (int i = 0; i < needForMatch; ++i) {
+                fillRandom<int>(rnd, word.data(), length, 0, chars.size());
+                uint64_t hash = hashAndPack(word.data(), packed);
+                auto result = table.insert(hash, packed, other);
+                if (result == CollisionTable::Result::Duplicate) {
+                    --i;
+                } else if (result == CollisionTable::Result::Collision) {
+                    return {unpack(other), unpack(packed)};
+                }
+            }
+            continue;
+        }
+
+        // Words are generated in chunks from separate streams by several
+        // threads at once and inserted in the same order as sequentially,
+        // so the result does not depend on the number of threads.
+        const size_t CHUNK = 1 << 12;
+        size_t chunks = (needForMatch + CHUNK - 1) / CHUNK;
+        auto streams = rnd.split(chunks);
+        size_t batch = config.threads;
+        std::vector<std::vector<std::pair<uint64_t, uint64_t>>> generated(
+            batch);
+
+        for (size_t start = 0; start < chunks; start += batch) {
+            size_t batchSize = std::min(batch, chunks - start);
+            parallelFor(batchSize, [&](size_t i) {
+                size_t chunk = start + i;
+                generated[i].resize(
+                    std::min(CHUNK, needForMatch - chunk * CHUNK));
+                std::vector<int> word(length);
+                for (auto& kv: generated[i]) {
+                    fillRandom<int>(
+                        streams[chunk], word.data(), length, 0, chars.size());
+                    kv.first = hashAndPack(word.data(), kv.second);
+                }
+            });
+            for (size_t i = 0; i < batchSize; ++i) {
+                size_t duplicates = 0;
+                for (const auto& kv: generated[i]) {
+                    packed = kv.second;
+                    auto result = table.insert(kv.first, packed, other);
+                    if (result == CollisionTable::Result::Duplicate) {
+                        ++duplicates;
+                    } else if (result == CollisionTable::Result::Collision) {
+                        return {unpack(other), unpack(packed)};
                     }
                 }
-                return result;
+                // As in the sequential search, duplicates are replaced with
+                // new words, drawn from the stream of the same chunk.
+                std::vector<int> word(length);
+                while (duplicates > 0) {
+                    fillRandom<int>(streams[start + i],
+                        word.data(), length, 0, chars.size());
+                    uint64_t hash = hashAndPack(word.data(), packed);
+                    auto result = table.insert(hash, packed, other);
+                    if (result == CollisionTable::Result::Inserted) {
+                        --duplicates;
+                    } else if (result == CollisionTable::Result::Collision) {
+                        return {unpack(other), unpack(packed)};
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Finds c[i] in {-1, 0, 1}, not all zero, such that sum c[i] * values[i] is
+// zero (as an integer). Values are sorted and split into adjacent pairs, each
+// pair is replaced with its difference; with n values this makes them about
+// n/2 times smaller on each of log(n) levels, until some value turns zero.
+// Returns an empty vector if no such value appears.
+std::vector<int> treeAttack(const std::vector<uint64_t>& values) {
+    struct Node {
+        uint64_t value;
+        // Nodes taken with the sign of this node and with the opposite one.
+        int plus;
+        int minus;
+    };
+
+    size_t n = values.size();
+    std::vector<Node> nodes;
+    nodes.reserve(2 * n);
+    std::vector<int> current;
+    for (size_t i = 0; i < n; ++i) {
+        nodes.push_back({values[i], -1, -1});
+        current.push_back(i);
+    }
+
+    int root = -1;
+    while (true) {
+        for (int id: current) {
+            if (nodes[id].value == 0) {
+                root = id;
+                break;
+            }
+        }
+        if (root != -1 || current.size() < 2) {
+            break;
+        }
+
+        std::sort(current.begin(), current.end(), [&nodes](int a, int b) {
+            return nodes[a].value < nodes[b].value;
+        });
+        std::vector<int> next;
+        for (size_t i = 0; i + 1 < current.size(); i += 2) {
+            int lower = current[i];
+            int upper = current[i + 1];
+            nodes.push_back(
+                {nodes[upper].value - nodes[lower].value, upper, lower});
+            next.push_back(nodes.size() - 1);
+        }
+        current.swap(next);
+    }
+
+    if (root == -1) {
+        return {};
+    }
+
+    std::vector<int> coefficients(n);
+    std::vector<std::pair<int, int>> stack = {{root, 1}};
+    while (!stack.empty()) {
+        int id = stack.back().first;
+        int sign = stack.back().second;
+        stack.pop_back();
+        if (nodes[id].plus == -1) {
+            coefficients[id] = sign;
+        } else {
+            stack.emplace_back(nodes[id].plus, sign);
+            stack.emplace_back(nodes[id].minus, -sign);
+        }
+    }
+    return coefficients;
+}
+
+// Polynomial hash arithmetic modulo |mod|, where mod = 0 stands for 2^64
+// (that is, unsigned overflow).
+uint64_t multiplyModulo(uint64_t x, uint64_t y, uint64_t mod) {
+    if (mod == 0) {
+        return x * y;
+    }
+    return multiply(
+        static_cast<long long>(x), static_cast<long long>(y),
+        static_cast<long long>(mod));
+}
+
+uint64_t stringHash(const std::string& s, uint64_t p, uint64_t mod) {
+    uint64_t hash = 0;
+    for (char c: s) {
+        hash = multiplyModulo(hash, p, mod);
+        if (mod == 0) {
+            hash += static_cast<uint64_t>(c);
+        } else {
+            hash = (hash + static_cast<uint64_t>(c < 0 ? c + mod : c)) % mod;
+        }
+    }
+    return hash;
+}
+
+// Given two strings |chars| of equal length, builds two strings of them with
+// equal hashes modulo the base with the tree attack. Used for moduli above
+// 2e9 and for 2^64, where birthday search is infeasible. The result length
+// grows by a factor of about 2^sqrt(2 log2(mod)), e.g. 2048 for 64-bit
+// moduli.
+std::vector<std::string> treeAntiHash(
+        const std::vector<std::string>& chars, HashBase base)
+{
+    ensure(chars.size() >= 2, "Cannot generate anti-hash test of one char");
+
+    uint64_t mod = base.first;
+    uint64_t p = base.second;
+
+    // Two distinct words to build the result from.
+    std::string x = chars[0];
+    std::string y = chars[1];
+    if (chars.size() > 2) {
+        int i = rnd.next(static_cast<int>(chars.size()));
+        int j = rnd.next(static_cast<int>(chars.size()) - 1);
+        x = chars[i];
+        y = chars[j < i ? j : j + 1];
+    }
+    ENSURE(x.size() == y.size());
+
+    uint64_t diff = stringHash(y, p, mod) - stringHash(x, p, mod);
+    if (mod != 0) {
+        diff = (diff + mod) % mod;
+    }
+    if (diff == 0) {
+        return {x, y};
+    }
+
+    uint64_t pPower = 1;
+    for (size_t i = 0; i < x.size(); ++i) {
+        pPower = multiplyModulo(pPower, p, mod);
+    }
+
+    int bits = mod == 0 ? 64 : 0;
+    while (bits < 64 && (uint64_t(1) << bits) < mod) {
+        ++bits;
+    }
+    int levels = 1;
+    while (levels * (levels + 1) / 2 < bits) {
+        ++levels;
+    }
+
+    for (; ; ++levels) {
+        ensure(levels <= 24, "Cannot generate anti-hash test for this modulo");
+        size_t n = size_t(1) << levels;
+        // Word w[0..n) has hash sum h(w[i]) * pPower^(n-1-i), so swapping
+        // x and y at position i changes it by diff * pPower^(n-1-i).
+        std::vector<uint64_t> values(n);
+        uint64_t cur = diff;
+        for (size_t i = n; i-- > 0; ) {
+            values[i] = cur;
+            cur = multiplyModulo(cur, pPower, mod);
+        }
+
+        auto coefficients = treeAttack(values);
+        if (coefficients.empty()) {
+            continue;
+        }
+
+        std::string first, second;
+        for (int c: coefficients) {
+            if (c == 0) {
+                const std::string& s = rnd.next(2) ? y : x;
+                first += s;
+                second += s;
+            } else {
+                first += c == 1 ? y : x;
+                second += c == 1 ? x : y;
             }
         }
+        return {first, second};
     }
 }
 
@@ -4905,13 +8496,14 @@ StringPair minimalAntiHashTest(
         const std::string allowedChars)
 {
     for (auto base: bases) {
-        ensure(base.first >= 0, "0 < MOD must hold");
-        ensure(
-            base.first <= (long long)(2e9),
-            "Modules larger than 2'000'000'000 are not supported yet");
-        ensure(
-            0 < base.second && base.second < base.first,
-            "0 <= P < MOD must hold");
+        ensure(base.first >= 0, "0 <= MOD must hold");
+        if (base.first == 0) {
+            ensure(base.second != 0, "P != 0 must hold");
+        } else {
+            ensure(
+                0 < base.second && base.second < base.first,
+                "0 < P < MOD must hold");
+        }
     }
 
     std::vector<int> counts;
@@ -4929,7 +8521,11 @@ StringPair minimalAntiHashTest(
     }
 
     for (size_t i = 0; i != bases.size(); ++i) {
-        cur = extendAntiHash(cur, bases[i], counts[i]);
+        if (bases[i].first == 0 || bases[i].first > (long long)(2e9)) {
+            cur = treeAntiHash(cur, bases[i]);
+        } else {
+            cur = extendAntiHash(cur, bases[i], counts[i]);
+        }
         ensure(static_cast<int>(cur.size()) == counts[i],
             "Cannot generate long enough pair with same hash");
     }
@@ -4942,15 +8538,34 @@ StringPair minimalAntiHashTest(
 
 std::string StringRandom::random(int len, const std::string& alphabet) {
     checkLargeParameter(len);
-    std::string chars = detail::parseAllowedChars(alphabet);
-    std::string res;
-    res.reserve(len);
-    for (int i = 0; i < len; ++i) {
-        res += choice(chars);
-    }
+    detail::AlphabetTable table(alphabet);
+    std::string res(len, ' ');
+    table.fill(rnd, &res[0], res.size());
     return res;
 }
 
+StringStream StringRandom::randomStream(
+        size_t len, const std::string& alphabet)
+{
+    return StringStream(len, alphabet);
+}
+
+StringStream::StringStream(size_t size, const std::string& alphabet) :
+    size_(size),
+    table_(alphabet),
+    base_(rnd.split(1)[0])
+{  }
+
+std::string StringStream::str() const {
+    checkLargeParameter(size_);
+    std::string result;
+    result.reserve(size_);
+    forEachChunk([&result](const char* data, size_t count) {
+        result.append(data, count);
+    });
+    return result;
+}
+
 std::string StringRandom::thueMorse(int len, char first, char second) {
     ensure(len >= 0);
     checkLargeParameter(len);
@@ -5006,6 +8621,43 @@ StringPair StringRandom::antiHash(
 #endif // JNGEN_DECLARE_ONLY
 
 
+#include <cstddef>
+
+namespace jngen {
+
+// A read-only view of a contiguous range of elements owned by some other
+// object. It does not copy anything and is valid only as long as the storage
+// it points to is not modified.
+template<typename T>
+class Span {
+public:
+    using value_type = T;
+    using const_iterator = const T*;
+    using iterator = const_iterator;
+
+    Span() : begin_(nullptr), end_(nullptr) {}
+    Span(const T* begin, const T* end) : begin_(begin), end_(end) {}
+
+    const T* begin() const { return begin_; }
+    const T* end() const { return end_; }
+    const T* data() const { return begin_; }
+
+    size_t size() const { return end_ - begin_; }
+    bool empty() const { return begin_ == end_; }
+
+    const T& operator[](size_t index) const { return begin_[index]; }
+
+    const T& front() const { return *begin_; }
+    const T& back() const { return *(end_ - 1); }
+
+private:
+    const T* begin_;
+    const T* end_;
+};
+
+} // namespace jngen
+
+
 #include <algorithm>
 #include <functional>
 #include <iostream>
@@ -5649,8 +9301,10 @@ using jngen::WeightArray;
 
 
 #include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <iterator>
+#include <numeric>
 #include <set>
 #include <utility>
 #include <vector>
@@ -5661,14 +9315,14 @@ class GenericGraph {
 public:
     virtual ~GenericGraph() {}
 
-    virtual int n() const { return adjList_.size(); }
+    virtual int n() const { return vertexLabel_.size(); }
     virtual int m() const { return numEdges_; }
 
     bool directed() const { return directed_; }
 
     // u, v: labels
     virtual void addEdge(int u, int v, const Weight& w = Weight{});
-    virtual bool isConnected() const { return dsu_.isConnected(); }
+    virtual bool isConnected() const { return dsu().isConnected(); }
 
     virtual int vertexLabel(int v) const { return vertexLabel_.at(v); }
     virtual int vertexByLabel(int v) const { return vertexByLabel_.at(v); }
@@ -5680,6 +9334,21 @@ public:
     // return: array<label, label>
     virtual Arrayp edges() const;
 
+    // v: label
+    // return: span<label>, valid until the graph is modified
+    // requires: the graph is frozen
+    Span<int> neighbors(int v) const;
+
+    // v: label
+    // return: span<edge index>, i-th edge leads to neighbors(v)[i]
+    // requires: the graph is frozen
+    Span<int> incidentEdges(int v) const;
+
+    // Moves adjacency lists to the compressed storage. Generators return
+    // frozen graphs; addEdge unfreezes the graph until the next call.
+    void freeze();
+    bool frozen() const { return frozen_; }
+
     // order: by labels
     // TODO: think about ordering here
     virtual void setVertexWeights(const WeightArray& weights);
@@ -5715,10 +9384,26 @@ protected:
 
     void extend(size_t size);
 
+    // Returns the components of the graph, rebuilding them if the graph was
+    // created by initWithEdges.
+    Dsu& dsu() const;
+
     // v: vertex number
     // returns: array<number>
     Array internalEdges(int v) const;
 
+    // v: vertex number
+    // returns: span<edge index>, does not freeze the graph
+    Span<int> internalIncidentEdges(int v) const;
+
+    // Moves them back to per-vertex lists before adding an edge.
+    void thaw();
+    // Fills adjLabels_ after the graph is frozen or relabeled.
+    void updateAdjacentLabels();
+    // Fills the compressed storage from edges_ using config.threads threads,
+    // exactly as initWithEdges does with one.
+    void buildAdjacencyInParallel();
+
     // u, v: vertex numbers
     void addEdgeUnsafe(int u, int v);
 
@@ -5736,8 +9421,21 @@ protected:
 
     bool directed_ = false;
 
-    Dsu dsu_;
+    // initWithEdges leaves dsu_ stale, since most generated graphs never
+    // need it, and dsu() rebuilds it on demand.
+    mutable Dsu dsu_;
+    mutable bool dsuStale_ = false;
+
+    // While edges are added one by one, adjList_[v] holds indices of edges
+    // incident to v. Otherwise the graph is frozen: these indices are stored
+    // in adjEdges_[adjOffsets_[v]..adjOffsets_[v + 1]) and adjLabels_ holds
+    // labels of their other ends in the same order.
+    bool frozen_ = false;
     std::vector<Array> adjList_;
+    Array adjOffsets_;
+    Array adjEdges_;
+    Array adjLabels_;
+
     Array vertexLabel_;
     Array vertexByLabel_;
     Arrayp edges_;
@@ -5751,7 +9449,16 @@ struct Hash<GenericGraph> {
     uint64_t operator()(const GenericGraph& graph) const {
         uint64_t h = 0;
         for (int i = 0; i < graph.n(); ++i) {
-            impl::hashCombine(h, Hash<Array>{}(graph.edges(i)));
+            if (!graph.frozen()) {
+                impl::hashCombine(h, Hash<Array>{}(graph.edges(i)));
+                continue;
+            }
+            // Same as Hash<Array> of graph.edges(i), but without a copy.
+            auto neighbors = graph.neighbors(i);
+            uint64_t vertexHash = 0;
+            impl::hashCombine(vertexHash, neighbors.size());
+            impl::hashCombine(vertexHash, neighbors.begin(), neighbors.end());
+            impl::hashCombine(h, vertexHash);
         }
         return h;
     }
@@ -5822,6 +9529,12 @@ Array GenericGraph::edges(int v) const {
     ensure(v < n(), "Graph::edges(v)");
     v = vertexByLabel(v);
 
+    if (frozen_) {
+        return Array(
+            adjLabels_.begin() + adjOffsets_[v],
+            adjLabels_.begin() + adjOffsets_[v + 1]);
+    }
+
     Array result = internalEdges(v);
     for (auto& x: result) {
         x = vertexLabel(x);
@@ -5830,6 +9543,24 @@ Array GenericGraph::edges(int v) const {
     return result;
 }
 
+Span<int> GenericGraph::neighbors(int v) const {
+    ensure(v < n(), "Graph::neighbors(v)");
+    ensure(frozen_, "Graph::neighbors(v): call freeze() after addEdge");
+    v = vertexByLabel(v);
+
+    return Span<int>(
+        adjLabels_.data() + adjOffsets_[v],
+        adjLabels_.data() + adjOffsets_[v + 1]);
+}
+
+Span<int> GenericGraph::incidentEdges(int v) const {
+    ensure(v < n(), "Graph::incidentEdges(v)");
+    ensure(frozen_, "Graph::incidentEdges(v): call freeze() after addEdge");
+    v = vertexByLabel(v);
+
+    return internalIncidentEdges(v);
+}
+
 Arrayp GenericGraph::edges() const {
     auto edges = edges_;
     for (auto& e: edges) {
@@ -5864,6 +9595,9 @@ void GenericGraph::doShuffle() {
     vertexByLabel_ = vertexLabel_.inverse();
 
     doShuffleEdges();
+    if (frozen_) {
+        updateAdjacentLabels();
+    }
 }
 
 void GenericGraph::doShuffleAllBut(const Array& except) {
@@ -5883,13 +9617,17 @@ void GenericGraph::doShuffleAllBut(const Array& except) {
     vertexByLabel_ = vertexLabel_.inverse();
 
     doShuffleEdges();
+    if (frozen_) {
+        updateAdjacentLabels();
+    }
 }
 
 void GenericGraph::doShuffleEdges() {
     if (!directed_) {
-        for (auto& edge: edges_) {
-            if (rnd.next(2)) {
-                std::swap(edge.first, edge.second);
+        Array flips = Array::random(edges_.size(), 2);
+        for (size_t i = 0; i < edges_.size(); ++i) {
+            if (flips[i]) {
+                std::swap(edges_[i].first, edges_[i].second);
             }
         }
     }
@@ -5901,25 +9639,106 @@ void GenericGraph::extend(size_t size) {
     checkLargeParameter(size);
     size_t oldSize = n();
     if (size > oldSize) {
-        adjList_.resize(size);
+        if (frozen_) {
+            adjOffsets_.resize(size + 1, adjOffsets_.back());
+        } else {
+            adjList_.resize(size);
+        }
         vertexLabel_ += Array::id(size - oldSize, oldSize);
         vertexByLabel_ += Array::id(size - oldSize, oldSize);
-        dsu_.extend(size);
+        if (!dsuStale_) {
+            dsu_.extend(size);
+        }
+    }
+}
+
+Dsu& GenericGraph::dsu() const {
+    if (dsuStale_) {
+        dsu_ = Dsu();
+        dsu_.extend(n());
+        for (const auto& edge: edges_) {
+            dsu_.unite(edge.first, edge.second);
+        }
+        dsuStale_ = false;
     }
+    return dsu_;
 }
 
 Array GenericGraph::internalEdges(int v) const {
+    auto ids = internalIncidentEdges(v);
     Array result;
+    result.reserve(ids.size());
     std::transform(
-        adjList_[v].begin(),
-        adjList_[v].end(),
+        ids.begin(),
+        ids.end(),
         std::back_inserter(result),
         [this, v](int x) { return edgeOtherEnd(v, x); }
     );
     return result;
 }
 
+Span<int> GenericGraph::internalIncidentEdges(int v) const {
+    if (frozen_) {
+        return Span<int>(
+            adjEdges_.data() + adjOffsets_[v],
+            adjEdges_.data() + adjOffsets_[v + 1]);
+    }
+    return Span<int>(
+        adjList_[v].data(), adjList_[v].data() + adjList_[v].size());
+}
+
+void GenericGraph::freeze() {
+    if (frozen_) {
+        return;
+    }
+
+    adjOffsets_.assign(n() + 1, 0);
+    for (int v = 0; v < n(); ++v) {
+        adjOffsets_[v + 1] = adjOffsets_[v] + adjList_[v].size();
+    }
+
+    adjEdges_.clear();
+    adjEdges_.reserve(adjOffsets_.back());
+    for (const auto& ids: adjList_) {
+        adjEdges_.insert(adjEdges_.end(), ids.begin(), ids.end());
+    }
+    std::vector<Array>().swap(adjList_);
+
+    frozen_ = true;
+    updateAdjacentLabels();
+}
+
+void GenericGraph::thaw() {
+    if (!frozen_) {
+        return;
+    }
+
+    adjList_.resize(n());
+    for (int v = 0; v < n(); ++v) {
+        adjList_[v].assign(
+            adjEdges_.begin() + adjOffsets_[v],
+            adjEdges_.begin() + adjOffsets_[v + 1]);
+    }
+    Array().swap(adjOffsets_);
+    Array().swap(adjEdges_);
+    Array().swap(adjLabels_);
+
+    frozen_ = false;
+}
+
+void GenericGraph::updateAdjacentLabels() {
+    ENSURE(frozen_, "GenericGraph::updateAdjacentLabels");
+    adjLabels_.resize(adjEdges_.size());
+    for (int v = 0; v < n(); ++v) {
+        for (int i = adjOffsets_[v]; i != adjOffsets_[v + 1]; ++i) {
+            adjLabels_[i] = vertexLabel_[edgeOtherEnd(v, adjEdges_[i])];
+        }
+    }
+}
+
 void GenericGraph::addEdgeUnsafe(int u, int v) {
+    thaw();
+
     int id = numEdges_++;
     edges_.emplace_back(u, v);
 
@@ -5948,9 +9767,18 @@ void GenericGraph::permuteEdges(const Array& order) {
     edges_ = edges_.subseq(order);
 
     auto newByOld = order.inverse();
-    for (int v = 0; v < n(); ++v) {
-        for (auto& x: adjList_[v]) {
-            x = newByOld[x];
+    if (frozen_) {
+        detail::parallelForChunks(
+            adjEdges_.size(), [this, &newByOld](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    adjEdges_[i] = newByOld[adjEdges_[i]];
+                }
+            });
+    } else {
+        for (int v = 0; v < n(); ++v) {
+            for (auto& x: adjList_[v]) {
+                x = newByOld[x];
+            }
         }
     }
 
@@ -5966,7 +9794,7 @@ void GenericGraph::addEdge(int u, int v, const Weight& w) {
     u = vertexByLabel(u);
     v = vertexByLabel(v);
 
-    dsu_.unite(u, v);
+    dsu().unite(u, v);
     addEdgeUnsafe(u, v);
 
     if (!w.empty()) {
@@ -6077,10 +9905,23 @@ void GenericGraph::normalizeEdges() {
         }
     }
 
-    auto order = Array::id(numEdges_).sorted(
-        [this](int i, int j) {
-            return edges_[i] < edges_[j];
-        });
+    // Equal edges are indistinguishable, so a stable radix sort gives the
+    // same graph as a comparison sort would.
+    std::vector<detail::KeyIndex> keys(numEdges_);
+    detail::parallelForChunks(numEdges_, [&](size_t begin, size_t end) {
+        for (size_t id = begin; id < end; ++id) {
+            keys[id] = {
+                static_cast<uint64_t>(edges_[id].first) * n() +
+                    edges_[id].second,
+                static_cast<int>(id)};
+        }
+    });
+    detail::sortByKey(keys, detail::bitWidth(static_cast<uint64_t>(n()) * n()));
+
+    Array order(numEdges_);
+    for (int i = 0; i < numEdges_; ++i) {
+        order[i] = keys[i].index;
+    }
 
     permuteEdges(order);
 }
@@ -6101,33 +9942,99 @@ int GenericGraph::compareTo(const GenericGraph& other) const {
 
 void GenericGraph::initWithEdges(int n, const Arrayp& edges) {
     ENSURE(this->n() == 0, "Can call initWithEdges only on empty graph");
+
+    // The graph is built frozen, so adjacency lists go straight to the
+    // compressed storage without per-vertex allocations.
+    std::vector<Array>().swap(adjList_);
+    adjOffsets_.assign(1, 0);
+    frozen_ = true;
     extend(n);
+    dsuStale_ = true;
 
     edges_ = edges;
     numEdges_ = edges.size();
 
+    if (config.threads > 0) {
+        buildAdjacencyInParallel();
+    } else {
+        // adjOffsets_[v] is the end of the v-th block at first, and moves to
+        // its beginning as edges are placed from the last one.
+        for (const auto& edge: edges) {
+            ++adjOffsets_[edge.first];
+            if (!directed_ && edge.first != edge.second) {
+                ++adjOffsets_[edge.second];
+            }
+        }
+        std::partial_sum(
+            adjOffsets_.begin(), adjOffsets_.end(), adjOffsets_.begin());
+
+        // Vertices are not relabeled yet, so the labels of other ends are
+        // known right away, and normalizeEdges() changes only edge indices.
+        adjEdges_.resize(adjOffsets_.back());
+        adjLabels_.resize(adjOffsets_.back());
+        for (int id = numEdges_ - 1; id >= 0; --id) {
+            const auto& edge = edges[id];
+            int position = --adjOffsets_[edge.first];
+            adjEdges_[position] = id;
+            adjLabels_[position] = edge.second;
+            if (!directed_ && edge.first != edge.second) {
+                position = --adjOffsets_[edge.second];
+                adjEdges_[position] = id;
+                adjLabels_[position] = edge.first;
+            }
+        }
+    }
+
+    normalizeEdges();
+}
+
+void GenericGraph::buildAdjacencyInParallel() {
+    int n = this->n();
 
-    Array degree(n);
-    for (const auto& edge: edges) {
-        ++degree[edge.first];
-        if (!directed_ && edge.first != edge.second) {
-            ++degree[edge.second];
+    // Degrees do not depend on the order of increments. Edges are then put
+    // into their blocks in arbitrary order, and each block is sorted, so the
+    // result is the same as the one of the serial placement.
+    std::vector<std::atomic<int>> position(n);
+    detail::parallelForChunks(numEdges_, [&](size_t begin, size_t end) {
+        for (size_t id = begin; id < end; ++id) {
+            const auto& edge = edges_[id];
+            ++position[edge.first];
+            if (!directed_ && edge.first != edge.second) {
+                ++position[edge.second];
+            }
         }
+    });
 
-        dsu_.unite(edge.first, edge.second);
-    }
-    for (int i = 0; i < n; ++i) {
-        adjList_[i].reserve(degree[i]);
+    adjOffsets_.assign(n + 1, 0);
+    for (int v = 0; v < n; ++v) {
+        adjOffsets_[v + 1] = adjOffsets_[v] + position[v];
+        position[v] = adjOffsets_[v];
     }
-    for (size_t id = 0; id != edges.size(); ++id) {
-        const auto& edge = edges[id];
-        adjList_[edge.first].push_back(id);
-        if (!directed_ && edge.first != edge.second) {
-            adjList_[edge.second].push_back(id);
+
+    adjEdges_.resize(adjOffsets_.back());
+    adjLabels_.resize(adjOffsets_.back());
+    detail::parallelForChunks(numEdges_, [&](size_t begin, size_t end) {
+        for (size_t id = begin; id < end; ++id) {
+            const auto& edge = edges_[id];
+            adjEdges_[position[edge.first]++] = id;
+            if (!directed_ && edge.first != edge.second) {
+                adjEdges_[position[edge.second]++] = id;
+            }
         }
-    }
+    });
 
-    normalizeEdges();
+    detail::parallelForChunks(n, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) {
+            std::sort(
+                adjEdges_.begin() + adjOffsets_[v],
+                adjEdges_.begin() + adjOffsets_[v + 1]);
+            for (int i = adjOffsets_[v]; i != adjOffsets_[v + 1]; ++i) {
+                const auto& edge = edges_[adjEdges_[i]];
+                adjLabels_[i] = edge.first == static_cast<int>(v) ?
+                    edge.second : edge.first;
+            }
+        }
+    });
 }
 
 } // namespace jngen
@@ -6149,7 +10056,7 @@ public:
     Tree(const GenericGraph& gg) : GenericGraph(gg) {
         extend(1);
         ensure(
-                dsu_.numComponents() == n() - m(),
+                dsu().numComponents() == n() - m(),
                 "Cannot create a tree from a graph with cycles");
     }
 
@@ -6216,7 +10123,7 @@ void Tree::addEdge(int u, int v, const Weight& w) {
     u = vertexByLabel(u);
     v = vertexByLabel(v);
 
-    int ret = dsu_.unite(u, v);
+    int ret = dsu().unite(u, v);
     ensure(ret, "A cycle appeared in the tree");
 
     addEdgeUnsafe(u, v);
@@ -6229,7 +10136,8 @@ void Tree::addEdge(int u, int v, const Weight& w) {
 bool Tree::canAddEdge(int u, int v) {
     u = vertexByLabel(u);
     v = vertexByLabel(v);
-    return dsu_.getRoot(u) != dsu_.getRoot(v);
+    Dsu& components = dsu();
+    return components.getRoot(u) != components.getRoot(v);
 }
 
 Array Tree::parents(int root) const {
@@ -6243,7 +10151,8 @@ Array Tree::parents(int root) const {
     for (size_t i = 0; i < queue.size(); ++i) {
         int v = queue[i];
         used[v] = true;
-        for (auto to: internalEdges(v)) {
+        for (int id: internalIncidentEdges(v)) {
+            int to = edgeOtherEnd(v, id);
             if (!used[to]) {
                 parents[to] = v;
                 queue.push_back(to);
@@ -6292,6 +10201,7 @@ Tree Tree::link(int vInThis, const Tree& other, int vInOther) {
 
     t.addEdge(vInThis, vInOther + n());
 
+    t.freeze();
     return t;
 }
 
@@ -6317,6 +10227,7 @@ Tree Tree::glue(int vInThis, const Tree& other, int vInOther) {
 
     ensure(t.n() == n() + other.n() - 1);
 
+    t.freeze();
     return t;
 }
 
@@ -6330,6 +10241,7 @@ Tree Tree::bamboo(int size) {
         t.addEdge(i, i+1);
     }
     t.normalizeEdges();
+    t.freeze();
     return t;
 }
 
@@ -6337,7 +10249,9 @@ Tree Tree::random(int size) {
     ensure(size > 0, "Number of vertices in the tree must be positive");
     checkLargeParameter(size);
     if (size == 1) {
-        return Tree();
+        Tree t;
+        t.freeze();
+        return t;
     }
     return fromPruferSequence(Array::random(size - 2, size));
 }
@@ -6351,6 +10265,7 @@ Tree Tree::randomPrim(int size, int elongation) {
         t.addEdge(parent, v);
     }
     t.normalizeEdges();
+    t.freeze();
     return t;
 }
 
@@ -6365,6 +10280,7 @@ Tree Tree::randomKruskal(int size) {
             t.addEdge(e.first, e.second);
         }
     }
+    t.freeze();
     return t;
 }
 
@@ -6376,6 +10292,7 @@ Tree Tree::star(int size) {
         t.addEdge(0, i);
     }
     t.normalizeEdges();
+    t.freeze();
     return t;
 }
 
@@ -6389,6 +10306,7 @@ Tree Tree::caterpillar(int size, int length) {
         t.addEdge(rnd.next(length), i);
     }
     t.normalizeEdges();
+    t.freeze();
     return t;
 }
 
@@ -6405,6 +10323,7 @@ Tree Tree::kary(int size, int k) {
         t.addEdge((i - 1) / k, i);
     }
     t.normalizeEdges();
+    t.freeze();
     return t;
 }
 
@@ -6436,6 +10355,7 @@ Tree Tree::fromPruferSequence(const Array& code) {
     ENSURE(leaves.size() == 2u);
     t.addEdge(*leaves.begin(), *leaves.rbegin());
     t.normalizeEdges();
+    t.freeze();
     return t;
 
 }
@@ -6491,6 +10411,9 @@ void Tree::doPrintParents(std::ostream& out, const OutputModifier& mod) const {
 #endif // JNGEN_DECLARE_ONLY
 
 
+#include <cmath>
+#include <functional>
+#include <limits>
 #include <memory>
 #include <set>
 #include <utility>
@@ -6530,6 +10453,9 @@ public:
             int n, int m, int elongation, int spread);
     static BuilderProxy randomBipartite(int n1, int n2, int m);
     static BuilderProxy completeBipartite(int n1, int n2);
+    static BuilderProxy randomRegular(int n, int d);
+    static BuilderProxy fromDegreeSequence(const Array& degrees);
+    static BuilderProxy randomExpectedDegrees(const Arrayf& weights);
 };
 
 inline void Graph::setN(int n) {
@@ -6590,17 +10516,143 @@ namespace jngen {
 namespace graph_detail {
 
 Graph BuilderProxy::g() const {
-    return builder_(traits_);
+    Graph g = builder_(traits_);
+    g.freeze();
+    return g;
 }
 
 BuilderProxy::operator Graph() const {
     return g();
 }
 
+std::pair<int, int> orderedEdge(int u, int v) {
+    return u < v ? std::make_pair(u, v) : std::make_pair(v, u);
+}
+
+// Rewires undirected edges with switches: edges (a, b) and (c, d) are replaced
+// by (a, c) and (b, d), which keeps degrees of all vertices. Only switches
+// giving edges allowed by traits are made. Adjacency lists are kept to look
+// up edges, so a lookup takes time proportional to the smaller degree. Since
+// degrees do not change, the lists are stored in a single array.
+class EdgeSwitcher {
+public:
+    EdgeSwitcher(int n, const Traits& t, Arrayp& edges) :
+        t_(t),
+        edges_(edges),
+        offset_(n + 1),
+        size_(n)
+    {
+        for (const auto& edge: edges_) {
+            ++offset_[edge.first + 1];
+            ++offset_[edge.second + 1];
+        }
+        std::partial_sum(offset_.begin(), offset_.end(), offset_.begin());
+        adjacent_.resize(offset_.back());
+        for (const auto& edge: edges_) {
+            add(edge.first, edge.second);
+        }
+    }
+
+    // Returns true if the i-th edge is a loop or a multiple edge forbidden by
+    // traits.
+    bool isForbidden(int i) const {
+        const auto& edge = edges_[i];
+        if (edge.first == edge.second && !t_.allowLoops) {
+            return true;
+        }
+        return !t_.allowMulti && count(edge.first, edge.second) > 1;
+    }
+
+    // Tries to switch the i-th and the j-th edges, taking the ends of the
+    // latter in random order. Returns true on success.
+    bool trySwitch(int i, int j) {
+        if (i == j) {
+            return false;
+        }
+        int a = edges_[i].first;
+        int b = edges_[i].second;
+        int c = edges_[j].first;
+        int d = edges_[j].second;
+        if (rnd.next(2)) {
+            std::swap(c, d);
+        }
+
+        remove(a, b);
+        remove(c, d);
+        bool success = isAllowed(a, c);
+        if (success) {
+            add(a, c);
+            success = isAllowed(b, d);
+            if (!success) {
+                remove(a, c);
+            }
+        }
+        if (!success) {
+            add(a, b);
+            add(c, d);
+            return false;
+        }
+
+        add(b, d);
+        edges_[i] = orderedEdge(a, c);
+        edges_[j] = orderedEdge(b, d);
+        return true;
+    }
+
+private:
+    bool isAllowed(int u, int v) const {
+        return (u != v || t_.allowLoops) && (t_.allowMulti || !count(u, v));
+    }
+
+    int count(int u, int v) const {
+        if (size_[u] > size_[v]) {
+            std::swap(u, v);
+        }
+        auto begin = adjacent_.begin() + offset_[u];
+        return std::count(begin, begin + size_[u], v);
+    }
+
+    // A loop takes one place in the list, though it adds 2 to the degree.
+    void add(int u, int v) {
+        adjacent_[offset_[u] + size_[u]++] = v;
+        if (u != v) {
+            adjacent_[offset_[v] + size_[v]++] = u;
+        }
+    }
+
+    void remove(int u, int v) {
+        erase(u, v);
+        if (u != v) {
+            erase(v, u);
+        }
+    }
+
+    void erase(int u, int v) {
+        auto begin = adjacent_.begin() + offset_[u];
+        auto end = begin + size_[u];
+        auto it = std::find(begin, end, v);
+        ENSURE(it != end, "EdgeSwitcher::erase");
+        *it = *(end - 1);
+        --size_[u];
+    }
+
+    const Traits& t_;
+    Arrayp& edges_;
+    Array offset_;
+    Array size_;
+    Array adjacent_;
+};
+
 class GraphRandom {
     using BuilderProxy = graph_detail::BuilderProxy;
     using Traits = graph_detail::Traits;
 
+    // Graphs with given degrees are rewired with switches: the configuration
+    // model gives up after this many attempts (plus 10 per edge), and a graph
+    // built deterministically is shuffled with this many switches per edge.
+    static constexpr long long MAX_SWITCH_ATTEMPTS = 1000;
+    static constexpr long long SWITCHES_PER_EDGE = 10;
+
 public:
     GraphRandom() {
         static bool created = false;
@@ -6744,6 +10796,41 @@ public:
         });
     }
 
+    static BuilderProxy randomRegular(int n, int d) {
+        ensure(
+            n >= 0 && d >= 0,
+            "Number of vertices and degree must be nonnegative");
+        return fromDegreeSequence(std::vector<int>(n, d));
+    }
+
+    static BuilderProxy fromDegreeSequence(const Array& degrees) {
+        long long sum = 0;
+        for (int d: degrees) {
+            ensure(d >= 0, "Degrees of vertices must be nonnegative");
+            sum += d;
+        }
+        ensure(sum % 2 == 0, "The sum of degrees must be even");
+        ensure(
+            sum / 2 <= std::numeric_limits<int>::max(),
+            "Too many edges in the graph");
+        checkLargeParameter(degrees.size());
+        checkLargeParameter(sum / 2);
+        return BuilderProxy(
+            Traits(degrees.size(), sum / 2), [degrees](Traits t) {
+                return doFromDegreeSequence(t, degrees);
+            });
+    }
+
+    static BuilderProxy randomExpectedDegrees(const Arrayf& weights) {
+        for (double w: weights) {
+            ensure(w >= 0, "Expected degrees must be nonnegative");
+        }
+        checkLargeParameter(weights.size());
+        return BuilderProxy(Traits(weights.size()), [weights](Traits t) {
+            return doRandomExpectedDegrees(t, weights);
+        });
+    }
+
 private:
     static Graph doRandom(Traits t) {
         int n = t.n;
@@ -6753,49 +10840,50 @@ private:
             ensure(m <= maxEdges(n, t), "Too many edges in the graph");
         }
 
-        std::unordered_set<std::pair<int, int>> usedEdges;
+        Arrayp result;
 
         if (t.connected) {
             ensure(m >= n - 1, "Not enough edges for a connected graph");
-            auto treeEdges = Tree::random(n).edges();
+            result = Tree::random(n).edges();
             if (t.directed) {
-                for (auto& edge: treeEdges) {
-                    if (rnd.next(2)) {
-                        std::swap(edge.first, edge.second);
+                Array flips = Array::random(result.size(), 2);
+                for (size_t i = 0; i < result.size(); ++i) {
+                    if (flips[i]) {
+                        std::swap(result[i].first, result[i].second);
                     }
                 }
             }
-            usedEdges.insert(treeEdges.begin(), treeEdges.end());
-            ENSURE(usedEdges.size() == static_cast<size_t>(n - 1));
         }
 
-        auto edgeIsGood = [&usedEdges, t](std::pair<int, int> edge) {
-            if (!t.allowMulti && usedEdges.count(edge)) {
-                return false;
-            }
-            if (t.directed && !t.allowAntiparallel &&
-                    usedEdges.count({edge.second, edge.first}))
-            {
-                return false;
-            }
-            return true;
-        };
-
-        Arrayp result(usedEdges.begin(), usedEdges.end());
         result.reserve(m);
-
-        while (result.size() < static_cast<size_t>(m)) {
-            auto edge = randomEdge(n, t);
-            if (edgeIsGood(edge)) {
-                usedEdges.insert(edge);
-                result.push_back(edge);
-            }
+        bool ordered = t.directed && t.allowAntiparallel;
+        // If loops are allowed in unordered pairs, randomEdge returns a loop
+        // half as often as any other edge, so edges are not equiprobable and
+        // only rejection sampling reproduces the distribution.
+        bool equiprobable = !t.allowLoops || ordered;
+        if (!t.allowMulti && equiprobable &&
+                isDense(m, maxEdges(n, t), result.size())) {
+            // Rows are first ends of edges in canonical order (see
+            // addRandomEdges), columns are second ends.
+            addDenseEdges(
+                n, m, maxEdges(n, t), t, result,
+                n,
+                [ordered, &t](int u) {
+                    return ordered ? 0 : t.allowLoops ? u : u + 1;
+                },
+                ordered && !t.allowLoops);
+        } else {
+            addRandomEdges(n, m, t, result,
+                [n, &t](Random& random, size_t count,
+                        std::pair<int, int>* out) {
+                    randomEdges(random, n, t, count, out);
+                });
         }
 
         Graph graph;
 
         if (t.directed && t.acyclic) {
-            makeAcyclic(result);
+            makeAcyclic(n, result);
         }
         if (t.directed) {
             graph.directed_ = true;
@@ -6813,64 +10901,99 @@ private:
 
         auto treeEdges = tree.edges();
         if (t.directed && !t.acyclic) {
-            for (auto& edge: treeEdges) {
-                if (rnd.next(2)) {
-                    std::swap(edge.first, edge.second);
+            Array flips = Array::random(treeEdges.size(), 2);
+            for (size_t i = 0; i < treeEdges.size(); ++i) {
+                if (flips[i]) {
+                    std::swap(treeEdges[i].first, treeEdges[i].second);
                 }
             }
         }
 
+        std::string error = format("Cannot generate random stretched graph "
+            "with parameters %d, %d, %d, %d", t.n, t.m, elongation, spread);
+        constexpr size_t MAX_ATTEMPTS = 1000;
+
         Arrayp edges = treeEdges;
         edges.reserve(t.m);
 
-        std::unordered_set<std::pair<int, int>> usedEdges(
-            treeEdges.begin(), treeEdges.end());
+        if (config.threads > 0) {
+            // Candidates are drawn as in the sequential loop below, but in
+            // parallel chunks, and checked by addRandomEdges. Loops are
+            // redrawn at once.
+            ensure(t.m >= t.n - 1, "Not enough edges for a connected graph");
+            bool complete = addRandomEdges(t.n, t.m, t, edges,
+                [&parents, &error, t, spread](Random& random, size_t count,
+                        std::pair<int, int>* out) {
+                    for (size_t i = 0; i < count; ++i) {
+                        size_t attemptsToFail = MAX_ATTEMPTS;
+                        while (true) {
+                            int u = random.next(t.n);
+                            int up = random.next(0, spread);
+                            int v = u;
+                            for (int iter = 0; iter < up; ++iter) {
+                                v = parents[v];
+                            }
+                            if (t.allowLoops || u != v) {
+                                if (t.directed && !t.acyclic &&
+                                        random.next(2)) {
+                                    std::swap(u, v);
+                                }
+                                out[i] = {v, u};
+                                break;
+                            }
+                            ensure(--attemptsToFail != 0, error);
+                        }
+                    }
+                },
+                MAX_ATTEMPTS);
+            ensure(complete, error);
+        } else {
+            std::unordered_set<std::pair<int, int>> usedEdges(
+                treeEdges.begin(), treeEdges.end());
 
-        auto edgeIsGood = [&usedEdges, t](std::pair<int, int> edge) {
-            if (!t.allowMulti && usedEdges.count(edge)) {
-                return false;
-            }
-            if (t.directed && !t.allowAntiparallel &&
-                    usedEdges.count({edge.second, edge.first}))
-            {
-                return false;
-            }
-            return true;
-        };
+            auto edgeIsGood = [&usedEdges, t](std::pair<int, int> edge) {
+                if (!t.allowMulti && usedEdges.count(edge)) {
+                    return false;
+                }
+                if (t.directed && !t.allowAntiparallel &&
+                        usedEdges.count({edge.second, edge.first}))
+                {
+                    return false;
+                }
+                return true;
+            };
 
-        constexpr size_t MAX_ATTEMPTS = 1000;
-        size_t attemptsToFail = MAX_ATTEMPTS;
+            size_t attemptsToFail = MAX_ATTEMPTS;
 
-        while (static_cast<int>(edges.size()) != t.m) {
-            if (--attemptsToFail == 0) {
-                ensure(false, format("Cannot generate random stretched graph "
-                    "with parameters %d, %d, %d, %d",
-                    t.n, t.m, elongation, spread));
-            }
-            int u = rnd.next(t.n);
-            int up = rnd.next(0, spread);
-            int v = u;
-            for (int iter = 0; iter < up; ++iter) {
-                v = parents[v];
-            }
+            while (static_cast<int>(edges.size()) != t.m) {
+                if (--attemptsToFail == 0) {
+                    ensure(false, error);
+                }
+                int u = rnd.next(t.n);
+                int up = rnd.next(0, spread);
+                int v = u;
+                for (int iter = 0; iter < up; ++iter) {
+                    v = parents[v];
+                }
 
-            ENSURE(v <= u);
+                ENSURE(v <= u);
 
-            if (!t.allowLoops && u == v) {
-                continue;
-            }
+                if (!t.allowLoops && u == v) {
+                    continue;
+                }
 
-            if (!edgeIsGood({v, u})) {
-                continue;
-            }
+                if (!edgeIsGood({v, u})) {
+                    continue;
+                }
 
-            if (t.directed && !t.acyclic && rnd.next(2)) {
-                std::swap(u, v);
-            }
+                if (t.directed && !t.acyclic && rnd.next(2)) {
+                    std::swap(u, v);
+                }
 
-            edges.emplace_back(v, u);
-            usedEdges.emplace(v, u);
-            attemptsToFail = MAX_ATTEMPTS;
+                edges.emplace_back(v, u);
+                usedEdges.emplace(v, u);
+                attemptsToFail = MAX_ATTEMPTS;
+            }
         }
 
         Graph graph;
@@ -6892,41 +11015,32 @@ private:
 
         ensure(!t.directed, "Directed bipartite graphs are not supported");
 
-        std::unordered_set<std::pair<int, int>> usedEdges;
+        Arrayp result;
 
         if (t.connected) {
             ensure(m >= n1 + n2 - 1, "Not enough edges for a connected graph");
             auto pruferCode = Array::random(n2 - 1, 0, n1 - 1) +
                 Array::random(n1 - 1, n1, n1 + n2 - 1);
             pruferCode.shuffle();
-            auto treeEdges = Tree::fromPruferSequence(pruferCode).edges();
-            usedEdges.insert(treeEdges.begin(), treeEdges.end());
-            ENSURE(usedEdges.size() == static_cast<size_t>(n1 + n2 - 1));
+            result = Tree::fromPruferSequence(pruferCode).edges();
         }
 
-        auto edgeIsGood = [&usedEdges, t](std::pair<int, int> edge) {
-            if (!t.allowMulti && usedEdges.count(edge)) {
-                return false;
-            }
-            if (t.directed && !t.allowAntiparallel &&
-                    usedEdges.count({edge.second, edge.first}))
-            {
-                return false;
-            }
-            return true;
-        };
-
-        Arrayp result(usedEdges.begin(), usedEdges.end());
         result.reserve(m);
-
-        while (result.size() < static_cast<size_t>(m)) {
-            int u = rnd.next(0, n1 - 1);
-            int v = rnd.next(n1, n1 + n2 - 1);
-            std::pair<int, int> edge(u, v);
-            if (edgeIsGood(edge)) {
-                usedEdges.insert(edge);
-                result.push_back(edge);
-            }
+        long long maxEdges = static_cast<long long>(n1) * n2;
+        if (!t.allowMulti && isDense(m, maxEdges, result.size())) {
+            addDenseEdges(
+                n1 + n2, m, maxEdges, t, result,
+                n1, [n1](int) { return n1; }, false);
+        } else {
+            addRandomEdges(n1 + n2, m, t, result,
+                [n1, n2](Random& random, size_t count,
+                        std::pair<int, int>* out) {
+                    for (size_t i = 0; i < count; ++i) {
+                        int u = random.next(0, n1 - 1);
+                        int v = random.next(n1, n1 + n2 - 1);
+                        out[i] = {u, v};
+                    }
+                });
         }
 
         Graph graph;
@@ -6939,6 +11053,315 @@ private:
         return rnd.nextp(n, RandomPairTraits{!t.directed, !t.allowLoops});
     }
 
+    // Writes to |out| the same |count| edges as successive calls of
+    // randomEdge(n, t) would return if rnd were |random|.
+    static void randomEdges(
+        Random& random, int n, const Traits& t, size_t count,
+        std::pair<int, int>* out)
+    {
+        Array values;
+        int first = -1;
+        while (count > 0) {
+            // Each edge takes at least two numbers (one if it is already
+            // started), so no more numbers are drawn than randomEdge would.
+            values.resize(2 * count - (first != -1));
+            random.fill(values.data(), values.size(), n);
+            for (int x: values) {
+                if (first == -1) {
+                    first = x;
+                } else if (t.allowLoops || x != first) {
+                    if (!t.directed && first > x) {
+                        *out++ = {x, first};
+                    } else {
+                        *out++ = {first, x};
+                    }
+                    first = -1;
+                    --count;
+                }
+            }
+        }
+    }
+
+    // Calls draw(random, count, out), which writes |count| random edges to
+    // out[0..count). The whole range is drawn from rnd, unless
+    // config.threads is set: then its chunks are drawn in parallel from
+    // streams split off rnd, so that they do not depend on the number of
+    // threads.
+    template<typename Draw>
+    static void drawEdges(size_t count, std::pair<int, int>* out, Draw& draw) {
+        if (config.threads > 0) {
+            detail::generateInChunks(
+                count, [out, &draw](Random& random, size_t begin, size_t size) {
+                    draw(random, size, out + begin);
+                });
+        } else {
+            draw(rnd, count, out);
+        }
+    }
+
+    // Appends random edges on n vertices to |result| until it has m of them.
+    // Edges are generated with drawEdges and are rejected if they are
+    // duplicate or antiparallel to already taken ones (as forbidden by
+    // traits), exactly as if they were drawn and checked one by one. Instead
+    // of looking up each edge in a hash set, the edges are drawn in batches
+    // and the rejected ones are found by sorting packed keys. A batch is never
+    // larger than the number of edges still missing, so without
+    // config.threads the draws are the same as with one-by-one checks. With
+    // it, every step is split into chunks processed in parallel, and the
+    // result depends only on the seed. If maxRejections is positive and that
+    // many draws in a row are rejected, stops and returns false.
+    template<typename Draw>
+    static bool addRandomEdges(
+        int n, int m, const Traits& t, Arrayp& result, Draw draw,
+        size_t maxRejections = 0)
+    {
+        bool checkAntiparallel = t.directed && !t.allowAntiparallel;
+        if (t.allowMulti && !checkAntiparallel) {
+            size_t taken = result.size();
+            result.resize(m);
+            drawEdges(m - taken, result.data() + taken, draw);
+            return true;
+        }
+
+        // Edges with the same key are checked against each other. With
+        // allowMulti (and antiparallel edges forbidden) the edge is taken
+        // unless the opposite one is, which is stored in the lowest bit of
+        // used keys. A loop is opposite to itself.
+        auto key = [n, checkAntiparallel, &t](std::pair<int, int> edge) {
+            if ((!t.directed || checkAntiparallel) &&
+                    edge.first > edge.second) {
+                std::swap(edge.first, edge.second);
+            }
+            return static_cast<uint64_t>(edge.first) * n + edge.second;
+        };
+        auto orientation = [&t](const std::pair<int, int>& edge) {
+            return t.allowMulti && edge.first > edge.second ? 1 : 0;
+        };
+
+        int bits = detail::bitWidth(static_cast<uint64_t>(n) * n);
+
+        std::vector<uint64_t> used;
+        used.reserve(m);
+        for (const auto& edge: result) {
+            used.push_back(key(edge) << 1 | orientation(edge));
+        }
+        std::sort(used.begin(), used.end());
+
+        Arrayp batch;
+        std::vector<detail::KeyIndex> keys;
+        std::vector<char> taken;
+        std::vector<uint64_t> merged;
+        size_t rejections = 0;
+
+        while (result.size() < static_cast<size_t>(m)) {
+            batch.resize(m - result.size());
+            drawEdges(batch.size(), batch.data(), draw);
+
+            keys.resize(batch.size());
+            detail::parallelForChunks(
+                batch.size(), [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; ++i) {
+                        keys[i] = {key(batch[i]), static_cast<int>(i)};
+                    }
+                });
+            detail::sortByKey(keys, bits);
+
+            // Sorted keys are split into segments which do not break groups
+            // of equal keys. Each segment is checked against its own range of
+            // used keys.
+            std::vector<size_t> segmentBegin{0};
+            for (size_t i = detail::PARALLEL_CHUNK_SIZE; i < keys.size();
+                    i += detail::PARALLEL_CHUNK_SIZE) {
+                size_t j = i;
+                while (j < keys.size() && keys[j].key == keys[j - 1].key) {
+                    ++j;
+                }
+                if (j < keys.size() && j > segmentBegin.back()) {
+                    segmentBegin.push_back(j);
+                }
+            }
+            size_t segments = segmentBegin.size();
+            segmentBegin.push_back(keys.size());
+
+            std::vector<size_t> usedBegin(segments + 1, 0);
+            usedBegin[segments] = used.size();
+            for (size_t s = 1; s < segments; ++s) {
+                usedBegin[s] = std::lower_bound(
+                    used.begin(), used.end(),
+                    keys[segmentBegin[s]].key << 1) - used.begin();
+            }
+
+            taken.assign(batch.size(), false);
+            std::vector<std::vector<uint64_t>> added(segments);
+            detail::parallelFor(segments, [&](size_t s) {
+                auto usedIt = used.begin() + usedBegin[s];
+                auto usedEnd = used.begin() + usedBegin[s + 1];
+                for (size_t i = segmentBegin[s]; i != segmentBegin[s + 1]; ) {
+                    uint64_t k = keys[i].key;
+                    // Keys are sorted, so used ones are walked forward as in
+                    // a merge.
+                    while (usedIt != usedEnd && *usedIt < (k << 1)) {
+                        ++usedIt;
+                    }
+                    // -1 if no edge with this key is taken, its orientation
+                    // otherwise.
+                    int state = -1;
+                    if (usedIt != usedEnd && (*usedIt >> 1) == k) {
+                        state = *usedIt & 1;
+                    }
+                    bool isNew = state == -1;
+
+                    for (; i != segmentBegin[s + 1] && keys[i].key == k; ++i) {
+                        const auto& edge = batch[keys[i].index];
+                        if (state == -1) {
+                            state = orientation(edge);
+                            taken[keys[i].index] = true;
+                        } else if (t.allowMulti &&
+                                edge.first != edge.second &&
+                                orientation(edge) == state) {
+                            taken[keys[i].index] = true;
+                        }
+                    }
+                    if (isNew) {
+                        added[s].push_back(k << 1 | state);
+                    }
+                }
+            });
+
+            std::vector<size_t> mergedBegin(segments + 1, 0);
+            for (size_t s = 0; s < segments; ++s) {
+                mergedBegin[s + 1] = mergedBegin[s] +
+                    (usedBegin[s + 1] - usedBegin[s]) + added[s].size();
+            }
+            merged.resize(mergedBegin[segments]);
+            detail::parallelFor(segments, [&](size_t s) {
+                std::merge(
+                    used.begin() + usedBegin[s],
+                    used.begin() + usedBegin[s + 1],
+                    added[s].begin(), added[s].end(),
+                    merged.begin() + mergedBegin[s]);
+            });
+            used.swap(merged);
+
+            // Taken edges are appended in the order they were drawn.
+            size_t chunks = (batch.size() + detail::PARALLEL_CHUNK_SIZE - 1) /
+                detail::PARALLEL_CHUNK_SIZE;
+            std::vector<size_t> resultBegin(chunks + 1);
+            resultBegin[0] = result.size();
+            detail::parallelForChunks(
+                batch.size(), [&](size_t begin, size_t end) {
+                    resultBegin[begin / detail::PARALLEL_CHUNK_SIZE + 1] =
+                        std::count(
+                            taken.begin() + begin, taken.begin() + end, true);
+                });
+            std::partial_sum(
+                resultBegin.begin(), resultBegin.end(), resultBegin.begin());
+            result.resize(resultBegin[chunks]);
+            detail::parallelForChunks(
+                batch.size(), [&](size_t begin, size_t end) {
+                    size_t position =
+                        resultBegin[begin / detail::PARALLEL_CHUNK_SIZE];
+                    for (size_t i = begin; i < end; ++i) {
+                        if (taken[i]) {
+                            result[position++] = batch[i];
+                        }
+                    }
+                });
+
+            if (maxRejections > 0 && result.size() < static_cast<size_t>(m)) {
+                size_t last = batch.size();
+                while (last > 0 && !taken[last - 1]) {
+                    --last;
+                }
+                rejections = last == 0 ?
+                    rejections + batch.size() : batch.size() - last;
+                if (rejections >= maxRejections) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Returns true if at least half of edges which are not taken yet are to
+    // be added. Rejection sampling would then draw too many duplicates, so
+    // all possible edges are enumerated instead.
+    static bool isDense(int m, long long maxEdges, size_t taken) {
+        return 2 * (m - static_cast<long long>(taken)) >
+            maxEdges - static_cast<long long>(taken);
+    }
+
+    // Appends to |result| edges chosen uniformly among those not taken yet,
+    // until it has m of them. All allowed edges in canonical order (see
+    // addRandomEdges) are (u, v) for u in [0, rows) and v in
+    // [firstColumn(u), n), except loops if skipLoops is set; there are
+    // maxEdges of them. The edges which are left out are sampled, and the
+    // added ones are shuffled, so the result is distributed exactly as the
+    // one of addRandomEdges, in O(maxEdges) time.
+    template<typename FirstColumn>
+    static void addDenseEdges(
+        int n, int m, long long maxEdges, const Traits& t, Arrayp& result,
+        int rows, FirstColumn firstColumn, bool skipLoops)
+    {
+        bool canonical = !(t.directed && t.allowAntiparallel);
+        std::vector<uint64_t> taken;
+        taken.reserve(result.size());
+        for (auto edge: result) {
+            if (canonical && edge.first > edge.second) {
+                std::swap(edge.first, edge.second);
+            }
+            taken.push_back(static_cast<uint64_t>(edge.first) * n + edge.second);
+        }
+        std::sort(taken.begin(), taken.end());
+
+        long long available = maxEdges - result.size();
+        long long needed = m - static_cast<long long>(result.size());
+        if (needed <= 0) {
+            return;
+        }
+        auto skipped = detail::sampleSortedOffsets(
+            rnd, available - needed, available - 1);
+
+        Arrayp added;
+        added.reserve(needed);
+        auto takenIt = taken.begin();
+        auto skippedIt = skipped.begin();
+        uint64_t index = 0;
+        for (int u = 0; u < rows; ++u) {
+            uint64_t rowKey = static_cast<uint64_t>(u) * n;
+            for (int v = firstColumn(u); v < n; ++v) {
+                if (skipLoops && u == v) {
+                    continue;
+                }
+                if (takenIt != taken.end() && *takenIt == rowKey + v) {
+                    ++takenIt;
+                    continue;
+                }
+                if (skippedIt != skipped.end() && *skippedIt == index) {
+                    ++skippedIt;
+                } else {
+                    added.emplace_back(u, v);
+                }
+                ++index;
+            }
+        }
+        ENSURE(
+            static_cast<long long>(index) == available &&
+            static_cast<long long>(added.size()) == needed,
+            "GraphRandom::addDenseEdges");
+
+        if (t.directed && !t.allowAntiparallel) {
+            Array flips = Array::random(added.size(), 2);
+            for (size_t i = 0; i < added.size(); ++i) {
+                if (flips[i]) {
+                    std::swap(added[i].first, added[i].second);
+                }
+            }
+        }
+        added.shuffle();
+        result.insert(result.end(), added.begin(), added.end());
+    }
+
     static long long maxEdges(int n, const Traits& t) {
         ENSURE(!t.allowMulti);
         long long res = static_cast<long long>(n) * (n-1);
@@ -6951,8 +11374,373 @@ private:
         return res;
     }
 
-    static void makeAcyclic(Arrayp& edges) {
-        auto numbering = Array::id(edges.size()).shuffle();
+    static Graph doFromDegreeSequence(Traits t, const Array& degrees) {
+        ensure(
+            !t.directed,
+            "Directed graphs with given degrees are not supported");
+
+        int n = t.n;
+        int maxDegree = degrees.empty() ?
+            0 : *std::max_element(degrees.begin(), degrees.end());
+        bool simple = !t.allowLoops && !t.allowMulti;
+        if (simple) {
+            ensure(isGraphical(degrees), "The degree sequence is not graphical");
+        } else if (!t.allowLoops) {
+            ensure(
+                maxDegree <= 2LL * t.m - maxDegree,
+                "The degree sequence is not graphical");
+        }
+
+        // A dense simple graph is generated as the complement of a sparse
+        // one, which is much easier to repair.
+        bool complement =
+            simple && t.m > static_cast<long long>(n) * (n - 1) / 4;
+        Array target = degrees;
+        if (complement) {
+            for (int& d: target) {
+                d = n - 1 - d;
+            }
+        }
+
+        Arrayp edges;
+        if (!configurationModel(n, t, target, edges)) {
+            ensure(
+                simple,
+                "Cannot generate a graph with the given degree sequence");
+            edges = havelHakimi(n, target);
+            EdgeSwitcher switcher(n, t, edges);
+            int m = edges.size();
+            for (long long i = 0; i < SWITCHES_PER_EDGE * m; ++i) {
+                switcher.trySwitch(rnd.next(m), rnd.next(m));
+            }
+        }
+        if (complement) {
+            edges = complementEdges(n, edges);
+        }
+
+        if (t.connected) {
+            connectBySwitches(n, edges);
+        }
+
+        Graph graph;
+        graph.initWithEdges(n, edges);
+        return graph;
+    }
+
+    // Checks the Erdos-Gallai condition: for each k the k largest degrees
+    // sum up to at most k(k-1) + sum of min(d, k) over the other degrees.
+    static bool isGraphical(Array degrees) {
+        int n = degrees.size();
+        std::sort(degrees.begin(), degrees.end(), std::greater<int>());
+        std::vector<long long> prefix(n + 1);
+        for (int i = 0; i < n; ++i) {
+            prefix[i + 1] = prefix[i] + degrees[i];
+        }
+        if (prefix[n] % 2 != 0) {
+            return false;
+        }
+
+        // Degrees at positions [0, atLeastK) are at least k.
+        int atLeastK = n;
+        for (long long k = 1; k <= n; ++k) {
+            while (atLeastK > 0 && degrees[atLeastK - 1] < k) {
+                --atLeastK;
+            }
+            long long rest = atLeastK > k ?
+                (atLeastK - k) * k + prefix[n] - prefix[atLeastK] :
+                prefix[n] - prefix[k];
+            if (prefix[k] > k * (k - 1) + rest) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Pairs up random stubs of vertices (the configuration model) and then
+    // rewires loops and multiple edges forbidden by traits with random
+    // switches. For sparse graphs only a few edges need it, so it takes
+    // linear time. Returns false if rewiring takes too long.
+    static bool configurationModel(
+        int n, const Traits& t, const Array& degrees, Arrayp& edges)
+    {
+        Array stubs;
+        for (int v = 0; v < n; ++v) {
+            stubs.insert(stubs.end(), degrees[v], v);
+        }
+        stubs.shuffle();
+
+        int m = stubs.size() / 2;
+        edges.resize(m);
+        for (int i = 0; i < m; ++i) {
+            edges[i] = orderedEdge(stubs[2 * i], stubs[2 * i + 1]);
+        }
+        if (t.allowLoops && t.allowMulti) {
+            return true;
+        }
+
+        // Forbidden edges are found by sorting, so that adjacency lists are
+        // built only if there are any.
+        std::vector<detail::KeyIndex> keys(m);
+        for (int i = 0; i < m; ++i) {
+            keys[i] = {
+                static_cast<uint64_t>(edges[i].first) * n + edges[i].second,
+                i};
+        }
+        detail::sortByKey(
+            keys, detail::bitWidth(static_cast<uint64_t>(n) * n));
+        Array forbidden;
+        for (int i = 0, j = 0; i < m; i = j) {
+            while (j < m && keys[j].key == keys[i].key) {
+                ++j;
+            }
+            const auto& edge = edges[keys[i].index];
+            if ((edge.first == edge.second && !t.allowLoops) ||
+                    (j - i > 1 && !t.allowMulti)) {
+                for (int k = i; k < j; ++k) {
+                    forbidden.push_back(keys[k].index);
+                }
+            }
+        }
+        if (forbidden.empty()) {
+            return true;
+        }
+
+        EdgeSwitcher switcher(n, t, edges);
+
+        long long attemptsLeft = MAX_SWITCH_ATTEMPTS + 10LL * m;
+        while (!forbidden.empty()) {
+            int i = forbidden.back();
+            if (!switcher.isForbidden(i)) {
+                forbidden.pop_back();
+                continue;
+            }
+            if (--attemptsLeft < 0) {
+                return false;
+            }
+            switcher.trySwitch(i, rnd.next(m));
+        }
+        return true;
+    }
+
+    // Builds a simple graph with the given graphical degree sequence by
+    // repeatedly connecting the vertex of the largest remaining degree to
+    // the vertices of the next largest ones.
+    static Arrayp havelHakimi(int n, const Array& degrees) {
+        // (remaining degree, vertex)
+        std::set<std::pair<int, int>> byDegree;
+        for (int v = 0; v < n; ++v) {
+            if (degrees[v] > 0) {
+                byDegree.emplace(degrees[v], v);
+            }
+        }
+
+        Arrayp edges;
+        std::vector<std::pair<int, int>> neighbors;
+        while (!byDegree.empty()) {
+            auto top = *byDegree.rbegin();
+            byDegree.erase(std::prev(byDegree.end()));
+
+            neighbors.clear();
+            auto it = byDegree.end();
+            for (int i = 0; i < top.first; ++i) {
+                ENSURE(it != byDegree.begin(), "GraphRandom::havelHakimi");
+                neighbors.push_back(*--it);
+            }
+            for (const auto& neighbor: neighbors) {
+                byDegree.erase(neighbor);
+                edges.push_back(orderedEdge(top.second, neighbor.second));
+                if (neighbor.first > 1) {
+                    byDegree.emplace(neighbor.first - 1, neighbor.second);
+                }
+            }
+        }
+        return edges;
+    }
+
+    static Arrayp complementEdges(int n, const Arrayp& edges) {
+        std::vector<Array> adjacent(n);
+        for (const auto& edge: edges) {
+            adjacent[edge.first].push_back(edge.second);
+        }
+
+        Arrayp result;
+        result.reserve(static_cast<long long>(n) * (n - 1) / 2 - edges.size());
+        for (int u = 0; u < n; ++u) {
+            adjacent[u].sort();
+            auto it = adjacent[u].begin();
+            for (int v = u + 1; v < n; ++v) {
+                if (it != adjacent[u].end() && *it == v) {
+                    ++it;
+                } else {
+                    result.emplace_back(u, v);
+                }
+            }
+        }
+        return result;
+    }
+
+    // Makes the graph connected keeping degrees of all vertices. An edge
+    // (a, b) outside a spanning forest lies on a cycle, so switching it with
+    // an edge (c, d) of another component to (a, c) and (b, d) joins the
+    // components. New edges connect different components, so they are never
+    // loops or duplicates.
+    static void connectBySwitches(int n, Arrayp& edges) {
+        if (n <= 1) {
+            return;
+        }
+        ensure(
+            edges.size() + 1 >= static_cast<size_t>(n),
+            "Not enough edges for a connected graph");
+
+        Dsu dsu;
+        dsu.extend(n);
+        std::vector<char> inForest(edges.size());
+        for (size_t i = 0; i < edges.size(); ++i) {
+            inForest[i] = dsu.unite(edges[i].first, edges[i].second);
+        }
+        if (dsu.isConnected()) {
+            return;
+        }
+
+        // Edges of each component, indexed by its root.
+        std::vector<Array> cycleEdges(n);
+        std::vector<Array> forestEdges(n);
+        for (size_t i = 0; i < edges.size(); ++i) {
+            int root = dsu.getRoot(edges[i].first);
+            (inForest[i] ? forestEdges : cycleEdges)[root].push_back(i);
+        }
+
+        Array cyclic;
+        Array acyclic;
+        for (int v: Array::id(n).shuffled()) {
+            if (dsu.getRoot(v) != v) {
+                continue;
+            }
+            ensure(
+                !forestEdges[v].empty() || !cycleEdges[v].empty(),
+                "Cannot make a graph with isolated vertices connected");
+            (cycleEdges[v].empty() ? acyclic : cyclic).push_back(v);
+        }
+        ENSURE(!cyclic.empty(), "GraphRandom::connectBySwitches");
+
+        auto takeRandom = [](Array& ids) {
+            std::swap(ids[rnd.next(ids.size())], ids.back());
+            int id = ids.back();
+            ids.pop_back();
+            return id;
+        };
+        auto join = [&edges](int i, int j) {
+            int a = edges[i].first;
+            int b = edges[i].second;
+            int c = edges[j].first;
+            int d = edges[j].second;
+            if (rnd.next(2)) {
+                std::swap(c, d);
+            }
+            edges[i] = orderedEdge(a, c);
+            edges[j] = orderedEdge(b, d);
+        };
+
+        // Joining two components with cycles leaves (b, d) on a cycle, and
+        // joining a tree uses up one cycle, which is enough since there are
+        // at least n - 1 edges.
+        Array& spare = cycleEdges[cyclic[0]];
+        for (size_t k = 1; k < cyclic.size(); ++k) {
+            Array& other = cycleEdges[cyclic[k]];
+            int i = takeRandom(spare);
+            int j = takeRandom(other);
+            join(i, j);
+            spare.push_back(j);
+            spare.insert(spare.end(), other.begin(), other.end());
+        }
+        for (int root: acyclic) {
+            ENSURE(!spare.empty(), "GraphRandom::connectBySwitches");
+            join(takeRandom(spare), takeRandom(forestEdges[root]));
+        }
+    }
+
+    // The Chung-Lu model: an edge (u, v) appears with probability
+    // min(1, w_u w_v / S), where S is the sum of weights. With vertices
+    // sorted by weight the probability does not increase along a row, so
+    // the pairs are skipped with geometric jumps as in Miller and Hagberg,
+    // "Efficient generation of networks with given expected degrees", which
+    // takes O(n + m) time.
+    static Graph doRandomExpectedDegrees(Traits t, const Arrayf& weights) {
+        ensure(
+            !t.directed,
+            "Directed graphs with given degrees are not supported");
+
+        int n = t.n;
+        double sum = 0;
+        for (double w: weights) {
+            sum += w;
+        }
+        auto order = Array::id(n).sorted([&weights](int i, int j) {
+            return weights[i] > weights[j];
+        });
+
+        Arrayp edges;
+        for (int i = 0; i < n && sum > 0; ++i) {
+            double weight = weights[order[i]];
+            int j = t.allowLoops ? i : i + 1;
+            double p = j < n ?
+                std::min(weight * weights[order[j]] / sum, 1.0) : 0;
+            while (j < n && p > 0) {
+                if (p < 1) {
+                    // Uniform from (0, 1], so that the skip is finite; nextf
+                    // may return 1.
+                    double u = (rnd.next() + 1.0) / 4294967296.0;
+                    double skip = std::floor(std::log(u) / std::log(1 - p));
+                    if (skip >= n - j) {
+                        break;
+                    }
+                    j += static_cast<int>(skip);
+                }
+                double q = std::min(weight * weights[order[j]] / sum, 1.0);
+                if (rnd.nextf() < q / p) {
+                    edges.push_back(orderedEdge(order[i], order[j]));
+                }
+                p = q;
+                ++j;
+            }
+        }
+
+        if (t.connected) {
+            linkComponents(n, edges);
+        }
+
+        Graph graph;
+        graph.initWithEdges(n, edges);
+        return graph;
+    }
+
+    // Joins components of the graph into a chain, in random order, with edges
+    // between their random vertices.
+    static void linkComponents(int n, Arrayp& edges) {
+        Dsu dsu;
+        dsu.extend(n);
+        for (const auto& edge: edges) {
+            dsu.unite(edge.first, edge.second);
+        }
+
+        std::vector<char> seen(n);
+        int last = -1;
+        for (int v: Array::id(n).shuffled()) {
+            int root = dsu.getRoot(v);
+            if (!seen[root]) {
+                seen[root] = true;
+                if (last != -1) {
+                    edges.push_back(orderedEdge(last, v));
+                }
+                last = v;
+            }
+        }
+    }
+
+    static void makeAcyclic(int n, Arrayp& edges) {
+        // The numbering used to have m elements, which is kept when m >= n
+        // for the sake of reproducibility.
+        auto numbering = Array::id(std::max<int>(n, edges.size())).shuffle();
         for (auto& edge: edges) {
             if (numbering[edge.first] > numbering[edge.second]) {
                 std::swap(edge.first, edge.second);
@@ -6992,6 +11780,18 @@ Graph::BuilderProxy Graph::completeBipartite( int n1, int n2) {
     return graph_detail::GraphRandom::completeBipartite(n1, n2);
 }
 
+Graph::BuilderProxy Graph::randomRegular(int n, int d) {
+    return graph_detail::GraphRandom::randomRegular(n, d);
+}
+
+Graph::BuilderProxy Graph::fromDegreeSequence(const Array& degrees) {
+    return graph_detail::GraphRandom::fromDegreeSequence(degrees);
+}
+
+Graph::BuilderProxy Graph::randomExpectedDegrees(const Arrayf& weights) {
+    return graph_detail::GraphRandom::randomExpectedDegrees(weights);
+}
+
 } // namespace jngen
 #undef JNGEN_INCLUDE_GRAPH_INL_H
 #endif // JNGEN_DECLARE_ONLY
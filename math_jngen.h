@@ -6,10 +6,12 @@
 
 #include "array.h"
 #include "common.h"
+#include "printers.h"
 #include "random.h"
 
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <iterator>
 #include <limits>
 #include <type_traits>
@@ -40,19 +42,150 @@ inline long long multiply(long long x, long long y, long long mod) {
 #endif
 }
 
-inline int power(int x, int k, int mod) {
-    int res = 1;
-    while (k) {
-        if (k&1) {
-            res = multiply(res, x, mod);
+// Modular arithmetic with a fixed modulus n. Numbers are kept in some
+// internal form: to() converts a number to it and from() converts it back,
+// one() and multiply() work with the internal form.
+
+#if defined(__SIZEOF_INT128__)
+
+// Montgomery form modulo an odd n: x is kept as x * 2^64 mod n, and a product
+// is reduced with two multiplications instead of a 128-bit division.
+class Montgomery64 {
+public:
+    explicit Montgomery64(uint64_t n) : n_(n) {
+        // Newton's iterations, each one doubles the number of correct bits.
+        inverse_ = n;
+        for (int i = 0; i < 5; ++i) {
+            inverse_ *= 2 - n * inverse_;
         }
-        x = multiply(x, x, mod);
-        k >>= 1;
+        one_ = (0 - n) % n;
+        r2_ = static_cast<unsigned __int128>(one_) * one_ % n;
     }
-    return res;
+
+    uint64_t one() const { return one_; }
+
+    uint64_t to(uint64_t x) const { return multiply(x % n_, r2_); }
+
+    uint64_t from(uint64_t x) const { return reduce(x); }
+
+    uint64_t multiply(uint64_t x, uint64_t y) const {
+        return reduce(static_cast<unsigned __int128>(x) * y);
+    }
+
+private:
+    // Returns t * 2^-64 mod n for t < n * 2^64.
+    uint64_t reduce(unsigned __int128 t) const {
+        uint64_t m = static_cast<uint64_t>(t) * inverse_;
+        uint64_t high = t >> 64;
+        uint64_t sub = (static_cast<unsigned __int128>(m) * n_) >> 64;
+        return high >= sub ? high - sub : high - sub + n_;
+    }
+
+    uint64_t n_;
+    uint64_t inverse_;
+    uint64_t one_;
+    uint64_t r2_;
+};
+
+// Barrett reduction modulo n < 2^32: x mod n is x - q * n, where the quotient
+// q is x * floor(2^64 / n) / 2^64 with an error of at most one.
+class Barrett32 {
+public:
+    explicit Barrett32(uint64_t n) : n_(n), m_(~uint64_t(0) / n) {}
+
+    uint64_t one() const { return 1 % n_; }
+
+    uint64_t to(uint64_t x) const { return reduce(x); }
+
+    uint64_t from(uint64_t x) const { return x; }
+
+    uint64_t reduce(uint64_t x) const {
+        uint64_t q = (static_cast<unsigned __int128>(x) * m_) >> 64;
+        uint64_t r = x - q * n_;
+        return r >= n_ ? r - n_ : r;
+    }
+
+    uint64_t multiply(uint64_t x, uint64_t y) const {
+        return reduce(x * y);
+    }
+
+private:
+    uint64_t n_;
+    uint64_t m_;
+};
+
+#else
+
+// Without 128-bit integers both classes fall back to plain division.
+class Montgomery64 {
+public:
+    explicit Montgomery64(uint64_t n) : n_(n) {}
+
+    uint64_t one() const { return 1 % n_; }
+
+    uint64_t to(uint64_t x) const { return x % n_; }
+
+    uint64_t from(uint64_t x) const { return x; }
+
+    uint64_t multiply(uint64_t x, uint64_t y) const {
+        uint64_t result = 0;
+        for (; y; y >>= 1) {
+            if (y & 1) {
+                result = result >= n_ - x ? result - (n_ - x) : result + x;
+            }
+            x = x >= n_ - x ? x - (n_ - x) : x + x;
+        }
+        return result;
+    }
+
+private:
+    uint64_t n_;
+};
+
+class Barrett32 {
+public:
+    explicit Barrett32(uint64_t n) : n_(n) {}
+
+    uint64_t one() const { return 1 % n_; }
+
+    uint64_t to(uint64_t x) const { return x % n_; }
+
+    uint64_t from(uint64_t x) const { return x; }
+
+    uint64_t reduce(uint64_t x) const { return x % n_; }
+
+    uint64_t multiply(uint64_t x, uint64_t y) const { return x * y % n_; }
+
+private:
+    uint64_t n_;
+};
+
+#endif // defined(__SIZEOF_INT128__)
+
+// Returns x^k in the internal form of |arithmetic|.
+template<typename Arithmetic>
+uint64_t modularPower(const Arithmetic& arithmetic, uint64_t x, uint64_t k) {
+    uint64_t result = arithmetic.one();
+    for (; k; k >>= 1) {
+        if (k & 1) {
+            result = arithmetic.multiply(result, x);
+        }
+        x = arithmetic.multiply(x, x);
+    }
+    return result;
+}
+
+// x^k mod |mod| for 0 <= x < mod.
+inline int power(int x, int k, int mod) {
+    Barrett32 arithmetic(mod);
+    return arithmetic.from(modularPower(arithmetic, x, k));
 }
 
 inline long long power(long long x, long long k, long long mod) {
+    if (mod % 2 == 1) {
+        Montgomery64 arithmetic(mod);
+        return arithmetic.from(modularPower(arithmetic, arithmetic.to(x), k));
+    }
     long long res = 1;
     while (k) {
         if (k&1) {
@@ -64,81 +197,50 @@ inline long long power(long long x, long long k, long long mod) {
     return res;
 }
 
-template<typename I>
-bool millerRabinTest(I n, const std::vector<I>& witnesses) {
-    static_assert(
-        std::is_same<I, int>::value || std::is_same<I, long long>::value,
-        "millerRabinTest<int/long long> only is supported");
+// Deterministic Miller-Rabin test for odd n > 2.
+bool millerRabinTest(uint64_t n);
 
-    if (n == 1) {
-        return false;
-    }
+// Appends primes from [l, r] to |out| in increasing order. The range is
+// sieved in segments by primes up to some limit; if it is less than sqrt(r),
+// the remaining numbers are checked with millerRabinTest.
+void primesInRange(long long l, long long r, std::vector<long long>& out);
 
-    constexpr int LIMIT = 10000;
+// Returns a uniformly random sequence of |count| numbers from
+// [minSize, maxSize] with sum n. Such a sequence must exist.
+Array64 randomComposition(
+        long long n, int count, long long minSize, long long maxSize);
 
-    if (n <= LIMIT) {
-        for (int i = 2; i*i <= n; ++i) {
-            if (n%i == 0) {
-                return false;
-            }
-        }
-        return true;
-    }
+class RandomPrimesProxy {
+public:
+    RandomPrimesProxy(size_t count, long long l, long long r) :
+        count_(count),
+        l_(l),
+        r_(r)
+    {  }
 
-    int r = 0;
-    I d = n - 1;
-    while (d % 2 == 0) {
-        ++r;
-        d /= 2;
-    }
+    Array64 a() const;
 
-    for (I a: witnesses) {
-        I x = power(a, d, n);
-        if (x == 1 || x == n - 1) {
-            continue;
-        }
+    operator Array64() const;
 
-        bool composite = true;
-        for (int i = 0; i < r - 1; ++i) {
-            x = multiply(x, x, n);
-            if (x == 1) {
-                return false;
-            }
-            if (x == n - 1) {
-                i = r;
-                composite = false;
-                continue;
-            }
-        }
-        if (composite) {
-            return false;
-        }
+    RandomPrimesProxy& distinct(bool value = true) {
+        distinct_ = value;
+        return *this;
     }
-    return true;
-}
+
+private:
+    size_t count_;
+    long long l_;
+    long long r_;
+    bool distinct_ = false;
+};
 
 } // namespace detail
 
-inline bool isPrime(long long n) {
-    const static std::vector<int> INT_WITNESSES{2, 7, 61};
-    const static std::vector<long long> LONG_LONG_WITNESSES
-        {2, 3, 5, 7, 11, 13, 17, 19, 23};
-    // todo: experiment with base
-    // 2, 325, 9375, 28178, 450775, 9780504, and 1795265022
-    // (guaranteed for all integers < 2^64)
-
-    // first strong pseudoprime to i64 bases is 3825123056546413051 ~= 3.8e18
-    ensure(n > 0, "isPrime() is undefined for negative numbers");
-    ensure(
-        n <= static_cast<long long>(3.8e18),
-        "isPrime() supports only numbers not greater than 3.8 * 10^18");
-
-    if (n < std::numeric_limits<int>::max()) {
-        return detail::millerRabinTest<int>(n, INT_WITNESSES);
-    } else {
-        return detail::millerRabinTest<long long>(n, LONG_LONG_WITNESSES);
-    }
-}
+bool isPrime(long long n);
+
+// Returns prime factors of n in increasing order, each one is repeated as
+// many times as it divides n.
+Array64 factorize(long long n);
 
 class MathRandom {
 public:
@@ -174,21 +276,41 @@ public:
         );
     }
 
-    static long long nextPrime(long long n) {
-        while (!isPrime(n)) {
-            ++n;
-        }
-        return n;
+    static long long nextPrime(long long n);
+
+    static long long previousPrime(long long n);
+
+    static Array64 primes(long long l, long long r) {
+        ensure(l <= r);
+        Array64 result;
+        detail::primesInRange(l, r, result);
+        return result;
     }
 
-    static long long previousPrime(long long n) {
-        ensure(n >= 2, format("There are no primes less or equal to %lld", n));
-        while (!isPrime(n)) {
-            --n;
-        }
-        return n;
+    static detail::RandomPrimesProxy randomPrimes(
+            size_t count, long long n)
+    {
+        ensure(n > 2, format("There are no primes below %lld", n));
+        return randomPrimes(count, 2, n - 1);
+    }
+
+    static detail::RandomPrimesProxy randomPrimes(
+            size_t count, long long l, long long r)
+    {
+        ensure(l <= r);
+        return detail::RandomPrimesProxy(count, l, r);
+    }
+
+    static long long highlyComposite(long long upTo);
+
+    static long long primeProduct(int k, long long l, long long r);
+
+    static long long semiprime(long long l, long long r) {
+        return primeProduct(2, l, r);
     }
 
+    static long long smooth(long long n, long long bound);
+
     static Array partition(
             int n,
             int numParts,
@@ -219,49 +341,7 @@ public:
         ensure(numParts * maxSize >= n, "maxSize is too small");
         ensure(minSize <= maxSize);
 
-        n -= minSize * numParts;
-
-        auto delimiters = Array64::random(
-                numParts - 1, 0, n).sorted();
-        delimiters.insert(delimiters.begin(), 0);
-        delimiters.push_back(n);
-
-        Array64 partition(numParts);
-        for (long long i = 0; i < numParts; ++i) {
-            partition[i] = delimiters[i + 1] - delimiters[i];
-        }
-        partition.sort().reverse();
-
-        long long remaining = 0;
-
-        long long localMax = maxSize - minSize;
-        for (auto& x: partition) {
-            if (x > localMax) {
-                remaining += x - localMax;
-                x = localMax;
-            }
-
-            x += minSize;
-        }
-
-        // Here we try to distribute the remaining part in some even manner
-        // between remaining slots. Looks like crap anyway, need a smarter way.
-
-        for (int divisor: { 2, 1 }) {
-            partition.shuffle();
-            for (auto& x: partition) {
-                if (x < maxSize) {
-                    long long add = std::min(
-                            remaining, (maxSize - x) / divisor);
-                    x += add;
-                    remaining -= add;
-                }
-            }
-        }
-
-        ensure(remaining == 0, "maxSize is too small");
-
-        return partition;
+        return detail::randomComposition(n, numParts, minSize, maxSize);
     }
 
     template<typename T>
@@ -299,8 +379,19 @@ public:
 
 JNGEN_EXTERN MathRandom rndm;
 
+JNGEN_DECLARE_SIMPLE_PRINTER(detail::RandomPrimesProxy, 2) {
+    JNGEN_PRINT(t.a());
+}
+
 } // namespace jngen
 
+#ifndef JNGEN_DECLARE_ONLY
+#define JNGEN_INCLUDE_MATH_JNGEN_INL_H
+#include "impl/math_jngen_inl.h"
+#undef JNGEN_INCLUDE_MATH_JNGEN_INL_H
+#endif // JNGEN_DECLARE_ONLY
+
 using jngen::isPrime;
+using jngen::factorize;
 
 using jngen::rndm;
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "common.h"
+#include "config.h"
+#include "random.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace jngen {
+namespace detail {
+
+// Calls f(i) for all i in [0, count) using up to config.threads threads
+// (including the calling one). The first exception thrown by f is rethrown
+// once all threads are finished; the remaining indices are skipped.
+template<typename F>
+void parallelFor(size_t count, F f) {
+    size_t threads = std::min<size_t>(std::max(config.threads, 1), count);
+    if (threads <= 1) {
+        for (size_t i = 0; i < count; ++i) {
+            f(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> nextIndex(0);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+
+    auto worker = [&]() {
+        while (true) {
+            size_t i = nextIndex++;
+            if (i >= count) {
+                return;
+            }
+            try {
+                f(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) {
+                    error = std::current_exception();
+                }
+                nextIndex = count;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads; ++i) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread: pool) {
+        thread.join();
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+// Parallel generators split their output into chunks of this size, each
+// filled from its own stream. The output thus depends on the seed only, not
+// on the number of threads.
+constexpr size_t PARALLEL_CHUNK_SIZE = 1 << 16;
+
+// Calls f(random, begin, count) for consecutive chunks of [0, size), where
+// |random| is a stream obtained with rnd.split.
+template<typename F>
+void generateInChunks(size_t size, F f) {
+    size_t chunks = (size + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+    auto streams = rnd.split(chunks);
+    parallelFor(chunks, [&](size_t chunk) {
+        size_t begin = chunk * PARALLEL_CHUNK_SIZE;
+        f(streams[chunk], begin,
+            std::min(PARALLEL_CHUNK_SIZE, size - begin));
+    });
+}
+
+// Calls f(begin, end) for consecutive chunks [begin, end) of [0, size) using
+// up to config.threads threads.
+template<typename F>
+void parallelForChunks(size_t size, F f) {
+    size_t chunks = (size + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+    parallelFor(chunks, [&](size_t chunk) {
+        size_t begin = chunk * PARALLEL_CHUNK_SIZE;
+        f(begin, std::min(size, begin + PARALLEL_CHUNK_SIZE));
+    });
+}
+
+} // namespace detail
+} // namespace jngen
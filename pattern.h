@@ -5,8 +5,12 @@
 #include <algorithm>
 #include <cctype>
 #include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -14,31 +18,141 @@
 
 namespace jngen {
 
+namespace detail {
+
+// Syntax tree of a pattern as built by Parser.
+struct PatternTree {
+    PatternTree() : isOrPattern(false), min(1), max(1) {}
+    PatternTree(PatternTree p, std::pair<int, int> quantity);
+    PatternTree(std::vector<char> chars, std::pair<int, int> quantity);
+
+    std::vector<char> chars;
+    std::vector<PatternTree> children;
+    bool isOrPattern;
+    int min;
+    int max;
+};
+
+class PatternCache;
+
+} // namespace detail
+
+// A pattern compiled to a flat program: an array of nodes where children of
+// each node occupy a contiguous range, and a table with the characters of
+// all character sets. Generation does not allocate memory except for the
+// output.
+//
+// The program is immutable and shared between copies of a Pattern, so
+// copying is cheap and one Pattern may be used from many threads at once
+// (each of them with its own Random).
 class Pattern {
-    friend class Parser;
+    friend class detail::PatternCache;
 public:
-    Pattern() : isOrPattern(false), min(1), max(1) {}
+    Pattern();
+
+    // Same as Pattern::compile(s).
     Pattern(const std::string& s);
 
+    // Returns the pattern from a process-wide cache of recently used
+    // patterns, parsing it on a miss. Thread-safe.
+    static Pattern compile(const std::string& s);
+
     std::string next(std::function<int(int)>&& rnd) const;
 
+    // Appends a random string matching the pattern to |out|. |rnd(n)| must
+    // return a random integer from [0, n).
+    template<typename Rnd>
+    void next(Rnd&& rnd, std::string& out) const {
+        run(0, rnd, out);
+    }
+
 private:
-    Pattern(Pattern p, std::pair<int, int> quantity);
+    enum class NodeKind { Chars, Sequence, Or };
+
+    // Chars: characters table[begin..end), repeated from min to max times.
+    // Sequence: nodes[begin..end) one after another, repeated the same way.
+    // Or: one of nodes[begin..end).
+    struct Node {
+        NodeKind kind;
+        int min;
+        int max;
+        int begin;
+        int end;
+    };
+
+    struct Program {
+        std::vector<Node> nodes;
+        std::string table;
+    };
+
+    explicit Pattern(const detail::PatternTree& tree);
+
+    template<typename Rnd>
+    void run(int index, Rnd& rnd, std::string& out) const;
+
+    std::shared_ptr<const Program> program_;
+};
 
-    Pattern(std::vector<char> chars, std::pair<int, int> quantity);
+namespace detail {
 
-    std::vector<char> chars;
-    std::vector<Pattern> children;
-    bool isOrPattern;
-    int min;
-    int max;
+// Least recently used patterns, at most CAPACITY of them.
+class PatternCache {
+public:
+    static PatternCache& instance();
+
+    Pattern get(const std::string& s);
+
+private:
+    static const size_t CAPACITY = 1024;
+
+    typedef std::list<std::pair<std::string, Pattern>> Entries;
 
-    static std::map<std::string, Pattern> cachedPatterns_;
+    std::mutex mutex_;
+    // Most recently used first.
+    Entries entries_;
+    std::unordered_map<std::string, Entries::iterator> index_;
 };
 
+} // namespace detail
+
+template<typename Rnd>
+void Pattern::run(int index, Rnd& rnd, std::string& out) const {
+    // Random calls are made in the same order as they used to be made by the
+    // recursive generator, so outputs do not change.
+    const Node& node = program_->nodes[index];
+    if (node.kind == NodeKind::Or) {
+        ENSURE(node.begin != node.end);
+        run(node.begin + rnd(node.end - node.begin), rnd, out);
+        return;
+    }
+
+    ENSURE(node.begin != node.end);
+
+    int count;
+    if (node.min == node.max) {
+        count = node.min;
+    } else {
+        count = node.min + rnd(node.max - node.min + 1);
+    }
+
+    if (node.kind == NodeKind::Chars) {
+        const char* chars = program_->table.data() + node.begin;
+        int size = node.end - node.begin;
+        for (int i = 0; i < count; ++i) {
+            out += chars[rnd(size)];
+        }
+    } else {
+        for (int i = 0; i < count; ++i) {
+            for (int child = node.begin; child != node.end; ++child) {
+                run(child, rnd, out);
+            }
+        }
+    }
+}
+
 class Parser {
 public:
-    Pattern parse(const std::string& s) {
+    detail::PatternTree parse(const std::string& s) {
         this->s = s;
         pos = 0;
         return parsePattern();
@@ -64,7 +178,7 @@ private:
 
     std::vector<char> parseBlock();
 
-    Pattern parsePattern();
+    detail::PatternTree parsePattern();
 
     std::string s;
     size_t pos;
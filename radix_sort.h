@@ -0,0 +1,32 @@
+#pragma once
+
+#include "common.h"
+#include "parallel.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace jngen {
+namespace detail {
+
+struct KeyIndex {
+    uint64_t key;
+    int index;
+};
+
+// Sorts |items| by key, keeping the order of items with equal keys, given
+// that all keys are less than 2^bits. Uses up to config.threads threads; the
+// result, being the only stable order, does not depend on their number.
+void sortByKey(std::vector<KeyIndex>& items, int bits);
+
+// Returns the number of bits needed to store values from [0, n).
+int bitWidth(uint64_t n);
+
+} // namespace detail
+} // namespace jngen
+
+#ifndef JNGEN_DECLARE_ONLY
+#define JNGEN_INCLUDE_RADIX_SORT_INL_H
+#include "impl/radix_sort_inl.h"
+#undef JNGEN_INCLUDE_RADIX_SORT_INL_H
+#endif // JNGEN_DECLARE_ONLY
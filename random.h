@@ -1,7 +1,10 @@
 #pragma once
 
 #include "common.h"
+#include "config.h"
 #include "pattern.h"
+#include "random_engine.h"
+#include "random_simd.h"
 
 #include <algorithm>
 #include <cmath>
@@ -35,23 +38,155 @@ struct TypedRandom;
 
 uint64_t maskForBound(uint64_t bound);
 
-template<typename Result, typename Source>
-Result uniformRandom(Result bound, Random& random, Source (Random::*method)()) {
-    static_assert(sizeof(Result) <= sizeof(Source),
-        "uniformRandom: Source type must be at least as large as Result type");
-#ifdef JNGEN_FAST_RANDOM
-    return (random.*method)() % bound;
-#else
-    Source mask = maskForBound(bound);
+namespace detail {
+
+// Bounded sampling kernels. Each of them consumes engine words one by one and
+// yields exactly the values that successive single draws would yield, so bulk
+// and per-call generation stay interchangeable.
+//
+// Mt19937 keeps the historical mask-and-reject scheme to keep old generators
+// reproducible. Other engines use Lemire's multiply-shift rejection: the
+// answer is the upper half of word * bound, and the word is rejected only if
+// the lower half is below 2^32 mod bound. 64-bit bounds are handled the same
+// way with a 64x64->128 multiplication.
+
+template<typename Engine>
+uint32_t uniformMasked32(Engine& engine, uint32_t bound, uint32_t mask) {
     while (true) {
-        Source outcome = (random.*method)() & mask;
-        if (outcome < static_cast<Source>(bound)) {
+        uint32_t outcome = engine.next32() & mask;
+        if (outcome < bound) {
             return outcome;
         }
     }
-#endif
 }
 
+template<typename Engine>
+uint64_t uniformMasked64(Engine& engine, uint64_t bound, uint64_t mask) {
+    while (true) {
+        uint64_t outcome = engine.next64() & mask;
+        if (outcome < bound) {
+            return outcome;
+        }
+    }
+}
+
+// |threshold| must be equal to (2^32 - bound) % bound.
+template<typename Engine>
+uint32_t uniformLemire32(Engine& engine, uint32_t bound, uint32_t threshold) {
+    while (true) {
+        uint64_t product = static_cast<uint64_t>(engine.next32()) * bound;
+        if (static_cast<uint32_t>(product) >= threshold) {
+            return product >> 32;
+        }
+    }
+}
+
+template<typename Engine>
+uint32_t uniformLemire32(Engine& engine, uint32_t bound) {
+    uint64_t product = static_cast<uint64_t>(engine.next32()) * bound;
+    if (static_cast<uint32_t>(product) < bound) {
+        uint32_t threshold = -bound % bound;
+        while (static_cast<uint32_t>(product) < threshold) {
+            product = static_cast<uint64_t>(engine.next32()) * bound;
+        }
+    }
+    return product >> 32;
+}
+
+template<typename Engine>
+uint64_t uniformLemire64(Engine& engine, uint64_t bound) {
+    uint64_t hi;
+    uint64_t lo = mul128(engine.next64(), bound, hi);
+    if (lo < bound) {
+        uint64_t threshold = -bound % bound;
+        while (lo < threshold) {
+            lo = mul128(engine.next64(), bound, hi);
+        }
+    }
+    return hi;
+}
+
+// Draws words from the engine in blocks and reduces them with |reduce|
+// (see random_simd.h), drawing more words for the rejected ones. Exactly the
+// same words are consumed as by a sequence of single draws.
+template<typename T, typename Engine, typename Reduce>
+void fillReduced32(
+        Engine& engine, T* out, size_t count, uint32_t base, Reduce reduce)
+{
+    const size_t BLOCK = 1024;
+    uint32_t buffer[BLOCK];
+    while (count > 0) {
+        size_t size = std::min(count, BLOCK);
+        for (size_t i = 0; i < size; ++i) {
+            buffer[i] = engine.next32();
+        }
+        size = reduce(buffer, size, buffer);
+        for (size_t i = 0; i < size; ++i) {
+            out[i] = static_cast<T>(base + buffer[i]);
+        }
+        out += size;
+        count -= size;
+    }
+}
+
+template<typename T, typename Engine>
+void fillMasked32(
+        Engine& engine, T* out, size_t count, uint32_t bound, uint32_t base)
+{
+    uint32_t mask = maskForBound(bound);
+    fillReduced32(engine, out, count, base,
+        [bound, mask](const uint32_t* in, size_t n, uint32_t* res) {
+            return reduceMasked32(in, n, bound, mask, res);
+        });
+}
+
+template<typename T, typename Engine>
+void fillMasked64(
+        Engine& engine, T* out, size_t count, uint64_t bound, uint64_t base)
+{
+    uint64_t mask = maskForBound(bound);
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = static_cast<T>(base + uniformMasked64(engine, bound, mask));
+    }
+}
+
+template<typename T, typename Engine>
+void fillLemire64(
+        Engine& engine, T* out, size_t count, uint64_t bound, uint64_t base)
+{
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = static_cast<T>(base + uniformLemire64(engine, bound));
+    }
+}
+
+template<typename T, typename Engine>
+void fillLemire32(
+        Engine& engine, T* out, size_t count, uint32_t bound, uint32_t base)
+{
+    uint32_t threshold = -bound % bound;
+    fillReduced32(engine, out, count, base,
+        [bound, threshold](const uint32_t* in, size_t n, uint32_t* res) {
+            return reduceLemire32(in, n, bound, threshold, res);
+        });
+}
+
+// Bound 0 stands for the full range of the word.
+template<typename T, typename Engine>
+void fillRaw32(Engine& engine, T* out, size_t count, uint32_t base) {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = static_cast<T>(base + engine.next32());
+    }
+}
+
+template<typename T, typename Engine>
+void fillRaw64(Engine& engine, T* out, size_t count, uint64_t base) {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = static_cast<T>(base + engine.next64());
+    }
+}
+
+} // namespace detail
+
 class Random {
 public:
     Random() {
@@ -70,6 +205,19 @@ public:
     void seed(uint32_t val);
     void seed(const std::vector<uint32_t>& seed);
 
+    // Switching the engine reseeds it with the last seed passed to this
+    // object, so setEngine and seed/registerGen may be called in any order.
+    void setEngine(RandomEngine engine);
+    RandomEngine engine() const { return engine_; }
+
+    // Independent Philox generators for parallel work. stream(i) depends only
+    // on the last seed of this object and on i, so a fixed seed gives the
+    // same streams regardless of what was generated before. split(k) takes
+    // one 64-bit value from this generator and derives k streams from it;
+    // successive split calls yield different streams.
+    Random stream(uint64_t index) const;
+    std::vector<Random> split(size_t count);
+
     uint32_t next();
     uint64_t next64();
     double nextf();
@@ -96,6 +244,11 @@ public:
 
     std::string next(const std::string& pattern);
 
+    // A pattern may be parsed once and reused, appending to a buffer which
+    // keeps its capacity between calls.
+    std::string next(const Pattern& pattern);
+    void next(const Pattern& pattern, std::string& out);
+
     template<typename ... Args>
     std::string next(const std::string& pattern, Args... args) {
         return next(format(pattern, args...));
@@ -154,6 +307,22 @@ public:
         return nextByDistribution(std::vector<Numeric>(ilist));
     }
 
+    // Bulk generation: fill(out, count, args...) writes to out[0..count) the
+    // same values as |count| successive next(args...) calls would return.
+    void fill(int* out, size_t count, int n);
+    void fill(long long* out, size_t count, long long n);
+    void fill(size_t* out, size_t count, size_t n);
+    void fill(double* out, size_t count, double n);
+
+    void fill(int* out, size_t count, int l, int r);
+    void fill(long long* out, size_t count, long long l, long long r);
+    void fill(size_t* out, size_t count, size_t l, size_t r);
+    void fill(double* out, size_t count, double l, double r);
+
+    // Raw words: the same as |count| successive next() or next64() calls.
+    void fill(uint32_t* out, size_t count);
+    void fill(uint64_t* out, size_t count);
+
 private:
     template<typename T, typename ...Args>
     T smallWnext(int w, Args... args) {
@@ -170,6 +339,14 @@ private:
         return result;
     }
 
+    // Closed-form wnext for config.fastWnext: an offset in [0, n), n > 0.
+    // Returns false if |w| > WNEXT_LIMIT and n^(|w|+1) does not fit into 128
+    // bits, then the default formula is used.
+    bool fastWnext(uint64_t n, int w, uint64_t& result);
+    // Maximum of k values from [0, n); n^k must fit into 128 bits (64 if
+    // 128-bit integers are not supported).
+    uint64_t maxOfUniform(uint64_t n, int k);
+
     double realWnext(int w) {
         if (w == 0) {
             return nextf();
@@ -180,7 +357,124 @@ private:
         }
     }
 
-    std::mt19937 randomEngine_;
+    struct Unseeded {};
+
+    // Leaves engines in their default states, to be seeded by the caller.
+    explicit Random(Unseeded) {}
+
+    void reseed();
+
+    // Key of the Philox streams derived from the current seed.
+    uint64_t streamKey() const;
+    static Random makeStream(
+            uint64_t key, uint64_t index, std::vector<uint32_t> seed);
+
+    uint32_t uniform32(uint32_t bound);
+    uint64_t uniform64(uint64_t bound);
+
+    template<typename T, typename Engine>
+    void fillUniform32(
+            Engine& engine, T* out, size_t count, uint32_t bound, uint32_t base,
+            bool legacy)
+    {
+        if (bound == 0) {
+            detail::fillRaw32(engine, out, count, base);
+            return;
+        }
+#ifdef JNGEN_FAST_RANDOM
+        (void)legacy;
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = static_cast<T>(base + engine.next32() % bound);
+        }
+#else
+        if (legacy) {
+            detail::fillMasked32(engine, out, count, bound, base);
+        } else {
+            detail::fillLemire32(engine, out, count, bound, base);
+        }
+#endif
+    }
+
+    template<typename T, typename Engine>
+    void fillUniform64(
+            Engine& engine, T* out, size_t count, uint64_t bound, uint64_t base,
+            bool legacy)
+    {
+        if (bound == 0) {
+            detail::fillRaw64(engine, out, count, base);
+            return;
+        }
+#ifdef JNGEN_FAST_RANDOM
+        (void)legacy;
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = static_cast<T>(base + engine.next64() % bound);
+        }
+#else
+        if (legacy) {
+            detail::fillMasked64(engine, out, count, bound, base);
+        } else {
+            detail::fillLemire64(engine, out, count, bound, base);
+        }
+#endif
+    }
+
+    template<typename T>
+    void fillUniform32(T* out, size_t count, uint32_t bound, uint32_t base) {
+        switch (engine_) {
+        case RandomEngine::Xoshiro256:
+            fillUniform32(xoshiro256_, out, count, bound, base, false); break;
+        case RandomEngine::Pcg64:
+            fillUniform32(pcg64_, out, count, bound, base, false); break;
+        case RandomEngine::Wyrand:
+            fillUniform32(wyrand_, out, count, bound, base, false); break;
+        case RandomEngine::Philox:
+            fillUniform32(philox_, out, count, bound, base, false); break;
+        case RandomEngine::Mt19937_64:
+            fillUniform32(mt19937_64_, out, count, bound, base, false); break;
+        default:
+            fillUniform32(mt19937_, out, count, bound, base, true); break;
+        }
+    }
+
+    template<typename T>
+    void fillUniform64(T* out, size_t count, uint64_t bound, uint64_t base) {
+        switch (engine_) {
+        case RandomEngine::Xoshiro256:
+            fillUniform64(xoshiro256_, out, count, bound, base, false); break;
+        case RandomEngine::Pcg64:
+            fillUniform64(pcg64_, out, count, bound, base, false); break;
+        case RandomEngine::Wyrand:
+            fillUniform64(wyrand_, out, count, bound, base, false); break;
+        case RandomEngine::Philox:
+            fillUniform64(philox_, out, count, bound, base, false); break;
+        case RandomEngine::Mt19937_64:
+            fillUniform64(mt19937_64_, out, count, bound, base, false); break;
+        default:
+            fillUniform64(mt19937_, out, count, bound, base, true); break;
+        }
+    }
+
+    template<typename Engine>
+    void fillReal(
+            Engine& engine, double* out, size_t count, double l, double d)
+    {
+        const double MAX = std::numeric_limits<uint32_t>::max();
+        for (size_t i = 0; i < count; ++i) {
+            out[i] = l + engine.next32() / MAX * d;
+        }
+    }
+
+    RandomEngine engine_ = RandomEngine::JNGEN_RANDOM_ENGINE;
+    detail::Mt19937Engine mt19937_;
+    detail::Xoshiro256Engine xoshiro256_;
+    detail::Pcg64Engine pcg64_;
+    detail::WyrandEngine wyrand_;
+    detail::PhiloxEngine philox_;
+    detail::Mt19937_64Engine mt19937_64_;
+
+    std::vector<uint32_t> seed_;
+    bool scalarSeed_ = false;
+
     constexpr static int WNEXT_LIMIT = 8;
 };
 
@@ -191,6 +485,10 @@ struct TypedRandom<int> : public BaseTypedRandom {
     using BaseTypedRandom::BaseTypedRandom;
     int next(int n) { return random.next(n); }
     int next(int l, int r) { return random.next(l, r); }
+    void fill(int* out, size_t count, int n) { random.fill(out, count, n); }
+    void fill(int* out, size_t count, int l, int r) {
+        random.fill(out, count, l, r);
+    }
 };
 
 template<>
@@ -198,6 +496,10 @@ struct TypedRandom<double> : public BaseTypedRandom {
     using BaseTypedRandom::BaseTypedRandom;
     double next(double n) { return random.next(n); }
     double next(double l, double r) { return random.next(l, r); }
+    void fill(double* out, size_t count, double n) { random.fill(out, count, n); }
+    void fill(double* out, size_t count, double l, double r) {
+        random.fill(out, count, l, r);
+    }
 };
 
 template<>
@@ -212,6 +514,10 @@ struct TypedRandom<long long> : public BaseTypedRandom {
     using BaseTypedRandom::BaseTypedRandom;
     long long next(long long n) { return random.next(n); }
     long long next(long long l, long long r) { return random.next(l, r); }
+    void fill(long long* out, size_t count, long long n) { random.fill(out, count, n); }
+    void fill(long long* out, size_t count, long long l, long long r) {
+        random.fill(out, count, l, r);
+    }
 };
 
 template<>
@@ -219,6 +525,10 @@ struct TypedRandom<size_t> : public BaseTypedRandom {
     using BaseTypedRandom::BaseTypedRandom;
     size_t next(size_t n) { return random.next(n); }
     size_t next(size_t l, size_t r) { return random.next(l, r); }
+    void fill(size_t* out, size_t count, size_t n) { random.fill(out, count, n); }
+    void fill(size_t* out, size_t count, size_t l, size_t r) {
+        random.fill(out, count, l, r);
+    }
 };
 
 template<>
@@ -261,10 +571,10 @@ struct TypedRandom<std::pair<int, int>> : public BaseTypedRandom {
     }
 
     std::pair<int, int> next(int n, RandomPairTraits traits) {
-        int first = rnd.next(n);
+        int first = random.next(n);
         int second;
         do {
-            second = rnd.next(n);
+            second = random.next(n);
         } while (traits.distinct && first == second);
         if (traits.ordered && first > second) {
             std::swap(first, second);
@@ -0,0 +1,304 @@
+#pragma once
+
+#include "common.h"
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Engine selected for newly created Random objects, including the global
+// 'rnd'. Can be overridden with e.g. -DJNGEN_RANDOM_ENGINE=Xoshiro256.
+#ifndef JNGEN_RANDOM_ENGINE
+#define JNGEN_RANDOM_ENGINE Mt19937
+#endif
+
+namespace jngen {
+
+enum class RandomEngine {
+    Mt19937,
+    Xoshiro256,
+    Pcg64,
+    Wyrand,
+    Philox,
+    Mt19937_64
+};
+
+namespace detail {
+
+// Returns the lower 64 bits of a*b and stores the upper ones to |hi|.
+inline uint64_t mul128(uint64_t a, uint64_t b, uint64_t& hi) {
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 res = static_cast<unsigned __int128>(a) * b;
+    hi = static_cast<uint64_t>(res >> 64);
+    return static_cast<uint64_t>(res);
+#else
+    uint64_t aLo = a & 0xffffffffu, aHi = a >> 32;
+    uint64_t bLo = b & 0xffffffffu, bHi = b >> 32;
+    uint64_t ll = aLo * bLo;
+    uint64_t lh = aLo * bHi;
+    uint64_t hl = aHi * bLo;
+    uint64_t hh = aHi * bHi;
+    uint64_t mid = (ll >> 32) + (lh & 0xffffffffu) + (hl & 0xffffffffu);
+    hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+    return (mid << 32) | (ll & 0xffffffffu);
+#endif
+}
+
+inline uint64_t rotl64(uint64_t x, int k) {
+    return (x << k) | (x >> ((64 - k) & 63));
+}
+
+inline uint64_t rotr64(uint64_t x, int k) {
+    return (x >> k) | (x << ((64 - k) & 63));
+}
+
+inline uint64_t splitmix64(uint64_t& x) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// Draws |count| 64-bit words from the seed sequence.
+inline std::vector<uint64_t> generateSeedWords(
+        std::seed_seq& seq, size_t count)
+{
+    std::vector<uint32_t> words(count * 2);
+    seq.generate(words.begin(), words.end());
+    std::vector<uint64_t> result(count);
+    for (size_t i = 0; i < count; ++i) {
+        result[i] = (static_cast<uint64_t>(words[2*i]) << 32) | words[2*i + 1];
+    }
+    return result;
+}
+
+// All engines share the same interface: seeding with a single value or
+// with a seed sequence, and producing 32- and 64-bit words. 64-bit engines
+// yield the upper half of a 64-bit word on next32().
+
+class Mt19937Engine {
+public:
+    void seed(uint32_t val) { engine_.seed(val); }
+    void seed(std::seed_seq& seq) { engine_.seed(seq); }
+
+    uint32_t next32() { return engine_(); }
+
+    uint64_t next64() {
+        uint64_t a = next32();
+        uint64_t b = next32();
+        return (a << 32) ^ b;
+    }
+
+private:
+    std::mt19937 engine_;
+};
+
+// std::mt19937_64: the 64-bit Mersenne Twister, one call per 64-bit word.
+class Mt19937_64Engine {
+public:
+    void seed(uint32_t val) { engine_.seed(val); }
+    void seed(std::seed_seq& seq) { engine_.seed(seq); }
+
+    uint32_t next32() { return next64() >> 32; }
+    uint64_t next64() { return engine_(); }
+
+private:
+    std::mt19937_64 engine_;
+};
+
+// xoshiro256** by D. Blackman and S. Vigna.
+class Xoshiro256Engine {
+public:
+    void seed(uint32_t val) {
+        uint64_t x = val;
+        for (auto& s: s_) {
+            s = splitmix64(x);
+        }
+    }
+
+    void seed(std::seed_seq& seq) {
+        auto words = generateSeedWords(seq, 4);
+        for (size_t i = 0; i < 4; ++i) {
+            s_[i] = words[i];
+        }
+        if (!(s_[0] | s_[1] | s_[2] | s_[3])) {
+            // all-zero state is a fixed point
+            seed(0);
+        }
+    }
+
+    uint32_t next32() { return next64() >> 32; }
+
+    uint64_t next64() {
+        uint64_t result = rotl64(s_[1] * 5, 7) * 9;
+        uint64_t t = s_[1] << 17;
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = rotl64(s_[3], 45);
+        return result;
+    }
+
+private:
+    uint64_t s_[4] = {0, 0, 0, 0};
+};
+
+// PCG64 (XSL RR 128/64) by M. O'Neill.
+class Pcg64Engine {
+public:
+    void seed(uint32_t val) {
+        uint64_t x = val;
+        uint64_t stateHi = splitmix64(x);
+        uint64_t stateLo = splitmix64(x);
+        seed(stateHi, stateLo, 0x5851f42d4c957f2dull, 0x14057b7ef767814full);
+    }
+
+    void seed(std::seed_seq& seq) {
+        auto words = generateSeedWords(seq, 4);
+        seed(words[0], words[1], words[2], words[3]);
+    }
+
+    // Same as pcg64_srandom_r from the reference implementation.
+    void seed(
+            uint64_t stateHi, uint64_t stateLo,
+            uint64_t seqHi, uint64_t seqLo)
+    {
+        hi_ = lo_ = 0;
+        incHi_ = (seqHi << 1) | (seqLo >> 63);
+        incLo_ = (seqLo << 1) | 1;
+        step();
+        uint64_t lo = lo_ + stateLo;
+        hi_ += stateHi + (lo < lo_);
+        lo_ = lo;
+        step();
+    }
+
+    uint32_t next32() { return next64() >> 32; }
+
+    uint64_t next64() {
+        step();
+        return rotr64(hi_ ^ lo_, static_cast<int>(hi_ >> 58));
+    }
+
+private:
+    void step() {
+        const uint64_t MUL_HI = 2549297995355413924ull;
+        const uint64_t MUL_LO = 4865540595714422341ull;
+
+        uint64_t hi;
+        uint64_t lo = mul128(lo_, MUL_LO, hi);
+        hi += hi_ * MUL_LO + lo_ * MUL_HI;
+
+        lo_ = lo + incLo_;
+        hi_ = hi + incHi_ + (lo_ < lo);
+    }
+
+    uint64_t hi_ = 0;
+    uint64_t lo_ = 0;
+    uint64_t incHi_ = 0;
+    uint64_t incLo_ = 0;
+};
+
+// wyrand by Wang Yi.
+class WyrandEngine {
+public:
+    void seed(uint32_t val) { state_ = val; }
+
+    void seed(std::seed_seq& seq) {
+        state_ = generateSeedWords(seq, 1)[0];
+    }
+
+    uint32_t next32() { return next64() >> 32; }
+
+    uint64_t next64() {
+        state_ += 0xa0761d6478bd642full;
+        uint64_t hi;
+        uint64_t lo = mul128(state_, state_ ^ 0xe7037ed1a0b428dbull, hi);
+        return hi ^ lo;
+    }
+
+private:
+    uint64_t state_ = 0;
+};
+
+// Philox4x32-10 by J. Salmon et al. A counter-based generator: the output is
+// a bijection of the 128-bit counter under the 64-bit key, so any position
+// of the sequence is reachable in O(1). The upper half of the counter selects
+// a stream and the lower one is the position within the stream.
+class PhiloxEngine {
+public:
+    void seed(uint32_t val) {
+        uint64_t x = val;
+        seed(splitmix64(x), 0);
+    }
+
+    void seed(std::seed_seq& seq) {
+        seed(generateSeedWords(seq, 1)[0], 0);
+    }
+
+    void seed(uint64_t key, uint64_t stream) {
+        key_[0] = static_cast<uint32_t>(key);
+        key_[1] = static_cast<uint32_t>(key >> 32);
+        stream_ = stream;
+        position_ = 0;
+        bufferPos_ = 4;
+    }
+
+    uint32_t next32() {
+        if (bufferPos_ == 4) {
+            generateBlock();
+            bufferPos_ = 0;
+        }
+        return buffer_[bufferPos_++];
+    }
+
+    uint64_t next64() {
+        uint64_t a = next32();
+        uint64_t b = next32();
+        return (a << 32) ^ b;
+    }
+
+    // Encrypts |counter| in place with |key|.
+    static void block(uint32_t counter[4], const uint32_t key[2]) {
+        const uint64_t M0 = 0xd2511f53;
+        const uint64_t M1 = 0xcd9e8d57;
+        uint32_t k0 = key[0];
+        uint32_t k1 = key[1];
+        for (int round = 0; round < 10; ++round) {
+            uint64_t p0 = M0 * counter[0];
+            uint64_t p1 = M1 * counter[2];
+            uint32_t c0 = static_cast<uint32_t>(p1 >> 32) ^ counter[1] ^ k0;
+            uint32_t c2 = static_cast<uint32_t>(p0 >> 32) ^ counter[3] ^ k1;
+            counter[0] = c0;
+            counter[1] = static_cast<uint32_t>(p1);
+            counter[2] = c2;
+            counter[3] = static_cast<uint32_t>(p0);
+            k0 += 0x9e3779b9;
+            k1 += 0xbb67ae85;
+        }
+    }
+
+private:
+    void generateBlock() {
+        buffer_[0] = static_cast<uint32_t>(position_);
+        buffer_[1] = static_cast<uint32_t>(position_ >> 32);
+        buffer_[2] = static_cast<uint32_t>(stream_);
+        buffer_[3] = static_cast<uint32_t>(stream_ >> 32);
+        block(buffer_, key_);
+        ++position_;
+    }
+
+    uint32_t key_[2] = {0, 0};
+    uint64_t stream_ = 0;
+    uint64_t position_ = 0;
+    uint32_t buffer_[4] = {0, 0, 0, 0};
+    int bufferPos_ = 4;
+};
+
+} // namespace detail
+
+} // namespace jngen
+
+using jngen::RandomEngine;
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Vectorized reduction of raw engine words to a bounded range. The path is
+// chosen at compile time from the target ISA (e.g. -mavx2 or -march=native);
+// define JNGEN_NO_SIMD to force the scalar one. All paths produce exactly the
+// same output.
+
+#ifndef JNGEN_NO_SIMD
+#if defined(__AVX2__)
+#define JNGEN_SIMD_AVX2
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#define JNGEN_SIMD_SSE41
+#include <smmintrin.h>
+#elif defined(__ARM_NEON)
+#define JNGEN_SIMD_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+namespace jngen {
+namespace detail {
+
+#if defined(JNGEN_SIMD_AVX2) || defined(JNGEN_SIMD_SSE41)
+
+// For each mask of accepted lanes: the number of accepted lanes and the
+// permutation moving them to the front, preserving their order.
+template<int LANES>
+struct CompactionTable {
+    CompactionTable() {
+        for (int mask = 0; mask < (1 << LANES); ++mask) {
+            int k = 0;
+            for (int i = 0; i < LANES; ++i) {
+                if (mask & (1 << i)) {
+                    lanes[mask][k++] = i;
+                }
+            }
+            count[mask] = k;
+            while (k < LANES) {
+                lanes[mask][k++] = 0;
+            }
+        }
+    }
+
+    uint32_t lanes[1 << LANES][LANES];
+    int count[1 << LANES];
+};
+
+template<int LANES>
+const CompactionTable<LANES>& compactionTable() {
+    static const CompactionTable<LANES> table;
+    return table;
+}
+
+#endif // JNGEN_SIMD_AVX2 || JNGEN_SIMD_SSE41
+
+#if defined(JNGEN_SIMD_AVX2)
+
+// Writes all 8 lanes to |out|, accepted ones first. Returns their number.
+inline size_t compact(__m256i values, __m256i accepted, uint32_t* out) {
+    const auto& table = compactionTable<8>();
+    int mask = _mm256_movemask_ps(_mm256_castsi256_ps(accepted));
+    __m256i permutation = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(table.lanes[mask]));
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(out),
+        _mm256_permutevar8x32_epi32(values, permutation));
+    return table.count[mask];
+}
+
+#elif defined(JNGEN_SIMD_SSE41)
+
+inline size_t compact(__m128i values, __m128i accepted, uint32_t* out) {
+    const auto& table = compactionTable<4>();
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(accepted));
+    const uint32_t* lanes = table.lanes[mask];
+    // _mm_shuffle_epi8 works with bytes, so lane i is bytes 4i..4i+3.
+    __m128i shuffle = _mm_set_epi8(
+        lanes[3]*4 + 3, lanes[3]*4 + 2, lanes[3]*4 + 1, lanes[3]*4,
+        lanes[2]*4 + 3, lanes[2]*4 + 2, lanes[2]*4 + 1, lanes[2]*4,
+        lanes[1]*4 + 3, lanes[1]*4 + 2, lanes[1]*4 + 1, lanes[1]*4,
+        lanes[0]*4 + 3, lanes[0]*4 + 2, lanes[0]*4 + 1, lanes[0]*4);
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(values, shuffle));
+    return table.count[mask];
+}
+
+#elif defined(JNGEN_SIMD_NEON)
+
+inline size_t compact(uint32x4_t values, uint32x4_t accepted, uint32_t* out) {
+    uint32_t v[4];
+    uint32_t a[4];
+    vst1q_u32(v, values);
+    vst1q_u32(a, accepted);
+    size_t k = 0;
+    for (int i = 0; i < 4; ++i) {
+        if (a[i]) {
+            out[k++] = v[i];
+        }
+    }
+    return k;
+}
+
+#endif
+
+// Both reductions below process words in[0..n) in order, write the values
+// obtained from accepted words to out[0..), and return their number. They
+// match uniformMasked32 and uniformLemire32 from random.h word by word. |out|
+// must have room for n values and may coincide with |in|.
+
+// Accepts w & mask if it is less than bound.
+inline size_t reduceMasked32(
+        const uint32_t* in, size_t n,
+        uint32_t bound, uint32_t mask,
+        uint32_t* out)
+{
+    size_t i = 0;
+    size_t k = 0;
+    const uint32_t maxValue = bound - 1;
+
+#if defined(JNGEN_SIMD_AVX2)
+    const __m256i vmask = _mm256_set1_epi32(mask);
+    const __m256i vmax = _mm256_set1_epi32(maxValue);
+    for (; i + 8 <= n; i += 8) {
+        __m256i w = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(in + i));
+        __m256i value = _mm256_and_si256(w, vmask);
+        __m256i accepted = _mm256_cmpeq_epi32(
+            _mm256_min_epu32(value, vmax), value);
+        k += compact(value, accepted, out + k);
+    }
+#elif defined(JNGEN_SIMD_SSE41)
+    const __m128i vmask = _mm_set1_epi32(mask);
+    const __m128i vmax = _mm_set1_epi32(maxValue);
+    for (; i + 4 <= n; i += 4) {
+        __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i value = _mm_and_si128(w, vmask);
+        __m128i accepted = _mm_cmpeq_epi32(_mm_min_epu32(value, vmax), value);
+        k += compact(value, accepted, out + k);
+    }
+#elif defined(JNGEN_SIMD_NEON)
+    const uint32x4_t vmask = vdupq_n_u32(mask);
+    const uint32x4_t vmax = vdupq_n_u32(maxValue);
+    for (; i + 4 <= n; i += 4) {
+        uint32x4_t value = vandq_u32(vld1q_u32(in + i), vmask);
+        k += compact(value, vcleq_u32(value, vmax), out + k);
+    }
+#endif
+
+    for (; i < n; ++i) {
+        uint32_t value = in[i] & mask;
+        if (value <= maxValue) {
+            out[k++] = value;
+        }
+    }
+    return k;
+}
+
+// Accepts the upper half of w * bound if the lower half is at least
+// threshold.
+inline size_t reduceLemire32(
+        const uint32_t* in, size_t n,
+        uint32_t bound, uint32_t threshold,
+        uint32_t* out)
+{
+    size_t i = 0;
+    size_t k = 0;
+
+#if defined(JNGEN_SIMD_AVX2)
+    const __m256i vbound = _mm256_set1_epi32(bound);
+    const __m256i vthreshold = _mm256_set1_epi32(threshold);
+    for (; i + 8 <= n; i += 8) {
+        __m256i w = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(in + i));
+        // 32x32->64 multiplication is only available for even lanes.
+        __m256i even = _mm256_mul_epu32(w, vbound);
+        __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(w, 32), vbound);
+        __m256i hi = _mm256_blend_epi32(
+            _mm256_srli_epi64(even, 32), odd, 0xaa);
+        __m256i lo = _mm256_blend_epi32(
+            even, _mm256_slli_epi64(odd, 32), 0xaa);
+        __m256i accepted = _mm256_cmpeq_epi32(
+            _mm256_max_epu32(lo, vthreshold), lo);
+        k += compact(hi, accepted, out + k);
+    }
+#elif defined(JNGEN_SIMD_SSE41)
+    const __m128i vbound = _mm_set1_epi32(bound);
+    const __m128i vthreshold = _mm_set1_epi32(threshold);
+    for (; i + 4 <= n; i += 4) {
+        __m128i w = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i even = _mm_mul_epu32(w, vbound);
+        __m128i odd = _mm_mul_epu32(_mm_srli_epi64(w, 32), vbound);
+        __m128i hi = _mm_blend_epi16(_mm_srli_epi64(even, 32), odd, 0xcc);
+        __m128i lo = _mm_blend_epi16(even, _mm_slli_epi64(odd, 32), 0xcc);
+        __m128i accepted = _mm_cmpeq_epi32(_mm_max_epu32(lo, vthreshold), lo);
+        k += compact(hi, accepted, out + k);
+    }
+#elif defined(JNGEN_SIMD_NEON)
+    const uint32x2_t vbound = vdup_n_u32(bound);
+    const uint32x4_t vthreshold = vdupq_n_u32(threshold);
+    for (; i + 4 <= n; i += 4) {
+        uint32x4_t w = vld1q_u32(in + i);
+        uint64x2_t low = vmull_u32(vget_low_u32(w), vbound);
+        uint64x2_t high = vmull_u32(vget_high_u32(w), vbound);
+        // val[0] holds lower halves of the products, val[1] upper ones.
+        uint32x4x2_t halves = vuzpq_u32(
+            vreinterpretq_u32_u64(low), vreinterpretq_u32_u64(high));
+        k += compact(
+            halves.val[1], vcgeq_u32(halves.val[0], vthreshold), out + k);
+    }
+#endif
+
+    for (; i < n; ++i) {
+        uint64_t product = static_cast<uint64_t>(in[i]) * bound;
+        if (static_cast<uint32_t>(product) >= threshold) {
+            out[k++] = product >> 32;
+        }
+    }
+    return k;
+}
+
+} // namespace detail
+} // namespace jngen
@@ -28,9 +28,10 @@ public:
     static auto randomf(
             size_t size,
             F func,
-            Args... args) -> GenericArray<decltype(func(args...))>
+            Args... args) -> GenericArray<decltype(
+                detail::invokeWithRandom(func, rnd, 0, args...))>
     {
-        typedef decltype(func(args...)) T;
+        typedef decltype(detail::invokeWithRandom(func, rnd, 0, args...)) T;
         return GenericArray<T>::randomf(size, func, args...);
     }
 
@@ -2,6 +2,9 @@
 
 #include "array.h"
 #include "common.h"
+#include "math_jngen.h"
+#include "parallel.h"
+#include "printers.h"
 #include "random.h"
 #include "sequence_ops.h"
 
@@ -18,6 +21,95 @@ namespace jngen {
 typedef std::pair<long long, long long> HashBase; // (mod, base)
 typedef std::pair<std::string, std::string> StringPair;
 
+namespace detail {
+
+// Alphabet like "a-z0-9" parsed once, with bulk generation of characters.
+class AlphabetTable {
+public:
+    explicit AlphabetTable(const std::string& alphabet);
+
+    // Writes |count| random characters to |out|. With the Mt19937 engine the
+    // result is the same as of |count| successive rnd.choice calls.
+    void fill(Random& random, char* out, size_t count) const;
+
+private:
+    void fillLegacy(Random& random, char* out, size_t count) const;
+    void fillBits(Random& random, char* out, size_t count) const;
+    // Draws indices of type T with Random::fill.
+    template<typename T>
+    void fillIndices(Random& random, char* out, size_t count) const;
+
+    std::string chars_;
+    // log2(chars_.size()) for power-of-two alphabets, -1 otherwise.
+    int bits_;
+};
+
+template<typename T>
+void AlphabetTable::fillIndices(Random& random, char* out, size_t count) const {
+    // Small enough for the stack of a worker thread.
+    const size_t BLOCK = 512;
+    T indices[BLOCK];
+    while (count > 0) {
+        size_t size = std::min(count, BLOCK);
+        random.fill(indices, size, static_cast<T>(chars_.size()));
+        for (size_t i = 0; i < size; ++i) {
+            out[i] = chars_[indices[i]];
+        }
+        out += size;
+        count -= size;
+    }
+}
+
+} // namespace detail
+
+// A random string which is never stored as a whole, see rnds.randomStream.
+class StringStream {
+public:
+    StringStream(size_t size, const std::string& alphabet);
+
+    size_t size() const { return size_; }
+
+    // Calls f(const char* data, size_t count) for consecutive chunks. With
+    // config.threads > 0 that many chunks are generated in parallel.
+    template<typename F>
+    void forEachChunk(F f) const;
+
+    std::string str() const;
+
+private:
+    size_t size_;
+    detail::AlphabetTable table_;
+    Random base_;
+};
+
+template<typename F>
+void StringStream::forEachChunk(F f) const {
+    const size_t CHUNK = detail::PARALLEL_CHUNK_SIZE;
+    size_t chunks = (size_ + CHUNK - 1) / CHUNK;
+    size_t batch = std::max(config.threads, 1);
+    std::vector<std::string> buffers(std::min(batch, chunks));
+
+    for (size_t start = 0; start < chunks; start += batch) {
+        size_t count = std::min(batch, chunks - start);
+        detail::parallelFor(count, [&](size_t i) {
+            size_t chunk = start + i;
+            Random random = base_.stream(chunk);
+            buffers[i].resize(std::min(CHUNK, size_ - chunk * CHUNK));
+            table_.fill(random, &buffers[i][0], buffers[i].size());
+        });
+        for (size_t i = 0; i < count; ++i) {
+            f(static_cast<const char*>(buffers[i].data()), buffers[i].size());
+        }
+    }
+}
+
+JNGEN_DECLARE_SIMPLE_PRINTER(StringStream, 2) {
+    (void)mod;
+    t.forEachChunk([&out](const char* data, size_t count) {
+        out.write(data, count);
+    });
+}
+
 class StringRandom {
 public:
     StringRandom() {
@@ -28,6 +120,10 @@ public:
 
     static std::string random(int len, const std::string& alphabet = "a-z");
 
+    // Generated lazily when printed, for strings too large to be stored.
+    static StringStream randomStream(
+            size_t len, const std::string& alphabet = "a-z");
+
     template<typename ... Args>
     static std::string random(const std::string& pattern, Args... args) {
         return rnd.next(pattern, std::forward(args)...);
@@ -48,6 +144,7 @@ JNGEN_EXTERN StringRandom rnds;
 } // namespace jngen
 
 using jngen::rnds;
+using jngen::StringStream;
 
 #ifndef JNGEN_DECLARE_ONLY
 #define JNGEN_INCLUDE_RNDS_INL_H
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "common.h"
+#include "random.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace jngen {
+namespace detail {
+
+// Returns a uniformly random integer from [0, maxOffset].
+uint64_t randomOffset(Random& random, uint64_t maxOffset);
+
+// Returns |size| distinct integers from [0, maxOffset] in random order.
+// Sparse Fisher-Yates over the implicit array 0..maxOffset: O(size) time
+// and memory, no retries.
+std::vector<uint64_t> sampleOffsets(
+        Random& random, size_t size, uint64_t maxOffset);
+
+// Returns |size| distinct integers from [0, maxOffset] in increasing order.
+// Vitter's sequential sampling (Algorithm D): O(size) expected time, no
+// memory besides the result.
+std::vector<uint64_t> sampleSortedOffsets(
+        Random& random, size_t size, uint64_t maxOffset);
+
+} // namespace detail
+} // namespace jngen
+
+#ifndef JNGEN_DECLARE_ONLY
+#define JNGEN_INCLUDE_SAMPLING_INL_H
+#include "impl/sampling_inl.h"
+#undef JNGEN_INCLUDE_SAMPLING_INL_H
+#endif // JNGEN_DECLARE_ONLY
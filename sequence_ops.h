@@ -1,6 +1,8 @@
 #pragma once
 
 #include "common.h"
+#include "distribution.h"
+#include "parallel.h"
 #include "random.h"
 
 #include <algorithm>
@@ -9,12 +11,97 @@
 
 namespace jngen {
 
+namespace detail {
+
+// Merges two adjacent uniformly shuffled ranges into a uniformly shuffled
+// one. This is the merge step of MergeShuffle by A. Bacher et al.: elements
+// are taken from either range by a coin flip until one of them runs out, and
+// the rest is inserted with Fisher-Yates steps.
+template<typename Iterator>
+void mergeShuffled(
+        Iterator begin, Iterator middle, Iterator end, Random& random)
+{
+    size_t i = 0;
+    size_t j = middle - begin;
+    size_t size = end - begin;
+    uint64_t bits = 0;
+    int bitsLeft = 0;
+    while (true) {
+        if (bitsLeft == 0) {
+            bits = random.next64();
+            bitsLeft = 64;
+        }
+        bool fromSecond = bits & 1;
+        bits >>= 1;
+        --bitsLeft;
+
+        if (fromSecond) {
+            if (j == size) {
+                break;
+            }
+            std::swap(*(begin + i), *(begin + j));
+            ++j;
+        } else if (i == j) {
+            break;
+        }
+        ++i;
+    }
+
+    for (; i < size; ++i) {
+        std::swap(*(begin + i), *(begin + random.next(i + 1)));
+    }
+}
+
+// Shuffles cache-sized blocks independently and then merges them pairwise,
+// each block and each merge using its own stream. Blocks and merges of the
+// same level run in parallel. The layout depends only on the range size, so
+// the result does not depend on the number of threads.
+template<typename Iterator>
+void mergeShuffle(Iterator begin, Iterator end) {
+    size_t size = end - begin;
+    size_t blocks = 1;
+    while (size / (blocks * 2) >= PARALLEL_CHUNK_SIZE) {
+        blocks *= 2;
+    }
+    auto streams = rnd.split(2 * blocks - 1);
+    auto border = [begin, size, blocks](size_t k) {
+        return begin + size * k / blocks;
+    };
+
+    parallelFor(blocks, [&border, &streams](size_t k) {
+        Iterator first = border(k);
+        int length = border(k + 1) - first;
+        for (int i = 1; i < length; ++i) {
+            std::swap(*(first + i), *(first + streams[k].next(i + 1)));
+        }
+    });
+
+    size_t node = blocks;
+    for (size_t width = 1; width < blocks; width *= 2) {
+        size_t pairs = blocks / (width * 2);
+        parallelFor(pairs, [&border, &streams, node, width](size_t k) {
+            mergeShuffled(
+                border(2 * k * width),
+                border((2 * k + 1) * width),
+                border((2 * k + 2) * width),
+                streams[node + k]);
+        });
+        node += pairs;
+    }
+}
+
+} // namespace detail
+
 // TODO: deprecate random_shuffle as done in testlib.h
 
 template<typename Iterator>
 void shuffle(Iterator begin, Iterator end) {
     ensure(end >= begin, "Cannot shuffle range of negative length");
     size_t size = end - begin;
+    if (config.threads > 0 && size >= 2 * detail::PARALLEL_CHUNK_SIZE) {
+        detail::mergeShuffle(begin, end);
+        return;
+    }
     for (size_t i = 1; i < size; ++i) {
         std::swap(*(begin + i), *(begin + rnd.next(i + 1)));
     }
@@ -47,11 +134,15 @@ typename Collection2D::value_type interleave(const Collection2D& collection) {
     }
     size_t size = std::accumulate(sizes.begin(), sizes.end(), 0u);
 
+    // Same choices as rnd.nextByDistribution(sizes) would make, but in
+    // O(log k) per element.
+    DynamicDistribution distribution(sizes);
     typename Collection2D::value_type result;
     while (size > 0) {
-        size_t id = rnd.nextByDistribution(sizes);
+        size_t id = distribution.next();
         result.emplace_back(collection[id][collection[id].size() - sizes[id]]);
         --sizes[id];
+        distribution.add(id, -1);
 
         --size;
     }
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "common.h"
+
+#include <cstddef>
+
+namespace jngen {
+
+// A read-only view of a contiguous range of elements owned by some other
+// object. It does not copy anything and is valid only as long as the storage
+// it points to is not modified.
+template<typename T>
+class Span {
+public:
+    using value_type = T;
+    using const_iterator = const T*;
+    using iterator = const_iterator;
+
+    Span() : begin_(nullptr), end_(nullptr) {}
+    Span(const T* begin, const T* end) : begin_(begin), end_(end) {}
+
+    const T* begin() const { return begin_; }
+    const T* end() const { return end_; }
+    const T* data() const { return begin_; }
+
+    size_t size() const { return end_ - begin_; }
+    bool empty() const { return begin_ == end_; }
+
+    const T& operator[](size_t index) const { return begin_[index]; }
+
+    const T& front() const { return *begin_; }
+    const T& back() const { return *(end_ - 1); }
+
+private:
+    const T* begin_;
+    const T* end_;
+};
+
+} // namespace jngen
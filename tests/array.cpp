@@ -3,6 +3,10 @@
 #include "../jngen.h"
 
 #include <algorithm>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
 #include <utility>
 
 BOOST_AUTO_TEST_SUITE(array)
@@ -142,6 +146,192 @@ BOOST_AUTO_TEST_CASE(random_generation) {
     BOOST_TEST(b.sorted() == c.sorted().uniqued());
 }
 
+BOOST_AUTO_TEST_CASE(unique_sampling) {
+    rnd.seed(2024);
+
+    auto a = Array::randomUnique(100000, 100000);
+    BOOST_TEST(a.sorted() == Array::id(100000));
+    BOOST_TEST(a != Array::id(100000));
+
+    a = Array::randomUnique(1000, -500, 1000000000);
+    BOOST_TEST(a.sorted().uniqued().size() == 1000u);
+    BOOST_TEST(*std::min_element(a.begin(), a.end()) >= -500);
+
+    auto b = Array64::randomUnique(
+        1000,
+        std::numeric_limits<long long>::min(),
+        std::numeric_limits<long long>::max());
+    BOOST_TEST(b.sorted().uniqued().size() == 1000u);
+
+    auto c = Array::randomUniqueSorted(1000, 10, 20000);
+    BOOST_TEST(c == c.sorted().uniqued());
+    BOOST_TEST(c.front() >= 10);
+    BOOST_TEST(c.back() <= 20000);
+
+    BOOST_TEST(Array::randomUniqueSorted(50, 50) == Array::id(50));
+    BOOST_TEST(Array::randomUniqueSorted(0, 5).empty());
+
+    auto d = Array64::randomUniqueSorted(100000, (long long)1e18);
+    BOOST_TEST(d == d.sorted().uniqued());
+    BOOST_TEST(d.back() < (long long)1e18);
+
+    BOOST_CHECK_THROW(Array::randomUnique(11, 10), jngen::Exception);
+    BOOST_CHECK_THROW(Array::randomUniqueSorted(11, 0, 9), jngen::Exception);
+}
+
+BOOST_AUTO_TEST_CASE(unique_sampling_is_uniform) {
+    rnd.seed(2024);
+
+    // Each of C(6, 3) = 20 subsets is sampled 1000 times on average.
+    std::map<Array, int> subsets;
+    for (int i = 0; i < 20000; ++i) {
+        ++subsets[Array::randomUniqueSorted(3, 6)];
+    }
+    BOOST_TEST(subsets.size() == 20u);
+    for (const auto& kv: subsets) {
+        BOOST_TEST(kv.second > 850);
+        BOOST_TEST(kv.second < 1150);
+    }
+
+    // Ordered samples from a small range, stored explicitly, and from a
+    // wider one, stored sparsely: 120 and 132 outcomes, 200 times each on
+    // average.
+    for (int n: {6, 12}) {
+        int size = n == 6 ? 3 : 2;
+        int outcomes = n == 6 ? 120 : 132;
+        std::map<Array, int> samples;
+        for (int i = 0; i < 200 * outcomes; ++i) {
+            ++samples[Array::randomUnique(size, n)];
+        }
+        BOOST_TEST(samples.size() == static_cast<size_t>(outcomes));
+        for (const auto& kv: samples) {
+            BOOST_TEST(kv.second > 130);
+            BOOST_TEST(kv.second < 270);
+        }
+    }
+
+    // Sorted sampling skips elements with Vitter's Algorithm D when the
+    // range is much wider than the sample. Each element is taken 2000 times
+    // on average.
+    Array marginal = std::vector<int>(100);
+    for (int i = 0; i < 50000; ++i) {
+        for (int x: Array::randomUniqueSorted(4, 100)) {
+            ++marginal[x];
+        }
+    }
+    for (int count: marginal) {
+        BOOST_TEST(count > 1750);
+        BOOST_TEST(count < 2250);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(parallel_generation) {
+    const int N = 200000;
+    std::vector<Array> a;
+    std::vector<Array64> b;
+    std::vector<Arrayf> c;
+    std::vector<Arrayp> d;
+    for (int threads: {1, 2, 3, 8}) {
+        config.threads = threads;
+        rnd.seed(789);
+        a.push_back(Array::random(N, -5, 5));
+        b.push_back(Array64::random(N, (long long)1e18));
+        c.push_back(Arrayf::random(N, 1.0));
+        d.push_back(Arrayp::randomf(N, [](Random& random, int n) {
+            return random.nextp(n);
+        }, 100));
+        a.push_back(rnda.randomf(N, [](Random& random) {
+            return random.next(1000);
+        }));
+    }
+    config.threads = 0;
+
+    for (size_t i = 1; i < b.size(); ++i) {
+        BOOST_TEST(a[2*i] == a[0]);
+        BOOST_TEST(a[2*i + 1] == a[1]);
+        BOOST_TEST(b[i] == b[0]);
+        BOOST_TEST(c[i] == c[0]);
+        BOOST_TEST(d[i] == d[0]);
+    }
+    BOOST_TEST(a[0].sorted().uniqued() == Array::id(11, -5));
+
+    rnd.seed(789);
+    auto e = Array::randomf(N, [](Random& random) { return random.next(1000); });
+    rnd.seed(789);
+    auto f = Array::randomf(N, []() { return rnd.next(1000); });
+    BOOST_TEST(e == f);
+}
+
+BOOST_AUTO_TEST_CASE(parallel_shuffle) {
+    const int N = 300000;
+    std::vector<Array> a;
+    std::vector<Graph> g;
+    for (int threads: {1, 2, 5}) {
+        config.threads = threads;
+        rnd.seed(31);
+        a.push_back(Array::id(N).shuffled());
+        g.push_back(Graph::random(N / 2, N).g().shuffled());
+    }
+    config.threads = 0;
+
+    BOOST_TEST(a[0].sorted() == Array::id(N));
+    BOOST_TEST(a[0] != Array::id(N));
+    for (size_t i = 1; i < a.size(); ++i) {
+        BOOST_TEST(a[i] == a[0]);
+        BOOST_TEST(g[i] == g[0]);
+    }
+
+    rnd.seed(31);
+    auto b = Array::id(1000).shuffled();
+    rnd.seed(31);
+    auto c = Array::id(1000);
+    for (int i = 1; i < 1000; ++i) {
+        std::swap(c[i], c[rnd.next(size_t(i) + 1)]);
+    }
+    BOOST_TEST(b == c);
+}
+
+BOOST_AUTO_TEST_CASE(array_stream) {
+    rnd.seed(99);
+    auto s = Array::randomStream(200000, 1, 100);
+    BOOST_TEST(s.size() == 200000u);
+
+    auto print = [](ArrayStream& stream) {
+        std::ostringstream out;
+        out << stream.printN().add1();
+        return out.str();
+    };
+
+    std::string text = print(s);
+    BOOST_TEST(text == print(s));
+    config.threads = 3;
+    BOOST_TEST(text == print(s));
+    config.threads = 0;
+
+    auto a = s.toArray();
+    std::ostringstream out;
+    out << a.printN().add1();
+    BOOST_TEST(text == out.str());
+    BOOST_TEST(a.sorted().uniqued() == Array::id(100, 1));
+
+    auto p = Arrayp::randomfStream(1000, [](Random& random) {
+        return random.nextp(10, odpair);
+    });
+    out.str("");
+    out << p;
+    std::ostringstream expected;
+    expected << p.toArray();
+    BOOST_TEST(out.str() == expected.str());
+    for (const auto& x: p.toArray()) {
+        BOOST_TEST(x.first < x.second);
+    }
+
+    config.threads = 4;
+    auto q = Array::randomfStream(300000, []() { return rnd.next(5); });
+    BOOST_TEST(q.toArray().sorted().uniqued() == Array::id(5));
+    config.threads = 0;
+}
+
 BOOST_AUTO_TEST_CASE(print_matrix) {
     Array2d a = {{1, 2, 3}, {4, 5, 6}};
     std::ostringstream out;
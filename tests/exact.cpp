@@ -72,21 +72,21 @@ BOOST_AUTO_TEST_CASE(tree) {
 
 BOOST_AUTO_TEST_CASE(graph) {
     rnd.seed(195);
-    check(Graph::random(5, 6), "0 2\n0 3\n1 3\n1 4\n2 3\n3 4");
-    check(Graph::random(7, 8).connected(), "0 1\n0 4\n0 6\n1 3\n2 3\n2 6\n3 4\n5 6");
+    check(Graph::random(5, 6), "0 1\n0 2\n0 3\n1 2\n2 3\n3 4");
+    check(Graph::random(7, 8).connected(), "0 4\n0 5\n0 6\n1 3\n1 4\n2 3\n2 6\n3 4");
     check(Graph::random(7, 8).connected().g().shuffle(), "0 2\n6 4\n0 6\n6 5\n4 0\n5 1\n2 3\n1 0");
     check(Graph::random(7, 8).directed().g().shuffle(), "5 6\n2 5\n2 3\n2 0\n3 5\n1 2\n1 5\n1 6");
     check(Graph::random(7, 10).directed().acyclic().g().shuffle(), "0 3\n0 2\n0 6\n4 6\n4 5\n2 4\n1 4\n6 5\n1 2\n4 3");
     check(Graph::complete(6).directed().acyclic(), "1 0\n2 0\n2 1\n3 0\n3 1\n3 2\n4 0\n4 1\n4 2\n4 3\n5 0\n5 1\n5 2\n5 3\n5 4");
     check(Graph::complete(5).directed().g().shuffle(), "4 1\n4 0\n1 2\n1 0\n4 2\n4 3\n0 3\n1 3\n3 2\n0 2");
-    check(Graph::randomStretched(7, 9, 2, 2), "0 1\n0 2\n0 2\n1 2\n1 3\n1 4\n2 4\n3 6\n4 5");
-    check(Graph::randomBipartite(3, 3, 5), "0 4\n0 5\n1 3\n1 5\n2 3");
+    check(Graph::randomStretched(7, 9, 2, 2), "0 1\n0 2\n0 3\n1 2\n1 3\n1 4\n2 4\n3 6\n4 5");
+    check(Graph::randomBipartite(3, 3, 5), "0 3\n0 4\n1 3\n1 4\n1 5");
 }
 
 BOOST_AUTO_TEST_CASE(math) {
     rnd.seed(256);
     check(rndm.randomPrime(100, 1000), "167");
-    check(rndm.partition(20, 5, 3, 8), "4 4 3 6 3");
+    check(rndm.partition(20, 5, 3, 8), "3 3 4 6 4");
 }
 
 BOOST_AUTO_TEST_CASE(geometry) {
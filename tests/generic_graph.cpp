@@ -6,6 +6,26 @@
 
 using jngen::GenericGraph;
 
+namespace {
+
+void checkAdjacency(const GenericGraph& g) {
+    auto edges = g.edges();
+    for (int v = 0; v < g.n(); ++v) {
+        auto expected = g.edges(v);
+        auto neighbors = g.neighbors(v);
+        auto ids = g.incidentEdges(v);
+        BOOST_CHECK(Array(neighbors.begin(), neighbors.end()) == expected);
+        BOOST_TEST(ids.size() == expected.size());
+        for (size_t i = 0; i < ids.size(); ++i) {
+            const auto& edge = edges[ids[i]];
+            int to = edge.first == v ? edge.second : edge.first;
+            BOOST_TEST(to == neighbors[i]);
+        }
+    }
+}
+
+} // namespace
+
 BOOST_AUTO_TEST_SUITE(generic_graph)
 
 BOOST_AUTO_TEST_CASE(basics) {
@@ -36,4 +56,64 @@ BOOST_AUTO_TEST_CASE(basics) {
     BOOST_CHECK(!(gg == g2));
 }
 
+BOOST_AUTO_TEST_CASE(frozen_adjacency) {
+    rnd.seed(123);
+
+    GenericGraph gg;
+    gg.addEdge(0, 1);
+    gg.addEdge(1, 2);
+    gg.addEdge(2, 0);
+    gg.addEdge(3, 3);
+    BOOST_TEST(!gg.frozen());
+    BOOST_CHECK_THROW(gg.neighbors(0), jngen::Exception);
+    BOOST_CHECK_THROW(gg.incidentEdges(0), jngen::Exception);
+    BOOST_CHECK(gg.edges(0) == Array({1, 2}));
+    gg.freeze();
+    checkAdjacency(gg);
+    BOOST_CHECK(gg.edges(3) == Array({3}));
+
+    gg.addEdge(3, 0);
+    gg.addEdge(5, 0);
+    BOOST_TEST(gg.n() == 6);
+    BOOST_CHECK(gg.edges(0) == Array({1, 2, 3, 5}));
+    gg.freeze();
+    BOOST_TEST(gg.neighbors(4).empty());
+    checkAdjacency(gg);
+
+    Graph g = Graph::random(100, 300).allowLoops().allowMulti();
+    BOOST_TEST(g.frozen());
+    checkAdjacency(g);
+
+    Graph copy;
+    for (const auto& edge: g.edges()) {
+        copy.addEdge(edge.first, edge.second);
+    }
+    copy.setN(g.n());
+    BOOST_CHECK(copy == g);
+    auto hash = jngen::Hash<Graph>{}(copy);
+    copy.freeze();
+    BOOST_TEST(jngen::Hash<Graph>{}(copy) == hash);
+
+    g.shuffle();
+    checkAdjacency(g);
+    g.addEdge(0, 99);
+    g.freeze();
+    checkAdjacency(g);
+    BOOST_CHECK(copy != g);
+
+    Graph directed = Graph::random(50, 200).directed();
+    directed.shuffle();
+    checkAdjacency(directed);
+    size_t total = 0;
+    for (int v = 0; v < directed.n(); ++v) {
+        total += directed.neighbors(v).size();
+    }
+    BOOST_TEST(total == 200u);
+
+    BOOST_TEST(Graph::complete(5).g().frozen());
+    BOOST_TEST(Tree::randomKruskal(10).frozen());
+    BOOST_TEST(Tree::random(1).frozen());
+    BOOST_TEST(Tree::bamboo(3).link(0, Tree::star(4), 0).frozen());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -2,6 +2,13 @@
 #include <boost/test/unit_test.hpp>
 #include "../jngen.h"
 
+#include <cmath>
+#include <map>
+#include <numeric>
+#include <set>
+#include <utility>
+#include <vector>
+
 BOOST_AUTO_TEST_SUITE(graph)
 
 BOOST_AUTO_TEST_CASE(output) {
@@ -154,4 +161,248 @@ BOOST_AUTO_TEST_CASE(empty_output) {
     ss.str("");
 }
 
+BOOST_AUTO_TEST_CASE(random_respects_traits) {
+    rnd.seed(123);
+    const int n = 30;
+
+    for (int mask = 0; mask < (1<<5); ++mask) {
+        bool antiparallel = mask & (1<<0);
+        bool loops = mask & (1<<1);
+        bool multi = mask & (1<<2);
+        bool connected = mask & (1<<3);
+        bool directed = mask & (1<<4);
+
+        // Half of all possible edges, so that many of them are rejected, and
+        // almost all of them, which are generated by sampling the missing
+        // ones.
+        for (int m: {n * (n - 1) / 4, n * (n - 1) / 2 - 5}) {
+            Graph g = Graph::random(n, m)
+                .allowAntiparallel(antiparallel)
+                .allowLoops(loops)
+                .allowMulti(multi)
+                .connected(connected)
+                .directed(directed);
+
+            BOOST_TEST(g.n() == n);
+            BOOST_TEST(g.m() == m);
+            if (connected) {
+                BOOST_TEST(g.isConnected());
+            }
+
+            std::set<std::pair<int, int>> edges;
+            bool hasMulti = false;
+            for (auto edge: g.edges()) {
+                BOOST_TEST((loops || edge.first != edge.second));
+                if (!directed && edge.first > edge.second) {
+                    std::swap(edge.first, edge.second);
+                }
+                hasMulti |= !edges.insert(edge).second;
+                if (directed && !antiparallel && edge.first != edge.second) {
+                    BOOST_TEST(!edges.count({edge.second, edge.first}));
+                }
+            }
+            if (!multi) {
+                BOOST_TEST(!hasMulti);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(dense_random_is_uniform) {
+    rnd.seed(123);
+
+    // Each of C(6, 4) = 15 graphs with 4 vertices and 4 edges is generated
+    // 1000 times on average.
+    std::map<Arrayp, int> count;
+    for (int i = 0; i < 15000; ++i) {
+        ++count[Graph::random(4, 4).g().edges()];
+    }
+    BOOST_TEST(count.size() == 15u);
+    for (const auto& kv: count) {
+        BOOST_TEST(kv.second > 850);
+        BOOST_TEST(kv.second < 1150);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(parallel_random_does_not_depend_on_threads) {
+    // Two chunks of edges are drawn, so rejected edges span chunk
+    // boundaries.
+    const int n = 20000;
+    const int m = n + jngen::detail::PARALLEL_CHUNK_SIZE + 5000;
+
+    Arrayp expected;
+    std::vector<Array> expectedAdjacency;
+    for (int threads: {1, 3}) {
+        config.threads = threads;
+        rnd.seed(123);
+        Graph g = Graph::random(n, m).connected().directed();
+        config.threads = 0;
+
+        BOOST_TEST(g.m() == m);
+        BOOST_TEST(g.isConnected());
+
+        std::set<std::pair<int, int>> edges;
+        bool simple = true;
+        for (auto edge: g.edges()) {
+            simple &= edge.first != edge.second;
+            if (edge.first > edge.second) {
+                std::swap(edge.first, edge.second);
+            }
+            simple &= edges.insert(edge).second;
+        }
+        BOOST_TEST(simple);
+
+        std::vector<Array> adjacency;
+        for (int v = 0; v < n; v += 1000) {
+            adjacency.push_back(g.edges(v));
+        }
+
+        if (threads == 1) {
+            expected = g.edges();
+            expectedAdjacency = adjacency;
+        } else {
+            BOOST_TEST(g.edges() == expected);
+            BOOST_TEST(adjacency == expectedAdjacency);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(parallel_stretched_does_not_depend_on_threads) {
+    // About 10n edges can be drawn, so many of them are drawn again. The
+    // edges beyond the tree take two chunks.
+    const int n = 20000;
+    const int m = n + jngen::detail::PARALLEL_CHUNK_SIZE + 5000;
+
+    Arrayp expected;
+    for (int threads: {1, 3}) {
+        config.threads = threads;
+        rnd.seed(321);
+        Graph g = Graph::randomStretched(n, m, 10, 10);
+        config.threads = 0;
+
+        BOOST_TEST(g.m() == m);
+        BOOST_TEST(g.isConnected());
+
+        std::set<std::pair<int, int>> edges;
+        bool simple = true;
+        for (auto edge: g.edges()) {
+            simple &= edge.first != edge.second;
+            if (edge.first > edge.second) {
+                std::swap(edge.first, edge.second);
+            }
+            simple &= edges.insert(edge).second;
+        }
+        BOOST_TEST(simple);
+
+        if (threads == 1) {
+            expected = g.edges();
+        } else {
+            BOOST_TEST(g.edges() == expected);
+        }
+    }
+
+    config.threads = 2;
+    // Only loops can be drawn.
+    BOOST_CHECK_THROW(
+        Graph::randomStretched(10, 20, 5, 0).g(), jngen::Exception);
+    // Only edges of the tree can be drawn, and they are taken.
+    BOOST_CHECK_THROW(
+        Graph::randomStretched(10, 20, 5, 1).g(), jngen::Exception);
+    BOOST_CHECK_THROW(
+        Graph::randomStretched(10, 5, 5, 1).g(), jngen::Exception);
+    config.threads = 0;
+}
+
+BOOST_AUTO_TEST_CASE(degree_sequence) {
+    rnd.seed(123);
+
+    auto degreesOf = [](const Graph& g) {
+        Array degrees = std::vector<int>(g.n());
+        for (const auto& edge: g.edges()) {
+            ++degrees[edge.first];
+            ++degrees[edge.second];
+        }
+        return degrees;
+    };
+    auto isSimple = [](const Graph& g) {
+        std::set<std::pair<int, int>> edges;
+        for (auto edge: g.edges()) {
+            if (edge.first == edge.second) {
+                return false;
+            }
+            if (edge.first > edge.second) {
+                std::swap(edge.first, edge.second);
+            }
+            if (!edges.insert(edge).second) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // Sparse ones are repaired after the configuration model, dense ones are
+    // complements of sparse ones.
+    for (int d: {0, 1, 2, 3, 10, 25, 29}) {
+        Graph g = Graph::randomRegular(30, d);
+        BOOST_TEST(isSimple(g));
+        BOOST_TEST(degreesOf(g) == Array(std::vector<int>(30, d)));
+    }
+
+    // A vertex adjacent to all others makes the configuration model fail
+    // often, so this one may be built deterministically and shuffled.
+    Array degrees = std::vector<int>(500, 1);
+    degrees[0] = 499;
+    degrees[1] = degrees[2] = 2;
+    Graph star = Graph::fromDegreeSequence(degrees);
+    BOOST_TEST(isSimple(star));
+    BOOST_TEST(degreesOf(star) == degrees);
+
+    degrees = Array::random(1000, 1, 10);
+    if (std::accumulate(degrees.begin(), degrees.end(), 0) % 2) {
+        ++degrees[0];
+    }
+    Graph connected = Graph::fromDegreeSequence(degrees).connected();
+    BOOST_TEST(isSimple(connected));
+    BOOST_TEST(connected.isConnected());
+    BOOST_TEST(degreesOf(connected) == degrees);
+
+    Graph multi = Graph::randomRegular(1000, 3).allowMulti().connected();
+    BOOST_TEST(multi.isConnected());
+    for (const auto& edge: multi.edges()) {
+        BOOST_TEST(edge.first != edge.second);
+    }
+    BOOST_TEST(degreesOf(multi) == Array(std::vector<int>(1000, 3)));
+
+    BOOST_CHECK_THROW(
+        Graph::fromDegreeSequence(Array{3, 3, 1, 1}).g(), jngen::Exception);
+    BOOST_CHECK_THROW(Graph::randomRegular(5, 3), jngen::Exception);
+    BOOST_CHECK_THROW(
+        Graph::fromDegreeSequence(Array{1, 1, 0}).connected().g(),
+        jngen::Exception);
+}
+
+BOOST_AUTO_TEST_CASE(expected_degrees) {
+    rnd.seed(123);
+
+    const int n = 2000;
+    Arrayf weights = std::vector<double>(n, 10);
+    weights[0] = 500;
+
+    Graph g = Graph::randomExpectedDegrees(weights);
+    Array degrees = std::vector<int>(n);
+    for (const auto& edge: g.edges()) {
+        BOOST_TEST(edge.first != edge.second);
+        ++degrees[edge.first];
+        ++degrees[edge.second];
+    }
+    // Sums of independent Bernoulli variables with expectations about
+    // 10 * 2000 / 2 and 500.
+    BOOST_TEST(std::abs(g.m() - 10250) < 500);
+    BOOST_TEST(std::abs(degrees[0] - 500) < 100);
+
+    weights = std::vector<double>(n, 0.5);
+    Graph connected = Graph::randomExpectedDegrees(weights).connected();
+    BOOST_TEST(connected.isConnected());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
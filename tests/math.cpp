@@ -2,6 +2,9 @@
 #include <boost/test/unit_test.hpp>
 #include "../jngen.h"
 
+#include <algorithm>
+#include <map>
+#include <numeric>
 #include <utility>
 
 BOOST_AUTO_TEST_SUITE(math)
@@ -14,7 +17,9 @@ BOOST_AUTO_TEST_CASE(primes) {
             10ll,
             25326001ll,
             1000000000000000000ll,
-            2147483648ll
+            2147483648ll,
+            3825123056546413051ll,
+            9223372036854775807ll
     } ) {
         BOOST_CHECK(!isPrime(x));
     }
@@ -27,7 +32,8 @@ BOOST_AUTO_TEST_CASE(primes) {
             2147483647ll,
             313287970493ll,
             153204046992197ll,
-            184917989787916379ll
+            184917989787916379ll,
+            9223372036854775783ll
     } ) {
         BOOST_CHECK(isPrime(x));
     }
@@ -48,6 +54,123 @@ BOOST_AUTO_TEST_CASE(primes) {
     BOOST_CHECK_THROW(rndm.randomPrime(14, 16), jngen::Exception);
 }
 
+BOOST_AUTO_TEST_CASE(modular_arithmetic) {
+    rnd.seed(654);
+
+    for (int iteration = 0; iteration < 1000; ++iteration) {
+        uint64_t mod64 = rnd.next(1ll, 1ll << 62) * 2 + 1;
+        uint64_t mod32 = rnd.next(1ll, 1ll << 32);
+        uint64_t x = rnd.next64();
+        uint64_t y = rnd.next64();
+        int k = rnd.next(100);
+
+        jngen::detail::Montgomery64 montgomery(mod64);
+        uint64_t product = montgomery.from(
+            montgomery.multiply(montgomery.to(x), montgomery.to(y)));
+        uint64_t expected = static_cast<unsigned __int128>(x % mod64) *
+            (y % mod64) % mod64;
+        BOOST_TEST(product == expected);
+
+        jngen::detail::Barrett32 barrett(mod32);
+        BOOST_TEST(barrett.to(x) == x % mod32);
+        BOOST_TEST(barrett.multiply(x % mod32, y % mod32) ==
+            (x % mod32) * (y % mod32) % mod32);
+
+        uint64_t power = 1 % mod32;
+        for (int i = 0; i < k; ++i) {
+            power = power * (x % mod32) % mod32;
+        }
+        BOOST_TEST(jngen::detail::modularPower(barrett, x % mod32, k) == power);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(prime_ranges) {
+    rnd.seed(321);
+
+    for (long long l: {1ll, 1000000000000ll, 1000000000000000000ll}) {
+        auto primes = rndm.primes(l, l + 20000);
+        Array64 expected;
+        for (long long x = l; x <= l + 20000; ++x) {
+            if (isPrime(x)) {
+                expected.push_back(x);
+            }
+        }
+        BOOST_TEST(primes == expected);
+    }
+
+    BOOST_TEST(rndm.nextPrime(1000000000000000000ll) == 1000000000000000003ll);
+    BOOST_TEST(rndm.previousPrime(1000000000ll) == 999999937ll);
+    BOOST_TEST(rndm.previousPrime(9223372036854775807ll) ==
+        9223372036854775783ll);
+    BOOST_CHECK_THROW(rndm.nextPrime(9223372036854775790ll), jngen::Exception);
+
+    Array64 a = rndm.randomPrimes(10000, 100);
+    BOOST_TEST(a.size() == 10000u);
+    for (auto x: a) {
+        BOOST_TEST(isPrime(x));
+        BOOST_TEST(x < 100);
+    }
+
+    a = rndm.randomPrimes(25, 100).distinct();
+    BOOST_TEST(a.sorted() == rndm.primes(1, 100));
+
+    a = rndm.randomPrimes(1000, 1, 1000000000000000000ll).distinct();
+    BOOST_TEST(a.sorted().uniqued().size() == 1000u);
+    for (auto x: a) {
+        BOOST_TEST(isPrime(x));
+    }
+
+    BOOST_CHECK_THROW(
+        Array64(rndm.randomPrimes(3, 14, 20).distinct()), jngen::Exception);
+    BOOST_CHECK_THROW(
+        Array64(rndm.randomPrimes(1, 24, 28)), jngen::Exception);
+}
+
+BOOST_AUTO_TEST_CASE(factorization) {
+    rnd.seed(987);
+
+    BOOST_TEST(factorize(1).empty());
+    BOOST_TEST(factorize(360) == Array64({2, 2, 2, 3, 3, 5}));
+    BOOST_TEST(factorize(1000000007ll * 1000000009ll) ==
+        Array64({1000000007, 1000000009}));
+    BOOST_TEST(factorize(9223372036854775807ll) ==
+        Array64({7, 7, 73, 127, 337, 92737, 649657}));
+    BOOST_TEST(factorize(4611686014132420609ll) ==
+        Array64({2147483647, 2147483647}));
+
+    for (int i = 0; i < 200; ++i) {
+        long long x = rnd.next(1ll, 1000000000000000000ll);
+        long long product = 1;
+        for (long long p: factorize(x)) {
+            BOOST_TEST(isPrime(p));
+            product *= p;
+        }
+        BOOST_TEST(product == x);
+    }
+
+    BOOST_TEST(rndm.highlyComposite(1) == 1);
+    BOOST_TEST(rndm.highlyComposite(100) == 60);
+    BOOST_TEST(rndm.highlyComposite(1000000000) == 735134400);
+    BOOST_TEST(rndm.highlyComposite(1000000000000000000ll) ==
+        897612484786617600ll);
+
+    for (int i = 0; i < 20; ++i) {
+        auto factors = factorize(rndm.semiprime(1000000, 2000000));
+        BOOST_TEST(factors.size() == 2u);
+        BOOST_TEST(factors[0] >= 1000000);
+        BOOST_TEST(factors[1] <= 2000000);
+
+        BOOST_TEST(factorize(rndm.primeProduct(3, 100, 1000)).size() == 3u);
+
+        long long x = rndm.smooth(1000000000000ll, 50);
+        BOOST_TEST(x > 500000000000ll);
+        BOOST_TEST(x <= 1000000000000ll);
+        BOOST_TEST(factorize(x).back() <= 50);
+    }
+
+    BOOST_CHECK_THROW(rndm.semiprime(2, 4000000000ll), jngen::Exception);
+}
+
 BOOST_AUTO_TEST_CASE(partitions) {
     rnd.seed(456);
 
@@ -62,6 +185,22 @@ BOOST_AUTO_TEST_CASE(partitions) {
         BOOST_TEST(x <= 12);
     }
 
+    // Every composition of 10 into 4 parts from [1, 4] (there are 44 of
+    // them) is equally likely.
+    std::map<Array, int> count;
+    for (int i = 0; i < 44000; ++i) {
+        ++count[rndm.partition(10, 4, 1, 4)];
+    }
+    BOOST_TEST(count.size() == 44u);
+    for (const auto& kv: count) {
+        BOOST_TEST(std::abs(kv.second - 1000) < 150);
+    }
+
+    auto d = rndm.partition(1000000000000ll, 1000, 0ll, 2000000000ll);
+    BOOST_TEST(d.size() == 1000u);
+    BOOST_TEST(std::accumulate(d.begin(), d.end(), 0ll) == 1000000000000ll);
+    BOOST_TEST(*std::max_element(d.begin(), d.end()) <= 2000000000ll);
+
     auto c = rndm.partition(Array::id(10), {1, 2, 3, 4});
     std::set<int> sizes;
     for (const auto& t: c) {
@@ -3,7 +3,11 @@
 #include "../jngen.h"
 
 #include <algorithm>
+#include <cmath>
+#include <limits>
+#include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
 BOOST_AUTO_TEST_SUITE(random_suite)
@@ -85,6 +89,23 @@ BOOST_AUTO_TEST_CASE(patterns) {
     for (auto s: patterns) {
         rnd.next(s);
     }
+
+    Random r;
+    std::string buffer = "prefix";
+    for (auto s: patterns) {
+        Pattern p(s);
+        rnd.seed(5);
+        r.seed(5);
+        std::string expected = rnd.next(s);
+        buffer.resize(6);
+        r.next(p, buffer);
+        BOOST_TEST(buffer == "prefix" + expected);
+        BOOST_TEST(r.next() == rnd.next());
+    }
+
+    rnd.seed(1);
+    BOOST_TEST(rnd.next("[a-z]{5,10}") == "lmijlfpaqb");
+    BOOST_TEST(rnd.next("(ab|ba){3}|c{4}") == "babaab");
 }
 
 std::vector<uint32_t> generate(Random& random) {
@@ -95,6 +116,53 @@ std::vector<uint32_t> generate(Random& random) {
     return result;
 }
 
+BOOST_AUTO_TEST_CASE(pattern_cache) {
+    auto generateAll = [](Random& r, const std::vector<Pattern>& patterns) {
+        std::string result;
+        for (int i = 0; i < 100; ++i) {
+            for (const auto& p: patterns) {
+                r.next(p, result);
+            }
+        }
+        return result;
+    };
+
+    std::vector<std::string> sources;
+    for (int i = 0; i < 1500; ++i) {
+        sources.push_back(format("[a-%c]{%d}|x", 'a' + i % 26, i % 7 + 1));
+    }
+    std::vector<Pattern> patterns;
+    for (const auto& s: sources) {
+        patterns.push_back(Pattern::compile(s));
+    }
+
+    Random etalon;
+    etalon.seed(10);
+    std::string expected = generateAll(etalon, patterns);
+
+    // Compile the same patterns in several threads, overflowing the cache,
+    // and use them at once.
+    std::vector<std::string> results(4);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < results.size(); ++t) {
+        threads.emplace_back([&sources, &results, &generateAll, t]() {
+            std::vector<Pattern> local;
+            for (const auto& s: sources) {
+                local.push_back(Pattern::compile(s));
+            }
+            Random r;
+            r.seed(10);
+            results[t] = generateAll(r, local);
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    for (const auto& result: results) {
+        BOOST_TEST(result == expected);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(several_engines) {
     rnd.seed(123);
     auto etalon = generate(rnd);
@@ -116,6 +184,257 @@ BOOST_AUTO_TEST_CASE(several_engines) {
     BOOST_TEST(etalon == generate(r1));
 }
 
+BOOST_AUTO_TEST_CASE(pluggable_engines) {
+    std::vector<RandomEngine> engines = {
+        RandomEngine::Mt19937,
+        RandomEngine::Xoshiro256,
+        RandomEngine::Pcg64,
+        RandomEngine::Wyrand,
+        RandomEngine::Philox,
+        RandomEngine::Mt19937_64
+    };
+
+    std::set<std::vector<uint32_t>> outputs;
+    for (auto engine: engines) {
+        Random r1;
+        r1.setEngine(engine);
+        r1.seed(123);
+        BOOST_TEST((r1.engine() == engine));
+
+        Random r2;
+        r2.seed(123);
+        r2.setEngine(engine);
+
+        auto etalon = generate(r1);
+        BOOST_TEST(etalon == generate(r2));
+        outputs.insert(etalon);
+
+        r1.seed({1, 2, 3});
+        r2.setEngine(RandomEngine::Mt19937);
+        r2.seed({1, 2, 3});
+        r2.setEngine(engine);
+        BOOST_TEST(generate(r1) == generate(r2));
+
+        std::vector<int> a;
+        for (int i = 0; i < 100; ++i) {
+            a.push_back(r1.next(-5, 5));
+        }
+        checkEndpointsHit(a, -5, 5);
+    }
+    BOOST_TEST(outputs.size() == engines.size());
+
+    rnd.seed(123);
+    BOOST_TEST(rnd.next() == 2991312382);
+
+    Random r;
+    r.setEngine(RandomEngine::Mt19937_64);
+    r.seed(123);
+    std::mt19937_64 mt(123);
+    BOOST_TEST(r.next64() == mt());
+    BOOST_TEST(r.next() == (mt() >> 32));
+
+    // Bounds close to 2^64 reject almost half of the words with masking,
+    // 128-bit multiplication keeps the result uniform as well.
+    const uint64_t bound = (uint64_t(3) << 62) + 1;
+    std::vector<int> count(3);
+    for (int i = 0; i < 30000; ++i) {
+        uint64_t x = r.next(size_t(bound));
+        BOOST_TEST(x < bound);
+        ++count[std::min<uint64_t>(x / (bound / 3), 2)];
+    }
+    for (int c: count) {
+        BOOST_TEST(std::abs(c - 10000) < 500);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(philox_known_answers) {
+    uint32_t key[2] = {0xa4093822, 0x299f31d0};
+    uint32_t counter[4] = {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344};
+    jngen::detail::PhiloxEngine::block(counter, key);
+    std::vector<uint32_t> result(counter, counter + 4);
+    std::vector<uint32_t> expected = {
+        0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1};
+    BOOST_TEST(result == expected);
+}
+
+std::vector<uint32_t> generateStream(const Random& random, uint64_t index) {
+    Random stream = random.stream(index);
+    return generate(stream);
+}
+
+BOOST_AUTO_TEST_CASE(streams) {
+    Random r;
+    r.seed(123);
+    auto s1 = generateStream(r, 1);
+    BOOST_TEST(s1 != generateStream(r, 2));
+    BOOST_TEST(s1 != generate(r));
+    BOOST_TEST(s1 == generateStream(r, 1));
+
+    r.seed(124);
+    BOOST_TEST(s1 != generateStream(r, 1));
+
+    r.seed({1, 2, 3});
+    auto v1 = generateStream(r, 1);
+    r.setEngine(RandomEngine::Philox);
+    BOOST_TEST(v1 == generateStream(r, 1));
+    BOOST_TEST(v1 != generate(r));
+
+    auto stream = r.stream(1);
+    stream.setEngine(RandomEngine::Mt19937);
+    r.setEngine(RandomEngine::Mt19937);
+    BOOST_TEST(generate(stream) != generate(r));
+
+    std::vector<std::vector<uint32_t>> sequential, parallel(4);
+    for (int i = 0; i < 4; ++i) {
+        sequential.push_back(generateStream(r, i));
+    }
+    std::vector<std::thread> threads;
+    for (int i = 3; i >= 0; --i) {
+        threads.emplace_back([&r, &parallel, i]() {
+            parallel[i] = generateStream(r, i);
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    BOOST_TEST(sequential == parallel);
+}
+
+BOOST_AUTO_TEST_CASE(split) {
+    Random r;
+    r.seed(5);
+    auto first = r.split(3);
+    auto second = r.split(3);
+    BOOST_TEST(first.size() == 3u);
+
+    std::vector<std::vector<uint32_t>> outputs;
+    for (auto& s: first) {
+        outputs.push_back(generate(s));
+    }
+    for (auto& s: second) {
+        outputs.push_back(generate(s));
+    }
+    BOOST_TEST(std::set<std::vector<uint32_t>>(
+        outputs.begin(), outputs.end()).size() == 6u);
+
+    r.seed(5);
+    auto again = r.split(3);
+    BOOST_TEST(generate(again[1]) == outputs[1]);
+}
+
+BOOST_AUTO_TEST_CASE(streams_depend_only_on_seed) {
+    // Both generators are created with seeds from random_device, which must
+    // not leak into the streams.
+    std::vector<std::vector<uint32_t>> outputs[2];
+    for (auto& output: outputs) {
+        Random r;
+        r.seed(5);
+        for (auto& s: r.split(3)) {
+            output.push_back(generate(s));
+        }
+        auto stream = r.stream(7);
+        output.push_back(generate(stream));
+    }
+    BOOST_TEST(outputs[0] == outputs[1]);
+
+    // Chunked generation splits rnd once per call.
+    Array arrays[2];
+    config.threads = 2;
+    for (auto& a: arrays) {
+        rnd.seed(5);
+        a = Array::random(3 * jngen::detail::PARALLEL_CHUNK_SIZE, 100);
+    }
+    config.threads = 0;
+    BOOST_TEST(arrays[0] == arrays[1]);
+}
+
+template<typename T, typename ...Args>
+void checkFill(RandomEngine engine, const Args& ... args) {
+    Random r1, r2;
+    r1.setEngine(engine);
+    r2.setEngine(engine);
+    r1.seed(42);
+    r2.seed(42);
+
+    std::vector<T> a(1000), b;
+    r1.fill(a.data(), a.size(), args...);
+    for (size_t i = 0; i < a.size(); ++i) {
+        b.push_back(r2.next(args...));
+    }
+    BOOST_TEST(a == b);
+    BOOST_TEST(r1.next() == r2.next());
+}
+
+BOOST_AUTO_TEST_CASE(bulk_fill) {
+    for (auto engine: {
+            RandomEngine::Mt19937, RandomEngine::Xoshiro256,
+            RandomEngine::Pcg64, RandomEngine::Wyrand, RandomEngine::Philox,
+            RandomEngine::Mt19937_64})
+    {
+        checkFill<int>(engine, 1);
+        checkFill<int>(engine, 10);
+        checkFill<int>(engine, 1000000007);
+        checkFill<int>(engine, -5, 5);
+        checkFill<int>(engine, int(-2e9), int(2e9));
+        checkFill<int>(engine, std::numeric_limits<int>::min(),
+            std::numeric_limits<int>::max());
+        checkFill<long long>(engine, 1000000000000000000ll);
+        checkFill<long long>(engine, -10ll, 10ll);
+        checkFill<long long>(engine, std::numeric_limits<long long>::min(),
+            std::numeric_limits<long long>::max());
+        checkFill<size_t>(engine, size_t(26));
+        checkFill<size_t>(engine, size_t(5), size_t(100));
+        checkFill<double>(engine, 123.0);
+        checkFill<double>(engine, 0.1, 0.2);
+    }
+
+    rnd.seed(123);
+    auto a = Array::random(100, 10, 20);
+    rnd.seed(123);
+    for (int x: a) {
+        BOOST_TEST(x == rnd.next(10, 20));
+    }
+    checkEndpointsHit(std::vector<int>(a), 10, 20);
+}
+
+BOOST_AUTO_TEST_CASE(discrete_distribution) {
+    rnd.seed(55);
+
+    DiscreteDistribution d({1, 0, 3, 6});
+    std::vector<int> count(4);
+    for (int i = 0; i < 100000; ++i) {
+        ++count[d.next()];
+    }
+    BOOST_TEST(count[1] == 0);
+    BOOST_TEST(std::abs(count[0] - 10000) < 1000);
+    BOOST_TEST(std::abs(count[2] - 30000) < 1000);
+    BOOST_TEST(std::abs(count[3] - 60000) < 1000);
+
+    DiscreteDistribution f(std::vector<double>{0.0, 0.5, 0.5});
+    for (int i = 0; i < 1000; ++i) {
+        BOOST_TEST(f.next() != 0u);
+    }
+
+    BOOST_CHECK_THROW(DiscreteDistribution({0, 0}), jngen::Exception);
+
+    std::vector<long long> weights = {5, 0, 7, 1, 12, 3};
+    DynamicDistribution dynamic(weights);
+    Random r1, r2;
+    r1.seed(1);
+    r2.seed(1);
+    for (int i = 0; i < 1000; ++i) {
+        size_t index = r1.next(weights.size());
+        long long w = r1.next(0, 10);
+        r2.next(weights.size());
+        r2.next(0, 10);
+        weights[index] = w;
+        dynamic.set(index, w);
+        if (dynamic.total() > 0) {
+            BOOST_TEST(dynamic.next(r1) == r2.nextByDistribution(weights));
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(test_choice) {
     rnd.seed(444);
 
@@ -160,6 +479,66 @@ BOOST_AUTO_TEST_CASE(wnext) {
     ensure(a[9] == 10);
 }
 
+BOOST_AUTO_TEST_CASE(fast_wnext) {
+    rnd.seed(988);
+    config.fastWnext = true;
+
+    // P(max of 3 values from [0, 5) is x) = ((x + 1)^3 - x^3) / 125.
+    const int N = 125000;
+    std::vector<int> count(5), countMin(5);
+    for (int i = 0; i < N; ++i) {
+        ++count[rnd.wnext(5, 2)];
+        ++countMin[rnd.wnext(10, 14, -2) - 10];
+    }
+    for (int x = 0; x < 5; ++x) {
+        int expected = (x + 1) * (x + 1) * (x + 1) - x * x * x;
+        BOOST_TEST(std::abs(count[x] - expected * 1000) < 1000);
+        BOOST_TEST(std::abs(countMin[4 - x] - expected * 1000) < 1000);
+    }
+
+    // n^k does not fit into 64 bits, but fits into 128. The maximum is less
+    // than (x + 1) * n / 5 with probability ((x + 1) / 5)^3.
+    const long long n = 3000000;
+    std::fill(count.begin(), count.end(), 0);
+    std::fill(countMin.begin(), countMin.end(), 0);
+    for (int i = 0; i < N; ++i) {
+        ++count[rnd.wnext(n, 2) * 5 / n];
+        ++countMin[rnd.wnext(n, n * 2 - 1, -2) * 5 / n - 5];
+    }
+    for (int x = 0; x < 5; ++x) {
+        int expected = (x + 1) * (x + 1) * (x + 1) - x * x * x;
+        BOOST_TEST(std::abs(count[x] - expected * 1000) < 1000);
+        BOOST_TEST(std::abs(countMin[4 - x] - expected * 1000) < 1000);
+    }
+
+    // n^9 does not fit into 128 bits, so the maximum is taken over groups
+    // of 7 and 2 values.
+    const long long big = 100000;
+    std::fill(count.begin(), count.end(), 0);
+    std::fill(countMin.begin(), countMin.end(), 0);
+    for (int i = 0; i < N; ++i) {
+        ++count[rnd.wnext(big, 8) * 5 / big];
+        ++countMin[rnd.wnext(big, big * 2 - 1, -8) * 5 / big - 5];
+    }
+    for (int x = 0; x < 5; ++x) {
+        double expected =
+            N * (std::pow((x + 1) / 5.0, 9) - std::pow(x / 5.0, 9));
+        BOOST_TEST(std::abs(count[x] - expected) < 1000);
+        BOOST_TEST(std::abs(countMin[4 - x] - expected) < 1000);
+    }
+
+    // Groups and the default wnext for |w| > 8.
+    for (int i = 0; i < 1000; ++i) {
+        long long x = rnd.wnext(1ll << 40, 5);
+        BOOST_TEST((x >= 0 && x < (1ll << 40)));
+        int y = rnd.wnext(-1000000000, 1000000000, -20);
+        BOOST_TEST((y >= -1000000000 && y <= 1000000000));
+        BOOST_TEST(rnd.wnext(size_t(1), 7) == 0u);
+    }
+
+    config.fastWnext = false;
+}
+
 BOOST_AUTO_TEST_CASE(signed_bounds) {
     rnd.seed(19283);
 
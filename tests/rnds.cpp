@@ -3,10 +3,24 @@
 #include "../jngen.h"
 
 #include <algorithm>
+#include <sstream>
+#include <string>
 #include <utility>
 
 BOOST_AUTO_TEST_SUITE(rnds_suite)
 
+uint64_t polynomialHash(const std::string& s, uint64_t p, uint64_t mod) {
+    uint64_t hash = 0;
+    for (char c: s) {
+        if (mod == 0) {
+            hash = hash * p + c;
+        } else {
+            hash = (static_cast<unsigned __int128>(hash) * p + c) % mod;
+        }
+    }
+    return hash;
+}
+
 BOOST_AUTO_TEST_CASE(basics) {
     rnd.seed(123);
 
@@ -17,4 +31,124 @@ BOOST_AUTO_TEST_CASE(basics) {
     BOOST_TEST(rnds.thueMorse(10, 'q', 'w') == "qwwqwqqwwq");
 }
 
+BOOST_AUTO_TEST_CASE(bulk_random) {
+    std::vector<std::pair<std::string, std::string>> alphabets = {
+        {"a-z", "abcdefghijklmnopqrstuvwxyz"},
+        {"ba", "ab"},
+        {"a-h", "abcdefgh"},
+        {"x", "x"}
+    };
+    for (const auto& kv: alphabets) {
+        const std::string& alphabet = kv.first;
+        const std::string& chars = kv.second;
+
+        rnd.seed(5);
+        std::string s = rnds.random(10000, alphabet);
+        rnd.seed(5);
+        std::string expected;
+        for (size_t i = 0; i < s.size(); ++i) {
+            expected += rnd.choice(chars);
+        }
+        BOOST_TEST(s == expected);
+
+        rnd.setEngine(RandomEngine::Xoshiro256);
+        s = rnds.random(10000, alphabet);
+        rnd.setEngine(RandomEngine::Mt19937);
+        std::vector<int> count(256);
+        for (char c: s) {
+            ++count[static_cast<unsigned char>(c)];
+        }
+        for (char c: chars) {
+            int expectedCount = s.size() / chars.size();
+            BOOST_TEST(std::abs(count[c] - expectedCount) < 300);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(large_modulo_anti_hash) {
+    rnd.seed(7);
+    std::vector<std::vector<std::pair<long long, long long>>> tests = {
+        {{(1ll << 61) - 1, 1234567}},
+        {{0, 131}},
+        {{0, 1ll << 20}},
+        {{4000000007ll, 31}, {0, 1000003}}
+    };
+    for (const auto& bases: tests) {
+        auto result = rnds.antiHash(bases, "a-z");
+        BOOST_TEST(result.first != result.second);
+        BOOST_TEST(result.first.size() == result.second.size());
+        for (const auto& base: bases) {
+            BOOST_TEST(
+                polynomialHash(result.first, base.second, base.first) ==
+                polynomialHash(result.second, base.second, base.first));
+        }
+    }
+
+    auto result = rnds.antiHash({{0, 131}}, "a-z", 10000);
+    BOOST_TEST(result.first.size() == 10000u);
+    BOOST_TEST(polynomialHash(result.first, 131, 0) ==
+        polynomialHash(result.second, 131, 0));
+}
+
+BOOST_AUTO_TEST_CASE(parallel_anti_hash) {
+    std::vector<std::pair<long long, long long>> bases = {
+        {1000000007, 107}, {1000000009, 109}
+    };
+    std::vector<std::pair<std::string, std::string>> results;
+    for (int threads: {1, 3}) {
+        config.threads = threads;
+        rnd.seed(8);
+        results.push_back(rnds.antiHash(bases, "a-z"));
+    }
+    config.threads = 0;
+
+    BOOST_TEST(results[0].first == results[1].first);
+    BOOST_TEST(results[0].second == results[1].second);
+    const auto& result = results[0];
+    BOOST_TEST(result.first != result.second);
+    for (const auto& base: bases) {
+        BOOST_TEST(
+            polynomialHash(result.first, base.second, base.first) ==
+            polynomialHash(result.second, base.second, base.first));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(parallel_anti_hash_with_duplicates) {
+    // Few distinct words, so duplicates are drawn and must be replaced.
+    std::vector<std::pair<long long, long long>> bases = {
+        {999983, 2}, {999979, 3}
+    };
+    std::vector<std::pair<std::string, std::string>> results;
+    for (int threads: {1, 2}) {
+        config.threads = threads;
+        rnd.seed(13);
+        results.push_back(rnds.antiHash(bases, "ab"));
+    }
+    config.threads = 0;
+
+    BOOST_TEST(results[0].first == results[1].first);
+    BOOST_TEST(results[0].second == results[1].second);
+    const auto& result = results[0];
+    BOOST_TEST(result.first != result.second);
+    for (const auto& base: bases) {
+        BOOST_TEST(
+            polynomialHash(result.first, base.second, base.first) ==
+            polynomialHash(result.second, base.second, base.first));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(string_stream) {
+    rnd.seed(6);
+    auto stream = rnds.randomStream(200000, "a-c");
+    std::string s = stream.str();
+    BOOST_TEST(s.size() == 200000u);
+    BOOST_TEST(s.find_first_not_of("abc") == std::string::npos);
+
+    std::ostringstream out;
+    config.threads = 3;
+    out << stream;
+    config.threads = 0;
+    BOOST_TEST(out.str() == s);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
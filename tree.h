@@ -18,7 +18,7 @@ public:
     Tree(const GenericGraph& gg) : GenericGraph(gg) {
         extend(1);
         ensure(
-                dsu_.numComponents() == n() - m(),
+                dsu().numComponents() == n() - m(),
                 "Cannot create a tree from a graph with cycles");
     }
 